@@ -6,6 +6,7 @@
 #include "itkImageRegionIterator.h"
 #include "itkBinaryThinningImageFilter3D.h"
 
+#include <fstream>
 #include <iostream>
 #include <stdlib.h>   // for atoi()
 using namespace std;
@@ -16,7 +17,10 @@ int main(int argc, char* argv[])
   if( argc <= 2 )
   {
     std::cerr << "Usage: " << std::endl;
-    std::cerr << argv[0] << " inputImageFile outputImageFile" << std::endl;
+    std::cerr << argv[0] << " inputImageFile outputImageFile [timingsFile]" << std::endl;
+    std::cerr << "If timingsFile is given, the time and the performance counters" << std::endl;
+    std::cerr << "(hardware if available, software otherwise) of each stage of the" << std::endl;
+    std::cerr << "thinning are written to it as JSON." << std::endl;
     return EXIT_FAILURE;
   }
   char* infilename  = argv[1];
@@ -45,7 +49,20 @@ int main(int argc, char* argv[])
   typedef itk::BinaryThinningImageFilter3D< ImageType, ImageType > ThinningFilterType;
   ThinningFilterType::Pointer thinningFilter = ThinningFilterType::New();
   thinningFilter->SetInput( reader->GetOutput() );
+  if( argc > 3 )
+  {
+    thinningFilter->GetProfiler()->UsePerformanceCountersOn();
+  }
   thinningFilter->Update();
+  cout << "Thinning passes: " << itk::WorkCounters::Get( "BinaryThinning3D.Passes" )
+       << ", deletions: " << itk::WorkCounters::Get( "BinaryThinning3D.Deletions" ) << endl;
+
+  if( argc > 3 )
+  {
+    std::ofstream timingsFile( argv[3] );
+    thinningFilter->GetProfiler()->WriteJSON( timingsFile );
+    cout << argv[3] << " sucessfully written." << endl;
+  }
 
   // output to file
   typedef itk::ImageFileWriter< ImageType > WriterType;
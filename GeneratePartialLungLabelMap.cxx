@@ -8,6 +8,13 @@
 #include "itkGDCMImageIO.h"
 #include "itkGDCMSeriesFileNames.h"
 #include "itkImageSeriesReader.h"
+#include "itkImageMemoryTracker.h"
+#include "itkImageBufferPool.h"
+#include "itkWorkCounters.h"
+#include "itkVoxelPass.h"
+#include <fstream>
+#include <sstream>
+#include <string>
 
 
 typedef itk::Image< unsigned short, 3 >                           UShortImageType;
@@ -23,10 +30,12 @@ typedef itk::ImageSeriesReader< ShortImageType >                  SeriesReaderTy
 
 
 
-void LowerClipImage( ShortImageType::Pointer, short, short );
-void UpperClipImage( ShortImageType::Pointer, short, short );
+void ClipImage( ShortImageType::Pointer, short, short, short, short );
 ShortImageType::Pointer ReadCTFromDirectory( char* );
 ShortImageType::Pointer ReadCTFromFile( char*  );
+void ComputeClosingNeighborhood( double, ShortImageType::SpacingType, unsigned long* );
+int RunParameterSweep( PartialLungType::Pointer, char*, char*, char*, ShortImageType::SpacingType );
+std::string GetSweepFileName( const char*, unsigned int );
 
 
 void usage()
@@ -51,8 +60,30 @@ void usage()
   std::cerr << "            than the specified amount\n";
   std::cerr << "   <-agg>   Set to 1 for aggressive lung splitting.  Set to 0 (default) otherwise\n";
   std::cerr << "   <-lsr>   Radius used to split the left and right lungs (3 by default)\n";
+  std::cerr << "   <-seam>  Set to 1 (default) to split the left and right lungs along seams (min cost\n";
+  std::cerr << "            paths that never go back up). Set to 0 to always use the graph search\n";
+  std::cerr << "   <-gsf>   Set to 1 (default) to fall back on the graph search when a seam would not\n";
+  std::cerr << "            split the lungs. Set to 0 otherwise\n";
+  std::cerr << "   <-nbr>   Radius (in pixels) of the band around the previous slice's split path in\n";
+  std::cerr << "            which the seam is first searched for (default is 5). Set to 0 to disable\n";
   std::cerr << "   <-ir>    Max airway volume increase rate (default is 2.0). This is passed to the\n";
   std::cerr << "            partial lung label map filter. Decrease this value if you see leakage\n";  
+  std::cerr << "   <-apf>   Set to 1 to segment the airways with a priority flood that computes the airway\n";
+  std::cerr << "            volume versus threshold curve in one pass. Set to 0 (default) otherwise\n";
+  std::cerr << "   <-acf>   Shrink factor (2 or 4) for coarse-to-fine airway segmentation. The airways are\n";
+  std::cerr << "            segmented on a shrunk copy of the CT and refined at full resolution near the\n";
+  std::cerr << "            coarse result. Set to 1 (default) to segment at full resolution only\n";
+  std::cerr << "   <-roi>   Set to 1 to run all stages after thresholding on the padded bounding box of the\n";
+  std::cerr << "            lungs only, which is faster and uses less memory. Set to 0 (default) otherwise\n";
+  std::cerr << "   <-roip>  Padding (in voxels) of the lung bounding box (default is 10)\n";
+  std::cerr << "   <-pcd>   Set to 1 to expand the conditional dilation wavefronts with multiple threads.\n";
+  std::cerr << "            Set to 0 (default) otherwise\n";
+  std::cerr << "   <-dtc>   Set to 1 to close the lungs with distance transforms instead of the ball\n";
+  std::cerr << "            dilation and erosion, using the closing radius. Set to 0 (default) otherwise\n";
+  std::cerr << "   <-psp>   Set to 1 to split the left and right lungs with multiple threads. Set to 0\n";
+  std::cerr << "            (default) otherwise\n";
+  std::cerr << "   <-cc>    Set to 1 to close the left and right lungs concurrently. Set to 0 (default)\n";
+  std::cerr << "            otherwise\n";
   std::cerr << "   <-min>   Minimum airway volume \n";
   std::cerr << "   <-max>   Maximum airway volume \n";
   std::cerr << "   <-hf>    Set to 1 if the scan is head first (default) and 0 if feet first\n";
@@ -63,6 +94,30 @@ void usage()
   std::cerr << "   <-sthr>  Standard deviation value to check if Otsu gives correct threhold, i.e. between Lung Threshold +/-std \n";
   std::cerr << "   <-pvmax> Max. Percentage of airway volume to total lung volume + airways volume.  \n";
   std::cerr << "   <-pvmin> Min. Percentage of airway volume to total lung volume + airways volume.  \n";
+  std::cerr << "   <-tj>    Timings file name. If specified, the wall and CPU time of each stage of the\n";
+  std::cerr << "            partial lung filter are written to this file as JSON, together with the\n";
+  std::cerr << "            image memory allocated and the peak image memory of each stage\n";
+  std::cerr << "   <-tt>    Trace file name. If specified, the stages of the partial lung filter are written\n";
+  std::cerr << "            to this file in the Chrome trace format (open with chrome://tracing)\n";
+  std::cerr << "   <-hpc>   Record the hardware performance counters (cycles, instructions, LLC misses,\n";
+  std::cerr << "            branch misses) of each stage in the timings and trace files. Falls back to\n";
+  std::cerr << "            software counters if the PMU is not accessible (Linux only)\n";
+  std::cerr << "   <-pool>  Set to 1 to allocate image buffers from a pool that reuses the buffers of\n";
+  std::cerr << "            temporary images of the same size. Set to 0 (default) otherwise\n";
+  std::cerr << "   <-hp>    Set to 1 to back pooled image buffers by huge pages (Linux only)\n";
+  std::cerr << "   <-wc>    Work counters file name. If specified, the algorithmic work counters (growth\n";
+  std::cerr << "            iterations, dilation rounds, split retries, graph nodes settled, etc.) are\n";
+  std::cerr << "            written to this file as JSON\n";
+  std::cerr << "   <-cache> Checkpoint directory (must exist). If specified, the outputs of the median\n";
+  std::cerr << "            filter, the lung mask and the airway removal are stored in this directory,\n";
+  std::cerr << "            keyed by the input and the parameters they depend on, and loaded instead of\n";
+  std::cerr << "            recomputed when a later run has the same input and parameters for them\n";
+  std::cerr << "   <-sweep> Parameter sweep file name. Each line of the file is a parameter set: the\n";
+  std::cerr << "            manual threshold, the lung split radius, the closing radius (mm), and the\n";
+  std::cerr << "            min and max airway volume percentages. The pipeline is run for every set,\n";
+  std::cerr << "            sharing the stages that sets have in common, and the lung mask (and stage\n";
+  std::cerr << "            timings, if -tj is given) of the k-th set is written with '_sweep<k>'\n";
+  std::cerr << "            inserted before the extension of the file name\n";
 
   exit(1);
 }
@@ -78,15 +133,34 @@ int main( int argc, char *argv[] )
   char*    helperMaskFileName            = new char[512];  strcpy( helperMaskFileName, "q" );
   char*    ctFileName                    = new char[512];  strcpy( ctFileName, "q" );
   char*    ctDir                         = new char[512];  strcpy( ctDir, "q" );
+  char*    timingsFileName               = new char[512];  strcpy( timingsFileName, "q" );
+  char*    traceFileName                 = new char[512];  strcpy( traceFileName, "q" );
+  char*    countersFileName              = new char[512];  strcpy( countersFileName, "q" );
+  char*    checkpointDirectory           = new char[512];  strcpy( checkpointDirectory, "q" );
+  char*    sweepFileName                 = new char[512];  strcpy( sweepFileName, "q" );
   short    lowerClipValue                = -1025;
   short    lowerReplacementValue         = 1024;
   short    upperClipValue                = 1024;
   short    upperReplacementValue         = 1024;
   double   closingRadius                 = 5.0;
   int      aggressiveLungSplitting       = 0;
+  int      usePerformanceCounters        = 0;
+  int      useBufferPool                 = 0;
+  int      useHugePages                  = 0;
   int      lungSplitRadius               = 3;
+  int      useSeamSolver                 = 1;
+  int      graphSearchFallback           = 1;
+  int      narrowBandRadius              = 5;
   int      headFirst                     = 1;
   double   airwayVolumeIncreaseRate      = 2.0;
+  int      airwayPriorityFlood           = 0;
+  int      useLungBoundingBox            = 0;
+  int      parallelConditionalDilation   = 0;
+  int      useDistanceTransformClosing   = 0;
+  int      concurrentClosing             = 0;
+  int      parallelSplitting             = 0;
+  unsigned int lungBoundingBoxPadding    = 10;
+  unsigned int airwayShrinkFactor        = 1;
   double   minAirwayVolume               = 0.0;
   double   maxAirwayVolume               = 50.0;
   short    manualThreshold               = -400;
@@ -164,6 +238,86 @@ int main( int argc, char *argv[] )
       argc--; argv++;
       }
 
+    if ((ok == false) && (strcmp(argv[1], "-apf") == 0))
+      {
+      argc--; argv++;
+      ok = true;
+
+      airwayPriorityFlood = atoi( argv[1] );
+
+      argc--; argv++;
+      }
+
+    if ((ok == false) && (strcmp(argv[1], "-acf") == 0))
+      {
+      argc--; argv++;
+      ok = true;
+
+      airwayShrinkFactor = static_cast< unsigned int >( atoi( argv[1] ) );
+
+      argc--; argv++;
+      }
+
+    if ((ok == false) && (strcmp(argv[1], "-roi") == 0))
+      {
+      argc--; argv++;
+      ok = true;
+
+      useLungBoundingBox = atoi( argv[1] );
+
+      argc--; argv++;
+      }
+
+    if ((ok == false) && (strcmp(argv[1], "-roip") == 0))
+      {
+      argc--; argv++;
+      ok = true;
+
+      lungBoundingBoxPadding = static_cast< unsigned int >( atoi( argv[1] ) );
+
+      argc--; argv++;
+      }
+
+    if ((ok == false) && (strcmp(argv[1], "-pcd") == 0))
+      {
+      argc--; argv++;
+      ok = true;
+
+      parallelConditionalDilation = atoi( argv[1] );
+
+      argc--; argv++;
+      }
+
+    if ((ok == false) && (strcmp(argv[1], "-dtc") == 0))
+      {
+      argc--; argv++;
+      ok = true;
+
+      useDistanceTransformClosing = atoi( argv[1] );
+
+      argc--; argv++;
+      }
+
+    if ((ok == false) && (strcmp(argv[1], "-cc") == 0))
+      {
+      argc--; argv++;
+      ok = true;
+
+      concurrentClosing = atoi( argv[1] );
+
+      argc--; argv++;
+      }
+
+    if ((ok == false) && (strcmp(argv[1], "-psp") == 0))
+      {
+      argc--; argv++;
+      ok = true;
+
+      parallelSplitting = atoi( argv[1] );
+
+      argc--; argv++;
+      }
+
     if ((ok == false) && (strcmp(argv[1], "-lsr") == 0))
       {
       argc--; argv++;
@@ -174,6 +328,36 @@ int main( int argc, char *argv[] )
       argc--; argv++;
       }
 
+    if ((ok == false) && (strcmp(argv[1], "-seam") == 0))
+      {
+      argc--; argv++;
+      ok = true;
+
+      useSeamSolver = atoi( argv[1] );
+
+      argc--; argv++;
+      }
+
+    if ((ok == false) && (strcmp(argv[1], "-gsf") == 0))
+      {
+      argc--; argv++;
+      ok = true;
+
+      graphSearchFallback = atoi( argv[1] );
+
+      argc--; argv++;
+      }
+
+    if ((ok == false) && (strcmp(argv[1], "-nbr") == 0))
+      {
+      argc--; argv++;
+      ok = true;
+
+      narrowBandRadius = atoi( argv[1] );
+
+      argc--; argv++;
+      }
+
     if ((ok == false) && (strcmp(argv[1], "-dir") == 0))
       {
       argc--; argv++;
@@ -274,6 +458,104 @@ int main( int argc, char *argv[] )
          minVolPercentAirway= static_cast< double >( atof(argv[1]));
          argc--; argv++;
          }
+
+    if ((ok == false) && (strcmp(argv[1], "-tj") == 0))
+      {
+      argc--; argv++;
+      ok = true;
+
+      timingsFileName = argv[1];
+
+      argc--; argv++;
+      }
+
+    if ((ok == false) && (strcmp(argv[1], "-tt") == 0))
+      {
+      argc--; argv++;
+      ok = true;
+
+      traceFileName = argv[1];
+
+      argc--; argv++;
+      }
+
+    if ((ok == false) && (strcmp(argv[1], "-hpc") == 0))
+      {
+      argc--; argv++;
+      ok = true;
+
+      usePerformanceCounters = 1;
+      }
+
+    if ((ok == false) && (strcmp(argv[1], "-pool") == 0))
+      {
+      argc--; argv++;
+      ok = true;
+
+      useBufferPool = atoi( argv[1] );
+
+      argc--; argv++;
+      }
+
+    if ((ok == false) && (strcmp(argv[1], "-hp") == 0))
+      {
+      argc--; argv++;
+      ok = true;
+
+      useHugePages = atoi( argv[1] );
+
+      argc--; argv++;
+      }
+
+    if ((ok == false) && (strcmp(argv[1], "-wc") == 0))
+      {
+      argc--; argv++;
+      ok = true;
+
+      countersFileName = argv[1];
+
+      argc--; argv++;
+      }
+
+    if ((ok == false) && (strcmp(argv[1], "-cache") == 0))
+      {
+      argc--; argv++;
+      ok = true;
+
+      checkpointDirectory = argv[1];
+
+      argc--; argv++;
+      }
+
+    if ((ok == false) && (strcmp(argv[1], "-sweep") == 0))
+      {
+      argc--; argv++;
+      ok = true;
+
+      sweepFileName = argv[1];
+
+      argc--; argv++;
+      }
+    }
+
+  //
+  // Track image memory if stage timings are requested so that memory
+  // can be reported per stage. This must be done before any image is
+  // allocated
+  //
+  if ( strcmp( timingsFileName, "q") != 0 || strcmp( traceFileName, "q") != 0 )
+    {
+    itk::ImageMemoryTracker::Enable();
+    }
+
+  //
+  // Likewise, the buffer pool only serves images allocated after it
+  // is enabled
+  //
+  if ( useBufferPool == 1 )
+    {
+    itk::ImageBufferPool::SetUseHugePages( useHugePages == 1 );
+    itk::ImageBufferPool::Enable();
     }
 
   //
@@ -301,61 +583,116 @@ int main( int argc, char *argv[] )
   ShortImageType::SpacingType spacing = ctImage->GetSpacing();
   
   unsigned long closingNeighborhood[3];
-    closingNeighborhood[0] = static_cast< unsigned long >( vnl_math_rnd( closingRadius/spacing[0] ) );
-    closingNeighborhood[1] = static_cast< unsigned long >( vnl_math_rnd( closingRadius/spacing[1] ) );
-    closingNeighborhood[2] = static_cast< unsigned long >( vnl_math_rnd( closingRadius/spacing[2] ) );
-
-  closingNeighborhood[0] = closingNeighborhood[0]>0 ? closingNeighborhood[0] : 1;
-  closingNeighborhood[1] = closingNeighborhood[1]>0 ? closingNeighborhood[1] : 1;
-  closingNeighborhood[2] = closingNeighborhood[2]>0 ? closingNeighborhood[2] : 1;
+  ComputeClosingNeighborhood( closingRadius, spacing, closingNeighborhood );
 
-  std::cout << "Clipping low CT image values..." << std::endl;
-  LowerClipImage( ctImage, lowerClipValue, lowerReplacementValue );
-
-  //std::cout << "Clipping low CT image values (enforcing -1024 lower bound)..." << std::endl;
-  //LowerClipImage( ctImage, -1024, -1024 );
-
-  std::cout << "Clipping upper CT image values..." << std::endl;
-  UpperClipImage( ctImage, upperClipValue, upperReplacementValue );
+  std::cout << "Clipping low and upper CT image values..." << std::endl;
+  ClipImage( ctImage, lowerClipValue, lowerReplacementValue, upperClipValue, upperReplacementValue );
   
 
+  itk::StageCheckpointCache::Pointer checkpointCache;
+  if ( strcmp( checkpointDirectory, "q") != 0 )
+    {
+    checkpointCache = itk::StageCheckpointCache::New();
+    checkpointCache->SetDirectory( checkpointDirectory );
+    }
+
   {
   ShortImageType::SizeType medianRadius;
     medianRadius[0] = 1;
     medianRadius[1] = 1;
     medianRadius[2] = 1;
 
+  //
+  // The median filtered image replaces the clipped CT image, so its
+  // checkpoint is keyed by the clipped CT image and the radius
+  //
+  itk::StageCheckpointKey medianKey;
+  itk::StageCheckpointCache::SectionsType medianSections;
+
+  itk::StageCheckpointCache::AddSection( medianSections, ctImage->GetBufferPointer(),
+                                         ctImage->GetBufferedRegion().GetNumberOfPixels()*sizeof( short ) );
+
+  bool medianLoaded = false;
+  if ( checkpointCache.IsNotNull() )
+    {
+    for ( unsigned int i=0; i<3; i++ )
+      {
+      medianKey.Add( static_cast< long >( ctImage->GetBufferedRegion().GetSize()[i] ) );
+      medianKey.Add( static_cast< long >( medianRadius[i] ) );
+      }
+    medianKey.Add( ctImage->GetBufferPointer(), ctImage->GetBufferedRegion().GetNumberOfPixels()*sizeof( short ) );
+
+    medianLoaded = checkpointCache->Load( "Median", medianKey, medianSections );
+    }
 
+  if ( !medianLoaded )
+  {
  std::cout << "Executing median filter..." << std::endl;
   MedianType::Pointer median = MedianType::New();
     median->SetInput( ctImage );
     median->SetRadius( medianRadius );
     median->Update();
 
-  ShortIteratorType gIt( ctImage, ctImage->GetBufferedRegion() );
-  ShortIteratorType mIt( median->GetOutput(), median->GetOutput()->GetBufferedRegion() );
+  itk::VoxelCopyOperation< short > copyMedian( median->GetOutput()->GetBufferPointer(), ctImage->GetBufferPointer() );
 
-  gIt.GoToBegin();
-  mIt.GoToBegin();
-  while ( !gIt.IsAtEnd() )
-    {
-    gIt.Set( mIt.Get() );
+  itk::VoxelPass::Pointer copyPass = itk::VoxelPass::New();
+    copyPass->AddOperation( &copyMedian );
+    copyPass->Execute( ctImage->GetBufferedRegion().GetNumberOfPixels() );
 
-    ++gIt;
-    ++mIt;
+  if ( checkpointCache.IsNotNull() )
+    {
+    checkpointCache->Store( "Median", medianKey, medianSections );
     }
-    
-    
+  }
   }
   
 
   std::cout << "Executing partial lung filter..." << std::endl;
   PartialLungType::Pointer partialLungFilter = PartialLungType::New();
     partialLungFilter->SetInput( ctImage );
+    partialLungFilter->SetCheckpointCache( checkpointCache );
   if ( aggressiveLungSplitting == 1 )
     {
     partialLungFilter->SetAggressiveLeftRightSplitter( true );
     }
+  if ( airwayPriorityFlood == 1 )
+    {
+    partialLungFilter->SetUseAirwayPriorityFlood( true );
+    }
+  if ( useSeamSolver == 0 )
+    {
+    partialLungFilter->SetUseSeamSolver( false );
+    }
+  if ( graphSearchFallback == 0 )
+    {
+    partialLungFilter->SetGraphSearchFallback( false );
+    }
+  if ( useLungBoundingBox == 1 )
+    {
+    partialLungFilter->SetUseLungBoundingBox( true );
+    partialLungFilter->SetLungBoundingBoxPadding( lungBoundingBoxPadding );
+    }
+  if ( parallelConditionalDilation == 1 )
+    {
+    partialLungFilter->SetParallelConditionalDilation( true );
+    }
+  if ( useDistanceTransformClosing == 1 )
+    {
+    partialLungFilter->SetUseDistanceTransformClosing( true );
+    partialLungFilter->SetClosingRadius( closingRadius );
+    }
+  if ( concurrentClosing == 1 )
+    {
+    partialLungFilter->SetConcurrentClosing( true );
+    }
+  if ( parallelSplitting == 1 )
+    {
+    partialLungFilter->SetParallelSplitting( true );
+    }
+  if ( usePerformanceCounters == 1 )
+    {
+    partialLungFilter->GetProfiler()->SetUsePerformanceCounters( true );
+    }
   if ( headFirst == 1 )
     {
     partialLungFilter->SetHeadFirst( true );
@@ -368,6 +705,8 @@ int main( int argc, char *argv[] )
     partialLungFilter->SetLeftRightLungSplitRadius( lungSplitRadius );
     partialLungFilter->SetMinAirwayVolume( minAirwayVolume );
     partialLungFilter->SetMaxAirwayVolume( maxAirwayVolume );
+    partialLungFilter->SetAirwayCoarseToFineShrinkFactor( airwayShrinkFactor );
+    partialLungFilter->SetNarrowBandRadius( narrowBandRadius );
     partialLungFilter->SetClosingNeighborhood( closingNeighborhood );
     partialLungFilter->SetManualThreshold( manualThreshold );
     partialLungFilter->SetStdLungThreshold( stdLungThreshold );
@@ -392,8 +731,52 @@ int main( int argc, char *argv[] )
       }
     partialLungFilter->SetHelperMask( helperReader->GetOutput() );
     }
+
+  if ( strcmp( sweepFileName, "q") != 0 )
+    {
+    return RunParameterSweep( partialLungFilter, sweepFileName, outputLungMaskFileName, timingsFileName, spacing );
+    }
+
     partialLungFilter->Update();
 
+  if ( strcmp( timingsFileName, "q") != 0 )
+    {
+    std::cout << "Writing stage timings..." << std::endl;
+    std::ofstream timingsFile( timingsFileName );
+    partialLungFilter->GetProfiler()->WriteJSON( timingsFile );
+    }
+
+  if ( strcmp( traceFileName, "q") != 0 )
+    {
+    std::cout << "Writing stage trace..." << std::endl;
+    std::ofstream traceFile( traceFileName );
+    partialLungFilter->GetProfiler()->WriteChromeTrace( traceFile );
+    }
+
+  if ( strcmp( countersFileName, "q") != 0 )
+    {
+    std::cout << "Writing work counters..." << std::endl;
+    std::ofstream countersFile( countersFileName );
+    itk::WorkCounters::WriteJSON( countersFile );
+    }
+
+  if ( itk::ImageMemoryTracker::GetEnabled() )
+    {
+    std::cout << "---Peak image memory (bytes):\t" << itk::ImageMemoryTracker::GetPeakLiveBytes() << std::endl;
+    }
+
+  if ( checkpointCache.IsNotNull() )
+    {
+    std::cout << "---Checkpoints loaded:\t" << checkpointCache->GetNumberOfHits() << std::endl;
+    std::cout << "---Checkpoints computed:\t" << checkpointCache->GetNumberOfMisses() << std::endl;
+    }
+
+  if ( itk::ImageBufferPool::GetEnabled() )
+    {
+    std::cout << "---Image buffers allocated:\t" << itk::ImageBufferPool::GetNumberOfAcquisitions() << std::endl;
+    std::cout << "---Image buffers reused:\t" << itk::ImageBufferPool::GetNumberOfReuses() << std::endl;
+    }
+
   std::cout << "Writing lung mask image..." << std::endl;
   UShortWriterType::Pointer maskWriter = UShortWriterType::New(); 
     maskWriter->SetInput( partialLungFilter->GetOutput() );
@@ -416,37 +799,20 @@ int main( int argc, char *argv[] )
 }
 
 
-void LowerClipImage( ShortImageType::Pointer image, short clipValue, short replacementValue )
-{
-  ShortIteratorType iIt( image, image->GetBufferedRegion() );
-
-  iIt.GoToBegin();
-  while ( !iIt.IsAtEnd() )
-    {
-    if ( iIt.Get() < clipValue )
-      {
-      iIt.Set( replacementValue );
-      }
-
-    ++iIt;
-    }
-}
-
-
-void UpperClipImage( ShortImageType::Pointer image, short clipValue, short replacementValue )
+//
+// Both clips are done in the same pass over the image, the upper
+// clip applying to the result of the lower clip
+//
+void ClipImage( ShortImageType::Pointer image, short lowerClipValue, short lowerReplacementValue,
+                short upperClipValue, short upperReplacementValue )
 {
-  ShortIteratorType iIt( image, image->GetBufferedRegion() );
+  itk::VoxelClipOperation< short > lowerClip( image->GetBufferPointer(), lowerClipValue, lowerReplacementValue, false );
+  itk::VoxelClipOperation< short > upperClip( image->GetBufferPointer(), upperClipValue, upperReplacementValue, true );
 
-  iIt.GoToBegin();
-  while ( !iIt.IsAtEnd() )
-    {
-    if ( iIt.Get() > clipValue )
-      {
-      iIt.Set( replacementValue );
-      }
-
-    ++iIt;
-    }
+  itk::VoxelPass::Pointer pass = itk::VoxelPass::New();
+    pass->AddOperation( &lowerClip );
+    pass->AddOperation( &upperClip );
+    pass->Execute( image->GetBufferedRegion().GetNumberOfPixels() );
 }
 
 
@@ -494,3 +860,136 @@ ShortImageType::Pointer ReadCTFromFile( char* fileName )
 
   return reader->GetOutput();
 }
+
+
+void ComputeClosingNeighborhood( double closingRadius, ShortImageType::SpacingType spacing, unsigned long* closingNeighborhood )
+{
+  for ( unsigned int i=0; i<3; i++ )
+    {
+    closingNeighborhood[i] = static_cast< unsigned long >( vnl_math_rnd( closingRadius/spacing[i] ) );
+    closingNeighborhood[i] = closingNeighborhood[i]>0 ? closingNeighborhood[i] : 1;
+    }
+}
+
+
+int RunParameterSweep( PartialLungType::Pointer partialLungFilter, char* sweepFileName, char* outputFileName,
+                       char* timingsFileName, ShortImageType::SpacingType spacing )
+{
+  std::cout << "Reading sweep parameters..." << std::endl;
+  std::ifstream sweepFile( sweepFileName );
+
+  if ( !sweepFile )
+    {
+    std::cerr << "ERROR: Could not read sweep file " << sweepFileName << std::endl;
+
+    return 1;
+    }
+
+  partialLungFilter->ClearSweepParameters();
+
+  std::string line;
+  while ( std::getline( sweepFile, line ) )
+    {
+    if ( line.find_first_not_of( " \t" ) == std::string::npos || line[line.find_first_not_of( " \t" )] == '#' )
+      {
+      continue;
+      }
+
+    std::istringstream values( line );
+
+    int    manualThreshold;
+    double closingRadius;
+
+    PartialLungType::SweepParametersType parameters;
+
+    if ( !(values >> manualThreshold >> parameters.LeftRightLungSplitRadius >> closingRadius
+           >> parameters.MinVolPercentAirway >> parameters.MaxVolPercentAirway) )
+      {
+      std::cerr << "ERROR: Could not parse sweep parameters: " << line << std::endl;
+
+      return 1;
+      }
+
+    parameters.ManualThreshold = static_cast< short >( manualThreshold );
+    ComputeClosingNeighborhood( closingRadius, spacing, parameters.ClosingNeighborhood );
+
+    //
+    // Distance transform closing uses the radius itself rather than
+    // the neighborhood
+    //
+    parameters.ClosingRadius = partialLungFilter->GetUseDistanceTransformClosing() ? closingRadius : 0.0;
+
+    partialLungFilter->AddSweepParameters( parameters );
+    }
+
+  std::cout << "Executing parameter sweep..." << std::endl;
+  partialLungFilter->RunParameterSweep();
+
+  const std::vector< PartialLungType::SweepResultType >& results = partialLungFilter->GetSweepResults();
+
+  int status = 0;
+
+  for ( unsigned int i=0; i<results.size(); i++ )
+    {
+    if ( results[i].LabelMap.IsNull() )
+      {
+      std::cerr << "ERROR: Sweep run " << i << " failed" << std::endl;
+      status = 1;
+
+      continue;
+      }
+
+    if ( strcmp( timingsFileName, "q") != 0 )
+      {
+      std::ofstream timingsFile( GetSweepFileName( timingsFileName, i ).c_str() );
+      results[i].Profiler->WriteJSON( timingsFile );
+      }
+
+    if ( results[i].Profiler->GetNumberOfStages() > 0 )
+      {
+      std::cout << "---Sweep run " << i << " wall time:\t" << results[i].Profiler->GetStage( 0 ).WallTime << std::endl;
+      }
+
+    std::cout << "Writing lung mask image of sweep run " << i << "..." << std::endl;
+    UShortWriterType::Pointer maskWriter = UShortWriterType::New();
+      maskWriter->SetInput( results[i].LabelMap );
+      maskWriter->SetFileName( GetSweepFileName( outputFileName, i ) );
+      maskWriter->UseCompressionOn();
+    try
+      {
+      maskWriter->Update();
+      }
+    catch ( itk::ExceptionObject &excp )
+      {
+      std::cerr << "Exception caught while writing lung mask:";
+      std::cerr << excp << std::endl;
+      status = 1;
+      }
+    }
+
+  std::cout << "DONE." << std::endl;
+
+  return status;
+}
+
+
+/**
+ * 'fileName' with "_sweep<run>" inserted before the extension
+ */
+std::string GetSweepFileName( const char* fileName, unsigned int run )
+{
+  std::string name( fileName );
+
+  std::string::size_type extension = name.rfind( '.' );
+  std::string::size_type directory = name.rfind( '/' );
+
+  if ( extension == std::string::npos || (directory != std::string::npos && extension < directory) )
+    {
+    extension = name.size();
+    }
+
+  std::ostringstream sweepName;
+  sweepName << name.substr( 0, extension ) << "_sweep" << run << name.substr( extension );
+
+  return sweepName.str();
+}
@@ -26,6 +26,14 @@
 #include "itkBinaryBallStructuringElement.h"
 #include "itkBinaryThresholdImageFilter.h"
 #include "itkBinaryErodeImageFilter.h"
+#include "itkMultiThreader.h"
+#include "itkWorkCounters.h"
+#include "itkVoxelNeighborhood.h"
+#include "itkIntensityHistogram.h"
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <vector>
 
 
 namespace itk
@@ -102,6 +110,70 @@ public:
   itkSetMacro( MaxAirwayVolumeIncreaseRate, double );
   itkGetMacro( MaxAirwayVolumeIncreaseRate, double );
 
+  /** By default the airways are segmented by growing a region from
+   *  the seeds until the min airway volume is reached. When
+   *  'UsePriorityFlood' is set, a priority flood from the seeds is
+   *  used instead. In a single pass, it computes the lowest threshold
+   *  at which each voxel joins the airway tree. This gives the full
+   *  airway volume versus threshold curve at once. The final threshold
+   *  is then picked from the curve. The volume may not exceed
+   *  MaxAirwayVolume, and once MinAirwayVolume is reached the volume
+   *  may not grow faster than MaxAirwayVolumeIncreaseRate (cc per
+   *  HU). Off by default. */
+  itkSetMacro( UsePriorityFlood, bool );
+  itkGetMacro( UsePriorityFlood, bool );
+  itkBooleanMacro( UsePriorityFlood );
+
+  /** The airway volume versus threshold curve computed by the
+   *  priority flood. Each entry is a threshold and the volume of the
+   *  region connected to the seeds at that threshold (in the units of
+   *  MinAirwayVolume and MaxAirwayVolume). Entries are sorted by
+   *  increasing threshold and are only listed where the volume
+   *  changes. The first entry is the seeds alone. The curve stops at
+   *  the first threshold whose volume exceeds MaxAirwayVolume. It is
+   *  only filled when UsePriorityFlood is on and only valid after
+   *  Update() */
+  typedef std::pair< InputPixelType, double >     ThresholdVolumePairType;
+  typedef std::vector< ThresholdVolumePairType >  ThresholdVolumeCurveType;
+  const ThresholdVolumeCurveType & GetThresholdVolumeCurve() const
+    {
+      return this->m_ThresholdVolumeCurve;
+    }
+
+  /** The final threshold: the threshold picked from the volume curve
+   *  when UsePriorityFlood is on, otherwise the threshold reached by
+   *  region growing. Only valid after Update() */
+  itkGetMacro( FinalThreshold, InputPixelType );
+
+  /** When set to a value greater than 1 (2 or 4 are typical), the
+   *  airways are first segmented on a copy of the input shrunk by
+   *  this factor in each direction. The full resolution segmentation
+   *  is then restricted to a narrow band around the coarse
+   *  result. The min and max airway volumes are physical volumes and
+   *  apply to both resolutions. On the coarse image, a voxel counts
+   *  for the full resolution voxels of its block at or below the
+   *  threshold at which it joins the airways, not for its whole
+   *  block. The coarse result is still only an approximation, so the
+   *  final threshold and airways may differ from those found at full
+   *  resolution alone. Default is 1 (off) */
+  itkSetMacro( CoarseToFineShrinkFactor, unsigned int );
+  itkGetMacro( CoarseToFineShrinkFactor, unsigned int );
+
+  /** Radius (in coarse voxels) of the band around the coarse airways
+   *  within which the full resolution segmentation is allowed. Only
+   *  used when CoarseToFineShrinkFactor is greater than 1. Default
+   *  is 1 */
+  itkSetMacro( CoarseToFineBandRadius, unsigned int );
+  itkGetMacro( CoarseToFineBandRadius, unsigned int );
+
+  /** Histogram of the input (or of an image holding at least the
+   *  values of the input, such as the image the input was cropped
+   *  from). When set, region growing raises the threshold past the
+   *  values that no voxel has in a single step instead of one
+   *  increment at a time. The result is the same. Optional */
+  itkSetConstObjectMacro( IntensityHistogram, IntensityHistogram );
+  itkGetConstObjectMacro( IntensityHistogram, IntensityHistogram );
+
   /** Set a seed (multiple seeds may be specified) for the region
    * growing */
   void AddSeed( OutputImageType::IndexType );
@@ -115,12 +187,220 @@ protected:
   typedef itk::BinaryBallStructuringElement< LabelMapPixelType, 3 >                  ElementType;
   typedef itk::BinaryDilateImageFilter< LabelMapType, LabelMapType, ElementType >    DilateType;
   typedef itk::BinaryErodeImageFilter< LabelMapType, LabelMapType, ElementType >     ErodeType;
+  typedef itk::VoxelNeighborhood< 3, 26 >                                            NeighborhoodType;
+
+  /** Priority flood queue elements are (join threshold, linear
+   *  offset) pairs, smallest first */
+  typedef std::pair< InputPixelType, unsigned long >                                 FloodElementType;
+  typedef std::priority_queue< FloodElementType, std::vector< FloodElementType >,
+                               std::greater< FloodElementType > >                    FloodQueueType;
+
+  /** Counts the full resolution voxels at or below a threshold in
+   *  the block of a voxel of the coarse image (see CoarseToFine). A
+   *  voxel counts for at least one voxel, so that seeds brighter than
+   *  the threshold still count. 'FineVoxelVolume' is the volume of a
+   *  full resolution voxel. */
+  struct FineVoxelCounter
+  {
+    const InputPixelType*  FineBuffer;
+    long                   FineSize[3];
+    long                   CoarseSize[3];
+    long                   Factor;
+    double                 FineVoxelVolume;
+
+    unsigned long Count( unsigned long coarseOffset, InputPixelType threshold ) const
+      {
+        long coarseIndex[3];
+        for ( unsigned int i=0; i<3; i++ )
+          {
+          coarseIndex[i] = static_cast< long >( coarseOffset%this->CoarseSize[i] );
+          coarseOffset  /= this->CoarseSize[i];
+          }
+
+        unsigned long count = 0;
+
+        for ( long z=coarseIndex[2]*this->Factor; z<std::min( (coarseIndex[2]+1)*this->Factor, this->FineSize[2] ); z++ )
+          {
+          for ( long y=coarseIndex[1]*this->Factor; y<std::min( (coarseIndex[1]+1)*this->Factor, this->FineSize[1] ); y++ )
+            {
+            const InputPixelType* row = this->FineBuffer + (z*this->FineSize[1] + y)*this->FineSize[0];
+
+            for ( long x=coarseIndex[0]*this->Factor; x<std::min( (coarseIndex[0]+1)*this->Factor, this->FineSize[0] ); x++ )
+              {
+              if ( row[x] <= threshold )
+                {
+                count++;
+                }
+              }
+            }
+          }
+
+        return count > 0 ? count : 1;
+      }
+  };
+
+  /** Tags the neighbors of the frontier not yet in the region as
+   *  dark enough to be added ('ACCEPT') or, unless already rejected,
+   *  too bright ('REJECT'). Used by the threads expanding the
+   *  frontier (see VoxelFrontierExpansion). */
+  struct GrowthClassifier
+  {
+    enum { ACCEPT = 1, REJECT = 2 };
+
+    const InputPixelType*       InputBuffer;
+    const std::vector< bool >*  Visited;
+    const std::vector< bool >*  IsRejected;
+    short                       Threshold;
+
+    unsigned char operator()( unsigned long, unsigned long neighbor ) const
+      {
+        if ( (*this->Visited)[neighbor] )
+          {
+          return 0;
+          }
+
+        if ( this->InputBuffer[neighbor] <= this->Threshold )
+          {
+          return ACCEPT;
+          }
+
+        return (*this->IsRejected)[neighbor] ? 0 : REJECT;
+      }
+  };
+
+  /** Adds a neighbor of the frontier to the region if it is dark
+   *  enough and the max volume has not been reached. Neighbors that
+   *  are too bright are recorded (once) as rejected. Called for each
+   *  neighbor when the frontier is expanded serially, and for the
+   *  tagged neighbors of each frontier voxel when it is expanded in
+   *  parallel. */
+  struct GrowthFunctor
+  {
+    const InputPixelType*          InputBuffer;
+    LabelMapPixelType*             OutputBuffer;
+    std::vector< bool >*           Visited;
+    std::vector< bool >*           IsRejected;
+    std::vector< unsigned long >*  Rejected;
+    std::vector< unsigned long >*  NextFrontier;
+    unsigned int*                  NumberOfVoxels;
+    unsigned int                   MaxNumberVoxels;
+    short                          Threshold;
+    LabelMapPixelType              Label;
+    const FineVoxelCounter*        Counter;
+
+    void operator()( unsigned long, unsigned long neighbor )
+      {
+        if ( (*this->Visited)[neighbor] )
+          {
+          return;
+          }
+
+        if ( this->InputBuffer[neighbor] <= this->Threshold )
+          {
+          this->Add( neighbor );
+          }
+        else
+          {
+          this->Reject( neighbor );
+          }
+      }
+
+    /** The tags were computed before the claims made earlier in the
+     *  generation, so the region membership is rechecked. Returns
+     *  false once the max volume is reached. */
+    bool operator()( unsigned long, const unsigned long* neighbors, const unsigned char* tags, unsigned long numberOfNeighbors )
+      {
+        for ( unsigned long n=0; n<numberOfNeighbors; n++ )
+          {
+          if ( (*this->Visited)[neighbors[n]] )
+            {
+            continue;
+            }
+
+          if ( tags[n] == GrowthClassifier::ACCEPT )
+            {
+            this->Add( neighbors[n] );
+            }
+          else
+            {
+            this->Reject( neighbors[n] );
+            }
+          }
+
+        return *this->NumberOfVoxels < this->MaxNumberVoxels;
+      }
+
+    void Add( unsigned long neighbor )
+      {
+        if ( *this->NumberOfVoxels < this->MaxNumberVoxels )
+          {
+          (*this->Visited)[neighbor] = true;
+          this->OutputBuffer[neighbor] = this->Label;
+          this->NextFrontier->push_back( neighbor );
+          (*this->NumberOfVoxels) += this->Counter != 0 ? this->Counter->Count( neighbor, this->Threshold ) : 1;
+          }
+      }
+
+    void Reject( unsigned long neighbor )
+      {
+        if ( !(*this->IsRejected)[neighbor] )
+          {
+          (*this->IsRejected)[neighbor] = true;
+          this->Rejected->push_back( neighbor );
+          }
+      }
+  };
+
+  typedef itk::VoxelFrontierExpansion< NeighborhoodType, std::vector< unsigned long >, GrowthClassifier >  FrontierExpansionType;
+
+  /** Pushes the neighbors not queued yet at the level at which they
+   *  join the flood */
+  struct FloodFunctor
+  {
+    const InputPixelType*  InputBuffer;
+    std::vector< bool >*   Queued;
+    FloodQueueType*        Queue;
+    InputPixelType         CurrentLevel;
+
+    void operator()( unsigned long, unsigned long neighbor )
+      {
+        if ( !(*this->Queued)[neighbor] )
+          {
+          (*this->Queued)[neighbor] = true;
+
+          InputPixelType level = this->InputBuffer[neighbor] > this->CurrentLevel ? this->InputBuffer[neighbor] : this->CurrentLevel;
+
+          this->Queue->push( FloodElementType( level, neighbor ) );
+          }
+      }
+  };
 
   AutoThresholdAirwaySegmentationImageFilter();
   virtual ~AutoThresholdAirwaySegmentationImageFilter() {}
 
   void GenerateData();
-  void Test();
+
+  /** Frontier-based region growing used to produce the airway label
+   *  map. See the implementation for details. When more than one
+   *  thread is available (see SetNumberOfThreads) and the frontier is
+   *  large, the frontier is expanded in parallel. The output does not
+   *  depend on the number of threads. Growing starts at
+   *  'initialThreshold' and, if 'band' is not null, stays within
+   *  'band' (one entry per voxel of the buffered region). */
+  void Test( short initialThreshold, const std::vector< bool >* band );
+
+  /** Priority flood used when UsePriorityFlood is on. If 'band' is
+   *  not null, the flood stays within 'band' */
+  void PriorityFlood( const std::vector< bool >* band );
+
+  /** Coarse-to-fine segmentation used when CoarseToFineShrinkFactor
+   *  is greater than 1 */
+  void CoarseToFine();
+
+  /** Volume of a voxel as counted against the min and max airway
+   *  volumes: a full resolution voxel when segmenting the coarse
+   *  image of CoarseToFine, otherwise a voxel of the input */
+  double GetCountedVoxelVolume() const;
 
 private:
   AutoThresholdAirwaySegmentationImageFilter(const Self&); //purposely not implemented
@@ -132,6 +412,19 @@ private:
   double           m_MinAirwayVolume;
   double           m_MaxAirwayVolume;
   double           m_MaxAirwayVolumeIncreaseRate;
+  bool             m_UsePriorityFlood;
+  InputPixelType   m_FinalThreshold;
+  unsigned int     m_CoarseToFineShrinkFactor;
+  unsigned int     m_CoarseToFineBandRadius;
+
+  ThresholdVolumeCurveType  m_ThresholdVolumeCurve;
+
+  IntensityHistogram::ConstPointer  m_IntensityHistogram;
+
+  //
+  // Set on the filter segmenting the coarse image of CoarseToFine
+  //
+  const FineVoxelCounter*  m_FineVoxelCounter;
 };
   
 } // end namespace itk
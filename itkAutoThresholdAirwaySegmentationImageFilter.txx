@@ -30,6 +30,11 @@ AutoThresholdAirwaySegmentationImageFilter< TInputImage >
   this->m_MinAirwayVolume             = 10.0;
   this->m_MaxAirwayVolume             = 500.0;
   this->m_MaxAirwayVolumeIncreaseRate = 2.0; 
+  this->m_UsePriorityFlood            = false;
+  this->m_FinalThreshold              = 0;
+  this->m_CoarseToFineShrinkFactor    = 1;
+  this->m_CoarseToFineBandRadius      = 1;
+  this->m_FineVoxelCounter            = 0;
 }
 
 
@@ -49,7 +54,18 @@ AutoThresholdAirwaySegmentationImageFilter< TInputImage >
     outputPtr->Allocate();
     outputPtr->FillBuffer( 0 );
 
-  this->Test();
+  if ( this->m_CoarseToFineShrinkFactor > 1 )
+    {
+    this->CoarseToFine();
+    }
+  else if ( this->m_UsePriorityFlood )
+    {
+    this->PriorityFlood( 0 );
+    }
+  else
+    {
+    this->Test( -960, 0 ); //sila
+    }
 
 //   unsigned short airwayLabel = this->m_LungConventions.GetValueFromLungRegionAndType( UNDEFINEDREGION, AIRWAY );
 
@@ -213,133 +229,646 @@ AutoThresholdAirwaySegmentationImageFilter< TInputImage >
 }
 
 
+/**
+ * Grow the airway region from the seeds. Only the voxels added in the
+ * most recent generation (the frontier) are expanded. Neighbors that
+ * are rejected because they are brighter than the current threshold
+ * are kept, in the order in which they were first encountered, so
+ * that raising the threshold only requires revisiting those voxels
+ * instead of the entire region grown so far. Membership is tracked
+ * in a visited bitmap and all voxels are stored as linear buffer
+ * offsets. The visiting order is identical to that of an exhaustive
+ * rescan of the region, so the result is the same voxel for voxel
+ * (including which voxels are kept when the max volume is reached).
+ * Growing starts at 'initialThreshold'. If 'band' is specified, the
+ * region is not allowed to grow outside of it.
+ */
 template < class TInputImage >
 void
 AutoThresholdAirwaySegmentationImageFilter< TInputImage >
-::Test()
+::Test( short initialThreshold, const std::vector< bool >* band )
 {
   unsigned short airwayLabel = this->m_LungConventions.GetValueFromLungRegionAndType( UNDEFINEDREGION, AIRWAY );
 
-  typename InputImageType::SpacingType spacing = this->GetInput()->GetSpacing();
+  InputImageRegionType  region = this->GetInput()->GetBufferedRegion();
+
+  const unsigned long  numberOfVoxels = region.GetNumberOfPixels();
+
+  const InputPixelType* inputBuffer  = this->GetInput()->GetBufferPointer();
+  LabelMapPixelType*    outputBuffer = this->GetOutput()->GetBufferPointer();
+
+  //
+  // The neighbor ordering of the neighborhood (x outermost, z
+  // innermost) determines the order in which candidates are
+  // discovered, which in turn determines which voxels are kept when
+  // the max volume is reached.
+  //
+  NeighborhoodType neighborhood( region );
 
   unsigned int numVoxels = 0; // Will keep track of the number of
-                              // voxels as we add to the vector of
-                              // indices to go in the output
+                              // voxels as we add to the output
 
   //
-  // 'indicesVecFinal' will be a container for our final collection of
-  // indices to set to foreground in our output label
-  // map. 'indicesVecTemp' will be a temporary container that will
-  // collect new indices during the iterative process below. After a
-  // given iteration, the indices in 'indicesVecTemp' will be dumped
-  // into 'indicesVecFinal' (provided we don't go over the max number
-  // of allowable indices as deteremined by the 'm_MaxAirwayVolume'.
+  // 'frontier' holds the voxels added during the last generation and
+  // 'nextFrontier' collects the voxels added during the current
+  // one. 'rejected' holds every neighbor that has been examined but
+  // was too bright for the threshold in effect at the time. 'visited'
+  // marks voxels that belong to the region and 'isRejected' marks
+  // voxels already in 'rejected' so that each is stored only once.
   //
-  std::vector< OutputImageType::IndexType > indicesVecFinal;
-  std::vector< OutputImageType::IndexType > indicesVecTemp;
+  std::vector< unsigned long > frontier;
+  std::vector< unsigned long > nextFrontier;
+  std::vector< unsigned long > rejected;
+  std::vector< bool >          visited( numberOfVoxels, false );
+  std::vector< bool >          isRejected( numberOfVoxels, false );
 
   //
-  // Find the darkest value among the seeds
+  // Voxels outside of the band are marked as visited so that the
+  // region never grows into them
   //
-  InputPixelType darkestSeedPixel = itk::NumericTraits< InputPixelType >::max();
+  if ( band != 0 )
+    {
+    visited = *band;
+    visited.flip();
+    }
 
   for ( unsigned int i=0; i<this->m_SeedVec.size(); i++ )
     {
-    numVoxels++;
-
-    this->GetOutput()->SetPixel( this->m_SeedVec[i], airwayLabel );
+    unsigned long seedOffset = neighborhood.ComputeOffset( this->m_SeedVec[i] );
 
-    indicesVecFinal.push_back( this->m_SeedVec[i] );
+    numVoxels += this->m_FineVoxelCounter != 0 ? this->m_FineVoxelCounter->Count( seedOffset, initialThreshold ) : 1;
 
-    InputPixelType value = this->GetInput()->GetPixel( this->m_SeedVec[i] );
+    outputBuffer[seedOffset] = airwayLabel;
 
-    if ( value < darkestSeedPixel )
+    if ( !visited[seedOffset] )
       {
-      darkestSeedPixel = value;
+      visited[seedOffset] = true;
+      frontier.push_back( seedOffset );
       }
     }
 
   //
   // Out strategy will be to grow the airway region until the max
   // volume is exactly reached. We will do this be considering 3x3x3
-  // neighborhoods of the current set of seed points using the
-  // darkestSeedPixel value as our initial threshold value. We will
-  // keep adding indices to our label map until the max volume is
-  // reached. If after considering all neighborhoods in our current
-  // set of indices no new indices are added and the max volume has
-  // not been reached, increment the threshold value.
+  // neighborhoods of the current frontier using the threshold value
+  // below. We will keep adding indices to our label map until the max
+  // volume is reached. If no new indices are added and the max volume
+  // has not been reached, increment the threshold value and revisit
+  // the rejected neighbors.
   //
-  //short threshold = darkestSeedPixel;
-  short threshold=-960; //sila
-  unsigned int maxNumberVoxels = static_cast< unsigned int >( this->m_MaxAirwayVolume/(spacing[0]*spacing[1]*spacing[2]) );
-  unsigned int minNumberVoxels = static_cast< unsigned int >( this->m_MinAirwayVolume/(spacing[0]*spacing[1]*spacing[2]) );
+  short threshold = initialThreshold;
+  unsigned int maxNumberVoxels = static_cast< unsigned int >( this->m_MaxAirwayVolume/this->GetCountedVoxelVolume() );
+  unsigned int minNumberVoxels = static_cast< unsigned int >( this->m_MinAirwayVolume/this->GetCountedVoxelVolume() );
 
-  OutputImageType::IndexType index;
-
-  bool add, addedNew;
+  //
+  // Large frontiers are expanded by the threads of the filter (small
+  // ones are not worth the threading overhead)
+  //
+  this->GetMultiThreader()->SetNumberOfThreads( this->GetNumberOfThreads() );
+
+  FrontierExpansionType expansion( neighborhood, this->GetMultiThreader() );
+
+  GrowthClassifier classifier;
+    classifier.InputBuffer = inputBuffer;
+    classifier.Visited     = &visited;
+    classifier.IsRejected  = &isRejected;
+    classifier.Threshold   = threshold;
+
+  GrowthFunctor grower;
+    grower.InputBuffer     = inputBuffer;
+    grower.OutputBuffer    = outputBuffer;
+    grower.Visited         = &visited;
+    grower.IsRejected      = &isRejected;
+    grower.Rejected        = &rejected;
+    grower.NextFrontier    = &nextFrontier;
+    grower.NumberOfVoxels  = &numVoxels;
+    grower.MaxNumberVoxels = maxNumberVoxels;
+    grower.Label           = airwayLabel;
+    grower.Threshold       = threshold;
+    grower.Counter         = this->m_FineVoxelCounter;
+
+  unsigned long numIterations       = 0;
+  unsigned long numThresholdBumps   = 0;
+  unsigned long numParallelExpanded = 0;
 
   while ( numVoxels < minNumberVoxels )
     {
-    indicesVecTemp.clear();
+    numIterations++;
+
+    nextFrontier.clear();
+
+    if ( expansion.IsParallel( frontier.size() ) )
+      {
+      //
+      // The threads tag the neighbors against the region membership
+      // and rejections as they were at the start of this generation,
+      // so a neighbor may be tagged for several frontier voxels or
+      // claimed earlier in the generation. The tags are claimed here,
+      // in frontier order, rechecking membership. This is exactly the
+      // order of the serial expansion below, so the max volume is
+      // enforced exactly and the output does not depend on the number
+      // of threads.
+      //
+      expansion.Expand( frontier, frontier.size(), classifier );
+      expansion.Claim( grower );
+
+      numParallelExpanded++;
+      }
+    else if ( frontier.size() > 0 )
+      {
+      for ( unsigned int i=0; i<frontier.size() && numVoxels < maxNumberVoxels; i++ )
+        {
+        neighborhood.VisitNeighbors( frontier[i], grower );
+        }
+      }
+    else
+      {
+      //
+      // The threshold has just been raised. Every voxel that can now
+      // be added has been rejected before, and the rejected container
+      // is already ordered by first discovery. Keep those that are
+      // still too bright (in order) for the next increment.
+      //
+      unsigned long numKept = 0;
+
+      for ( unsigned long i=0; i<rejected.size(); i++ )
+        {
+        unsigned long candidate = rejected[i];
 
-    addedNew = false;
+        if ( visited[candidate] )
+          {
+          continue;
+          }
+
+        if ( inputBuffer[candidate] <= threshold && numVoxels < maxNumberVoxels )
+          {
+          grower.Add( candidate );
+          }
+        else
+          {
+          rejected[numKept] = candidate;
+          numKept++;
+          }
+        }
 
-    for ( unsigned int i=0; i<indicesVecFinal.size(); i++ )
+      rejected.resize( numKept );
+      }
+  
+    if ( nextFrontier.size() > 0 )
+      {
+      frontier.swap( nextFrontier );
+      }
+    else if ( numVoxels < maxNumberVoxels )
       {
-      for ( int x=-1; x<=1; x++ )
+      frontier.clear();
+
+      //
+      // Nothing is left to grow into, or the threshold can no longer
+      // be raised. Further iterations could not change the output.
+      //
+      if ( rejected.size() == 0 || threshold > itk::NumericTraits< short >::max() - 10 )
+        {
+        break;
+        }
+
+      threshold += 10; 
+      numThresholdBumps++;
+
+      //
+      // The voxels that can be added at the new threshold are those
+      // with values in (threshold - 10, threshold]. While no voxel of
+      // the input has such a value, the iteration at that threshold
+      // would add nothing and raise the threshold again.
+      //
+      if ( this->m_IntensityHistogram.IsNotNull() )
         {
-        index[0] = indicesVecFinal[i][0] + x;
-        
-        for ( int y=-1; y<=1; y++ )
+        while ( threshold <= itk::NumericTraits< short >::max() - 10 &&
+                this->m_IntensityHistogram->GetCount( threshold - 9, threshold ) == 0 )
           {
-          index[1] = indicesVecFinal[i][1] + y;
-          
-          for ( int z=-1; z<=1; z++ )
-            {
-            index[2] = indicesVecFinal[i][2] + z;
+          threshold += 10;
+          numThresholdBumps++;
+          }
+        }
+
+      grower.Threshold     = threshold;
+      classifier.Threshold = threshold;
+      }
+    else
+      {
+      break;
+      }
+    }
+
+  WorkCounters::Add( "AutoThresholdAirwaySegmentation.GrowthIterations", numIterations );
+  WorkCounters::Add( "AutoThresholdAirwaySegmentation.ThresholdBumps", numThresholdBumps );
+  WorkCounters::Add( "AutoThresholdAirwaySegmentation.ParallelExpansions", numParallelExpanded );
+  WorkCounters::Add( "AutoThresholdAirwaySegmentation.VoxelsAdded", numVoxels );
+
+  this->m_FinalThreshold = threshold;
+}
+
+
+/**
+ * Priority flood from the seeds. A voxel joins the airway at the
+ * lowest threshold for which a path to a seed exists along which no
+ * voxel is brighter than the threshold. Voxels are popped from the
+ * queue in order of that join threshold, so the order in which they
+ * are popped directly gives the airway volume as a function of
+ * threshold. Each voxel is pushed at most once, making this
+ * O(N log N) in the number of voxels flooded. Flooding stops as
+ * soon as the volume exceeds the max airway volume since no
+ * threshold beyond that point can be selected. If 'band' is
+ * specified, the flood is not allowed to leave it.
+ */
+template < class TInputImage >
+void
+AutoThresholdAirwaySegmentationImageFilter< TInputImage >
+::PriorityFlood( const std::vector< bool >* band )
+{
+  unsigned short airwayLabel = this->m_LungConventions.GetValueFromLungRegionAndType( UNDEFINEDREGION, AIRWAY );
+
+  double voxelVolume = this->GetCountedVoxelVolume();
+
+  InputImageRegionType  region = this->GetInput()->GetBufferedRegion();
+
+  const unsigned long  numberOfVoxels = region.GetNumberOfPixels();
+
+  const InputPixelType* inputBuffer  = this->GetInput()->GetBufferPointer();
+  LabelMapPixelType*    outputBuffer = this->GetOutput()->GetBufferPointer();
+
+  NeighborhoodType neighborhood( region );
+
+  //
+  // Queue elements are (join threshold, linear offset) pairs. Ties
+  // are broken by offset so that the flood is deterministic.
+  //
+  //
+  // 'floodCount' is the number of voxels flooded as counted against
+  // the airway volumes (see GetCountedVoxelVolume), 'curveCounts'
+  // the number of voxels of 'floodOrder' at each point of the curve.
+  //
+  FloodQueueType                queue;
+  std::vector< bool >           queued( numberOfVoxels, false );
+  std::vector< unsigned long >  floodOrder;
+  std::vector< unsigned long >  curveCounts;
+  unsigned long                 floodCount = 0;
+
+  if ( band != 0 )
+    {
+    queued = *band;
+    queued.flip();
+    }
+
+  this->m_ThresholdVolumeCurve.clear();
+
+  //
+  // Seeds are always part of the airway regardless of their
+  // intensity, so they enter the queue at the lowest possible level
+  //
+  InputPixelType darkestSeedPixel = itk::NumericTraits< InputPixelType >::max();
+
+  for ( unsigned int i=0; i<this->m_SeedVec.size(); i++ )
+    {
+    unsigned long seedOffset = neighborhood.ComputeOffset( this->m_SeedVec[i] );
+
+    if ( inputBuffer[seedOffset] < darkestSeedPixel )
+      {
+      darkestSeedPixel = inputBuffer[seedOffset];
+      }
+
+    if ( !queued[seedOffset] )
+      {
+      queued[seedOffset] = true;
+      queue.push( FloodElementType( itk::NumericTraits< InputPixelType >::NonpositiveMin(), seedOffset ) );
+      }
+    }
+
+  unsigned long maxNumberVoxels = static_cast< unsigned long >( this->m_MaxAirwayVolume/voxelVolume );
+
+  InputPixelType currentLevel  = itk::NumericTraits< InputPixelType >::NonpositiveMin();
+  bool           volumeExceeded = false;
+
+  FloodFunctor flooder;
+    flooder.InputBuffer = inputBuffer;
+    flooder.Queued      = &queued;
+    flooder.Queue       = &queue;
+
+  while ( !queue.empty() )
+    {
+    FloodElementType element = queue.top();
+    queue.pop();
+
+    //
+    // All voxels joining at 'currentLevel' have been collected. Record
+    // the corresponding point on the curve.
+    //
+    if ( floodOrder.size() > 0 && element.first > currentLevel )
+      {
+      this->m_ThresholdVolumeCurve.push_back( ThresholdVolumePairType( currentLevel, static_cast< double >( floodCount )*voxelVolume ) );
+      curveCounts.push_back( floodOrder.size() );
+
+      if ( floodCount > maxNumberVoxels )
+        {
+        volumeExceeded = true;
+        break;
+        }
+      }
+
+    currentLevel = element.first;
+
+    unsigned long current = element.second;
+    floodOrder.push_back( current );
+    floodCount += this->m_FineVoxelCounter != 0 ? this->m_FineVoxelCounter->Count( current, currentLevel ) : 1;
+
+    flooder.CurrentLevel = currentLevel;
+
+    neighborhood.VisitNeighbors( current, flooder );
+    }
 
-            if ( this->GetInput()->GetBufferedRegion().IsInside( index ) )
+  WorkCounters::Add( "AutoThresholdAirwaySegmentation.FloodVoxelsPopped", floodOrder.size() );
+
+  if ( !volumeExceeded && floodOrder.size() > 0 )
+    {
+    this->m_ThresholdVolumeCurve.push_back( ThresholdVolumePairType( currentLevel, static_cast< double >( floodCount )*voxelVolume ) );
+    curveCounts.push_back( floodOrder.size() );
+    }
+
+  if ( curveCounts.size() == 0 )
+    {
+    return;
+    }
+
+  //
+  // Walk the curve starting at the darkest seed value, raising the
+  // threshold in the same increments used by the region growing
+  // approach. Stop when the volume goes over the max airway volume or
+  // when, once the min airway volume has been reached, the volume
+  // increases faster than the max increase rate (leakage).
+  //
+  const int thresholdInc = 10;
+
+  double       lastVolume      = -1;
+  unsigned int curveIndex      = 0;
+  unsigned int finalCurveIndex = 0;
+
+  InputPixelType threshold = darkestSeedPixel;
+
+  this->m_FinalThreshold = threshold;
+
+  while ( true )
+    {
+    while ( curveIndex+1 < this->m_ThresholdVolumeCurve.size() && 
+            this->m_ThresholdVolumeCurve[curveIndex+1].first <= threshold )
+      {
+      curveIndex++;
+      }
+
+    double volume = this->m_ThresholdVolumeCurve[curveIndex].second;
+
+    if ( volume > this->m_MaxAirwayVolume )
+      {
+      break;
+      }
+
+    if ( volume >= this->m_MinAirwayVolume )
+      {
+      if ( lastVolume >= 0 && 
+           (volume - lastVolume)/1000.0/static_cast< double >( thresholdInc ) > this->m_MaxAirwayVolumeIncreaseRate )
+        {
+        break;
+        }
+
+      lastVolume = volume;
+      }
+
+    this->m_FinalThreshold = threshold;
+    finalCurveIndex        = curveIndex;
+
+    if ( curveIndex+1 == this->m_ThresholdVolumeCurve.size() || 
+         threshold > itk::NumericTraits< InputPixelType >::max() - thresholdInc )
+      {
+      break;
+      }
+
+    threshold += thresholdInc;
+    }
+
+  for ( unsigned long i=0; i<curveCounts[finalCurveIndex]; i++ )
+    {
+    outputBuffer[floodOrder[i]] = airwayLabel;
+    }
+}
+
+
+/**
+ * Coarse-to-fine airway segmentation. The airways are first segmented
+ * on a copy of the input shrunk by 'm_CoarseToFineShrinkFactor' in
+ * each direction. Each coarse voxel takes the darkest value of the
+ * block it covers so that airways narrower than a block are not
+ * lost. The full resolution segmentation is then only allowed within
+ * a band of 'm_CoarseToFineBandRadius' coarse voxels around the
+ * coarse airways. When region growing is used, the full resolution
+ * growing starts at the threshold reached on the coarse image.
+ *
+ * The same min and max airway volumes apply to both levels. Because
+ * of the min pooling, a coarse voxel joins the airways as soon as one
+ * voxel of its block is dark enough, so counting whole blocks would
+ * inflate the coarse volumes and stop the coarse growing at a lower
+ * threshold than the full resolution one. A coarse voxel therefore
+ * counts for the voxels of its block at or below the threshold at
+ * which it joins (see FineVoxelCounter). Voxels of its block that only
+ * get dark enough at a higher threshold are not added later, so the
+ * coarse volumes run slightly low and the band errs on the large
+ * side. The coarse threshold and band still only approximate the
+ * full resolution growing, so the result can differ from that of a
+ * full resolution segmentation.
+ */
+template < class TInputImage >
+void
+AutoThresholdAirwaySegmentationImageFilter< TInputImage >
+::CoarseToFine()
+{
+  const long factor = static_cast< long >( this->m_CoarseToFineShrinkFactor );
+  const long radius = static_cast< long >( this->m_CoarseToFineBandRadius );
+
+  typename InputImageType::ConstPointer inputImage = this->GetInput();
+
+  InputImageRegionType                   region  = inputImage->GetBufferedRegion();
+  InputSizeType                          size    = region.GetSize();
+  typename InputImageType::IndexType     start   = region.GetIndex();
+  typename InputImageType::SpacingType   spacing = inputImage->GetSpacing();
+
+  InputSizeType                          coarseSize;
+  typename InputImageType::IndexType     coarseStart;
+  typename InputImageType::SpacingType   coarseSpacing;
+  ContinuousIndex< double, 3 >           blockCenter;
+
+  for ( unsigned int i=0; i<3; i++ )
+    {
+    coarseSize[i]    = (size[i] + factor - 1)/factor;
+    coarseStart[i]   = 0;
+    coarseSpacing[i] = spacing[i]*static_cast< double >( factor );
+    blockCenter[i]   = static_cast< double >( start[i] ) + 0.5*static_cast< double >( factor - 1 );
+    }
+
+  typename InputImageType::PointType coarseOrigin;
+  inputImage->TransformContinuousIndexToPhysicalPoint( blockCenter, coarseOrigin );
+
+  InputImageRegionType coarseRegion;
+    coarseRegion.SetSize( coarseSize );
+    coarseRegion.SetIndex( coarseStart );
+
+  typename InputImageType::Pointer coarseImage = InputImageType::New();
+    coarseImage->SetRegions( coarseRegion );
+    coarseImage->SetSpacing( coarseSpacing );
+    coarseImage->SetOrigin( coarseOrigin );
+    coarseImage->SetDirection( inputImage->GetDirection() );
+    coarseImage->Allocate();
+    coarseImage->FillBuffer( itk::NumericTraits< InputPixelType >::max() );
+
+  const long xSize       = static_cast< long >( size[0] );
+  const long ySize       = static_cast< long >( size[1] );
+  const long zSize       = static_cast< long >( size[2] );
+  const long coarseXSize = static_cast< long >( coarseSize[0] );
+  const long coarseYSize = static_cast< long >( coarseSize[1] );
+  const long coarseZSize = static_cast< long >( coarseSize[2] );
+
+  const InputPixelType* inputBuffer  = inputImage->GetBufferPointer();
+  InputPixelType*       coarseBuffer = coarseImage->GetBufferPointer();
+
+  unsigned long offset = 0;
+  for ( long z=0; z<zSize; z++ )
+    {
+    for ( long y=0; y<ySize; y++ )
+      {
+      InputPixelType* coarseRow = coarseBuffer + (z/factor)*coarseXSize*coarseYSize + (y/factor)*coarseXSize;
+
+      for ( long x=0; x<xSize; x++ )
+        {
+        if ( inputBuffer[offset] < coarseRow[x/factor] )
+          {
+          coarseRow[x/factor] = inputBuffer[offset];
+          }
+
+        offset++;
+        }
+      }
+    }
+
+  //
+  // Segment the airways on the coarse image, counting the volumes in
+  // full resolution voxels
+  //
+  FineVoxelCounter counter;
+    counter.FineBuffer      = inputBuffer;
+    counter.Factor          = factor;
+    counter.FineVoxelVolume = spacing[0]*spacing[1]*spacing[2];
+  for ( unsigned int i=0; i<3; i++ )
+    {
+    counter.FineSize[i]   = static_cast< long >( size[i] );
+    counter.CoarseSize[i] = static_cast< long >( coarseSize[i] );
+    }
+
+  typename Self::Pointer coarseSegmenter = Self::New();
+    coarseSegmenter->SetInput( coarseImage );
+    coarseSegmenter->SetMinAirwayVolume( this->m_MinAirwayVolume );
+    coarseSegmenter->SetMaxAirwayVolume( this->m_MaxAirwayVolume );
+    coarseSegmenter->SetMaxAirwayVolumeIncreaseRate( this->m_MaxAirwayVolumeIncreaseRate );
+    coarseSegmenter->SetUsePriorityFlood( this->m_UsePriorityFlood );
+    coarseSegmenter->SetNumberOfThreads( this->GetNumberOfThreads() );
+    coarseSegmenter->SetIntensityHistogram( this->m_IntensityHistogram );
+    coarseSegmenter->m_FineVoxelCounter = &counter;
+  for ( unsigned int i=0; i<this->m_SeedVec.size(); i++ )
+    {
+    OutputImageType::IndexType coarseSeed;
+    for ( unsigned int j=0; j<3; j++ )
+      {
+      coarseSeed[j] = (this->m_SeedVec[i][j] - start[j])/factor;
+      }
+
+    coarseSegmenter->AddSeed( coarseSeed );
+    }
+    coarseSegmenter->Update();
+
+  //
+  // Mark the coarse voxels within 'radius' of the coarse airways and
+  // map them to the full resolution band
+  //
+  const LabelMapPixelType* coarseLabelBuffer = coarseSegmenter->GetOutput()->GetBufferPointer();
+
+  std::vector< bool > coarseBand( coarseRegion.GetNumberOfPixels(), false );
+
+  unsigned long coarseOffset = 0;
+  for ( long cz=0; cz<coarseZSize; cz++ )
+    {
+    for ( long cy=0; cy<coarseYSize; cy++ )
+      {
+      for ( long cx=0; cx<coarseXSize; cx++ )
+        {
+        if ( coarseLabelBuffer[coarseOffset] != 0 )
+          {
+          for ( long bz=std::max( cz-radius, 0L ); bz<=std::min( cz+radius, coarseZSize-1 ); bz++ )
+            {
+            for ( long by=std::max( cy-radius, 0L ); by<=std::min( cy+radius, coarseYSize-1 ); by++ )
               {
-              if ( this->GetOutput()->GetPixel( index ) == 0 && this->GetInput()->GetPixel( index ) <= threshold )
+              for ( long bx=std::max( cx-radius, 0L ); bx<=std::min( cx+radius, coarseXSize-1 ); bx++ )
                 {
-                add = true;
-                for ( unsigned int j=0; j<indicesVecTemp.size(); j++ )
-                  {
-                  if ( indicesVecTemp[j][0] == index[0] && indicesVecTemp[j][1] == index[1] && indicesVecTemp[j][2] == index[2] )
-                    {
-                    add = false;
-                    break;
-                    }
-                  }
-                if ( add && numVoxels < maxNumberVoxels )
-                  {
-                  indicesVecTemp.push_back( index );
-                  numVoxels++;
-
-                  addedNew = true;
-                  }
+                coarseBand[bx + by*coarseXSize + bz*coarseXSize*coarseYSize] = true;
                 }
               }
             }
           }
+
+        coarseOffset++;
         }
-      } 
-  
-    if ( addedNew )
+      }
+    }
+
+  std::vector< bool > band( region.GetNumberOfPixels(), false );
+
+  offset = 0;
+  for ( long z=0; z<zSize; z++ )
+    {
+    for ( long y=0; y<ySize; y++ )
       {
-      for ( unsigned int k=0; k<indicesVecTemp.size(); k++ )
+      const long coarseRowOffset = (z/factor)*coarseXSize*coarseYSize + (y/factor)*coarseXSize;
+
+      for ( long x=0; x<xSize; x++ )
         {
-        indicesVecFinal.push_back( indicesVecTemp[k] );
+        band[offset] = coarseBand[coarseRowOffset + x/factor];
 
-        this->GetOutput()->SetPixel( indicesVecTemp[k], airwayLabel );
+        offset++;
         }
       }
-    else if ( numVoxels < maxNumberVoxels )
-      {
-      threshold += 10; 
-      }
     }
 
+  //
+  // Refine at full resolution within the band
+  //
+  if ( this->m_UsePriorityFlood )
+    {
+    this->PriorityFlood( &band );
+    }
+  else
+    {
+    this->Test( static_cast< short >( coarseSegmenter->GetFinalThreshold() ), &band );
+    }
+}
+
+
+template < class TInputImage >
+double
+AutoThresholdAirwaySegmentationImageFilter< TInputImage >
+::GetCountedVoxelVolume() const
+{
+  if ( this->m_FineVoxelCounter != 0 )
+    {
+    return this->m_FineVoxelCounter->FineVoxelVolume;
+    }
+
+  typename InputImageType::SpacingType spacing = this->GetInput()->GetSpacing();
+
+  return spacing[0]*spacing[1]*spacing[2];
 }
 
 
@@ -364,6 +893,9 @@ AutoThresholdAirwaySegmentationImageFilter< TInputImage >
   os << indent << "Printing itkAutoThresholdAirwaySegmentationImageFilter: " << std::endl;
   os << indent << "MinAirwayVolume:\t" << this->m_MinAirwayVolume << std::endl;
   os << indent << "MaxAirwayVolumeIncreaseRate:\t" << this->m_MaxAirwayVolumeIncreaseRate << std::endl;
+  os << indent << "UsePriorityFlood:\t" << this->m_UsePriorityFlood << std::endl;
+  os << indent << "CoarseToFineShrinkFactor:\t" << this->m_CoarseToFineShrinkFactor << std::endl;
+  os << indent << "CoarseToFineBandRadius:\t" << this->m_CoarseToFineBandRadius << std::endl;
   for ( unsigned int i=0; i<this->m_SeedVec.size(); i++ )
     {
     os << indent << "Seed " << i << ":\t" << this->m_SeedVec[i] << std::endl;
@@ -5,6 +5,8 @@
 #include <itkImageToImageFilter.h>
 #include <itkImageRegionIteratorWithIndex.h>
 #include <itkConstantBoundaryCondition.h>
+#include "itkWorkCounters.h"
+#include "itkPipelineProfiler.h"
 
 namespace itk
 {
@@ -96,6 +98,11 @@ public:
   /** Get Skelenton by thinning image. */
   OutputImageType * GetThinning(void);
 
+  /** Profiler recording the time spent preparing the data and
+   *  thinning. Its stages are cleared every time the filter runs. */
+  itkSetObjectMacro(Profiler, PipelineProfiler);
+  itkGetObjectMacro(Profiler, PipelineProfiler);
+
   /** ImageDimension enumeration   */
   itkStaticConstMacro(InputImageDimension, unsigned int,
                       TInputImage::ImageDimension );
@@ -146,6 +153,8 @@ private:
   BinaryThinningImageFilter3D(const Self&); //purposely not implemented
   void operator=(const Self&); //purposely not implemented
 
+  PipelineProfiler::Pointer m_Profiler;
+
 }; // end of BinaryThinningImageFilter3D class
 
 } //end namespace itk
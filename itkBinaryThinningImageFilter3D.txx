@@ -25,6 +25,7 @@ BinaryThinningImageFilter3D<TInputImage,TOutputImage>
   OutputImagePointer thinImage = OutputImageType::New();
   this->SetNthOutput( 0, thinImage.GetPointer() );
 
+  m_Profiler = PipelineProfiler::New();
 }
 
 /**
@@ -128,8 +129,11 @@ BinaryThinningImageFilter3D<TInputImage,TOutputImage>
   fillEulerLUT( eulerLUT );
   // Loop through the image several times until there is no change.
   int unchangedBorders = 0;
+  unsigned long numPasses = 0;
+  unsigned long numDeletions = 0;
   while( unchangedBorders < 6 )  // loop until no change for all the six border types
   {
+    numPasses++;
     unchangedBorders = 0;
     for( int currentBorder = 1; currentBorder <= 6; currentBorder++)
     {
@@ -203,6 +207,7 @@ BinaryThinningImageFilter3D<TInputImage,TOutputImage>
         else
         {
           noChange = false;
+          numDeletions++;
         }
       }
       if( noChange )
@@ -212,6 +217,9 @@ BinaryThinningImageFilter3D<TInputImage,TOutputImage>
     } // end currentBorder for loop
   } // end unchangedBorders while loop
 
+  WorkCounters::Add( "BinaryThinning3D.Passes", numPasses );
+  WorkCounters::Add( "BinaryThinning3D.Deletions", numDeletions );
+
   itkDebugMacro( << "ComputeThinImage End");
 }
 
@@ -223,11 +231,16 @@ void
 BinaryThinningImageFilter3D<TInputImage,TOutputImage>
 ::GenerateData() 
 {
+  m_Profiler->Reset();
 
+  m_Profiler->StartStage( "PrepareData" );
   this->PrepareData();
+  m_Profiler->StopStage();
 
   itkDebugMacro(<< "GenerateData: Computing Thinning Image");
+  m_Profiler->StartStage( "ComputeThinImage" );
   this->ComputeThinImage();
+  m_Profiler->StopStage();
 } // end GenerateData()
 
 /** 
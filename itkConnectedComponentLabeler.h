@@ -0,0 +1,214 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkConnectedComponentLabeler.h,v $
+  Language:  C++
+  Date:      $Date: 2012/09/04 20:23:08 $
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkConnectedComponentLabeler_h
+#define __itkConnectedComponentLabeler_h
+
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+#include "itkMultiThreader.h"
+#include "itkContinuousIndex.h"
+#include "itkRunLengthLabelMap.h"
+#include <vector>
+
+
+namespace itk
+{
+/** \class ConnectedComponentLabeler
+ * \brief Labels the connected components of the nonzero voxels of a
+ * 3D label map (whatever their labels), with 6-connectivity or, if
+ * FullyConnected is on, 26-connectivity.
+ *
+ * The components are labeled on the runs of a RunLengthLabelMap, so
+ * there is one label per run rather than per voxel. The slices are
+ * split into slabs, one per thread. Each thread encodes its slab and
+ * joins its runs with a union-find, then the slabs are joined across
+ * their boundaries. The size, bounding box and centroid of each
+ * component are gathered while the runs are labeled.
+ *
+ * As with RelabelComponentImageFilter, the components are labeled
+ * from 1 by decreasing size, components of the same size in the order
+ * of their first voxel in the buffer. The run labels are stored in
+ * the narrowest unsigned integer type that holds the number of
+ * components (see GetLabelSize).
+ */
+class ITK_EXPORT ConnectedComponentLabeler : public Object
+{
+public:
+  /** Standard class typedefs. */
+  typedef ConnectedComponentLabeler   Self;
+  typedef Object                      Superclass;
+  typedef SmartPointer< Self >        Pointer;
+  typedef SmartPointer< const Self >  ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro( Self );
+
+  /** Create a labeler with the given number of threads and
+   *  connectivity */
+  static Pointer New( unsigned int numberOfThreads, bool fullyConnected );
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro( ConnectedComponentLabeler, Object );
+
+  typedef RunLengthLabelMap::LabelImageType  LabelImageType;
+  typedef RunLengthLabelMap::RegionType      RegionType;
+  typedef RunLengthLabelMap::IndexType       IndexType;
+  typedef RunLengthLabelMap::RunType         RunType;
+  typedef ContinuousIndex< double, 3 >       CentroidType;
+
+  /** Statistics of a component, in the index space of the map */
+  struct ComponentType
+  {
+    unsigned long  Size;
+    RegionType     BoundingBox;
+    CentroidType   Centroid;
+  };
+
+  /** Use 26-connectivity instead of 6-connectivity (default is off) */
+  itkSetMacro( FullyConnected, bool );
+  itkGetMacro( FullyConnected, bool );
+  itkBooleanMacro( FullyConnected );
+
+  /** Number of threads (default is the MultiThreader default) */
+  itkSetMacro( NumberOfThreads, unsigned int );
+  itkGetMacro( NumberOfThreads, unsigned int );
+
+  /** Label the components of the buffered region of an image */
+  void Execute( const LabelImageType* image );
+
+  /** Label the components of a run-length encoded label map. The
+   *  labeler keeps a reference to the map. */
+  void Execute( const RunLengthLabelMap* map );
+
+  /** The runs that were labeled */
+  const RunLengthLabelMap* GetRunLengthLabelMap() const
+    {
+      return this->m_Map.GetPointer();
+    }
+
+  unsigned long GetNumberOfComponents() const
+    {
+      return this->m_Components.size();
+    }
+
+  /** Statistics of the component with the given label (from 1) */
+  const ComponentType & GetComponent( unsigned long label ) const
+    {
+      return this->m_Components[label-1];
+    }
+
+  unsigned long GetComponentSize( unsigned long label ) const
+    {
+      return this->m_Components[label-1].Size;
+    }
+
+  /** Label of the component of a run */
+  unsigned long GetRunLabel( unsigned long run ) const
+    {
+      switch ( this->m_LabelSize )
+        {
+        case 1:
+          return this->m_RunLabels8[run];
+        case 2:
+          return this->m_RunLabels16[run];
+        default:
+          return this->m_RunLabels32[run];
+        }
+    }
+
+  /** Number of bytes of a stored run label (1, 2 or 4) */
+  unsigned int GetLabelSize() const
+    {
+      return this->m_LabelSize;
+    }
+
+protected:
+  ConnectedComponentLabeler();
+  virtual ~ConnectedComponentLabeler() {}
+
+  void PrintSelf( std::ostream& os, Indent indent ) const;
+
+  /** Union-find over the runs. The root of a set is always its
+   *  smallest run, so that the roots come in the order of the first
+   *  voxels of the components. */
+  unsigned long FindRoot( unsigned long run );
+  void Unite( unsigned long run1, unsigned long run2 );
+
+  /** Join the touching runs of a row */
+  void UniteRow( unsigned long row );
+
+  /** Join the runs of a row with those of a neighboring row */
+  void UniteRows( unsigned long row, unsigned long neighborRow );
+
+  /** Join the runs of row (y, z) with those of the neighboring rows
+   *  (before it in the buffer) whose slice is in [minimumZ, z] */
+  void UniteNeighborRows( long y, long z, long minimumZ );
+
+  /** Number the components and gather their statistics */
+  void NumberComponents();
+
+  /** First slice of each slab, plus the number of slices */
+  void ComputeSlabs( unsigned long numberOfSlices );
+
+  /** Data shared with the threads encoding the slabs of an image.
+   *  Each thread encodes its slab into its own runs. */
+  struct EncodeThreadStruct
+  {
+    const LabelImageType*                        Image;
+    const std::vector< long >*                   Slabs;
+    std::vector< std::vector< RunType > >        Runs;
+    std::vector< std::vector< unsigned long > >  RowEnds;
+  };
+
+  /** Static function used as a "callback" by the MultiThreader to
+   *  encode a slab */
+  static ITK_THREAD_RETURN_TYPE EncodeThreaderCallback( void* arg );
+
+  /** Data shared with the threads joining the runs of the slabs */
+  struct UniteThreadStruct
+  {
+    Self*  Labeler;
+  };
+
+  /** Static function used as a "callback" by the MultiThreader to
+   *  join the runs of a slab */
+  static ITK_THREAD_RETURN_TYPE UniteThreaderCallback( void* arg );
+
+private:
+  ConnectedComponentLabeler( const Self& ); //purposely not implemented
+  void operator=( const Self& ); //purposely not implemented
+
+  bool                                 m_FullyConnected;
+  unsigned int                         m_NumberOfThreads;
+  MultiThreader::Pointer               m_MultiThreader;
+  RunLengthLabelMap::ConstPointer      m_Map;
+  std::vector< long >                  m_Slabs;
+  std::vector< unsigned long >         m_Parents;
+  std::vector< ComponentType >         m_Components;
+  unsigned int                         m_LabelSize;
+  std::vector< unsigned char >         m_RunLabels8;
+  std::vector< unsigned short >        m_RunLabels16;
+  std::vector< unsigned int >          m_RunLabels32;
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkConnectedComponentLabeler.txx"
+#endif
+
+#endif
@@ -0,0 +1,523 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkConnectedComponentLabeler.txx,v $
+  Language:  C++
+  Date:      $Date: 2012/09/04 20:23:08 $
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef _itkConnectedComponentLabeler_txx
+#define _itkConnectedComponentLabeler_txx
+
+#include "itkConnectedComponentLabeler.h"
+#include "itkNumericTraits.h"
+#include <algorithm>
+
+
+namespace itk
+{
+
+inline
+ConnectedComponentLabeler
+::ConnectedComponentLabeler()
+{
+  this->m_FullyConnected  = false;
+  this->m_MultiThreader   = MultiThreader::New();
+  this->m_NumberOfThreads = this->m_MultiThreader->GetNumberOfThreads();
+  this->m_LabelSize       = 1;
+}
+
+
+inline ConnectedComponentLabeler::Pointer
+ConnectedComponentLabeler
+::New( unsigned int numberOfThreads, bool fullyConnected )
+{
+  Pointer labeler = New();
+    labeler->SetNumberOfThreads( numberOfThreads );
+    labeler->SetFullyConnected( fullyConnected );
+
+  return labeler;
+}
+
+
+/**
+ * Each thread encodes the rows of its slab, then the runs of the
+ * slabs are appended in order to a new map
+ */
+inline void
+ConnectedComponentLabeler
+::Execute( const LabelImageType* image )
+{
+  this->ComputeSlabs( image->GetBufferedRegion().GetSize()[2] );
+
+  const unsigned int numberOfSlabs = this->m_Slabs.size() - 1;
+
+  EncodeThreadStruct str;
+    str.Image = image;
+    str.Slabs = &this->m_Slabs;
+    str.Runs.resize( numberOfSlabs );
+    str.RowEnds.resize( numberOfSlabs );
+
+  this->m_MultiThreader->SetNumberOfThreads( numberOfSlabs );
+  this->m_MultiThreader->SetSingleMethod( this->EncodeThreaderCallback, &str );
+  this->m_MultiThreader->SingleMethodExecute();
+
+  RunLengthLabelMap::Pointer map = RunLengthLabelMap::New();
+    map->Initialize( image->GetBufferedRegion() );
+
+  for ( unsigned int s=0; s<numberOfSlabs; s++ )
+    {
+    unsigned long r = 0;
+
+    for ( unsigned long row=0; row<str.RowEnds[s].size(); row++ )
+      {
+      for ( ; r<str.RowEnds[s][row]; r++ )
+        {
+        map->AddRun( str.Runs[s][r].X, str.Runs[s][r].Length, str.Runs[s][r].Label );
+        }
+
+      map->EndRow();
+      }
+
+    std::vector< RunType >().swap( str.Runs[s] );
+    }
+
+  this->Execute( map );
+}
+
+
+/**
+ * Each thread joins the runs of its slab, touching only the parents of
+ * its own runs. The slabs are then joined along their boundaries.
+ */
+inline void
+ConnectedComponentLabeler
+::Execute( const RunLengthLabelMap* map )
+{
+  this->m_Map = map;
+
+  const long sizeY = static_cast< long >( map->GetRegion().GetSize()[1] );
+  const long sizeZ = static_cast< long >( map->GetRegion().GetSize()[2] );
+
+  if ( map->GetNumberOfRows() != static_cast< unsigned long >( sizeY*sizeZ ) )
+    {
+    itkExceptionMacro( << "Run length label map has " << map->GetNumberOfRows() << " rows instead of " << sizeY*sizeZ );
+    }
+
+  const unsigned long numberOfRuns = map->GetNumberOfRuns();
+
+  this->m_Parents.resize( numberOfRuns );
+  for ( unsigned long r=0; r<numberOfRuns; r++ )
+    {
+    this->m_Parents[r] = r;
+    }
+
+  this->ComputeSlabs( sizeZ );
+
+  UniteThreadStruct str;
+    str.Labeler = this;
+
+  this->m_MultiThreader->SetNumberOfThreads( this->m_Slabs.size() - 1 );
+  this->m_MultiThreader->SetSingleMethod( this->UniteThreaderCallback, &str );
+  this->m_MultiThreader->SingleMethodExecute();
+
+  for ( unsigned int s=1; s+1<this->m_Slabs.size(); s++ )
+    {
+    const long z = this->m_Slabs[s];
+
+    for ( long y=0; y<sizeY; y++ )
+      {
+      this->UniteNeighborRows( y, z, z-1 );
+      }
+    }
+
+  this->NumberComponents();
+}
+
+
+/**
+ * The slices are split as evenly as possible, with at most one slab
+ * per slice
+ */
+inline void
+ConnectedComponentLabeler
+::ComputeSlabs( unsigned long numberOfSlices )
+{
+  unsigned long numberOfSlabs = std::max( this->m_NumberOfThreads, static_cast< unsigned int >( 1 ) );
+  numberOfSlabs = std::max( std::min( numberOfSlabs, numberOfSlices ), static_cast< unsigned long >( 1 ) );
+
+  this->m_Slabs.resize( numberOfSlabs + 1 );
+  for ( unsigned long s=0; s<=numberOfSlabs; s++ )
+    {
+    this->m_Slabs[s] = static_cast< long >( (numberOfSlices*s)/numberOfSlabs );
+    }
+}
+
+
+inline ITK_THREAD_RETURN_TYPE
+ConnectedComponentLabeler
+::EncodeThreaderCallback( void* arg )
+{
+  MultiThreader::ThreadInfoStruct* info = static_cast< MultiThreader::ThreadInfoStruct* >( arg );
+
+  unsigned int threadId = info->ThreadID;
+
+  EncodeThreadStruct* str = static_cast< EncodeThreadStruct* >( info->UserData );
+
+  const unsigned long sizeX = str->Image->GetBufferedRegion().GetSize()[0];
+  const unsigned long sizeY = str->Image->GetBufferedRegion().GetSize()[1];
+
+  const unsigned long firstRow = (*str->Slabs)[threadId]*sizeY;
+  const unsigned long lastRow  = (*str->Slabs)[threadId+1]*sizeY;
+
+  std::vector< RunType >&       runs    = str->Runs[threadId];
+  std::vector< unsigned long >& rowEnds = str->RowEnds[threadId];
+
+  const RunLengthLabelMap::LabelType* line = str->Image->GetBufferPointer() + firstRow*sizeX;
+
+  for ( unsigned long row=firstRow; row<lastRow; row++, line += sizeX )
+    {
+    unsigned long x = 0;
+    while ( x < sizeX )
+      {
+      RunType run;
+        run.Label = line[x];
+        run.X     = x;
+
+      while ( ++x < sizeX && line[x] == run.Label )
+        {
+        }
+
+      if ( run.Label != 0 )
+        {
+        run.Length = x - run.X;
+        runs.push_back( run );
+        }
+      }
+
+    rowEnds.push_back( runs.size() );
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+
+inline ITK_THREAD_RETURN_TYPE
+ConnectedComponentLabeler
+::UniteThreaderCallback( void* arg )
+{
+  MultiThreader::ThreadInfoStruct* info = static_cast< MultiThreader::ThreadInfoStruct* >( arg );
+
+  unsigned int threadId = info->ThreadID;
+
+  UniteThreadStruct* str = static_cast< UniteThreadStruct* >( info->UserData );
+
+  Self* labeler = str->Labeler;
+
+  const long sizeY  = static_cast< long >( labeler->m_Map->GetRegion().GetSize()[1] );
+  const long firstZ = labeler->m_Slabs[threadId];
+  const long lastZ  = labeler->m_Slabs[threadId+1];
+
+  for ( long z=firstZ; z<lastZ; z++ )
+    {
+    for ( long y=0; y<sizeY; y++ )
+      {
+      labeler->UniteRow( y + z*sizeY );
+      labeler->UniteNeighborRows( y, z, firstZ );
+      }
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+
+inline unsigned long
+ConnectedComponentLabeler
+::FindRoot( unsigned long run )
+{
+  while ( this->m_Parents[run] != run )
+    {
+    this->m_Parents[run] = this->m_Parents[this->m_Parents[run]];
+    run                  = this->m_Parents[run];
+    }
+
+  return run;
+}
+
+
+inline void
+ConnectedComponentLabeler
+::Unite( unsigned long run1, unsigned long run2 )
+{
+  unsigned long root1 = this->FindRoot( run1 );
+  unsigned long root2 = this->FindRoot( run2 );
+
+  if ( root1 < root2 )
+    {
+    this->m_Parents[root2] = root1;
+    }
+  else if ( root2 < root1 )
+    {
+    this->m_Parents[root1] = root2;
+    }
+}
+
+
+inline void
+ConnectedComponentLabeler
+::UniteRow( unsigned long row )
+{
+  const unsigned long end = this->m_Map->GetRowEnd( row );
+
+  for ( unsigned long r=this->m_Map->GetRowBegin( row ); r+1<end; r++ )
+    {
+    if ( this->m_Map->GetRun( r ).X + this->m_Map->GetRun( r ).Length == this->m_Map->GetRun( r+1 ).X )
+      {
+      this->Unite( r, r+1 );
+      }
+    }
+}
+
+
+/**
+ * Runs of neighboring rows are joined when they overlap along the
+ * first axis or, with 26-connectivity, when they touch diagonally.
+ * The runs of both rows are walked together.
+ */
+inline void
+ConnectedComponentLabeler
+::UniteRows( unsigned long row, unsigned long neighborRow )
+{
+  const unsigned int slack = this->m_FullyConnected ? 1 : 0;
+
+  unsigned long i = this->m_Map->GetRowBegin( row );
+  unsigned long j = this->m_Map->GetRowBegin( neighborRow );
+
+  const unsigned long end         = this->m_Map->GetRowEnd( row );
+  const unsigned long neighborEnd = this->m_Map->GetRowEnd( neighborRow );
+
+  while ( i < end && j < neighborEnd )
+    {
+    const RunType& run         = this->m_Map->GetRun( i );
+    const RunType& neighborRun = this->m_Map->GetRun( j );
+
+    unsigned int runEnd         = run.X + run.Length;
+    unsigned int neighborRunEnd = neighborRun.X + neighborRun.Length;
+
+    if ( run.X < neighborRunEnd + slack && neighborRun.X < runEnd + slack )
+      {
+      this->Unite( i, j );
+      }
+
+    if ( runEnd <= neighborRunEnd )
+      {
+      i++;
+      }
+    else
+      {
+      j++;
+      }
+    }
+}
+
+
+/**
+ * Each row is joined with the neighboring rows that come before it in
+ * the buffer (the others are joined with it later)
+ */
+inline void
+ConnectedComponentLabeler
+::UniteNeighborRows( long y, long z, long minimumZ )
+{
+  const long sizeY = static_cast< long >( this->m_Map->GetRegion().GetSize()[1] );
+
+  long neighborRows[4][2] = { { -1, 0 }, { 0, -1 }, { -1, -1 }, { 1, -1 } };
+  const unsigned int numberOfNeighborRows = this->m_FullyConnected ? 4 : 2;
+
+  for ( unsigned int n=0; n<numberOfNeighborRows; n++ )
+    {
+    long neighborY = y + neighborRows[n][0];
+    long neighborZ = z + neighborRows[n][1];
+
+    if ( neighborY < 0 || neighborY >= sizeY || neighborZ < minimumZ )
+      {
+      continue;
+      }
+
+    this->UniteRows( y + z*sizeY, neighborY + neighborZ*sizeY );
+    }
+}
+
+
+/**
+ * Components first get a number in the order of their root (their
+ * first run), then the numbers are sorted by decreasing size. The
+ * statistics of a run are added to its component in closed form.
+ */
+inline void
+ConnectedComponentLabeler
+::NumberComponents()
+{
+  const RunLengthLabelMap* map = this->m_Map;
+
+  const unsigned long numberOfRuns = map->GetNumberOfRuns();
+
+  std::vector< unsigned long > runComponents( numberOfRuns );
+  std::vector< ComponentType > components;
+  std::vector< double >        sums;
+  std::vector< long >          bounds;
+
+  RunLengthLabelMap::ConstRunIterator rIt( map );
+
+  for ( rIt.GoToBegin(); !rIt.IsAtEnd(); ++rIt )
+    {
+    const unsigned long r    = rIt.GetRunNumber();
+    const unsigned long root = this->FindRoot( r );
+
+    if ( root == r )
+      {
+      runComponents[r] = components.size();
+
+      ComponentType component;
+        component.Size = 0;
+      components.push_back( component );
+
+      sums.resize( sums.size() + 3, 0.0 );
+      bounds.push_back( NumericTraits< long >::max() );
+      bounds.push_back( NumericTraits< long >::max() );
+      bounds.push_back( NumericTraits< long >::max() );
+      bounds.push_back( NumericTraits< long >::NonpositiveMin() );
+      bounds.push_back( NumericTraits< long >::NonpositiveMin() );
+      bounds.push_back( NumericTraits< long >::NonpositiveMin() );
+      }
+    else
+      {
+      runComponents[r] = runComponents[root];
+      }
+
+    const unsigned long c      = runComponents[r];
+    const double        length = static_cast< double >( rIt.GetLength() );
+    const IndexType     index  = rIt.GetIndex();
+
+    components[c].Size += rIt.GetLength();
+
+    sums[3*c]   += length*index[0] + length*(length - 1.0)/2.0;
+    sums[3*c+1] += length*index[1];
+    sums[3*c+2] += length*index[2];
+
+    bounds[6*c]   = std::min( bounds[6*c], static_cast< long >( index[0] ) );
+    bounds[6*c+1] = std::min( bounds[6*c+1], static_cast< long >( index[1] ) );
+    bounds[6*c+2] = std::min( bounds[6*c+2], static_cast< long >( index[2] ) );
+    bounds[6*c+3] = std::max( bounds[6*c+3], static_cast< long >( index[0] + rIt.GetLength() - 1 ) );
+    bounds[6*c+4] = std::max( bounds[6*c+4], static_cast< long >( index[1] ) );
+    bounds[6*c+5] = std::max( bounds[6*c+5], static_cast< long >( index[2] ) );
+    }
+
+  std::vector< unsigned long >().swap( this->m_Parents );
+
+  //
+  // Sort the components by decreasing size. Components of the same
+  // size are ordered by their index, which is the order of their
+  // first voxel.
+  //
+  std::vector< std::pair< long, unsigned long > > order( components.size() );
+  for ( unsigned long c=0; c<components.size(); c++ )
+    {
+    order[c] = std::make_pair( -static_cast< long >( components[c].Size ), c );
+    }
+  std::sort( order.begin(), order.end() );
+
+  std::vector< unsigned long > componentLabels( components.size() );
+
+  this->m_Components.resize( components.size() );
+
+  for ( unsigned long l=0; l<order.size(); l++ )
+    {
+    const unsigned long c = order[l].second;
+
+    componentLabels[c] = l+1;
+
+    ComponentType& component = this->m_Components[l];
+      component.Size = components[c].Size;
+
+    IndexType                  boundingBoxIndex;
+    RegionType::SizeType       boundingBoxSize;
+
+    for ( unsigned int d=0; d<3; d++ )
+      {
+      boundingBoxIndex[d]   = bounds[6*c+d];
+      boundingBoxSize[d]    = bounds[6*c+3+d] - bounds[6*c+d] + 1;
+      component.Centroid[d] = sums[3*c+d]/static_cast< double >( component.Size );
+      }
+
+    component.BoundingBox.SetIndex( boundingBoxIndex );
+    component.BoundingBox.SetSize( boundingBoxSize );
+    }
+
+  //
+  // Store the run labels in the narrowest type that holds them
+  //
+  std::vector< unsigned char >().swap( this->m_RunLabels8 );
+  std::vector< unsigned short >().swap( this->m_RunLabels16 );
+  std::vector< unsigned int >().swap( this->m_RunLabels32 );
+
+  if ( components.size() <= NumericTraits< unsigned char >::max() )
+    {
+    this->m_LabelSize = 1;
+    this->m_RunLabels8.resize( numberOfRuns );
+    }
+  else if ( components.size() <= NumericTraits< unsigned short >::max() )
+    {
+    this->m_LabelSize = 2;
+    this->m_RunLabels16.resize( numberOfRuns );
+    }
+  else
+    {
+    this->m_LabelSize = 4;
+    this->m_RunLabels32.resize( numberOfRuns );
+    }
+
+  for ( unsigned long r=0; r<numberOfRuns; r++ )
+    {
+    const unsigned long label = componentLabels[runComponents[r]];
+
+    switch ( this->m_LabelSize )
+      {
+      case 1:
+        this->m_RunLabels8[r] = static_cast< unsigned char >( label );
+        break;
+      case 2:
+        this->m_RunLabels16[r] = static_cast< unsigned short >( label );
+        break;
+      default:
+        this->m_RunLabels32[r] = static_cast< unsigned int >( label );
+      }
+    }
+}
+
+
+/**
+ * Standard "PrintSelf" method
+ */
+inline void
+ConnectedComponentLabeler
+::PrintSelf( std::ostream& os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+  os << indent << "FullyConnected: " << this->m_FullyConnected << std::endl;
+  os << indent << "NumberOfThreads: " << this->m_NumberOfThreads << std::endl;
+  os << indent << "NumberOfComponents: " << this->GetNumberOfComponents() << std::endl;
+  os << indent << "LabelSize: " << this->m_LabelSize << std::endl;
+}
+
+} // end namespace itk
+
+#endif
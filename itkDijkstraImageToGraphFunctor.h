@@ -21,6 +21,7 @@
 #define __itkDijkstraImageToGraphFunctor_h
 
 #include "itkDefaultImageToGraphFunctor.h"
+#include "itkIntensityCostTable.h"
 
 namespace itk
 {
@@ -56,6 +57,12 @@ namespace itk
  * dark pathways (e.g. airways). Note that by making the steepness
  * value negative, bright paths can be favored instead of dark paths.
  *
+ * Instead of evaluating the cost function for every node, the functor
+ * can look the costs up in an IntensityCostTable (see
+ * 'SetCostTable'). The table's parameters then apply, not the
+ * functor's. A table computed once can be shared by all the functors
+ * (and any other callers) costing the same image.
+ *
  **/
 
 template<typename TInputImage, typename TOutputGraph>
@@ -160,6 +167,18 @@ public:
       return m_LinearBasedCostAssignment;
     }
 
+  /** Computed table of costs to use for the node weights, for 16 bit
+   *  images. If it is null (the default), the cost function is
+   *  evaluated for each node. */
+  void SetCostTable( const IntensityCostTable* table )
+    {
+      m_CostTable = table;
+    }
+  const IntensityCostTable* GetCostTable() const
+    {
+      return m_CostTable;
+    }
+
 
 protected:
   DijkstraImageToGraphFunctor();
@@ -182,6 +201,8 @@ private:
   bool      m_SigmoidBasedCostAssignment;
   bool      m_ExponentialBasedCostAssignment;
   bool      m_LinearBasedCostAssignment;
+
+  IntensityCostTable::ConstPointer m_CostTable;
 };
 
 
@@ -56,6 +56,13 @@ typename DijkstraImageToGraphFunctor<TInputImage, TOutputGraph>::NodeWeightType
 DijkstraImageToGraphFunctor<TInputImage, TOutputGraph>
 ::GetNodeWeight( IndexType idx1 )
 {
+  if ( this->m_CostTable.IsNotNull() )
+    {
+    IntensityCostTable::PixelType pixel = static_cast< IntensityCostTable::PixelType >( this->GetInput()->GetPixel( idx1 ) );
+
+    return static_cast< NodeWeightType >( this->m_CostTable->GetCost( pixel ) );
+    }
+
   double pixelValue = static_cast< double >( this->GetInput()->GetPixel( idx1 ) );
 
   double nodeWeight;
@@ -21,6 +21,7 @@
 #define __itkDijkstraMinCostPathGraphToGraphFilter_h
 
 #include "itkGraphToGraphFilter.h"
+#include "itkWorkCounters.h"
 
 namespace itk
 {
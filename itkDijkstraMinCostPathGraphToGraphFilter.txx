@@ -72,8 +72,12 @@ DijkstraMinCostPathGraphToGraphFilter< TInputGraph, TOutputGraph >
 
   typename InputGraphType::NodeIdentifierType visitingNodeID = this->m_StartNode;
 
+  unsigned long numNodesSettled = 0;
+
   do 
     {
+    numNodesSettled++;
+
     if ( visitingNodeID == this->m_EndNode )
       {
       endNodeVisited = true;
@@ -144,6 +148,9 @@ DijkstraMinCostPathGraphToGraphFilter< TInputGraph, TOutputGraph >
     }
   while ( this->GetIDOfLowestCostUnvisited( visitingNodeID, nodeIDVec )  );
 
+  WorkCounters::Add( "DijkstraMinCostPath.Searches" );
+  WorkCounters::Add( "DijkstraMinCostPath.NodesSettled", numNodesSettled );
+
   //-------
   // Now that we have the optimal edges determined, we can back-track
   // from the end node to the start node to find all the indices along
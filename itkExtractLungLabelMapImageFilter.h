@@ -21,6 +21,7 @@
 #include "itkImage.h"
 #include "itkImageRegionIteratorWithIndex.h"
 #include "itkImageRegionConstIterator.h"
+#include "itkRunLengthLabelMap.h"
 #include "itkLungConventions.h"
 
 
@@ -121,7 +122,7 @@ private:
   ExtractLungLabelMapImageFilter(const Self&); //purposely not implemented
   void operator=(const Self&); //purposely not implemented
 
-  void InitializeMaps();
+  void InitializeMaps( const RunLengthLabelMap* );
 
   std::vector< unsigned char >                m_RegionVec;
   std::vector< unsigned char >                m_TypeVec;
@@ -37,46 +37,48 @@ ExtractLungLabelMapImageFilter
 }
 
 
+/**
+ * The mapping is done on a run length encoded copy of the input, so
+ * that each value is looked up once per run rather than once per
+ * voxel
+ */
 void
 ExtractLungLabelMapImageFilter
 ::GenerateData()
 {
-  this->InitializeMaps();
+  RunLengthLabelMap::Pointer labelMap = RunLengthLabelMap::New();
+    labelMap->Encode( this->GetInput() );
+
+  this->InitializeMaps( labelMap );
 
   //
   // Allocate the output buffer
   //
   this->GetOutput()->SetBufferedRegion( this->GetOutput()->GetRequestedRegion() );
   this->GetOutput()->Allocate();
-  this->GetOutput()->FillBuffer( 0 );
 
   //
   // Now assign the regions and types in the output image based on the
   // mapping we determined in 'InitializeMaps'
   //
-  OutputIteratorType oIt( this->GetOutput(), this->GetOutput()->GetBufferedRegion() );
-  InputIteratorType iIt( this->GetInput(), this->GetInput()->GetBufferedRegion() );
+  RunLengthLabelMap::RunIterator rIt( labelMap );
 
-  oIt.GoToBegin();
-  iIt.GoToBegin();
-  while ( !iIt.IsAtEnd() )
+  rIt.GoToBegin();
+  while ( !rIt.IsAtEnd() )
     {
-    if ( iIt.Get() != 0 )
-      {
-      unsigned short outputValue = this->m_ValueToValueMap[ iIt.Get() ];
+    rIt.SetLabel( this->m_ValueToValueMap[ rIt.GetLabel() ] );
 
-      oIt.Set( outputValue );
-      }
-    
-    ++oIt;
-    ++iIt;
+    ++rIt;
     }
+
+  labelMap->Compact();
+  labelMap->Decode( this->GetOutput() );
 }
 
 
 void
 ExtractLungLabelMapImageFilter
-::InitializeMaps()
+::InitializeMaps( const RunLengthLabelMap* labelMap )
 {
   typedef std::pair< unsigned char, unsigned char > UCHAR_PAIR;
 
@@ -133,31 +135,22 @@ ExtractLungLabelMapImageFilter
     }
 
   //
-  // Iterate through the input image and create a list of all values.
-  // Sort and unique this list and then compute a mapping of the
-  // values to the appropriate region/type pairs.  Using this map will
-  // greatly speed computation later.
+  // Create a list of all values of the input (from its runs) and
+  // compute a mapping of the values to the appropriate region/type
+  // pairs.  Using this map will greatly speed computation later.
   //
+  RunLengthLabelMap::LabelCountsType labelCounts;
+  labelMap->ComputeLabelCounts( labelCounts );
+
   std::list< unsigned short > valueList;
   valueList.push_back( 0 );
 
-  InputIteratorType iIt( this->GetInput(), this->GetInput()->GetBufferedRegion() );
-
-  iIt.GoToBegin();
-  while ( !iIt.IsAtEnd() )
+  RunLengthLabelMap::LabelCountsType::const_iterator countIt;
+  for ( countIt = labelCounts.begin(); countIt != labelCounts.end(); ++countIt )
     {
-    if ( iIt.Get() != 0 )
-      {
-      valueList.push_back( iIt.Get() );
-      }
-
-    ++iIt;
+    valueList.push_back( countIt->first );
     }
 
-  valueList.unique();
-  valueList.sort();
-  valueList.unique();
-
   std::list< unsigned short >::iterator listIt;
   listIt = valueList.begin();
 
@@ -0,0 +1,261 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkImageBufferPool.h,v $
+  Language:  C++
+  Date:      $Date: 2012/09/18 14:06:52 $
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkImageBufferPool_h
+#define __itkImageBufferPool_h
+
+#include "itkImage.h"
+#include "itkImportImageContainer.h"
+#include "itkObjectFactoryBase.h"
+#include "itkSimpleFastMutexLock.h"
+#include "itkVersion.h"
+#include "itkImageMemoryTracker.h"
+#include <map>
+#include <typeinfo>
+#include <vector>
+
+
+namespace itk
+{
+/** \class ImageBufferPool
+ * \brief Pool of image buffers keyed by size. Once Enable() has been
+ * called, the buffers of all images (for the pixel types registered
+ * by PooledImageContainerFactory) are checked out of the pool and
+ * returned to it when the image releases them, instead of being
+ * allocated and freed. The temporary volumes of a pipeline (filter
+ * outputs, dilation/erosion results, per-slice images, ...) are
+ * typically of a few distinct sizes, so after the first pass through
+ * a pipeline they are served from the pool without page faults.
+ *
+ * Buffers of at least 2 MB can be backed by huge pages (explicit
+ * huge pages if some are reserved, transparent huge pages otherwise;
+ * Linux only). The memory held by idle buffers is capped by
+ * MaximumIdleBytes; buffers returned beyond that are freed.
+ *
+ * Buffers are not initialized when checked out, as is the case for
+ * buffers allocated by ImportImageContainer.
+ */
+class ITK_EXPORT ImageBufferPool
+{
+public:
+  /** Install the pooled image container factory. Only buffers
+   *  allocated afterwards come from the pool. */
+  static void Enable();
+  static bool GetEnabled();
+
+  /** Back new buffers of at least 2 MB by huge pages (default is
+   *  false). Must be set before the buffers are allocated. */
+  static void SetUseHugePages( bool );
+  static bool GetUseHugePages();
+
+  /** Max number of bytes held by idle buffers (default is 1 GB) */
+  static void SetMaximumIdleBytes( unsigned long );
+  static unsigned long GetMaximumIdleBytes();
+
+  /** Check out a buffer of (at least) the given number of bytes */
+  static void* Acquire( unsigned long bytes );
+
+  /** Return a buffer to the pool. Returns false if the buffer does not
+   *  come from the pool. */
+  static bool Release( const void* );
+
+  /** Free all idle buffers */
+  static void Clear();
+
+  /** Number of buffers checked out, and how many of them were idle
+   *  buffers being reused */
+  static unsigned long GetNumberOfAcquisitions();
+  static unsigned long GetNumberOfReuses();
+
+  /** Number of bytes currently held by idle buffers */
+  static unsigned long GetIdleBytes();
+
+private:
+  /** How the memory of a buffer was obtained, which determines how it
+   *  is freed */
+  enum AllocationType { MALLOC, MMAP };
+
+  struct BufferType
+  {
+    unsigned long   Bytes;
+    AllocationType  Allocation;
+    bool            Idle;
+  };
+
+  struct StateType
+  {
+    StateType() : Enabled( false ), UseHugePages( false ), MaximumIdleBytes( 1UL << 30 ),
+                  IdleBytes( 0 ), NumberOfAcquisitions( 0 ), NumberOfReuses( 0 ) {}
+
+    bool                                       Enabled;
+    bool                                       UseHugePages;
+    unsigned long                              MaximumIdleBytes;
+    unsigned long                              IdleBytes;
+    unsigned long                              NumberOfAcquisitions;
+    unsigned long                              NumberOfReuses;
+    std::map< const void*, BufferType >        Buffers;
+    std::multimap< unsigned long, void* >      IdleBuffers;
+    SimpleFastMutexLock                        Lock;
+  };
+
+  static StateType & GetState();
+
+  static void* AllocateBuffer( unsigned long bytes, bool useHugePages, AllocationType& );
+  static void  FreeBuffer( void*, const BufferType& );
+};
+
+
+/** \class PooledImportImageContainer
+ * \brief Image pixel container whose buffer is checked out of the
+ * ImageBufferPool. It is created in place of ImportImageContainer by
+ * PooledImageContainerFactory. Allocations are reported to the
+ * ImageMemoryTracker when it is enabled.
+ */
+template < class TElementIdentifier, class TElement >
+class ITK_EXPORT PooledImportImageContainer : public ImportImageContainer< TElementIdentifier, TElement >
+{
+public:
+  /** Standard class typedefs. */
+  typedef PooledImportImageContainer                            Self;
+  typedef ImportImageContainer< TElementIdentifier, TElement >  Superclass;
+  typedef SmartPointer< Self >                                  Pointer;
+  typedef SmartPointer< const Self >                            ConstPointer;
+
+  typedef typename Superclass::ElementIdentifier  ElementIdentifier;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro( Self );
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro( PooledImportImageContainer, ImportImageContainer );
+
+protected:
+  PooledImportImageContainer() {}
+
+  /** The base class destructor does not call the overridden
+   *  DeallocateManagedMemory(), so the buffer is returned to the pool
+   *  here */
+  virtual ~PooledImportImageContainer()
+    {
+      this->DeallocateManagedMemory();
+    }
+
+  virtual TElement* AllocateElements( ElementIdentifier size ) const
+    {
+      unsigned long bytes = static_cast< unsigned long >( size )*sizeof( TElement );
+
+      TElement* data = static_cast< TElement* >( ImageBufferPool::Acquire( bytes ) );
+
+      if ( data == 0 )
+        {
+        itkExceptionMacro( << "Failed to allocate memory for image." );
+        }
+
+      if ( ImageMemoryTracker::GetEnabled() )
+        {
+        ImageMemoryTracker::RecordAllocation( data, bytes );
+        }
+
+      return data;
+    }
+
+  /** Pooled buffers are handed back to the pool and the base class is
+   *  told not to delete them. Imported buffers are left alone. */
+  virtual void DeallocateManagedMemory()
+    {
+      TElement* data = this->GetImportPointer();
+
+      if ( data != 0 && this->GetContainerManageMemory() )
+        {
+        if ( ImageMemoryTracker::GetEnabled() )
+          {
+          ImageMemoryTracker::RecordDeallocation( data );
+          }
+
+        if ( ImageBufferPool::Release( data ) )
+          {
+          this->ContainerManageMemoryOff();
+          }
+        }
+
+      Superclass::DeallocateManagedMemory();
+    }
+
+private:
+  PooledImportImageContainer( const Self& ); //purposely not implemented
+  void operator=( const Self& ); //purposely not implemented
+};
+
+
+/** \class PooledImageContainerFactory
+ * \brief Object factory that overrides the pixel containers of images
+ * of the scalar pixel types used in this project with
+ * PooledImportImageContainer.
+ */
+class ITK_EXPORT PooledImageContainerFactory : public ObjectFactoryBase
+{
+public:
+  /** Standard class typedefs. */
+  typedef PooledImageContainerFactory  Self;
+  typedef ObjectFactoryBase            Superclass;
+  typedef SmartPointer< Self >         Pointer;
+  typedef SmartPointer< const Self >   ConstPointer;
+
+  /** Class methods used to interface with the registered factories. */
+  virtual const char* GetITKSourceVersion() const
+    {
+      return ITK_SOURCE_VERSION;
+    }
+  virtual const char* GetDescription() const
+    {
+      return "Factory overriding image pixel containers to reuse pooled buffers";
+    }
+
+  /** Method for class instantiation. */
+  itkFactorylessNewMacro( Self );
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro( PooledImageContainerFactory, ObjectFactoryBase );
+
+protected:
+  PooledImageContainerFactory();
+  virtual ~PooledImageContainerFactory() {}
+
+  template < class TPixel >
+  void RegisterContainerOverride()
+    {
+      typedef typename Image< TPixel, 3 >::PixelContainer                                        ContainerType;
+      typedef PooledImportImageContainer< typename ContainerType::ElementIdentifier, TPixel >   PooledContainerType;
+
+      this->RegisterOverride( typeid( ContainerType ).name(),
+                              typeid( PooledContainerType ).name(),
+                              "Pooled image container",
+                              1,
+                              CreateObjectFunction< PooledContainerType >::New() );
+    }
+
+private:
+  PooledImageContainerFactory( const Self& ); //purposely not implemented
+  void operator=( const Self& ); //purposely not implemented
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkImageBufferPool.txx"
+#endif
+
+#endif
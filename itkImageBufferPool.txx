@@ -0,0 +1,372 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkImageBufferPool.txx,v $
+  Language:  C++
+  Date:      $Date: 2012/09/18 14:06:52 $
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef _itkImageBufferPool_txx
+#define _itkImageBufferPool_txx
+
+#include "itkImageBufferPool.h"
+#include <cstdlib>
+
+#if defined( __linux__ )
+#include <sys/mman.h>
+#endif
+
+
+namespace itk
+{
+
+inline ImageBufferPool::StateType &
+ImageBufferPool
+::GetState()
+{
+  static StateType state;
+
+  return state;
+}
+
+
+/**
+ * The containers of the pool report their allocations to the memory
+ * tracker themselves, so the tracking container factory must not be
+ * used at the same time (the first registered factory would win)
+ */
+inline void
+ImageBufferPool
+::Enable()
+{
+  StateType& state = GetState();
+
+  if ( !state.Enabled )
+    {
+    ImageMemoryTracker::UseExternalContainers();
+    ObjectFactoryBase::RegisterFactory( PooledImageContainerFactory::New() );
+
+    state.Enabled = true;
+    }
+}
+
+
+inline bool
+ImageBufferPool
+::GetEnabled()
+{
+  return GetState().Enabled;
+}
+
+
+inline void
+ImageBufferPool
+::SetUseHugePages( bool useHugePages )
+{
+  GetState().UseHugePages = useHugePages;
+}
+
+
+inline bool
+ImageBufferPool
+::GetUseHugePages()
+{
+  return GetState().UseHugePages;
+}
+
+
+inline void
+ImageBufferPool
+::SetMaximumIdleBytes( unsigned long maximumIdleBytes )
+{
+  GetState().MaximumIdleBytes = maximumIdleBytes;
+}
+
+
+inline unsigned long
+ImageBufferPool
+::GetMaximumIdleBytes()
+{
+  return GetState().MaximumIdleBytes;
+}
+
+
+/**
+ * Buffers of at least 2 MB are rounded up to a multiple of 2 MB when
+ * huge pages are used. An explicit huge page mapping is tried first;
+ * it fails unless huge pages have been reserved, in which case a
+ * 2 MB aligned buffer is requested and marked as a candidate for
+ * transparent huge pages.
+ */
+inline void*
+ImageBufferPool
+::AllocateBuffer( unsigned long bytes, bool useHugePages, AllocationType& allocation )
+{
+  void* buffer = 0;
+
+  allocation = MALLOC;
+
+#if defined( __linux__ )
+  const unsigned long hugePageSize = 2UL << 20;
+
+  if ( useHugePages && bytes >= hugePageSize )
+    {
+    unsigned long mappedBytes = ( bytes + hugePageSize - 1 )/hugePageSize*hugePageSize;
+
+#if defined( MAP_HUGETLB )
+    buffer = mmap( 0, mappedBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0 );
+
+    if ( buffer != MAP_FAILED )
+      {
+      allocation = MMAP;
+
+      return buffer;
+      }
+#endif
+
+    buffer = 0;
+    if ( posix_memalign( &buffer, hugePageSize, mappedBytes ) != 0 )
+      {
+      return 0;
+      }
+
+#if defined( MADV_HUGEPAGE )
+    madvise( buffer, mappedBytes, MADV_HUGEPAGE );
+#endif
+
+    return buffer;
+    }
+
+  if ( posix_memalign( &buffer, 64, bytes ) != 0 )
+    {
+    return 0;
+    }
+#else
+  (void)useHugePages;
+
+  buffer = std::malloc( bytes );
+#endif
+
+  return buffer;
+}
+
+
+inline void
+ImageBufferPool
+::FreeBuffer( void* buffer, const BufferType& info )
+{
+#if defined( __linux__ )
+  if ( info.Allocation == MMAP )
+    {
+    const unsigned long hugePageSize = 2UL << 20;
+
+    munmap( buffer, ( info.Bytes + hugePageSize - 1 )/hugePageSize*hugePageSize );
+
+    return;
+    }
+#else
+  (void)info;
+#endif
+
+  std::free( buffer );
+}
+
+
+/**
+ * An idle buffer of exactly the requested size is reused if there is
+ * one. Sizes are not rounded, so buffers are only shared between
+ * images of the same size and pixel size, which is the common case
+ * within a pipeline.
+ */
+inline void*
+ImageBufferPool
+::Acquire( unsigned long bytes )
+{
+  StateType& state = GetState();
+
+  if ( bytes == 0 )
+    {
+    bytes = 1;
+    }
+
+  state.Lock.Lock();
+
+  state.NumberOfAcquisitions++;
+
+  std::multimap< unsigned long, void* >::iterator it = state.IdleBuffers.find( bytes );
+
+  if ( it != state.IdleBuffers.end() )
+    {
+    void* buffer = it->second;
+
+    state.IdleBuffers.erase( it );
+    state.Buffers[buffer].Idle = false;
+    state.IdleBytes -= bytes;
+    state.NumberOfReuses++;
+
+    state.Lock.Unlock();
+
+    return buffer;
+    }
+
+  bool useHugePages = state.UseHugePages;
+
+  state.Lock.Unlock();
+
+  AllocationType allocation;
+  void* buffer = AllocateBuffer( bytes, useHugePages, allocation );
+
+  if ( buffer == 0 )
+    {
+    //
+    // Free the idle buffers and try again
+    //
+    Clear();
+
+    buffer = AllocateBuffer( bytes, useHugePages, allocation );
+
+    if ( buffer == 0 )
+      {
+      return 0;
+      }
+    }
+
+  BufferType info;
+    info.Bytes      = bytes;
+    info.Allocation = allocation;
+    info.Idle       = false;
+
+  state.Lock.Lock();
+  state.Buffers[buffer] = info;
+  state.Lock.Unlock();
+
+  return buffer;
+}
+
+
+inline bool
+ImageBufferPool
+::Release( const void* buffer )
+{
+  StateType& state = GetState();
+
+  state.Lock.Lock();
+
+  std::map< const void*, BufferType >::iterator it = state.Buffers.find( buffer );
+
+  if ( it == state.Buffers.end() || it->second.Idle )
+    {
+    state.Lock.Unlock();
+
+    return false;
+    }
+
+  if ( state.IdleBytes + it->second.Bytes > state.MaximumIdleBytes )
+    {
+    BufferType info = it->second;
+    state.Buffers.erase( it );
+
+    state.Lock.Unlock();
+
+    FreeBuffer( const_cast< void* >( buffer ), info );
+
+    return true;
+    }
+
+  it->second.Idle = true;
+  state.IdleBytes += it->second.Bytes;
+  state.IdleBuffers.insert( std::make_pair( it->second.Bytes, const_cast< void* >( buffer ) ) );
+
+  state.Lock.Unlock();
+
+  return true;
+}
+
+
+inline void
+ImageBufferPool
+::Clear()
+{
+  StateType& state = GetState();
+
+  state.Lock.Lock();
+
+  std::multimap< unsigned long, void* > idleBuffers;
+  idleBuffers.swap( state.IdleBuffers );
+
+  std::vector< std::pair< void*, BufferType > > toFree;
+
+  for ( std::multimap< unsigned long, void* >::iterator it = idleBuffers.begin(); it != idleBuffers.end(); ++it )
+    {
+    std::map< const void*, BufferType >::iterator bIt = state.Buffers.find( it->second );
+
+    toFree.push_back( std::make_pair( it->second, bIt->second ) );
+    state.Buffers.erase( bIt );
+    }
+
+  state.IdleBytes = 0;
+
+  state.Lock.Unlock();
+
+  for ( unsigned int i=0; i<toFree.size(); i++ )
+    {
+    FreeBuffer( toFree[i].first, toFree[i].second );
+    }
+}
+
+
+inline unsigned long
+ImageBufferPool
+::GetNumberOfAcquisitions()
+{
+  return GetState().NumberOfAcquisitions;
+}
+
+
+inline unsigned long
+ImageBufferPool
+::GetNumberOfReuses()
+{
+  return GetState().NumberOfReuses;
+}
+
+
+inline unsigned long
+ImageBufferPool
+::GetIdleBytes()
+{
+  return GetState().IdleBytes;
+}
+
+
+/**
+ * Register overrides for every scalar pixel type used by the filters
+ * in this project (including the unsigned long component images)
+ */
+inline
+PooledImageContainerFactory
+::PooledImageContainerFactory()
+{
+  this->RegisterContainerOverride< char >();
+  this->RegisterContainerOverride< unsigned char >();
+  this->RegisterContainerOverride< short >();
+  this->RegisterContainerOverride< unsigned short >();
+  this->RegisterContainerOverride< int >();
+  this->RegisterContainerOverride< unsigned int >();
+  this->RegisterContainerOverride< long >();
+  this->RegisterContainerOverride< unsigned long >();
+  this->RegisterContainerOverride< float >();
+  this->RegisterContainerOverride< double >();
+}
+
+} // end namespace itk
+
+#endif
@@ -0,0 +1,214 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkImageMemoryTracker.h,v $
+  Language:  C++
+  Date:      $Date: 2012/09/04 20:23:08 $
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkImageMemoryTracker_h
+#define __itkImageMemoryTracker_h
+
+#include "itkImage.h"
+#include "itkImportImageContainer.h"
+#include "itkObjectFactoryBase.h"
+#include "itkSimpleFastMutexLock.h"
+#include "itkVersion.h"
+#include <map>
+#include <typeinfo>
+#include <vector>
+
+
+namespace itk
+{
+/** \class ImageMemoryTracker
+ * \brief Keeps track of the memory used by image buffers. Once
+ * Enable() has been called, every image buffer allocated by any
+ * filter (for the pixel types registered by
+ * TrackingImageContainerFactory) is recorded: the total number of
+ * bytes allocated, the number of bytes currently live and the
+ * high-water mark of live bytes. Peak markers can be pushed and popped
+ * to get the high-water mark over a section of code, e.g. a pipeline
+ * stage (see PipelineProfiler). Each marker is popped through the
+ * handle returned when it was pushed, so sections that overlap without
+ * nesting (e.g. the stages of concurrent pipelines) get their own
+ * marks. The live bytes are those of the whole process, so the mark of
+ * a section includes the buffers of concurrent sections.
+ */
+class ITK_EXPORT ImageMemoryTracker
+{
+public:
+  /** Install the tracking image container factory. Only buffers
+   *  allocated afterwards are tracked. */
+  static void Enable();
+  static bool GetEnabled();
+
+  /** Stop installing (and remove, if it was installed) the tracking
+   *  image container factory. This is for other container factories
+   *  (e.g. the one of ImageBufferPool) whose containers report their
+   *  allocations to the tracker themselves. */
+  static void UseExternalContainers();
+
+  static void RecordAllocation( const void*, unsigned long );
+  static void RecordDeallocation( const void* );
+
+  /** Total number of bytes allocated since tracking was enabled */
+  static unsigned long GetBytesAllocated();
+
+  /** Number of bytes in image buffers that are currently allocated */
+  static unsigned long GetLiveBytes();
+
+  /** Largest value ever reached by the live bytes */
+  static unsigned long GetPeakLiveBytes();
+
+  /** Start recording the high-water mark of live bytes. Returns the
+   *  handle of the marker. */
+  static unsigned long PushPeakMarker();
+
+  /** Stop recording and return the high-water mark of live bytes
+   *  since the marker was pushed */
+  static unsigned long PopPeakMarker( unsigned long marker );
+
+private:
+  struct StateType
+  {
+    StateType() : Enabled( false ), ExternalContainers( false ), BytesAllocated( 0 ), LiveBytes( 0 ), PeakLiveBytes( 0 ),
+                  NextMarker( 0 ) {}
+
+    bool                                      Enabled;
+    bool                                      ExternalContainers;
+    ObjectFactoryBase::Pointer                Factory;
+    unsigned long                             BytesAllocated;
+    unsigned long                             LiveBytes;
+    unsigned long                             PeakLiveBytes;
+    std::map< const void*, unsigned long >    Buffers;
+    std::map< unsigned long, unsigned long >  MarkerPeaks;
+    unsigned long                             NextMarker;
+    SimpleFastMutexLock                       Lock;
+  };
+
+  static StateType & GetState();
+};
+
+
+/** \class TrackingImportImageContainer
+ * \brief Image pixel container that reports its allocations to the
+ * ImageMemoryTracker. It is created in place of ImportImageContainer
+ * by TrackingImageContainerFactory.
+ */
+template < class TElementIdentifier, class TElement >
+class ITK_EXPORT TrackingImportImageContainer : public ImportImageContainer< TElementIdentifier, TElement >
+{
+public:
+  /** Standard class typedefs. */
+  typedef TrackingImportImageContainer                          Self;
+  typedef ImportImageContainer< TElementIdentifier, TElement >  Superclass;
+  typedef SmartPointer< Self >                                  Pointer;
+  typedef SmartPointer< const Self >                            ConstPointer;
+
+  typedef typename Superclass::ElementIdentifier  ElementIdentifier;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro( Self );
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro( TrackingImportImageContainer, ImportImageContainer );
+
+protected:
+  TrackingImportImageContainer() {}
+
+  /** The base class destructor does not call the overridden
+   *  DeallocateManagedMemory(), so the buffer is released from the
+   *  tracker here */
+  virtual ~TrackingImportImageContainer()
+    {
+      ImageMemoryTracker::RecordDeallocation( this->GetImportPointer() );
+    }
+
+  virtual TElement* AllocateElements( ElementIdentifier size ) const
+    {
+      TElement* data = Superclass::AllocateElements( size );
+      ImageMemoryTracker::RecordAllocation( data, static_cast< unsigned long >( size )*sizeof( TElement ) );
+
+      return data;
+    }
+
+  virtual void DeallocateManagedMemory()
+    {
+      ImageMemoryTracker::RecordDeallocation( this->GetImportPointer() );
+      Superclass::DeallocateManagedMemory();
+    }
+
+private:
+  TrackingImportImageContainer( const Self& ); //purposely not implemented
+  void operator=( const Self& ); //purposely not implemented
+};
+
+
+/** \class TrackingImageContainerFactory
+ * \brief Object factory that overrides the pixel containers of images
+ * of the scalar pixel types used in this project with
+ * TrackingImportImageContainer.
+ */
+class ITK_EXPORT TrackingImageContainerFactory : public ObjectFactoryBase
+{
+public:
+  /** Standard class typedefs. */
+  typedef TrackingImageContainerFactory  Self;
+  typedef ObjectFactoryBase              Superclass;
+  typedef SmartPointer< Self >           Pointer;
+  typedef SmartPointer< const Self >     ConstPointer;
+
+  /** Class methods used to interface with the registered factories. */
+  virtual const char* GetITKSourceVersion() const
+    {
+      return ITK_SOURCE_VERSION;
+    }
+  virtual const char* GetDescription() const
+    {
+      return "Factory overriding image pixel containers to track image memory";
+    }
+
+  /** Method for class instantiation. */
+  itkFactorylessNewMacro( Self );
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro( TrackingImageContainerFactory, ObjectFactoryBase );
+
+protected:
+  TrackingImageContainerFactory();
+  virtual ~TrackingImageContainerFactory() {}
+
+  template < class TPixel >
+  void RegisterContainerOverride()
+    {
+      typedef typename Image< TPixel, 3 >::PixelContainer                                          ContainerType;
+      typedef TrackingImportImageContainer< typename ContainerType::ElementIdentifier, TPixel >   TrackingContainerType;
+
+      this->RegisterOverride( typeid( ContainerType ).name(),
+                              typeid( TrackingContainerType ).name(),
+                              "Tracking image container",
+                              1,
+                              CreateObjectFunction< TrackingContainerType >::New() );
+    }
+
+private:
+  TrackingImageContainerFactory( const Self& ); //purposely not implemented
+  void operator=( const Self& ); //purposely not implemented
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkImageMemoryTracker.txx"
+#endif
+
+#endif
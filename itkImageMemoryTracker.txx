@@ -0,0 +1,228 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkImageMemoryTracker.txx,v $
+  Language:  C++
+  Date:      $Date: 2012/09/04 20:23:08 $
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef _itkImageMemoryTracker_txx
+#define _itkImageMemoryTracker_txx
+
+#include "itkImageMemoryTracker.h"
+
+
+namespace itk
+{
+
+inline ImageMemoryTracker::StateType &
+ImageMemoryTracker
+::GetState()
+{
+  static StateType state;
+
+  return state;
+}
+
+
+inline void
+ImageMemoryTracker
+::Enable()
+{
+  StateType& state = GetState();
+
+  if ( !state.Enabled )
+    {
+    if ( !state.ExternalContainers )
+      {
+      state.Factory = TrackingImageContainerFactory::New();
+      ObjectFactoryBase::RegisterFactory( state.Factory );
+      }
+
+    state.Enabled = true;
+    }
+}
+
+
+inline void
+ImageMemoryTracker
+::UseExternalContainers()
+{
+  StateType& state = GetState();
+
+  if ( state.Factory.IsNotNull() )
+    {
+    ObjectFactoryBase::UnRegisterFactory( state.Factory );
+    state.Factory = 0;
+    }
+
+  state.ExternalContainers = true;
+}
+
+
+inline bool
+ImageMemoryTracker
+::GetEnabled()
+{
+  return GetState().Enabled;
+}
+
+
+inline void
+ImageMemoryTracker
+::RecordAllocation( const void* buffer, unsigned long bytes )
+{
+  if ( buffer == 0 )
+    {
+    return;
+    }
+
+  StateType& state = GetState();
+
+  state.Lock.Lock();
+
+  state.Buffers[buffer] = bytes;
+
+  state.BytesAllocated += bytes;
+  state.LiveBytes      += bytes;
+
+  if ( state.LiveBytes > state.PeakLiveBytes )
+    {
+    state.PeakLiveBytes = state.LiveBytes;
+    }
+
+  for ( std::map< unsigned long, unsigned long >::iterator it = state.MarkerPeaks.begin(); it != state.MarkerPeaks.end(); ++it )
+    {
+    if ( state.LiveBytes > it->second )
+      {
+      it->second = state.LiveBytes;
+      }
+    }
+
+  state.Lock.Unlock();
+}
+
+
+/**
+ * Buffers that were not allocated through a tracking container
+ * (e.g. imported buffers) are ignored
+ */
+inline void
+ImageMemoryTracker
+::RecordDeallocation( const void* buffer )
+{
+  if ( buffer == 0 )
+    {
+    return;
+    }
+
+  StateType& state = GetState();
+
+  state.Lock.Lock();
+
+  std::map< const void*, unsigned long >::iterator it = state.Buffers.find( buffer );
+
+  if ( it != state.Buffers.end() )
+    {
+    state.LiveBytes -= it->second;
+    state.Buffers.erase( it );
+    }
+
+  state.Lock.Unlock();
+}
+
+
+inline unsigned long
+ImageMemoryTracker
+::GetBytesAllocated()
+{
+  return GetState().BytesAllocated;
+}
+
+
+inline unsigned long
+ImageMemoryTracker
+::GetLiveBytes()
+{
+  return GetState().LiveBytes;
+}
+
+
+inline unsigned long
+ImageMemoryTracker
+::GetPeakLiveBytes()
+{
+  return GetState().PeakLiveBytes;
+}
+
+
+inline unsigned long
+ImageMemoryTracker
+::PushPeakMarker()
+{
+  StateType& state = GetState();
+
+  state.Lock.Lock();
+  unsigned long marker = state.NextMarker++;
+  state.MarkerPeaks[marker] = state.LiveBytes;
+  state.Lock.Unlock();
+
+  return marker;
+}
+
+
+/**
+ * Unknown markers (e.g. already popped) have a mark of 0
+ */
+inline unsigned long
+ImageMemoryTracker
+::PopPeakMarker( unsigned long marker )
+{
+  StateType& state = GetState();
+
+  unsigned long peak = 0;
+
+  state.Lock.Lock();
+  std::map< unsigned long, unsigned long >::iterator it = state.MarkerPeaks.find( marker );
+  if ( it != state.MarkerPeaks.end() )
+    {
+    peak = it->second;
+    state.MarkerPeaks.erase( it );
+    }
+  state.Lock.Unlock();
+
+  return peak;
+}
+
+
+/**
+ * Register overrides for every scalar pixel type used by the filters
+ * in this project (including the unsigned long component images)
+ */
+inline
+TrackingImageContainerFactory
+::TrackingImageContainerFactory()
+{
+  this->RegisterContainerOverride< char >();
+  this->RegisterContainerOverride< unsigned char >();
+  this->RegisterContainerOverride< short >();
+  this->RegisterContainerOverride< unsigned short >();
+  this->RegisterContainerOverride< int >();
+  this->RegisterContainerOverride< unsigned int >();
+  this->RegisterContainerOverride< long >();
+  this->RegisterContainerOverride< unsigned long >();
+  this->RegisterContainerOverride< float >();
+  this->RegisterContainerOverride< double >();
+}
+
+} // end namespace itk
+
+#endif
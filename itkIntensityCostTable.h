@@ -0,0 +1,178 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkIntensityCostTable.h,v $
+  Language:  C++
+  Date:      $Date: 2012/09/04 20:23:08 $
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkIntensityCostTable_h
+#define __itkIntensityCostTable_h
+
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+#include "itkImage.h"
+#include "itkVoxelPass.h"
+#include <vector>
+
+
+namespace itk
+{
+/** \class IntensityCostTable
+ * \brief The cost DijkstraImageToGraphFunctor assigns to each CT value
+ * (exponential, sigmoid or linear in the value, with the same
+ * parameters and defaults), tabulated for all 65536 values. The
+ * functions are evaluated once per value when the table is computed;
+ * costing a voxel is then a table lookup.
+ *
+ * The table can cost a whole image in a single pass (see VoxelPass),
+ * giving a float cost image that path searches can read directly, and
+ * can be handed to DijkstraImageToGraphFunctor in place of its own
+ * cost functions.
+ *
+ * With 'TruncateCosts' on, the costs are truncated towards zero, as
+ * they are when converted to integer graph weights, so that searches
+ * on the table and on an integer weighted graph agree exactly (for
+ * costs below 2^24, which float represents exactly).
+ */
+class ITK_EXPORT IntensityCostTable : public Object
+{
+public:
+  /** Standard class typedefs. */
+  typedef IntensityCostTable          Self;
+  typedef Object                      Superclass;
+  typedef SmartPointer< Self >        Pointer;
+  typedef SmartPointer< const Self >  ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro( Self );
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro( IntensityCostTable, Object );
+
+  typedef short                    PixelType;
+  typedef float                    CostType;
+  typedef Image< PixelType, 3 >    ImageType;
+  typedef Image< CostType, 3 >     CostImageType;
+
+  /** Number of threads used to cost an image (default is the
+   *  MultiThreader default) */
+  itkSetMacro( NumberOfThreads, unsigned int );
+  itkGetMacro( NumberOfThreads, unsigned int );
+
+  /** Parameters of the cost functions (see
+   *  DijkstraImageToGraphFunctor). They take effect when the table is
+   *  computed. */
+  itkSetMacro( ExponentialCoefficient, double );
+  itkGetMacro( ExponentialCoefficient, double );
+
+  itkSetMacro( ExponentialTimeConstant, double );
+  itkGetMacro( ExponentialTimeConstant, double );
+
+  itkSetMacro( SigmoidScale, double );
+  itkGetMacro( SigmoidScale, double );
+
+  itkSetMacro( SigmoidShift, double );
+  itkGetMacro( SigmoidShift, double );
+
+  itkSetMacro( SigmoidSteepness, double );
+  itkGetMacro( SigmoidSteepness, double );
+
+  itkSetMacro( TruncateCosts, bool );
+  itkGetMacro( TruncateCosts, bool );
+  itkBooleanMacro( TruncateCosts );
+
+  inline void SetExponentialBasedCostAssignment( bool use )
+    {
+      m_ExponentialBasedCostAssignment =  use;
+      m_SigmoidBasedCostAssignment     = !use;
+      m_LinearBasedCostAssignment      = !use;
+    }
+  inline bool GetExponentialBasedCostAssignment() const
+    {
+      return m_ExponentialBasedCostAssignment;
+    }
+
+  inline void SetSigmoidBasedCostAssignment( bool use )
+    {
+      m_SigmoidBasedCostAssignment     =  use;
+      m_ExponentialBasedCostAssignment = !use;
+      m_LinearBasedCostAssignment      = !use;
+    }
+  inline bool GetSigmoidBasedCostAssignment() const
+    {
+      return m_SigmoidBasedCostAssignment;
+    }
+
+  inline void SetLinearBasedCostAssignment( bool use )
+    {
+      m_LinearBasedCostAssignment      =  use;
+      m_SigmoidBasedCostAssignment     = !use;
+      m_ExponentialBasedCostAssignment = !use;
+    }
+  inline bool GetLinearBasedCostAssignment() const
+    {
+      return m_LinearBasedCostAssignment;
+    }
+
+  /** Evaluate the cost function for every value */
+  void Compute();
+
+  /** Cost of a value (valid after Compute) */
+  CostType GetCost( PixelType value ) const
+    {
+      return this->m_Table[value + 32768];
+    }
+
+  /** The 65536 costs, indexed by the value plus 32768 */
+  const CostType* GetTable() const
+    {
+      return &this->m_Table[0];
+    }
+
+  /** Cost of each voxel of the buffered region of an image, in an
+   *  image with the same regions, spacing, origin and direction */
+  CostImageType::Pointer ComputeCostImage( const ImageType* image ) const;
+
+  /** Same, but only for a slab of whole slices of the buffered region
+   *  (the cost image's buffered region is the slab) */
+  CostImageType::Pointer ComputeCostImage( const ImageType* image, const ImageType::RegionType& slab ) const;
+
+protected:
+  IntensityCostTable();
+  virtual ~IntensityCostTable() {}
+
+  void PrintSelf( std::ostream& os, Indent indent ) const;
+
+private:
+  IntensityCostTable( const Self& ); //purposely not implemented
+  void operator=( const Self& ); //purposely not implemented
+
+  unsigned int             m_NumberOfThreads;
+  double                   m_ExponentialCoefficient;
+  double                   m_ExponentialTimeConstant;
+  double                   m_SigmoidScale;
+  double                   m_SigmoidShift;
+  double                   m_SigmoidSteepness;
+  bool                     m_SigmoidBasedCostAssignment;
+  bool                     m_ExponentialBasedCostAssignment;
+  bool                     m_LinearBasedCostAssignment;
+  bool                     m_TruncateCosts;
+  std::vector< CostType >  m_Table;
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkIntensityCostTable.txx"
+#endif
+
+#endif
@@ -0,0 +1,168 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkIntensityCostTable.txx,v $
+  Language:  C++
+  Date:      $Date: 2012/09/04 20:23:08 $
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef _itkIntensityCostTable_txx
+#define _itkIntensityCostTable_txx
+
+#include "itkIntensityCostTable.h"
+#include "itkMultiThreader.h"
+#include "itkWorkCounters.h"
+#include "vnl/vnl_math.h"
+
+
+namespace itk
+{
+
+inline
+IntensityCostTable
+::IntensityCostTable()
+{
+  this->m_NumberOfThreads                = MultiThreader::New()->GetNumberOfThreads();
+  this->m_ExponentialCoefficient         = 50;
+  this->m_ExponentialTimeConstant        = 700;
+  this->m_LinearBasedCostAssignment      = false;
+  this->m_SigmoidBasedCostAssignment     = false;
+  this->m_ExponentialBasedCostAssignment = true;
+  this->m_SigmoidScale                   = 5.0;
+  this->m_SigmoidShift                   = -800;
+  this->m_SigmoidSteepness               = 0.05;
+  this->m_TruncateCosts                  = false;
+  this->m_Table.assign( 65536, 0.0f );
+}
+
+
+/**
+ * The costs are computed in double precision, as the functor computes
+ * them, and truncated before being rounded to float: truncated costs
+ * are integers, which float represents exactly up to 2^24
+ */
+inline void
+IntensityCostTable
+::Compute()
+{
+  for ( long v=0; v<65536; v++ )
+    {
+    double pixelValue = static_cast< double >( v - 32768 );
+
+    double cost;
+
+    if ( this->m_LinearBasedCostAssignment )
+      {
+      cost = pixelValue;
+      }
+    else if ( this->m_ExponentialBasedCostAssignment )
+      {
+      cost = this->m_ExponentialCoefficient*vcl_exp( pixelValue/this->m_ExponentialTimeConstant );
+      }
+    else
+      {
+      cost = this->m_SigmoidScale/( 1.0 + vcl_exp( -this->m_SigmoidSteepness*( pixelValue - this->m_SigmoidShift ) ) );
+      }
+
+    if ( this->m_TruncateCosts )
+      {
+      cost = cost < 0.0 ? vcl_ceil( cost ) : vcl_floor( cost );
+      }
+
+    this->m_Table[v] = static_cast< CostType >( cost );
+    }
+}
+
+
+inline IntensityCostTable::CostImageType::Pointer
+IntensityCostTable
+::ComputeCostImage( const ImageType* image ) const
+{
+  return this->ComputeCostImage( image, image->GetBufferedRegion() );
+}
+
+
+/**
+ * The voxels of a slab of whole slices are contiguous in the buffer,
+ * so the slab is costed in a single pass like a whole image
+ */
+inline IntensityCostTable::CostImageType::Pointer
+IntensityCostTable
+::ComputeCostImage( const ImageType* image, const ImageType::RegionType& slab ) const
+{
+  const ImageType::RegionType& bufferedRegion = image->GetBufferedRegion();
+
+  for ( unsigned int d=0; d<2; d++ )
+    {
+    if ( slab.GetIndex()[d] != bufferedRegion.GetIndex()[d] || slab.GetSize()[d] != bufferedRegion.GetSize()[d] )
+      {
+      itkExceptionMacro( "The region to cost is not a slab of whole slices of the buffered region" );
+      }
+    }
+  if ( slab.GetIndex()[2] < bufferedRegion.GetIndex()[2] ||
+       slab.GetIndex()[2] + static_cast< long >( slab.GetSize()[2] ) > bufferedRegion.GetIndex()[2] + static_cast< long >( bufferedRegion.GetSize()[2] ) )
+    {
+    itkExceptionMacro( "The region to cost is not inside the buffered region" );
+    }
+
+  CostImageType::Pointer costImage = CostImageType::New();
+    costImage->SetLargestPossibleRegion( image->GetLargestPossibleRegion() );
+    costImage->SetBufferedRegion( slab );
+    costImage->SetRequestedRegion( slab );
+    costImage->SetSpacing( image->GetSpacing() );
+    costImage->SetOrigin( image->GetOrigin() );
+    costImage->SetDirection( image->GetDirection() );
+    costImage->Allocate();
+
+  const unsigned long numberOfVoxels = slab.GetNumberOfPixels();
+
+  if ( numberOfVoxels == 0 )
+    {
+    return costImage;
+    }
+
+  VoxelLookupOperation lookup( image->GetBufferPointer() + image->ComputeOffset( slab.GetIndex() ), &this->m_Table[0],
+                               costImage->GetBufferPointer() );
+
+  VoxelPass::Pointer pass = VoxelPass::New();
+    pass->SetNumberOfThreads( this->m_NumberOfThreads );
+    pass->AddOperation( &lookup );
+    pass->Execute( numberOfVoxels );
+
+  WorkCounters::Add( "IntensityCostTable.VoxelsCosted", numberOfVoxels );
+
+  return costImage;
+}
+
+
+/**
+ * Standard "PrintSelf" method
+ */
+inline void
+IntensityCostTable
+::PrintSelf( std::ostream& os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+  os << indent << "NumberOfThreads: " << this->m_NumberOfThreads << std::endl;
+  os << indent << "ExponentialCoefficient: " << this->m_ExponentialCoefficient << std::endl;
+  os << indent << "ExponentialTimeConstant: " << this->m_ExponentialTimeConstant << std::endl;
+  os << indent << "SigmoidScale: " << this->m_SigmoidScale << std::endl;
+  os << indent << "SigmoidShift: " << this->m_SigmoidShift << std::endl;
+  os << indent << "SigmoidSteepness: " << this->m_SigmoidSteepness << std::endl;
+  os << indent << "ExponentialBasedCostAssignment: " << this->m_ExponentialBasedCostAssignment << std::endl;
+  os << indent << "SigmoidBasedCostAssignment: " << this->m_SigmoidBasedCostAssignment << std::endl;
+  os << indent << "LinearBasedCostAssignment: " << this->m_LinearBasedCostAssignment << std::endl;
+  os << indent << "TruncateCosts: " << this->m_TruncateCosts << std::endl;
+}
+
+} // end namespace itk
+
+#endif
@@ -0,0 +1,125 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkIntensityHistogram.h,v $
+  Language:  C++
+  Date:      $Date: 2012/09/04 20:23:08 $
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkIntensityHistogram_h
+#define __itkIntensityHistogram_h
+
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+#include "itkImage.h"
+#include "itkVoxelPass.h"
+#include <vector>
+
+
+namespace itk
+{
+/** \class IntensityHistogram
+ * \brief The number of voxels of each CT value (one bin per value) of
+ * an image, optionally restricted to the voxels where a mask is
+ * nonzero. It is computed in a single pass over the image (see
+ * VoxelPass) and then answers threshold questions without reading
+ * the image again: the number of voxels within a range of values,
+ * the range of values and the Otsu threshold.
+ *
+ * Counts are stored cumulatively, so the count of any range of
+ * values takes constant time.
+ */
+class ITK_EXPORT IntensityHistogram : public Object
+{
+public:
+  /** Standard class typedefs. */
+  typedef IntensityHistogram          Self;
+  typedef Object                      Superclass;
+  typedef SmartPointer< Self >        Pointer;
+  typedef SmartPointer< const Self >  ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro( Self );
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro( IntensityHistogram, Object );
+
+  typedef short                           PixelType;
+  typedef Image< PixelType, 3 >           ImageType;
+  typedef Image< unsigned short, 3 >      MaskImageType;
+
+  /** Number of threads (default is the MultiThreader default) */
+  itkSetMacro( NumberOfThreads, unsigned int );
+  itkGetMacro( NumberOfThreads, unsigned int );
+
+  /** Count the voxels of the buffered region of an image. If a mask
+   *  is given (with the same buffered region size), only the voxels
+   *  where it is nonzero are counted. */
+  void Compute( const ImageType* image, const MaskImageType* mask = 0 );
+
+  /** Number of voxels counted */
+  unsigned long GetTotalCount() const
+    {
+      return this->m_CumulativeCounts.back();
+    }
+
+  /** Number of voxels with values in [lower, upper] (zero if lower is
+   *  greater than upper) */
+  unsigned long GetCount( PixelType lower, PixelType upper ) const
+    {
+      if ( lower > upper )
+        {
+        return 0;
+        }
+
+      return this->m_CumulativeCounts[upper + 32769] - this->m_CumulativeCounts[lower + 32768];
+    }
+
+  unsigned long GetCount( PixelType value ) const
+    {
+      return this->GetCount( value, value );
+    }
+
+  /** Smallest and largest values counted (only valid if some voxels
+   *  were counted) */
+  itkGetConstMacro( Minimum, PixelType );
+  itkGetConstMacro( Maximum, PixelType );
+
+  /** The threshold computed by OtsuThresholdImageFilter on the same
+   *  voxels with 'numberOfBins' histogram bins between the minimum
+   *  and maximum values (128 is the filter default) */
+  PixelType ComputeOtsuThreshold( unsigned int numberOfBins ) const;
+
+protected:
+  IntensityHistogram();
+  virtual ~IntensityHistogram() {}
+
+  void PrintSelf( std::ostream& os, Indent indent ) const;
+
+private:
+  IntensityHistogram( const Self& ); //purposely not implemented
+  void operator=( const Self& ); //purposely not implemented
+
+  unsigned int                  m_NumberOfThreads;
+  PixelType                     m_Minimum;
+  PixelType                     m_Maximum;
+
+  /** Entry v is the number of voxels with values below v - 32768 */
+  std::vector< unsigned long >  m_CumulativeCounts;
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkIntensityHistogram.txx"
+#endif
+
+#endif
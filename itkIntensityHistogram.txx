@@ -0,0 +1,203 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkIntensityHistogram.txx,v $
+  Language:  C++
+  Date:      $Date: 2012/09/04 20:23:08 $
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef _itkIntensityHistogram_txx
+#define _itkIntensityHistogram_txx
+
+#include "itkIntensityHistogram.h"
+#include "itkMultiThreader.h"
+#include <cmath>
+
+
+namespace itk
+{
+
+inline
+IntensityHistogram
+::IntensityHistogram()
+{
+  this->m_NumberOfThreads = MultiThreader::New()->GetNumberOfThreads();
+  this->m_Minimum         = 0;
+  this->m_Maximum         = 0;
+  this->m_CumulativeCounts.assign( 65537, 0 );
+}
+
+
+inline void
+IntensityHistogram
+::Compute( const ImageType* image, const MaskImageType* mask )
+{
+  const unsigned long numberOfVoxels = image->GetBufferedRegion().GetNumberOfPixels();
+
+  if ( mask != 0 && mask->GetBufferedRegion().GetSize() != image->GetBufferedRegion().GetSize() )
+    {
+    itkExceptionMacro( << "Image and mask sizes differ" );
+    }
+
+  VoxelHistogramOperation histogram( image->GetBufferPointer(), mask != 0 ? mask->GetBufferPointer() : 0 );
+
+  VoxelPass::Pointer pass = VoxelPass::New();
+    pass->SetNumberOfThreads( this->m_NumberOfThreads );
+    pass->AddOperation( &histogram );
+    pass->Execute( numberOfVoxels );
+
+  std::vector< unsigned long > counts;
+  histogram.GetCounts( counts );
+
+  this->m_Minimum = 0;
+  this->m_Maximum = 0;
+
+  bool minimumFound = false;
+
+  for ( unsigned long v=0; v<65536; v++ )
+    {
+    this->m_CumulativeCounts[v+1] = this->m_CumulativeCounts[v] + counts[v];
+
+    if ( counts[v] > 0 )
+      {
+      if ( !minimumFound )
+        {
+        this->m_Minimum = static_cast< PixelType >( static_cast< long >( v ) - 32768 );
+        minimumFound    = true;
+        }
+      this->m_Maximum = static_cast< PixelType >( static_cast< long >( v ) - 32768 );
+      }
+    }
+}
+
+
+/**
+ * This is the computation of OtsuThresholdImageCalculator: each value
+ * goes to the bin it would get there, and the between-class variance
+ * is maximized over the bins in the same order, so the threshold is
+ * the same
+ */
+inline IntensityHistogram::PixelType
+IntensityHistogram
+::ComputeOtsuThreshold( unsigned int numberOfBins ) const
+{
+  const PixelType imageMin = this->m_Minimum;
+  const PixelType imageMax = this->m_Maximum;
+
+  if ( this->GetTotalCount() == 0 || imageMin >= imageMax || numberOfBins == 0 )
+    {
+    return imageMin;
+    }
+
+  std::vector< double > relativeFrequency( numberOfBins, 0.0 );
+
+  const double totalPixels   = static_cast< double >( this->GetTotalCount() );
+  const double binMultiplier = static_cast< double >( numberOfBins )/static_cast< double >( imageMax - imageMin );
+
+  for ( long value=imageMin; value<=imageMax; value++ )
+    {
+    unsigned long count = this->GetCount( static_cast< PixelType >( value ) );
+
+    if ( count == 0 )
+      {
+      continue;
+      }
+
+    unsigned int binNumber;
+
+    if ( value == imageMin )
+      {
+      binNumber = 0;
+      }
+    else
+      {
+      binNumber = static_cast< unsigned int >( std::ceil( (value - imageMin)*binMultiplier ) ) - 1;
+
+      if ( binNumber == numberOfBins )
+        {
+        binNumber -= 1;
+        }
+      }
+
+    relativeFrequency[binNumber] += static_cast< double >( count );
+    }
+
+  for ( unsigned int j=0; j<numberOfBins; j++ )
+    {
+    relativeFrequency[j] /= totalPixels;
+    }
+
+  double totalMean = 0.0;
+  for ( unsigned int j=0; j<numberOfBins; j++ )
+    {
+    totalMean += (j+1)*relativeFrequency[j];
+    }
+
+  //
+  // Maximize the between-class variance
+  //
+  double freqLeft  = relativeFrequency[0];
+  double meanLeft  = 1.0;
+  double meanRight = (totalMean - freqLeft)/(1.0 - freqLeft);
+
+  double maxVarBetween = freqLeft*(1.0 - freqLeft)*(meanLeft - meanRight)*(meanLeft - meanRight);
+  int    maxBinNumber  = 0;
+
+  double freqLeftOld = freqLeft;
+  double meanLeftOld = meanLeft;
+
+  for ( unsigned int j=1; j<numberOfBins; j++ )
+    {
+    freqLeft += relativeFrequency[j];
+    meanLeft  = (meanLeftOld*freqLeftOld + (j+1)*relativeFrequency[j])/freqLeft;
+
+    if ( freqLeft == 1.0 )
+      {
+      meanRight = 0.0;
+      }
+    else
+      {
+      meanRight = (totalMean - meanLeft*freqLeft)/(1.0 - freqLeft);
+      }
+
+    double varBetween = freqLeft*(1.0 - freqLeft)*(meanLeft - meanRight)*(meanLeft - meanRight);
+
+    if ( varBetween > maxVarBetween )
+      {
+      maxVarBetween = varBetween;
+      maxBinNumber  = j;
+      }
+
+    freqLeftOld = freqLeft;
+    meanLeftOld = meanLeft;
+    }
+
+  return static_cast< PixelType >( imageMin + (maxBinNumber + 1)/binMultiplier );
+}
+
+
+/**
+ * Standard "PrintSelf" method
+ */
+inline void
+IntensityHistogram
+::PrintSelf( std::ostream& os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+  os << indent << "NumberOfThreads: " << this->m_NumberOfThreads << std::endl;
+  os << indent << "TotalCount: " << this->GetTotalCount() << std::endl;
+  os << indent << "Minimum: " << this->m_Minimum << std::endl;
+  os << indent << "Maximum: " << this->m_Maximum << std::endl;
+}
+
+} // end namespace itk
+
+#endif
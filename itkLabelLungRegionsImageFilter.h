@@ -19,10 +19,11 @@
 
 #include "itkImageToImageFilter.h"
 #include "itkImage.h"
-#include "itkConnectedComponentImageFilter.h"
-#include "itkRelabelComponentImageFilter.h"
 #include "itkImageRegionIteratorWithIndex.h"
+#include "itkRunLengthLabelMap.h"
+#include "itkConnectedComponentLabeler.h"
 #include "itkLungConventions.h"
+#include <map>
 
 
 namespace itk
@@ -53,6 +54,11 @@ namespace itk
  * lungs being merged/connected), then the output label map will only
  * have WHOLELUNG specified.
  *
+ * The labeling is done on run length encoded copies of the input and
+ * the output (see RunLengthLabelMap), so its cost is proportional to
+ * the number of runs rather than the number of voxels, except for the
+ * encoding of the input and the decoding of the output.
+ *
  * Labeling conforms to the conventions specified in itkLungConventions.h
  */
 class ITK_EXPORT LabelLungRegionsImageFilter :
@@ -131,17 +137,37 @@ public:
 
 protected:
   typedef itk::Image< LabelMapPixelType, 3 >                                   LabelMapType;
-  typedef itk::ConnectedComponentImageFilter< LabelMapType, LabelMapType >     ConnectedComponentType;
-  typedef itk::RelabelComponentImageFilter< LabelMapType, LabelMapType >       RelabelComponentType;
-  typedef itk::ImageRegionIteratorWithIndex< LabelMapType >                    LabelMapIteratorType;
-  typedef itk::ImageRegionConstIterator< InputImageType >                      InputIteratorType;
+  typedef RunLengthLabelMap::LabelCountsType                                   LabelCountsType;
+
+  /** Sets the type (upper byte) of the output label to the type of the
+   *  input label, where the input label has a defined type */
+  struct TypeFunctor
+  {
+    const std::map< unsigned short, unsigned char >*  ValueToTypeMap;
+
+    unsigned short operator()( unsigned short outputValue, unsigned short inputValue ) const
+      {
+        if ( inputValue == 0 )
+          {
+          return outputValue;
+          }
+
+        unsigned char lungType = this->ValueToTypeMap->find( inputValue )->second;
+
+        if ( lungType == UNDEFINEDTYPE )
+          {
+          return outputValue;
+          }
+
+        return static_cast< unsigned short >( (outputValue & 0xFF) | (static_cast< unsigned short >( lungType ) << 8) );
+      }
+  };
 
   LabelLungRegionsImageFilter();
   virtual ~LabelLungRegionsImageFilter() {}
 
-  void SetType( OutputImageType::IndexType, int );
-  bool LabelLeftAndRightLungs();
-  void SetLungThirds();
+  bool LabelLeftAndRightLungs( const RunLengthLabelMap*, const LabelCountsType&, RunLengthLabelMap* );
+  void SetLungThirds( RunLengthLabelMap* );
 
   void GenerateData();
 
@@ -18,7 +18,7 @@
 #define _itkLabelLungRegionsImageFilter_txx
 
 #include "itkLabelLungRegionsImageFilter.h"
-#include "itkImageFileWriter.h"
+#include <algorithm>
 
 
 namespace itk
@@ -49,7 +49,13 @@ LabelLungRegionsImageFilter
     outputPtr->SetBufferedRegion( inputPtr->GetBufferedRegion() );
     outputPtr->SetLargestPossibleRegion( inputPtr->GetLargestPossibleRegion() );
     outputPtr->Allocate();
-    outputPtr->FillBuffer( 0 );
+
+  //
+  // The labeling works on run length encoded label maps. The output
+  // image is only written at the end.
+  //
+  RunLengthLabelMap::Pointer inputRuns = RunLengthLabelMap::New();
+    inputRuns->Encode( this->GetInput() );
 
   //
   // Start by filling the output image with the WHOLELUNG region at
@@ -57,42 +63,19 @@ LabelLungRegionsImageFilter
   // by determining which of the input values correspond to a defined
   // lung region.
   //
-  std::list< unsigned short > inputValuesList;
-
-  InputIteratorType iIt( this->GetInput(), this->GetInput()->GetBufferedRegion() );
-
-  iIt.GoToBegin();
-  while ( !iIt.IsAtEnd() )
-    {
-    if ( iIt.Get() != 0 )
-      {
-      inputValuesList.push_back( iIt.Get() );
-      }
-
-    ++iIt;
-    }
-  
-  inputValuesList.unique();
-  inputValuesList.sort();
-  inputValuesList.unique();
-
-  std::vector< unsigned short > definedLungRegionValuesVec;
-
-  std::list< unsigned short >::iterator listIt;
+  LabelCountsType inputCounts;
+  inputRuns->ComputeLabelCounts( inputCounts );
 
   std::map< unsigned short, unsigned char > valueToTypeMap; 
+  std::map< unsigned short, bool >          definedLungRegionMap;
 
-  for ( listIt = inputValuesList.begin(); listIt != inputValuesList.end(); listIt++ )
+  for ( LabelCountsType::const_iterator countIt = inputCounts.begin(); countIt != inputCounts.end(); ++countIt )
     {
-    unsigned char lungRegion = this->m_LungConventions.GetLungRegionFromValue( *listIt );
-    unsigned char lungType   = this->m_LungConventions.GetLungTypeFromValue( *listIt );
-
-    valueToTypeMap[ *listIt ] = lungType;
+    unsigned char lungRegion = this->m_LungConventions.GetLungRegionFromValue( countIt->first );
+    unsigned char lungType   = this->m_LungConventions.GetLungTypeFromValue( countIt->first );
 
-    if ( lungRegion != 0 )
-      {
-      definedLungRegionValuesVec.push_back( *listIt );
-      }
+    valueToTypeMap[ countIt->first ]       = lungType;
+    definedLungRegionMap[ countIt->first ] = ( lungRegion != 0 );
     }
 
   //
@@ -102,129 +85,50 @@ LabelLungRegionsImageFilter
   //
   unsigned short wholeLungLabel = this->m_LungConventions.GetValueFromLungRegionAndType( WHOLELUNG, UNDEFINEDTYPE );
 
-  LabelMapIteratorType oIt( this->GetOutput(), this->GetOutput()->GetBufferedRegion() );
+  RunLengthLabelMap::Pointer outputRuns = RunLengthLabelMap::New();
+    outputRuns->DeepCopy( inputRuns );
+
+  RunLengthLabelMap::RunIterator oIt( outputRuns );
 
   oIt.GoToBegin();
-  iIt.GoToBegin();
   while ( !oIt.IsAtEnd() )
     {
-    if ( iIt.Get() != 0 )
+    if ( definedLungRegionMap[oIt.GetLabel()] )
       {
-      for ( unsigned int i=0; i<definedLungRegionValuesVec.size(); i++ )
-        {
-        if ( iIt.Get() == definedLungRegionValuesVec[i] )
-          {
-          oIt.Set( wholeLungLabel );
+      oIt.SetLabel( wholeLungLabel );
 
-          this->m_NumberLungVoxels++;
-          }
-        }
+      this->m_NumberLungVoxels += oIt.GetLength();
       }
-
-    ++oIt;
-    ++iIt;
-    }
-
-  if ( this->m_LabelLungThirds || this->m_LabelLeftAndRightLungs )
-    {
-    this->m_LabelingSuccess = this->LabelLeftAndRightLungs();
-    }
-  if ( this->m_LabelLungThirds && this->m_LabelingSuccess )
-    {
-    this->SetLungThirds();
-    }
-
-  //
-  // Now set the types from the input image 
-  //
-  iIt.GoToBegin();
-  oIt.GoToBegin();
-  while ( !oIt.IsAtEnd() )
-    {
-    if ( iIt.Get() != 0 )
+    else
       {
-      unsigned short lungTypeValue = valueToTypeMap[iIt.Get()];
-
-      if ( lungTypeValue != UNDEFINEDTYPE )
-        {
-        this->SetType( oIt.GetIndex(), lungTypeValue ); 
-        }
+      oIt.SetLabel( 0 );
       }
 
-    ++iIt;
     ++oIt;
     }
-}
-
-
-void
-LabelLungRegionsImageFilter
-::SetType( OutputImageType::IndexType index, int lungTypeValue )
-{
-  unsigned short currentValue = this->GetOutput()->GetPixel( index );
-
-  //
-  // Get the binary representation of the current value
-  //
-  int currentPlaces[16];
-  for ( int i=0; i<16; i++ )
-    {
-    currentPlaces[i] = 0;
-    }
 
-  for ( int i=15; i>=0; i-- )
-    {
-    int power = static_cast< int >( pow( 2, i ) );
+  outputRuns->Compact();
 
-    if ( power <= currentValue )
-      {
-      currentPlaces[i] = 1;
-      
-      currentValue = currentValue % power;
-      }
-    }
-
-  //
-  // Get the binary representation of the type to set
-  //
-  int typeValue = lungTypeValue;
-
-  int typePlaces[8];
-  for ( int i=0; i<8; i++ )
+  if ( this->m_LabelLungThirds || this->m_LabelLeftAndRightLungs )
     {
-    typePlaces[i] = 0;
+    this->m_LabelingSuccess = this->LabelLeftAndRightLungs( inputRuns, inputCounts, outputRuns );
     }
-
-  for ( int i=7; i>=0; i-- )
+  if ( this->m_LabelLungThirds && this->m_LabelingSuccess )
     {
-    int power = static_cast< int >( pow( 2, i ) );
-
-    if ( power <= typeValue )
-      {
-      typePlaces[i] = 1;
-      
-      typeValue = typeValue % power;
-      }
+    this->SetLungThirds( outputRuns );
     }
 
   //
-  // Compute the new value to assign to the label map voxel 
+  // Now set the types from the input image: the type of every voxel
+  // whose input value has a defined type goes to the upper byte of its
+  // output value
   //
-  unsigned short newValue = 0;
+  TypeFunctor setType;
+    setType.ValueToTypeMap = &valueToTypeMap;
 
-  for ( int i=0; i<16; i++ )
-    {
-    if ( i < 8 )
-      {
-      newValue += static_cast< unsigned short >( currentPlaces[i] )*static_cast< unsigned short >( pow( 2, i ) );
-      }
-    else
-      {
-      newValue += static_cast< unsigned short >( typePlaces[i-8] )*static_cast< unsigned short >( pow( 2, i ) );
-      }
-    }
+  outputRuns->Combine( outputRuns, inputRuns, setType );
 
-  this->GetOutput()->SetPixel( index, newValue );
+  outputRuns->Decode( this->GetOutput() );
 }
 
 
@@ -233,158 +137,86 @@ LabelLungRegionsImageFilter
  */
 bool
 LabelLungRegionsImageFilter
-::LabelLeftAndRightLungs()
+::LabelLeftAndRightLungs( const RunLengthLabelMap* inputRuns, const LabelCountsType& inputCounts, RunLengthLabelMap* outputRuns )
 {
-  typedef itk::ImageFileWriter< LabelMapType > WriterType;
-
   //
   // First test if the input is already split into left and right. For
   // this condition to be true, all voxel regions must be labeled as
   // either left or right. If this is true, simply transfer the labels
   // to the output image.  
   //
-  InputIteratorType iIt( this->GetInput(), this->GetInput()->GetBufferedRegion() );
-  LabelMapIteratorType oIt( this->GetOutput(), this->GetOutput()->GetBufferedRegion() );
-
   bool leftLungFound     = false;
   bool rightLungFound    = false;
   bool nonLeftRightFound = false;
 
-  iIt.GoToBegin();
-  while ( !iIt.IsAtEnd() )
+  for ( LabelCountsType::const_iterator countIt = inputCounts.begin(); countIt != inputCounts.end(); ++countIt )
     {
-    if ( iIt.Get() != 0 )
+    if ( countIt->first == static_cast< unsigned short >( LEFTLUNG ) )
       {
-      if ( iIt.Get() == static_cast< unsigned short >( LEFTLUNG ) )
-        {
-        leftLungFound = true;
-        }
-      else if ( iIt.Get() == static_cast< unsigned short >( RIGHTLUNG ) )
-        {
-        rightLungFound = true;
-        }
-      else
-        {
-        nonLeftRightFound = true;
-        }
+      leftLungFound = true;
+      }
+    else if ( countIt->first == static_cast< unsigned short >( RIGHTLUNG ) )
+      {
+      rightLungFound = true;
+      }
+    else
+      {
+      nonLeftRightFound = true;
       }
-
-    ++iIt;
     }
 
   if ( leftLungFound && rightLungFound && !nonLeftRightFound )
     {
-    oIt.GoToBegin();
-    iIt.GoToBegin();
-    while ( !oIt.IsAtEnd() )
-      {
-      oIt.Set( iIt.Get() );
-
-      ++oIt;
-      ++iIt;
-      }
+    outputRuns->DeepCopy( inputRuns );
 
 //    std::cout << "---Appears to already be left lung / right lung..." << std::endl;
 
     return true;
     }
 
-  LabelMapType::SizeType size = this->GetInput()->GetBufferedRegion().GetSize();
-
   //
   // Perform connected component analysis.
   //
-  ConnectedComponentType::Pointer connectedComponent = ConnectedComponentType::New();
-    connectedComponent->SetInput( this->GetOutput() );
-    connectedComponent->FullyConnectedOn();
-    connectedComponent->Update();
+  ConnectedComponentLabeler::Pointer labeler = ConnectedComponentLabeler::New( this->GetNumberOfThreads(), true );
+    labeler->Execute( outputRuns );
 
-  RelabelComponentType::Pointer relabelComponent = RelabelComponentType::New();
-    relabelComponent->SetInput( connectedComponent->GetOutput() );
-    relabelComponent->Update();
+  unsigned long numberOfComponents = labeler->GetNumberOfComponents();
 
-  if ( relabelComponent->GetNumberOfObjects() <= 1 )
+  if ( numberOfComponents <= 1 )
     {
 //    std::cout << "---Only found one component..." << std::endl;
     return false;
     }
 
   //
-  // The following containter will keep track of the x-coordinates for
-  // all the components. Once tallied, we'll determine the center of
-  // mass along the x-direction for each component. We will then
-  // assign each component to left or right depending on whether it is
-  // closer to the left or right edge of the bounding box.
-  //
-  std::vector< std::vector< unsigned short > > componentLocations;
-
-  //
-  // Begin by initializing the container. We want to have a vector for
-  // each component in order to contain the x coordinates for each
-  // component. 
-  //
-  for ( unsigned int i=0; i<relabelComponent->GetNumberOfObjects(); i++ )
-    {
-    std::vector< unsigned short > temp;
-    componentLocations.push_back( temp );
-    }
-
-  //
-  // Now loop over the relabled image and collect the x-coordinates for
-  // each of the components. At the same time, determine the min and
-  // max x coordinates.
+  // The bounding boxes of the components give the min and max x
+  // coordinates of the foreground. We will assign each component to
+  // left or right depending on whether its center of mass along the
+  // x-direction is closer to the left or right edge of the bounding
+  // box.
   //
-  unsigned short minX = size[0];
-  unsigned short maxX = 0;
-
-  LabelMapIteratorType rIt( relabelComponent->GetOutput(), relabelComponent->GetOutput()->GetBufferedRegion() );
+  long minX = labeler->GetComponent( 1 ).BoundingBox.GetIndex()[0];
+  long maxX = 0;
 
-//  std::cout << "---Writing relabeler..." << std::endl;
-//   WriterType::Pointer writer1 = WriterType::New();
-//   writer1->SetInput( relabelComponent->GetOutput() );
-//   writer1->SetFileName( "/projects/lmi/people/jross/tmp/relabeler.nhdr" );
-//   writer1->UseCompressionOn();
-//   writer1->Update();
-
-  rIt.GoToBegin();
-  while ( !rIt.IsAtEnd() )
+  for ( unsigned long i=1; i<=numberOfComponents; i++ )
     {
-    if ( rIt.Get() != 0 )
-      {
-      componentLocations[rIt.Get()-1].push_back( rIt.GetIndex()[0] );
+    const ConnectedComponentLabeler::RegionType& boundingBox = labeler->GetComponent( i ).BoundingBox;
 
-      if ( rIt.GetIndex()[0] < minX )
-        {
-        minX = rIt.GetIndex()[0];
-        }
-      if ( rIt.GetIndex()[0] > maxX )
-        {
-        maxX = rIt.GetIndex()[0];
-        }
-      }
-
-    ++rIt;
+    minX = std::min( minX, static_cast< long >( boundingBox.GetIndex()[0] ) );
+    maxX = std::max( maxX, static_cast< long >( boundingBox.GetIndex()[0] + boundingBox.GetSize()[0] - 1 ) );
     }
   
 //   std::cout << "---Min x:\t" << minX << std::endl;
 //   std::cout << "---Max x:\t" << maxX << std::endl;
 
   //
-  // Now compute the center of mass for each component and assign lung
-  // region values for each component value
+  // Now assign lung region values for each component label
   //
-  std::map<unsigned short, unsigned char> componentToLungRegionMap;
+  std::vector< unsigned char > componentToLungRegion( numberOfComponents+1 );
 
-  for ( unsigned int i=0; i<relabelComponent->GetNumberOfObjects(); i++ )
+  for ( unsigned int i=1; i<=numberOfComponents; i++ )
     {
-    double xInc = 0;
-
-    for ( unsigned int x=0; x<componentLocations[i].size(); x++ )
-      {
-      xInc += static_cast< double >( componentLocations[i][x] );
-      }
-
-    double massCenter = xInc/static_cast<double>(componentLocations[i].size());
+    double massCenter = labeler->GetComponent( i ).Centroid[0];
 
     //
     // We'll assign the component as left or right lung depending on
@@ -394,24 +226,22 @@ LabelLungRegionsImageFilter
       {
       if ( vcl_abs(massCenter-static_cast<double>(minX)) <= vcl_abs(massCenter-static_cast<double>(maxX)) )
         {
-//        std::cout << "---Setting component " << i+1 << " to right lung (mass center is: " << massCenter << "..." << std::endl;
-        componentToLungRegionMap[i+1] = static_cast<unsigned char>(RIGHTLUNG);
+        componentToLungRegion[i] = static_cast<unsigned char>(RIGHTLUNG);
         }
       else
         {
-//        std::cout << "---Setting component " << i+1 << " to left lung (mass center is: " << massCenter << "..." << std::endl;
-        componentToLungRegionMap[i+1] = static_cast<unsigned char>(LEFTLUNG);
+        componentToLungRegion[i] = static_cast<unsigned char>(LEFTLUNG);
         }
       }
     else
       {
       if ( vcl_abs(massCenter-static_cast<double>(minX)) <= vcl_abs(massCenter-static_cast<double>(maxX)) )
         {
-        componentToLungRegionMap[i+1] = static_cast<unsigned char>(LEFTLUNG);
+        componentToLungRegion[i] = static_cast<unsigned char>(LEFTLUNG);
         }
       else
         {
-        componentToLungRegionMap[i+1] = static_cast<unsigned char>(RIGHTLUNG);
+        componentToLungRegion[i] = static_cast<unsigned char>(RIGHTLUNG);
         }
       }
     }
@@ -423,39 +253,24 @@ LabelLungRegionsImageFilter
   unsigned short rightLungLabel = this->m_LungConventions.GetValueFromLungRegionAndType( RIGHTLUNG, UNDEFINEDTYPE );
   unsigned short leftLungLabel  = this->m_LungConventions.GetValueFromLungRegionAndType( LEFTLUNG, UNDEFINEDTYPE );
 
-//   std::cout << "---Right lung label:\t" << rightLungLabel << std::endl;
-//   std::cout << "---Left lung label:\t" << leftLungLabel << std::endl;
+  RunLengthLabelMap::RunIterator oIt( outputRuns );
 
-  rIt.GoToBegin();
   oIt.GoToBegin();
   while ( !oIt.IsAtEnd() )
     {
-    if ( rIt.Get() != 0 )
+    if ( componentToLungRegion[labeler->GetRunLabel( oIt.GetRunNumber() )] == static_cast<unsigned char>(LEFTLUNG) )
       {
-      if ( componentToLungRegionMap[rIt.Get()] == static_cast<unsigned char>(LEFTLUNG) )
-        {
-        oIt.Set( leftLungLabel );
-        }
-      else if ( componentToLungRegionMap[rIt.Get()] == static_cast<unsigned char>(RIGHTLUNG) )
-        {
-        oIt.Set( rightLungLabel );
-        }
+      oIt.SetLabel( leftLungLabel );
       }
     else
       {
-      oIt.Set( 0 );
+      oIt.SetLabel( rightLungLabel );
       }
 
-    ++rIt;
     ++oIt;
     }
 
-//   std::cout << "---Writing output before returning from itkLabelLungRegions..." << std::endl;
-//   WriterType::Pointer writer2 = WriterType::New();
-//   writer2->SetInput( this->GetOutput() );
-//   writer2->UseCompressionOn();
-//   writer2->SetFileName( "/projects/lmi/people/jross/tmp/atEndOfLabelingProcess.nhdr" );
-//   writer2->Update();
+  outputRuns->Compact();
 
   return true;
 }
@@ -463,11 +278,12 @@ LabelLungRegionsImageFilter
 
 /**
  * Entering this method, the left and right lung designations have
- * been made.
+ * been made. The lung voxels are split into thirds in buffer order
+ * (along the last axis), so a run may be split between two thirds.
  */
 void
 LabelLungRegionsImageFilter
-::SetLungThirds() 
+::SetLungThirds( RunLengthLabelMap* outputRuns ) 
 {
   unsigned short leftLowerThirdLabel   = this->m_LungConventions.GetValueFromLungRegionAndType( LEFTLOWERTHIRD, UNDEFINEDTYPE );
   unsigned short rightLowerThirdLabel  = this->m_LungConventions.GetValueFromLungRegionAndType( RIGHTLOWERTHIRD, UNDEFINEDTYPE );
@@ -476,82 +292,84 @@ LabelLungRegionsImageFilter
   unsigned short leftUpperThirdLabel   = this->m_LungConventions.GetValueFromLungRegionAndType( LEFTUPPERTHIRD, UNDEFINEDTYPE );
   unsigned short rightUpperThirdLabel  = this->m_LungConventions.GetValueFromLungRegionAndType( RIGHTUPPERTHIRD, UNDEFINEDTYPE );
 
-  int voxelTally = 0;
+  //
+  // Labels of the first, second and last thirds of the lung voxels
+  //
+  unsigned short leftThirdLabels[3];
+  unsigned short rightThirdLabels[3];
 
-  LabelMapIteratorType oIt( this->GetOutput(), this->GetOutput()->GetBufferedRegion() );
+  leftThirdLabels[0]  = this->m_HeadFirst ? leftLowerThirdLabel : leftUpperThirdLabel;
+  rightThirdLabels[0] = this->m_HeadFirst ? rightLowerThirdLabel : rightUpperThirdLabel;
+  leftThirdLabels[1]  = leftMiddleThirdLabel;
+  rightThirdLabels[1] = rightMiddleThirdLabel;
+  leftThirdLabels[2]  = this->m_HeadFirst ? leftUpperThirdLabel : leftLowerThirdLabel;
+  rightThirdLabels[2] = this->m_HeadFirst ? rightUpperThirdLabel : rightLowerThirdLabel;
 
-  oIt.GoToBegin();
-  while ( !oIt.IsAtEnd() )
+  const long firstThirdEnd  = this->m_NumberLungVoxels/3;
+  const long secondThirdEnd = 2*this->m_NumberLungVoxels/3;
+
+  long voxelTally = 0;
+
+  RunLengthLabelMap::Pointer thirdsRuns = RunLengthLabelMap::New();
+    thirdsRuns->Initialize( outputRuns->GetRegion() );
+
+  for ( unsigned long row=0; row<outputRuns->GetNumberOfRows(); row++ )
     {
-    if ( oIt.Get() != 0 )
+    for ( unsigned long r=outputRuns->GetRowBegin( row ); r<outputRuns->GetRowEnd( row ); r++ )
       {
-      voxelTally++;
+      const RunLengthLabelMap::RunType& run = outputRuns->GetRun( r );
+
+      unsigned int x         = run.X;
+      long         remaining = run.Length;
 
-      if ( voxelTally <= this->m_NumberLungVoxels/3 )
+      while ( remaining > 0 )
         {
-        if ( this->m_HeadFirst )
+        //
+        // Third of the next voxel and tally at which that third ends
+        //
+        unsigned int third;
+        long         thirdEnd;
+
+        if ( voxelTally + 1 <= firstThirdEnd )
           {
-          if ( oIt.Get() == LEFTLUNG )
-            {
-            oIt.Set( leftLowerThirdLabel );
-            }
-          if ( oIt.Get() == RIGHTLUNG )
-            {
-            oIt.Set( rightLowerThirdLabel );
-            }
+          third    = 0;
+          thirdEnd = firstThirdEnd;
           }
-        else
+        else if ( voxelTally + 1 <= secondThirdEnd )
           {
-          if ( oIt.Get() == LEFTLUNG )
-            {
-            oIt.Set( leftUpperThirdLabel );
-            }
-          if ( oIt.Get() == RIGHTLUNG )
-            {
-            oIt.Set( rightUpperThirdLabel );
-            }
+          third    = 1;
+          thirdEnd = secondThirdEnd;
           }
-        }
-      else if ( voxelTally <= 2*this->m_NumberLungVoxels/3 )
-        {
-        if ( oIt.Get() == LEFTLUNG )
-          {
-          oIt.Set( leftMiddleThirdLabel );
-          }
-        if ( oIt.Get() == RIGHTLUNG )
+        else
           {
-          oIt.Set( rightMiddleThirdLabel );
+          third    = 2;
+          thirdEnd = voxelTally + remaining;
           }
-        }
-      else
-        {
-        if ( this->m_HeadFirst )
+
+        long length = std::min( remaining, thirdEnd - voxelTally );
+
+        unsigned short label = run.Label;
+        if ( label == LEFTLUNG )
           {
-          if ( oIt.Get() == LEFTLUNG )
-            {
-            oIt.Set( leftUpperThirdLabel );
-            }
-          if ( oIt.Get() == RIGHTLUNG )
-            {
-            oIt.Set( rightUpperThirdLabel );
-            }
+          label = leftThirdLabels[third];
           }
-        else
+        else if ( label == RIGHTLUNG )
           {
-          if ( oIt.Get() == LEFTLUNG )
-            {
-            oIt.Set( leftLowerThirdLabel );
-            }
-          if ( oIt.Get() == RIGHTLUNG )
-            {
-            oIt.Set( rightLowerThirdLabel );
-            }
+          label = rightThirdLabels[third];
           }
+
+        thirdsRuns->AddRun( x, length, label );
+
+        x          += length;
+        remaining  -= length;
+        voxelTally += length;
         }
       }
 
-    ++oIt;
+    thirdsRuns->EndRow();
     }
+
+  outputRuns->DeepCopy( thirdsRuns );
 }
 
   
@@ -0,0 +1,116 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkMinCostSeamSolver.h,v $
+  Language:  C++
+  Date:      $Date: 2012/09/04 20:23:08 $
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkMinCostSeamSolver_h
+#define __itkMinCostSeamSolver_h
+
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+#include "itkImageRegion.h"
+#include "itkIndex.h"
+#include <utility>
+#include <vector>
+
+
+namespace itk
+{
+/** \class MinCostSeamSolver
+ * \brief Minimum cost path between two pixels of a 2D cost buffer,
+ * among the 8-connected paths that never go up (decreasing y). The
+ * cost of a path is the sum of the costs of its pixels, as with
+ * DijkstraMinCostPathGraphToGraphFilter on a graph whose node weights
+ * are the pixel costs.
+ *
+ * The path is found by dynamic programming over the rows: a pixel is
+ * reached from one of the three pixels above it, then from its left
+ * or right neighbor in the row. Each row is swept three times, so
+ * the cost is linear in the number of pixels and no graph is built.
+ * When the best path has to go up (around an obstacle), the seam is
+ * only the best path that does not, and a graph search is needed.
+ *
+ * The seam can be restricted to a band, given as an interval of x
+ * per row. Only the pixels of the band are then visited.
+ */
+class ITK_EXPORT MinCostSeamSolver : public Object
+{
+public:
+  /** Standard class typedefs. */
+  typedef MinCostSeamSolver           Self;
+  typedef Object                      Superclass;
+  typedef SmartPointer< Self >        Pointer;
+  typedef SmartPointer< const Self >  ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro( Self );
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro( MinCostSeamSolver, Object );
+
+  typedef ImageRegion< 2 >          RegionType;
+  typedef Index< 2 >                IndexType;
+  typedef std::vector< IndexType >  PathType;
+
+  /** First and last x of the band in each row, from the row of the
+   *  start to the row of the end */
+  typedef std::vector< std::pair< long, long > >  BandType;
+
+  /** Find the seam from 'start' to 'end'. 'costs' is a buffer
+   *  covering 'region', with nonnegative costs. 'end' must not be
+   *  above 'start'. If 'band' is given, the seam stays within it
+   *  (clipped to the region). Returns false, with an empty path, if
+   *  no seam within the band joins 'start' to 'end'. */
+  bool Compute( const float* costs, const RegionType& region, const IndexType& start, const IndexType& end,
+                const BandType* band = 0 );
+
+  /** Pixels of the seam, from the end to the start (the order of the
+   *  path of DijkstraMinCostPathGraphToGraphFilter) */
+  const PathType & GetPath() const
+    {
+      return this->m_Path;
+    }
+
+  /** Sum of the costs of the pixels of the seam */
+  itkGetConstMacro( PathCost, double );
+
+protected:
+  MinCostSeamSolver();
+  virtual ~MinCostSeamSolver() {}
+
+  void PrintSelf( std::ostream& os, Indent indent ) const;
+
+  /** How a pixel of the seam is reached */
+  enum MoveType { START, UP_LEFT, UP, UP_RIGHT, LEFT, RIGHT };
+
+  /** Reach the pixels of a row from their left and right neighbors
+   *  where it is cheaper than the way they were reached */
+  static void SweepRow( const float* costs, double* accumulated, unsigned char* moves, long width );
+
+private:
+  MinCostSeamSolver( const Self& ); //purposely not implemented
+  void operator=( const Self& ); //purposely not implemented
+
+  PathType                      m_Path;
+  double                        m_PathCost;
+  std::vector< unsigned char >  m_Moves;
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkMinCostSeamSolver.txx"
+#endif
+
+#endif
@@ -0,0 +1,248 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkMinCostSeamSolver.txx,v $
+  Language:  C++
+  Date:      $Date: 2012/09/04 20:23:08 $
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef _itkMinCostSeamSolver_txx
+#define _itkMinCostSeamSolver_txx
+
+#include "itkMinCostSeamSolver.h"
+#include "itkNumericTraits.h"
+#include "itkWorkCounters.h"
+#include "vnl/vnl_math.h"
+
+
+namespace itk
+{
+
+inline
+MinCostSeamSolver
+::MinCostSeamSolver()
+{
+  this->m_PathCost = 0.0;
+}
+
+
+inline bool
+MinCostSeamSolver
+::Compute( const float* costs, const RegionType& region, const IndexType& start, const IndexType& end,
+           const BandType* band )
+{
+  this->m_Path.clear();
+  this->m_PathCost = 0.0;
+
+  if ( !region.IsInside( start ) || !region.IsInside( end ) || end[1] < start[1] )
+    {
+    itkExceptionMacro( << "Seam end points must be inside the region, the end not above the start" );
+    }
+
+  const long width  = region.GetSize()[0];
+  const long startX = start[0] - region.GetIndex()[0];
+  const long endX   = end[0] - region.GetIndex()[0];
+
+  const long numberOfRows = end[1] - start[1] + 1;
+
+  if ( band != 0 && static_cast< long >( band->size() ) != numberOfRows )
+    {
+    itkExceptionMacro( << "The band must have one interval per row of the seam" );
+    }
+
+  //
+  // First and last x of each row, relative to the region
+  //
+  std::vector< long > firstX( numberOfRows, 0 );
+  std::vector< long > lastX( numberOfRows, width-1 );
+
+  if ( band != 0 )
+    {
+    for ( long r=0; r<numberOfRows; r++ )
+      {
+      firstX[r] = vnl_math_max( (*band)[r].first - region.GetIndex()[0], 0L );
+      lastX[r]  = vnl_math_min( (*band)[r].second - region.GetIndex()[0], width-1 );
+      }
+    }
+
+  if ( startX < firstX[0] || startX > lastX[0] || endX < firstX[numberOfRows-1] || endX > lastX[numberOfRows-1] )
+    {
+    return false;
+    }
+
+  const double infinity = NumericTraits< double >::max();
+
+  const float* rowCosts = costs + (start[1] - region.GetIndex()[1])*width;
+
+  this->m_Moves.resize( numberOfRows*width );
+
+  std::vector< double > previous( width, infinity );
+  std::vector< double > current( width, infinity );
+
+  unsigned long numPixelsVisited = lastX[0] - firstX[0] + 1;
+
+  //
+  // In the first row, the seam can only start at 'start' and move
+  // along the row
+  //
+  previous[startX] = rowCosts[startX];
+  this->m_Moves[startX] = START;
+
+  SweepRow( rowCosts + firstX[0], &previous[firstX[0]], &this->m_Moves[firstX[0]], lastX[0] - firstX[0] + 1 );
+
+  for ( long r=1; r<numberOfRows; r++ )
+    {
+    rowCosts += width;
+
+    unsigned char* moves = &this->m_Moves[r*width];
+
+    for ( long x=firstX[r]; x<=lastX[r]; x++ )
+      {
+      double        best = previous[x];
+      unsigned char move = UP;
+
+      if ( x > 0 && previous[x-1] < best )
+        {
+        best = previous[x-1];
+        move = UP_LEFT;
+        }
+      if ( x < width-1 && previous[x+1] < best )
+        {
+        best = previous[x+1];
+        move = UP_RIGHT;
+        }
+
+      current[x] = best < infinity ? best + rowCosts[x] : infinity;
+      moves[x]   = move;
+      }
+
+    SweepRow( rowCosts + firstX[r], &current[firstX[r]], moves + firstX[r], lastX[r] - firstX[r] + 1 );
+
+    numPixelsVisited += lastX[r] - firstX[r] + 1;
+
+    previous.swap( current );
+
+    //
+    // Pixels out of the band are unreachable: only those of the band
+    // of the row before need resetting
+    //
+    for ( long x=firstX[r-1]; x<=lastX[r-1]; x++ )
+      {
+      current[x] = infinity;
+      }
+    }
+
+  WorkCounters::Add( "MinCostSeamSolver.Searches" );
+  WorkCounters::Add( "MinCostSeamSolver.PixelsVisited", numPixelsVisited );
+
+  if ( previous[endX] == infinity )
+    {
+    return false;
+    }
+
+  this->m_PathCost = previous[endX];
+
+  //
+  // Back-track from the end to the start
+  //
+  long x = endX;
+  long r = numberOfRows - 1;
+
+  IndexType index;
+
+  while ( true )
+    {
+    index[0] = region.GetIndex()[0] + x;
+    index[1] = start[1] + r;
+
+    this->m_Path.push_back( index );
+
+    unsigned char move = this->m_Moves[r*width + x];
+
+    if ( move == START )
+      {
+      break;
+      }
+
+    switch ( move )
+      {
+      case UP_LEFT:
+        x--;
+        r--;
+        break;
+      case UP:
+        r--;
+        break;
+      case UP_RIGHT:
+        x++;
+        r--;
+        break;
+      case LEFT:
+        x--;
+        break;
+      default:
+        x++;
+        break;
+      }
+    }
+
+  return true;
+}
+
+
+/**
+ * A seam never moves back along a row (costs are nonnegative), so a
+ * left-to-right sweep followed by a right-to-left sweep finds the
+ * cheapest way to reach each pixel from the row above
+ */
+inline void
+MinCostSeamSolver
+::SweepRow( const float* costs, double* accumulated, unsigned char* moves, long width )
+{
+  for ( long x=1; x<width; x++ )
+    {
+    double fromLeft = accumulated[x-1] + costs[x];
+
+    if ( fromLeft < accumulated[x] )
+      {
+      accumulated[x] = fromLeft;
+      moves[x]       = LEFT;
+      }
+    }
+
+  for ( long x=width-2; x>=0; x-- )
+    {
+    double fromRight = accumulated[x+1] + costs[x];
+
+    if ( fromRight < accumulated[x] )
+      {
+      accumulated[x] = fromRight;
+      moves[x]       = RIGHT;
+      }
+    }
+}
+
+
+/**
+ * Standard "PrintSelf" method
+ */
+inline void
+MinCostSeamSolver
+::PrintSelf( std::ostream& os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+  os << indent << "PathLength: " << this->m_Path.size() << std::endl;
+  os << indent << "PathCost: " << this->m_PathCost << std::endl;
+}
+
+} // end namespace itk
+
+#endif
@@ -24,15 +24,30 @@
 #include "itkSplitLeftAndRightLungsImageFilter.h"
 #include "itkLabelLungRegionsImageFilter.h"
 #include "itkAutoThresholdAirwaySegmentationImageFilter.h"
+#include "itkTracheaSeedDetector.h"
+#include "itkPipelineProfiler.h"
+#include "itkWorkCounters.h"
+#include "itkVoxelNeighborhood.h"
+#include "itkSquaredDistanceTransform.h"
+#include "itkStageCheckpointCache.h"
+#include "itkVoxelPass.h"
+#include "itkRunLengthLabelMap.h"
+#include "itkConnectedComponentLabeler.h"
+#include "itkIntensityHistogram.h"
 #include "itkOtsuThresholdImageFilter.h"
 #include "itkConnectedComponentImageFilter.h"
 #include "itkRelabelComponentImageFilter.h"
 #include "itkImageRegionIteratorWithIndex.h"
 #include "itkExtractImageFilter.h"
+#include "itkRegionOfInterestImageFilter.h"
 #include "itkBinaryDilateImageFilter.h"
 #include "itkBinaryBallStructuringElement.h"
 #include "itkBinaryThresholdImageFilter.h"
 #include "itkBinaryErodeImageFilter.h"
+#include "itkMultiThreader.h"
+#include <algorithm>
+#include <deque>
+#include <vector>
 
 
 namespace itk
@@ -79,6 +94,7 @@ public:
   typedef typename InputImageType::RegionType          InputImageRegionType;
   typedef typename OutputImageType::RegionType         OutputImageRegionType;
   typedef typename InputImageType::SizeType            InputSizeType;
+  typedef itk::Image< LabelMapPixelType, 3 >           LabelMapType;
 
   /** Reasonable airway segmentations have been empiracally found to
       have volumes of at least 10.0 cc (default).  The value set by
@@ -125,6 +141,91 @@ public:
   itkSetMacro( MaxAirwayVolumeIncreaseRate, double );
   itkGetMacro( MaxAirwayVolumeIncreaseRate, double );
 
+  /** Set to true to segment the airways with a priority flood that
+   *  computes the airway volume versus threshold curve in one pass
+   *  (see AutoThresholdAirwaySegmentationImageFilter). False by
+   *  default */
+  itkSetMacro( UseAirwayPriorityFlood, bool );
+  itkGetMacro( UseAirwayPriorityFlood, bool );
+
+  /** When greater than 1, the airways are first segmented on a copy
+   *  of the input shrunk by this factor and then refined at full
+   *  resolution near the coarse result (see
+   *  AutoThresholdAirwaySegmentationImageFilter). Default is 1 (off) */
+  itkSetMacro( AirwayCoarseToFineShrinkFactor, unsigned int );
+  itkGetMacro( AirwayCoarseToFineShrinkFactor, unsigned int );
+
+  /** Set to true to run every stage after the Otsu threshold (or the
+   *  helper mask) on the bounding box of the thresholded lungs
+   *  only. The box is padded by 'LungBoundingBoxPadding' voxels (and
+   *  at least by the closing neighborhood plus one, so that closing
+   *  is not affected by the crop). The result is pasted back into the
+   *  full size output at the end. False by default */
+  itkSetMacro( UseLungBoundingBox, bool );
+  itkGetMacro( UseLungBoundingBox, bool );
+  itkBooleanMacro( UseLungBoundingBox );
+
+  /** Padding (in voxels) of the lung bounding box. Default is 10 */
+  itkSetMacro( LungBoundingBoxPadding, unsigned int );
+  itkGetMacro( LungBoundingBoxPadding, unsigned int );
+
+  /** Get the lung bounding box (in the index space of the input) used
+   *  by the last update. This is the whole buffered region of the
+   *  input if 'UseLungBoundingBox' is false. */
+  itkGetConstReferenceMacro( LungBoundingBox, OutputImageRegionType );
+
+  /** Set to true to close the lung labels by thresholding exact
+   *  Euclidean distance maps instead of dilating and eroding with a
+   *  ball structuring element, so that the cost does not depend on
+   *  the closing radius. This is an approximate closing. Its
+   *  structuring element is the set of voxel offsets inside the
+   *  ellipsoid with semi-axes 'ClosingRadius' over the spacing (or the
+   *  closing neighborhood plus half a voxel if 'ClosingRadius' is 0),
+   *  not the ball built from the integer closing neighborhood. The
+   *  two elements differ near their surface, and so may the closings
+   *  where the lungs come within about the closing radius of
+   *  themselves. False by default */
+  itkSetMacro( UseDistanceTransformClosing, bool );
+  itkGetMacro( UseDistanceTransformClosing, bool );
+  itkBooleanMacro( UseDistanceTransformClosing );
+
+  /** Radius (in mm) of the ball used for closing when
+   *  'UseDistanceTransformClosing' is true. The ball is taken in
+   *  physical space, so anisotropic spacing is honored exactly. If
+   *  the radius is 0 (default), the ball of the closing neighborhood
+   *  is used instead */
+  itkSetMacro( ClosingRadius, double );
+  itkGetMacro( ClosingRadius, double );
+
+  /** Set to true to close the left and right lungs concurrently, each
+   *  with half of the threads. The result is the same as closing them
+   *  one after the other. False by default */
+  itkSetMacro( ConcurrentClosing, bool );
+  itkGetMacro( ConcurrentClosing, bool );
+  itkBooleanMacro( ConcurrentClosing );
+
+  /** Set to true to expand large conditional dilation wavefronts
+   *  with multiple threads (see SetNumberOfThreads). The result does
+   *  not depend on the number of threads. False by default */
+  itkSetMacro( ParallelConditionalDilation, bool );
+  itkGetMacro( ParallelConditionalDilation, bool );
+  itkBooleanMacro( ParallelConditionalDilation );
+
+  /** The profiler records the wall and CPU time of every stage of
+   *  GenerateData (Otsu thresholding, airway growing, etc.). It is
+   *  reset at the start of each update. A profiler may be shared with
+   *  other filters by setting it. */
+  itkSetObjectMacro( Profiler, PipelineProfiler );
+  itkGetObjectMacro( Profiler, PipelineProfiler );
+
+  /** When a checkpoint cache is set, the lung mask (Otsu threshold or
+   *  helper mask) and the lung mask without the airways are loaded
+   *  from the cache if they were stored by an earlier update with the
+   *  same input and the same parameters for those stages, and stored
+   *  otherwise. There is no cache by default */
+  itkSetObjectMacro( CheckpointCache, StageCheckpointCache );
+  itkGetObjectMacro( CheckpointCache, StageCheckpointCache );
+
   /** This variable indicates whether or not the patient was scanned
    *  in the supine position (default is true) */
   itkSetMacro( Supine, bool );
@@ -143,6 +244,31 @@ public:
   itkSetMacro( AggressiveLeftRightSplitter, bool ); 
   itkGetMacro( AggressiveLeftRightSplitter, bool );
 
+  /** Split the left and right lungs along seams, falling back on the
+   *  graph search when a seam would not split them (see
+   *  SplitLeftAndRightLungsImageFilter). Both are true by default */
+  itkSetMacro( UseSeamSolver, bool );
+  itkGetMacro( UseSeamSolver, bool );
+  itkBooleanMacro( UseSeamSolver );
+
+  itkSetMacro( GraphSearchFallback, bool );
+  itkGetMacro( GraphSearchFallback, bool );
+  itkBooleanMacro( GraphSearchFallback );
+
+  /** Radius (in pixels) of the band around the previous slice's path
+   *  in which the seam is first searched for (see
+   *  SplitLeftAndRightLungsImageFilter). Zero disables the band.
+   *  Default is 5 */
+  itkSetMacro( NarrowBandRadius, int );
+  itkGetMacro( NarrowBandRadius, int );
+
+  /** Set to true to split the left and right lungs on multiple
+   *  threads (see SetNumberOfThreads). The result is the same as
+   *  splitting the slices in order. False by default */
+  itkSetMacro( ParallelSplitting, bool );
+  itkGetMacro( ParallelSplitting, bool );
+  itkBooleanMacro( ParallelSplitting );
+
   /** In order to split the left and right lungs, a min cost path
    *  algorithm is used.  To do this, a section of the image is
    *  converted to a graph and weights are assigned to the indices
@@ -195,29 +321,288 @@ public:
    */
   void SetHelperMask( OutputImageType::Pointer );
 
+  /** A parameter set of a parameter sweep. The other parameters of
+   *  the sweep runs are those of this filter. 'ClosingRadius' is only
+   *  used with distance transform closing (see ClosingRadius). */
+  struct SweepParametersType
+  {
+    short          ManualThreshold;
+    int            LeftRightLungSplitRadius;
+    unsigned long  ClosingNeighborhood[3];
+    double         ClosingRadius;
+    double         MinVolPercentAirway;
+    double         MaxVolPercentAirway;
+  };
+
+  /** The label map and the stage timings of a sweep run. The label
+   *  map is null if the run failed. The memory high-water marks of
+   *  runs done concurrently include the buffers of the other runs
+   *  (see ImageMemoryTracker). */
+  struct SweepResultType
+  {
+    SweepParametersType        Parameters;
+    LabelMapType::Pointer      LabelMap;
+    PipelineProfiler::Pointer  Profiler;
+  };
+
+  /** The parameters of this filter as a sweep parameter set */
+  SweepParametersType GetSweepParameters() const;
+
+  /** Add a parameter set to the sweep run by RunParameterSweep() */
+  void AddSweepParameters( const SweepParametersType& );
+  void ClearSweepParameters();
+
+  /** Run the pipeline on the input once for each sweep parameter
+   *  set. The runs that only differ by parameters of the stages after
+   *  the airway removal (split radius, closing) compute the stages
+   *  up to the airway removal once and share them through the
+   *  checkpoint cache (an in-memory cache if none is set). These
+   *  runs are done concurrently, with the threads of this filter
+   *  divided among them. The output of this filter is not
+   *  updated. */
+  void RunParameterSweep();
+
+  /** The results of the last sweep, in the order of the parameter
+   *  sets */
+  const std::vector< SweepResultType > & GetSweepResults() const
+    {
+      return this->m_SweepResults;
+    }
+
   void PrintSelf( std::ostream& os, Indent indent ) const;
 
 protected:
-  typedef itk::Image< unsigned long, 3 >                                              ComponentImageType;
   typedef typename itk::Image< LabelMapPixelType, 2 >                                 LabelMapSliceType;
   typedef itk::ImageRegionIteratorWithIndex< LabelMapSliceType >                      LabelMapSliceIteratorType;
-  typedef itk::Image< LabelMapPixelType, 3 >                                          LabelMapType;
   typedef itk::WholeLungVesselAndAirwaySegmentationImageFilter< InputImageType >      WholeLungVesselAndAirwayType;
   typedef itk::SplitLeftAndRightLungsImageFilter< InputImageType >                    SplitterType;
   typedef itk::LabelLungRegionsImageFilter                                            LungRegionLabelerType;
   typedef itk::AutoThresholdAirwaySegmentationImageFilter< InputImageType >           AirwaySegmentationType;
+  typedef itk::TracheaSeedDetector< LabelMapType >                                    TracheaSeedDetectorType;
   typedef itk::OtsuThresholdImageFilter< InputImageType, OutputImageType >            OtsuThresholdType;
   typedef itk::BinaryThresholdImageFilter< InputImageType, OutputImageType >          BinaryThresholdType;
   typedef itk::ConnectedComponentImageFilter< LabelMapSliceType, LabelMapSliceType >  ConnectedComponent2DType;
-  typedef itk::ConnectedComponentImageFilter< LabelMapType, ComponentImageType >      ConnectedComponent3DType;
   typedef itk::RelabelComponentImageFilter< LabelMapSliceType, LabelMapSliceType >    Relabel2DType;
-  typedef itk::RelabelComponentImageFilter< ComponentImageType, ComponentImageType >  Relabel3DType;
-  typedef itk::ImageRegionIteratorWithIndex< ComponentImageType >                     ComponentIteratorType;
   typedef itk::ImageRegionIteratorWithIndex< LabelMapType >                           LabelMapIteratorType;
   typedef itk::ExtractImageFilter< LabelMapType, LabelMapSliceType >                  LabelMapExtractorType;
+  typedef itk::RegionOfInterestImageFilter< InputImageType, InputImageType >          InputROIType;
+  typedef itk::RegionOfInterestImageFilter< LabelMapType, LabelMapType >              LabelMapROIType;
   typedef itk::BinaryBallStructuringElement< LabelMapPixelType, 3 >                   Element3DType;
   typedef itk::BinaryDilateImageFilter< LabelMapType, LabelMapType, Element3DType >   Dilate3DType;
   typedef itk::BinaryErodeImageFilter< LabelMapType, LabelMapType, Element3DType >    Erode3DType;
+  typedef itk::VoxelNeighborhood< 3, 26 >                                             NeighborhoodType;
+  typedef itk::VoxelNeighborhood< 3, 26, true >                                       BlockNeighborhoodType;
+
+  /** Functors applied by VoxelNeighborhood to the neighbors of a
+   *  voxel. All buffers cover the same (working) region. */
+
+  /** The voxel takes the label of any labeled neighbor. Used when
+   *  filling the output from the left / right labeled helper mask. */
+  struct HelperLabelFunctor
+  {
+    const LabelMapPixelType*  LeftRight;
+    LabelMapPixelType*        Output;
+
+    void operator()( unsigned long center, unsigned long neighbor )
+      {
+        if ( this->LeftRight[neighbor] != 0 )
+          {
+          this->Output[center] = this->LeftRight[neighbor];
+          }
+      }
+  };
+
+  /** Conditional dilation state of each voxel, packed two bits per
+   *  voxel. ELIGIBLE marks voxels the dilation may label (dark and
+   *  not airway), QUEUED marks voxels queued in the current round. */
+  struct DilationStateMap
+  {
+    enum { ELIGIBLE = 1, QUEUED = 2 };
+
+    std::vector< unsigned char > Bits;
+
+    void Initialize( unsigned long numberOfVoxels )
+      {
+        this->Bits.assign( (numberOfVoxels+3)/4, 0 );
+      }
+    unsigned char Get( unsigned long offset ) const
+      {
+        return (this->Bits[offset >> 2] >> ((offset & 3) << 1)) & 3;
+      }
+    void Set( unsigned long offset, unsigned char state )
+      {
+        this->Bits[offset >> 2] |= static_cast< unsigned char >( state << ((offset & 3) << 1) );
+      }
+    void Clear( unsigned long offset, unsigned char state )
+      {
+        this->Bits[offset >> 2] &= static_cast< unsigned char >( ~(state << ((offset & 3) << 1)) );
+      }
+  };
+
+  /** One FIFO of buffer offsets per conditional dilation label */
+  typedef std::deque< unsigned long >  WavefrontType;
+
+  /** Collects, by the label of the voxel, the unlabeled eligible
+   *  neighbors from which conditional dilation starts */
+  struct DilationSeedFunctor
+  {
+    const LabelMapPixelType*  Output;
+    const DilationStateMap*   State;
+    WavefrontType*            Left;
+    WavefrontType*            Right;
+    WavefrontType*            Whole;
+
+    void operator()( unsigned long center, unsigned long neighbor )
+      {
+        if ( this->Output[neighbor] == 0 && (this->State->Get( neighbor ) & DilationStateMap::ELIGIBLE) )
+          {
+          if ( this->Output[center] == static_cast< unsigned short >( LEFTLUNG ) )
+            {
+            this->Left->push_back( neighbor );
+            }
+          if ( this->Output[center] == static_cast< unsigned short >( RIGHTLUNG ) )
+            {
+            this->Right->push_back( neighbor );
+            }
+          if ( this->Output[center] == static_cast< unsigned short >( WHOLELUNG ) )
+            {
+            this->Whole->push_back( neighbor );
+            }
+          }
+      }
+  };
+
+  /** Queues the neighbors a conditional dilation wavefront of 'Label'
+   *  grows into next and marks them as queued for the round. The left
+   *  and right lungs may grow into the whole lung region
+   *  ('OverwriteWhole'), the whole lung only into the background. */
+  struct DilationGrowthFunctor
+  {
+    const LabelMapPixelType*  Output;
+    DilationStateMap*         State;
+    LabelMapPixelType         Label;
+    bool                      OverwriteWhole;
+    WavefrontType*            Next;
+
+    void operator()( unsigned long center, unsigned long neighbor )
+      {
+        if ( (this->Output[neighbor] == 0 || (this->OverwriteWhole && this->Output[neighbor] == static_cast< unsigned short >( WHOLELUNG )))
+             && this->State->Get( neighbor ) == DilationStateMap::ELIGIBLE && this->Output[center] == this->Label )
+          {
+          this->Next->push_back( neighbor );
+          this->State->Set( neighbor, DilationStateMap::QUEUED );
+          }
+      }
+  };
+
+  /** Tags the neighbors a wavefront voxel may grow into, as they are
+   *  at the start of a generation (the label test of
+   *  DilationGrowthFunctor). Used by the threads expanding a
+   *  wavefront (see VoxelFrontierExpansion). */
+  struct DilationClassifier
+  {
+    const LabelMapPixelType*  Output;
+    const DilationStateMap*   State;
+    bool                      OverwriteWhole;
+
+    unsigned char operator()( unsigned long, unsigned long neighbor ) const
+      {
+        if ( (this->Output[neighbor] == 0 || (this->OverwriteWhole && this->Output[neighbor] == static_cast< unsigned short >( WHOLELUNG )))
+             && this->State->Get( neighbor ) == DilationStateMap::ELIGIBLE )
+          {
+          return 1;
+          }
+
+        return 0;
+      }
+  };
+
+  /** Labels a wavefront voxel expanded in parallel and queues its
+   *  tagged neighbors, rechecking them as the serial expansion
+   *  would */
+  struct DilationClaimFunctor
+  {
+    LabelMapPixelType*      Output;
+    DilationGrowthFunctor*  Grower;
+
+    bool operator()( unsigned long center, const unsigned long* neighbors, const unsigned char*, unsigned long numberOfNeighbors )
+      {
+        this->Output[center] = this->Grower->Label;
+
+        for ( unsigned long n=0; n<numberOfNeighbors; n++ )
+          {
+          (*this->Grower)( center, neighbors[n] );
+          }
+
+        return true;
+      }
+  };
+
+  typedef VoxelFrontierExpansion< NeighborhoodType, WavefrontType, DilationClassifier >  WavefrontExpansionType;
+
+  /** Data shared with the threads closing the left and right lungs.
+   *  Each thread closes its own cropped copy of the output. */
+  struct ClosingThreadStruct
+  {
+    Self*                  Filter;
+    LabelMapType::Pointer  LabelMaps[2];
+    unsigned short         Labels[2];
+    unsigned int           NumberOfThreads;
+  };
+
+  /** Static function used as a "callback" by the MultiThreader to
+   *  close one of the labels of a ClosingThreadStruct */
+  static ITK_THREAD_RETURN_TYPE CloseLabelMapThreaderCallback( void* arg );
+
+  /** Data shared with the threads doing the runs of a sweep. Each
+   *  thread does every 'threadCount'th run of 'Runs'. */
+  struct SweepThreadStruct
+  {
+    Self*                               Filter;
+    StageCheckpointCache*               Cache;
+    const std::vector< unsigned int >*  Runs;
+    unsigned int                        NumberOfThreads;
+  };
+
+  /** Static function used as a "callback" by the MultiThreader to do
+   *  a share of the runs of a sweep */
+  static ITK_THREAD_RETURN_TYPE SweepThreaderCallback( void* arg );
+
+  /** Moves dark neighbors of the airways from the lung mask to the
+   *  airway label map */
+  struct AirwayNeighborFunctor
+  {
+    const InputPixelType*  Input;
+    short                  Threshold;
+    LabelMapPixelType*     Output;
+    LabelMapPixelType*     Airway;
+    LabelMapPixelType      AirwayLabel;
+
+    void operator()( unsigned long, unsigned long neighbor )
+      {
+        if ( this->Input[neighbor] <= this->Threshold )
+          {
+          this->Output[neighbor] = 0;
+          this->Airway[neighbor] = this->AirwayLabel;
+          }
+      }
+  };
+
+  /** Collects the neighbors darker than 'Threshold' */
+  struct DarkNeighborFunctor
+  {
+    const InputPixelType*          Input;
+    InputPixelType                 Threshold;
+    std::vector< unsigned long >*  Neighbors;
+
+    void operator()( unsigned long, unsigned long neighbor )
+      {
+        if ( this->Input[neighbor] < this->Threshold )
+          {
+          this->Neighbors->push_back( neighbor );
+          }
+      }
+  };
 
   PartialLungLabelMapImageFilter();
   virtual ~PartialLungLabelMapImageFilter() {}
@@ -225,10 +610,29 @@ protected:
   void GenerateData();
   void ApplyOtsuThreshold();
   void ApplyHelperMask();
+  VoxelPass::Pointer CreateVoxelPass();
+  IntensityHistogram* GetInputHistogram();
+  void CopyLabelMapToOutput( const LabelMapType* );
+  void CropToLungBoundingBox();
+  void PasteLungBoundingBox();
+  void SegmentAndRemoveAirways();
+  bool SweepRunsShareAirwayStages( const SweepParametersType&, const SweepParametersType& ) const;
+  void RunSweep( unsigned int, StageCheckpointCache*, unsigned int );
   void RecordAndRemoveAirways( LabelMapType::Pointer );
+  StageCheckpointKey ComputeLungMaskCheckpointKey();
+  StageCheckpointKey ComputeAirwaysCheckpointKey( const StageCheckpointKey& );
+  StageCheckpointCache::SectionsType GetLungMaskCheckpointSections();
+  StageCheckpointCache::SectionsType GetAirwaysCheckpointSections();
   void RemoveTracheaAndMainBronchi();
   void ExtractLabelMapSlice( LabelMapType::Pointer, LabelMapSliceType::Pointer, int );
   void CloseLabelMap( unsigned short );
+  void CloseLabelMaps( unsigned short, unsigned short );
+  void ComputeClosingRadius( long* );
+  bool ComputeClosingRegion( unsigned short, OutputImageRegionType& );
+  LabelMapType::Pointer ExtractClosingRegion( const OutputImageRegionType& );
+  void PasteClosedLabel( LabelMapType::Pointer, const OutputImageRegionType&, unsigned short );
+  void CloseLabelMapRegion( LabelMapType::Pointer, unsigned short, unsigned int );
+  void CloseLabelMapRegionWithDistanceTransform( LabelMapType::Pointer, unsigned short, unsigned int );
   void ExpandLungRegionsInSlices( LabelMapType::Pointer, short );
   void ExpandLungRegionInSlice( LabelMapType::Pointer, LabelMapType::IndexType, unsigned char, short );
   void ExpandLeftRight( LabelMapType::IndexType, short, unsigned short, unsigned int );
@@ -246,14 +650,46 @@ private:
   LabelMapType::Pointer m_AirwayLabelMap;
   LabelMapType::Pointer m_HelperMask;
 
+  //
+  // The input and helper mask the stages work on. These are cropped
+  // copies when the lung bounding box is used.
+  //
+  typename InputImageType::ConstPointer  m_WorkingInput;
+  LabelMapType::Pointer                  m_WorkingHelperMask;
+  OutputImageRegionType                  m_LungBoundingBox;
+
+  //
+  // Histogram of the input, computed once per update and shared by
+  // the stages that choose thresholds
+  //
+  IntensityHistogram::Pointer m_InputHistogram;
+
+  PipelineProfiler::Pointer m_Profiler;
+  StageCheckpointCache::Pointer m_CheckpointCache;
+
+  std::vector< SweepParametersType >  m_SweepParameters;
+  std::vector< SweepResultType >      m_SweepResults;
+
   double           m_MinAirwayVolume;
   double           m_MaxAirwayVolume;
   double           m_MaxAirwayVolumeIncreaseRate;
+  bool             m_UseAirwayPriorityFlood;
+  unsigned int     m_AirwayCoarseToFineShrinkFactor;
+  bool             m_UseLungBoundingBox;
+  unsigned int     m_LungBoundingBoxPadding;
+  bool             m_ParallelConditionalDilation;
+  bool             m_UseDistanceTransformClosing;
+  double           m_ClosingRadius;
+  bool             m_ConcurrentClosing;
   double           m_ExponentialCoefficient;
   double           m_ExponentialTimeConstant;
   bool             m_HeadFirst;
   bool             m_Supine;
   bool             m_AggressiveLeftRightSplitter;
+  bool             m_UseSeamSolver;
+  bool             m_GraphSearchFallback;
+  int              m_NarrowBandRadius;
+  bool             m_ParallelSplitting;
   unsigned long    m_ClosingNeighborhood[3];
   int              m_LeftRightLungSplitRadius;
   short            m_OtsuThreshold;
@@ -33,6 +33,14 @@ PartialLungLabelMapImageFilter< TInputImage >
   this->m_MinAirwayVolume             = 10.0;
   this->m_MaxAirwayVolume             = 500.0;
   this->m_MaxAirwayVolumeIncreaseRate = 2.0; 
+  this->m_UseAirwayPriorityFlood      = false;
+  this->m_AirwayCoarseToFineShrinkFactor = 1;
+  this->m_UseLungBoundingBox          = false;
+  this->m_LungBoundingBoxPadding      = 10;
+  this->m_ParallelConditionalDilation = false;
+  this->m_UseDistanceTransformClosing = false;
+  this->m_ClosingRadius               = 0.0;
+  this->m_ConcurrentClosing           = false;
   this->m_ExponentialCoefficient      = 200;
   this->m_ExponentialTimeConstant     = -700;
   this->m_LeftRightLungSplitRadius    = 2;
@@ -42,9 +50,14 @@ PartialLungLabelMapImageFilter< TInputImage >
   this->m_MaxVolPercentAirway         = 0.04;//sila
   this->m_MinVolPercentAirway         = 0.025;//sila
   this->m_AggressiveLeftRightSplitter = false;
+  this->m_UseSeamSolver               = true;
+  this->m_GraphSearchFallback         = true;
+  this->m_NarrowBandRadius            = 5;
+  this->m_ParallelSplitting           = false;
   this->m_HeadFirst                   = true;
   this->m_Supine                      = true;
   this->m_AirwayLabelMap = LabelMapType::New();
+  this->m_Profiler       = PipelineProfiler::New();
 }
 
 
@@ -70,21 +83,62 @@ PartialLungLabelMapImageFilter< TInputImage >
     outputPtr->Allocate();
     outputPtr->FillBuffer( 0 );
 
+  this->m_WorkingInput      = inputPtr;
+  this->m_WorkingHelperMask = this->m_HelperMask;
+  this->m_InputHistogram    = 0;
+  this->m_LungBoundingBox   = inputPtr->GetBufferedRegion();
+
+  this->m_Profiler->Reset();
+  this->m_Profiler->StartStage( "PartialLungLabelMap" );
+
     std::cout << this->m_MaxVolPercentAirway << std::endl;
     std::cout << this->m_MinVolPercentAirway << std::endl;
-  if ( this->m_HelperMask.IsNull() )
+  //
+  // Stage outputs are loaded from the checkpoint cache when they are
+  // there
+  //
+  StageCheckpointKey lungMaskKey;
+  bool               lungMaskLoaded = false;
+
+  if ( this->m_CheckpointCache.IsNotNull() )
+    {
+    lungMaskKey    = this->ComputeLungMaskCheckpointKey();
+    lungMaskLoaded = this->m_CheckpointCache->Load( "LungMask", lungMaskKey, this->GetLungMaskCheckpointSections() );
+    }
+
+  if ( lungMaskLoaded )
+    {
+    std::cout << "---Lung mask loaded from checkpoint..." << std::endl;
+    }
+  else if ( this->m_HelperMask.IsNull() )
     {
     //
     // Apply Otsu threshold
     //
+    this->m_Profiler->StartStage( "OtsuThreshold" );
     this->ApplyOtsuThreshold();
+    this->m_Profiler->StopStage();
     }
   else
     {
     //
     // Apply the helper mask
     //
+    this->m_Profiler->StartStage( "HelperMask" );
     this->ApplyHelperMask();
+    this->m_Profiler->StopStage();
+    }
+
+  if ( this->m_CheckpointCache.IsNotNull() && !lungMaskLoaded )
+    {
+    this->m_CheckpointCache->Store( "LungMask", lungMaskKey, this->GetLungMaskCheckpointSections() );
+    }
+
+  if ( this->m_UseLungBoundingBox )
+    {
+    this->m_Profiler->StartStage( "LungBoundingBoxCrop" );
+    this->CropToLungBoundingBox();
+    this->m_Profiler->StopStage();
     }
 
   //std::cout << "---Writing Otsu image..." << std::endl;
@@ -100,20 +154,15 @@ PartialLungLabelMapImageFilter< TInputImage >
   // lung volume (lungs plus airways). Compute the volume of the lungs
   // and airways
   //
-  unsigned int counter = 0;
+  const unsigned long numberOfVoxels = this->GetOutput()->GetBufferedRegion().GetNumberOfPixels();
 
-  LabelMapIteratorType  mIt( this->GetOutput(), this->GetOutput()->GetBufferedRegion() );  
+  VoxelCountOperation< LabelMapPixelType > countLungVoxels( this->GetOutput()->GetBufferPointer() );
 
-  mIt.GoToBegin();
-  while ( !mIt.IsAtEnd() )
-    {
-    if ( mIt.Get() != 0 )
-      {
-      counter++;
-      }
+  VoxelPass::Pointer countPass = this->CreateVoxelPass();
+    countPass->AddOperation( &countLungVoxels );
+    countPass->Execute( numberOfVoxels );
 
-    ++mIt;
-    }
+  unsigned long counter = countLungVoxels.GetCount();
 
   std::cout << "---Total volume:\t" << static_cast< double >( counter )*spacing[0]*spacing[1]*spacing[2] << std::endl;
   std::cout << "---Percentage:\t" << this->m_MaxAirwayVolume/(static_cast< double >( counter )*spacing[0]*spacing[1]*spacing[2]) << std::endl;
@@ -131,95 +180,31 @@ PartialLungLabelMapImageFilter< TInputImage >
   std::cout << "---percent max airway volume:\t" << this->m_MaxVolPercentAirway << std::endl;
   std::cout << "---percent min airway volume:\t" << this->m_MinVolPercentAirway<< std::endl;
   //
-  // Identify airways
+  // Identify and remove the airways, unless the result is in the
+  // checkpoint cache
   //
-  std::vector< OutputImageType::IndexType > airwaySeedVec = this->GetAirwaySeeds();
+  StageCheckpointKey airwaysKey;
+  bool               airwaysLoaded = false;
 
-  std::cout << "---Segmenting airways..." << std::endl;
-  typename AirwaySegmentationType::Pointer airwaySegmenter = AirwaySegmentationType::New();
-    airwaySegmenter->SetInput( this->GetInput() );    
-    airwaySegmenter->SetMaxAirwayVolumeIncreaseRate( this->m_MaxAirwayVolumeIncreaseRate );
-    airwaySegmenter->SetMinAirwayVolume( this->m_MinAirwayVolume );
-    airwaySegmenter->SetMaxAirwayVolume( this->m_MaxAirwayVolume );
-  for ( unsigned int i=0; i<airwaySeedVec.size(); i++ )
+  if ( this->m_CheckpointCache.IsNotNull() )
     {
-    airwaySegmenter->AddSeed( airwaySeedVec[i] );
-    }          
-    airwaySegmenter->Update();
-
-  std::cout << "---Writing airway segmentation..." << std::endl;
-  //WriterType::Pointer writerAirway1 = WriterType::New();
-  //writerAirway1->SetInput( airwaySegmenter->GetOutput() );
-  //writerAirway1->SetFileName( "/spl/tmp/sila/airwaySegmenter.nhdr" );
-  //writerAirway1->UseCompressionOn();
-  //writerAirway1->Update();
-
-//   std::cout << "---Removing trachea and main bronchi..." << std::endl;
-//   this->RemoveTracheaAndMainBronchi();
-
-//   std::cout << "---Writing airway label map..." << std::endl;
-//   WriterType::Pointer writerAirway = WriterType::New();
-//   writerAirway->SetInput( this->m_AirwayLabelMap );
-//   writerAirway->SetFileName( "/projects/lmi/people/jross/tmp/airway.nhdr" );
-//   writerAirway->UseCompressionOn();
-//   writerAirway->Update();
-
-  //
-  // Collect / remove airway indices
-  //
-  this->RecordAndRemoveAirways( airwaySegmenter->GetOutput() );  
-  std::cout << "---record and remove airways done..." << std::endl;
-  //
-  // There may still be small foreground regions
-  // within the trachea / main bronchi that were not picked up via the
-  // airway segmentation routine. We'll zero out all components that
-  // don't accomodate for a significant portion of the overall
-  // foreground region
-  //
-  ConnectedComponent3DType::Pointer connectedComponent = ConnectedComponent3DType::New();
-    connectedComponent->SetInput( this->GetOutput() );
-
-  //
-  // Relabel the connected components
-  //
-  Relabel3DType::Pointer relabelComponent = Relabel3DType::New();
-    relabelComponent->SetInput( connectedComponent->GetOutput() );
-    relabelComponent->Update();  
-
-  unsigned int totalSize = 0;
+    airwaysKey = this->ComputeAirwaysCheckpointKey( lungMaskKey );
 
-  for ( unsigned int i=0; i<relabelComponent->GetNumberOfObjects(); i++ )
-    {
-    totalSize += relabelComponent->GetSizeOfObjectsInPixels()[i];
-    }  
+    this->m_AirwayLabelMap->SetRegions( this->m_WorkingInput->GetBufferedRegion().GetSize() );
+    this->m_AirwayLabelMap->Allocate();
 
-  unsigned long componentsToRemoveThreshold;
+    airwaysLoaded = this->m_CheckpointCache->Load( "Airways", airwaysKey, this->GetAirwaysCheckpointSections() );
+    }
 
-  for ( unsigned int i=0; i<relabelComponent->GetNumberOfObjects(); i++ )
+  if ( !airwaysLoaded )
     {
-//    std::cout << "Component label:\t" << i+1 << "\t Percentage:\t" << static_cast< double >( relabelComponent->GetSizeOfObjectsInPixels()[i] )/static_cast< double >( totalSize ) << std::endl;
-    if ( static_cast< double >( relabelComponent->GetSizeOfObjectsInPixels()[i] )/static_cast< double >( totalSize ) < 0.20 )
-      {
-      componentsToRemoveThreshold = i+1;
-      break;
-      }
-    }  
+    this->SegmentAndRemoveAirways();
 
-  ComponentIteratorType rIt( relabelComponent->GetOutput(), relabelComponent->GetOutput()->GetBufferedRegion() );
-
-  mIt.GoToBegin();
-  rIt.GoToBegin();
-  while ( !mIt.IsAtEnd() )
-    {
-    if ( rIt.Get() >= componentsToRemoveThreshold )
+    if ( this->m_CheckpointCache.IsNotNull() )
       {
-      mIt.Set( 0 );
+      this->m_CheckpointCache->Store( "Airways", airwaysKey, this->GetAirwaysCheckpointSections() );
       }
-
-    ++mIt;
-    ++rIt;
     }
-  std::cout << "---remove small connected components done..." << std::endl;
 
 //   std::cout << "---Writing post-airway removal mask..." << std::endl;
 //   WriterType::Pointer writer1 = WriterType::New();
@@ -240,6 +225,8 @@ PartialLungLabelMapImageFilter< TInputImage >
 
   if ( this->m_HelperMask.IsNotNull() )
     {
+    this->m_Profiler->StartStage( "HelperMaskLeftRightLabeling" );
+
     Element3DType structuringElement;
       structuringElement.SetRadius( 1 );
       structuringElement.CreateStructuringElement();
@@ -273,53 +260,28 @@ PartialLungLabelMapImageFilter< TInputImage >
 //     writer2->UseCompressionOn();
 //     writer2->Update();
 
-    LabelMapIteratorType lrIt( leftRightLabeler->GetOutput(), leftRightLabeler->GetOutput()->GetBufferedRegion() );
-    LabelMapIteratorType hIt( this->m_HelperMask, this->m_HelperMask->GetBufferedRegion() ); 
+    //
+    // Every helper mask voxel takes the last nonzero left / right
+    // label found in its 3x3x3 neighborhood (or zero)
+    //
+//    std::cout << "---Filling output image will left / right labeled helper..." << std::endl;
 
-    LabelMapType::IndexType index;
-    unsigned short labelValue;
+    VoxelMaskOperation< LabelMapPixelType, LabelMapPixelType >
+      clearHelperVoxels( this->GetOutput()->GetBufferPointer(), this->m_WorkingHelperMask->GetBufferPointer(), 0, false );
 
-//    std::cout << "---Filling output image will left / right labeled helper..." << std::endl;
+    VoxelPass::Pointer helperPass = this->CreateVoxelPass();
+      helperPass->AddOperation( &clearHelperVoxels );
+      helperPass->Execute( numberOfVoxels );
 
-    mIt.GoToBegin();
-    lrIt.GoToBegin();
-    hIt.GoToBegin();
-    while ( !hIt.IsAtEnd() )
-      {
-      if ( hIt.Get() != 0 )
-        {
-        labelValue = 0;
+    BlockNeighborhoodType neighborhood( this->GetOutput()->GetBufferedRegion() );
 
-        for ( int x=-1; x<=1; x++ )
-          {
-          index[0] = hIt.GetIndex()[0] + x;
-
-          for ( int y=-1; y<=1; y++ )
-            {
-            index[1] = hIt.GetIndex()[1] + y;
-
-            for ( int z=-1; z<=1; z++ )
-              {
-              index[2] = hIt.GetIndex()[2] + z;
-              
-              if ( this->GetInput()->GetBufferedRegion().IsInside( index ) )
-                {
-                if ( leftRightLabeler->GetOutput()->GetPixel( index ) != 0 )
-                  {
-                  labelValue = leftRightLabeler->GetOutput()->GetPixel( index );
-                  }
-                }
-              }
-            }
-          }
+    HelperLabelFunctor helperLabel;
+      helperLabel.LeftRight = leftRightLabeler->GetOutput()->GetBufferPointer();
+      helperLabel.Output    = this->GetOutput()->GetBufferPointer();
 
-        mIt.Set( labelValue );
-        }
+    neighborhood.VisitMaskedNeighbors( this->m_WorkingHelperMask->GetBufferPointer(), helperLabel );
 
-      ++mIt;
-      ++lrIt;
-      ++hIt;
-      }
+    this->m_Profiler->StopStage();
     }
 
 //   std::cout << "---Writing relabeld expanded by helper..." << std::endl;
@@ -334,77 +296,86 @@ PartialLungLabelMapImageFilter< TInputImage >
     //
     // Attempt to label left and right. Further processing may not be necessary.
     //
+    this->m_Profiler->StartStage( "LeftRightLabelingStep1" );
     leftRightLabeler->SetInput( this->GetOutput() );
     leftRightLabeler->LabelLeftAndRightLungsOn();
     leftRightLabeler->SetHeadFirst( this->m_HeadFirst );
     leftRightLabeler->SetSupine( this->m_Supine );
     leftRightLabeler->Update();
     std::cout << "---Left right labeler step 1 finished..." << std::endl;
-//    LabelMapIteratorType mIt( this->GetOutput(), this->GetOutput()->GetBufferedRegion() );
-    LabelMapIteratorType lrIt( leftRightLabeler->GetOutput(), leftRightLabeler->GetOutput()->GetBufferedRegion() );
-
-    mIt.GoToBegin();
-    lrIt.GoToBegin();
-    while ( !mIt.IsAtEnd() )
-      {
-      mIt.Set( lrIt.Get() );
-      
-      ++mIt;
-      ++lrIt;
-      }
+    this->CopyLabelMapToOutput( leftRightLabeler->GetOutput() );
+    this->m_Profiler->StopStage();
     
     if ( !leftRightLabeler->GetLabelingSuccess() )
       {
       std::cout << "---Left right labeler step 2 started..." << std::endl;
+      this->m_Profiler->StartStage( "LeftRightLabelingStep2" );
       //
-      // Threshold the input with a more conservative upper threshold value
-      // 
-      typename BinaryThresholdType::Pointer thresholder = BinaryThresholdType::New();
-        thresholder->SetInput( this->GetInput() );
-        thresholder->SetOutsideValue( 0 );
-        thresholder->SetInsideValue( static_cast< unsigned short >( WHOLELUNG ) );
-        thresholder->SetLowerThreshold( itk::NumericTraits< short >::min() );
-//      thresholder->SetUpperThreshold( -700 );
-        thresholder->SetUpperThreshold( -800 );
-        thresholder->Update();
-      
-      LabelMapIteratorType tIt( thresholder->GetOutput(), thresholder->GetOutput()->GetBufferedRegion() );
-
-      mIt.GoToBegin();
-      tIt.GoToBegin();
-      while ( !tIt.IsAtEnd() )
-        {
-        if ( mIt.Get() == 0 )
-          {                                         
-          tIt.Set( 0 );
-          }
-      
-        ++mIt;
-        ++tIt;
-        }
+      // Threshold the input with a more conservative upper threshold
+      // value (-800, it used to be -700), keeping only voxels of the
+      // current lung mask. Both are done in the same pass.
+      //
+      LabelMapType::Pointer thresholded = LabelMapType::New();
+        thresholded->CopyInformation( this->m_WorkingInput );
+        thresholded->SetRegions( this->m_WorkingInput->GetBufferedRegion() );
+        thresholded->Allocate();
+
+      VoxelThresholdOperation< InputPixelType, LabelMapPixelType >
+        threshold( this->m_WorkingInput->GetBufferPointer(), thresholded->GetBufferPointer(),
+                   itk::NumericTraits< short >::min(), -800, static_cast< unsigned short >( WHOLELUNG ), 0 );
+      VoxelMaskOperation< LabelMapPixelType, LabelMapPixelType >
+        keepLungVoxels( thresholded->GetBufferPointer(), this->GetOutput()->GetBufferPointer(), 0, true );
+
+      VoxelPass::Pointer thresholdPass = this->CreateVoxelPass();
+        thresholdPass->AddOperation( &threshold );
+        thresholdPass->AddOperation( &keepLungVoxels );
+        thresholdPass->Execute( numberOfVoxels );
 
       //
       // Attempt to label left and right. Splitting may not be necessary
       //
-      leftRightLabeler->SetInput( thresholder->GetOutput() );
+      leftRightLabeler->SetInput( thresholded );
       leftRightLabeler->LabelLeftAndRightLungsOn();
       leftRightLabeler->SetHeadFirst( this->m_HeadFirst );
       leftRightLabeler->SetSupine( this->m_Supine );
       leftRightLabeler->Update();
+      this->m_Profiler->StopStage();
 
       if ( !leftRightLabeler->GetLabelingSuccess() )
         {
     	  std::cout << "---Left right labeler step 3 started..." << std::endl;
+        this->m_Profiler->StartStage( "LeftRightLabelingStep3" );
         //
         // Split left and right lungs
         //
+        //
+        // When cropped to the lung bounding box, the splitter still
+        // searches the middle third of the full image
+        //
+        OutputImageRegionType referenceRegion = this->GetInput()->GetBufferedRegion();
+
+        OutputImageType::IndexType referenceStart;
+        for ( unsigned int d=0; d<3; d++ )
+          {
+          referenceStart[d] = this->m_WorkingInput->GetBufferedRegion().GetIndex()[d] + referenceRegion.GetIndex()[d]
+                              - this->m_LungBoundingBox.GetIndex()[d];
+          }
+        referenceRegion.SetIndex( referenceStart );
+
         typename SplitterType::Pointer splitter = SplitterType::New();
-          splitter->SetInput( this->GetInput() );
-          splitter->SetLungLabelMap( thresholder->GetOutput() );
+          splitter->SetInput( this->m_WorkingInput );
+          splitter->SetSearchReferenceRegion( referenceRegion );
+          splitter->SetLungLabelMap( thresholded );
           splitter->SetExponentialCoefficient( this->m_ExponentialCoefficient );
           splitter->SetExponentialTimeConstant( this->m_ExponentialTimeConstant );
           splitter->SetLeftRightLungSplitRadius( this->m_LeftRightLungSplitRadius );
           splitter->SetAggressiveLeftRightSplitter( this->m_AggressiveLeftRightSplitter );    
+          splitter->SetUseSeamSolver( this->m_UseSeamSolver );
+          splitter->SetGraphSearchFallback( this->m_GraphSearchFallback );
+          splitter->SetNarrowBandRadius( this->m_NarrowBandRadius );
+          splitter->SetUseParallelSplitting( this->m_ParallelSplitting );
+          splitter->SetNumberOfThreads( this->GetNumberOfThreads() );
+          splitter->SetProfiler( this->m_Profiler );
           splitter->Update();    
       
         //
@@ -415,23 +386,18 @@ PartialLungLabelMapImageFilter< TInputImage >
         leftRightLabeler->SetHeadFirst( this->m_HeadFirst );
         leftRightLabeler->SetSupine( this->m_Supine );
         leftRightLabeler->Update();
+        this->m_Profiler->StopStage();
         }
 
-      lrIt.GoToBegin();
-      mIt.GoToBegin();
-      while ( !lrIt.IsAtEnd() )
-        {
-        mIt.Set( lrIt.Get() );
-        
-        ++mIt;
-        ++lrIt;
-        }
+      this->CopyLabelMapToOutput( leftRightLabeler->GetOutput() );
 
       //
       // Perform conditional dilation
       //
       std::cout << "---starting conditional dilation..." << std::endl;
+      this->m_Profiler->StartStage( "ConditionalDilation" );
       this->ConditionalDilation( this->m_OtsuThreshold );
+      this->m_Profiler->StopStage();
       std::cout << "---finishing conditional dilation..." << std::endl;
       }
     }
@@ -440,15 +406,16 @@ PartialLungLabelMapImageFilter< TInputImage >
   // Perform morphological closing on the left and right lungs
   //
   std::cout << "---Starting morphological closing..." << std::endl;
+  this->m_Profiler->StartStage( "Closing" );
   if ( leftRightLabeler->GetLabelingSuccess() )
     {
-    this->CloseLabelMap( static_cast< unsigned short >( LEFTLUNG ) );
-    this->CloseLabelMap( static_cast< unsigned short >( RIGHTLUNG ) );
+    this->CloseLabelMaps( static_cast< unsigned short >( LEFTLUNG ), static_cast< unsigned short >( RIGHTLUNG ) );
     }
   else
     {
     this->CloseLabelMap( static_cast< unsigned short >( WHOLELUNG ) );
     }
+  this->m_Profiler->StopStage();
 
 
    std::cout << "---Writing output just before thirds labeling..." << std::endl;
@@ -458,6 +425,7 @@ PartialLungLabelMapImageFilter< TInputImage >
 //   writer4->UseCompressionOn();
 //   writer4->Update();
 
+  this->m_Profiler->StartStage( "ThirdsLabeling" );
   LungRegionLabelerType::Pointer lungRegionLabeler = LungRegionLabelerType::New();
     lungRegionLabeler->SetInput( this->GetOutput() );
     lungRegionLabeler->LabelLungThirdsOn();
@@ -466,6 +434,7 @@ PartialLungLabelMapImageFilter< TInputImage >
     lungRegionLabeler->Update();
 
   this->GraftOutput( lungRegionLabeler->GetOutput() );
+  this->m_Profiler->StopStage();
 
    std::cout << "---Writing output just after thirds labeling..." << std::endl;
 //   WriterType::Pointer writer5 = WriterType::New();
@@ -477,6 +446,7 @@ PartialLungLabelMapImageFilter< TInputImage >
   //
   // Add back the airways
   //
+  this->m_Profiler->StartStage( "AirwayRestoration" );
   unsigned char  lungRegion;
   unsigned short labelValue;
 
@@ -500,6 +470,22 @@ PartialLungLabelMapImageFilter< TInputImage >
     ++aIt;
     ++m2It;
     }
+  this->m_Profiler->StopStage();
+
+  if ( this->m_UseLungBoundingBox )
+    {
+    this->m_Profiler->StartStage( "LungBoundingBoxPaste" );
+    this->PasteLungBoundingBox();
+    this->m_Profiler->StopStage();
+    }
+
+  //
+  // Release the cropped copies
+  //
+  this->m_WorkingInput      = 0;
+  this->m_WorkingHelperMask = 0;
+
+  this->m_Profiler->StopStage();
 
 
 //   std::cout << "---Writing finale..." << std::endl;
@@ -513,296 +499,842 @@ PartialLungLabelMapImageFilter< TInputImage >
 }
 
 
+/**
+ * Multi-label breadth-first dilation of the lung labels into dark,
+ * non-airway background. Each round labels the voxels queued in the
+ * previous round and queues their neighbors, going through the
+ * right, left and whole lung wavefronts in that order. A voxel is
+ * queued at most once per round (by the first wavefront reaching it)
+ * and the left and right lungs may grow into the whole lung region,
+ * so the order of the wavefronts decides the left / right boundary.
+ * When 'ParallelConditionalDilation' is on, the neighbors of large
+ * wavefront generations are collected by several threads and then
+ * claimed in wavefront order, which gives the same result as the
+ * serial expansion.
+ */
 template < class TInputImage >
 void
 PartialLungLabelMapImageFilter< TInputImage >
 ::ConditionalDilation( short threshold )
 {
-  typedef itk::Image< unsigned char, 3 >                       UCharImageType;
-  typedef itk::ImageRegionIteratorWithIndex< UCharImageType >  UCharIteratorType;
-
-  UCharImageType::Pointer tracker = UCharImageType::New();
-    tracker->SetRegions( this->GetOutput()->GetBufferedRegion().GetSize() );
-    tracker->Allocate();
-    tracker->FillBuffer( 0 );
-
-  std::vector< LabelMapType::IndexType > prevLeftIndicesVec;
-  std::vector< LabelMapType::IndexType > currLeftIndicesVec;
-  std::vector< LabelMapType::IndexType > prevRightIndicesVec;
-  std::vector< LabelMapType::IndexType > currRightIndicesVec;
-  std::vector< LabelMapType::IndexType > prevWholeIndicesVec;
-  std::vector< LabelMapType::IndexType > currWholeIndicesVec;
+  LabelMapPixelType*        outputBuffer = this->GetOutput()->GetBufferPointer();
+  const InputPixelType*     inputBuffer  = this->m_WorkingInput->GetBufferPointer();
+  const LabelMapPixelType*  airwayBuffer = this->m_AirwayLabelMap->GetBufferPointer();
 
-  LabelMapType::IndexType tempIndex;
+  const unsigned long numberOfVoxels = this->GetOutput()->GetBufferedRegion().GetNumberOfPixels();
 
-  LabelMapIteratorType it( this->GetOutput(), this->GetOutput()->GetBufferedRegion() );
+  //
+  // Whether a voxel may be labeled at all does not change during the
+  // dilation, so it is only computed once
+  //
+  DilationStateMap state;
+    state.Initialize( numberOfVoxels );
 
-  it.GoToBegin();
-  while ( !it.IsAtEnd() )
+  for ( unsigned long i=0; i<numberOfVoxels; i++ )
     {
-    if ( it.Get() != 0 )
+    if ( inputBuffer[i] <= threshold && airwayBuffer[i] == 0 )
       {
-      for ( int x=-1; x<=1; x++ )
-        {
-        tempIndex[0] = it.GetIndex()[0] + x;
-      
-        for ( int y=-1; y<=1; y++ )
-          {
-          tempIndex[1] = it.GetIndex()[1] + y;
-          
-          for ( int z=-1; z<=1; z++ )
-            {
-            tempIndex[2] = it.GetIndex()[2] + z;
-
-            if ( this->GetOutput()->GetBufferedRegion().IsInside( tempIndex ) )
-              {
-              if ( this->GetOutput()->GetPixel( tempIndex ) == 0 && this->GetInput()->GetPixel( tempIndex ) <= threshold 
-                   && this->m_AirwayLabelMap->GetPixel( tempIndex ) == 0 )
-                {
-                if ( it.Get() == static_cast< unsigned short >( LEFTLUNG ) )
-                  {
-                  prevLeftIndicesVec.push_back( tempIndex );
-                  }
-                if ( it.Get() == static_cast< unsigned short >( RIGHTLUNG ) )
-                  {
-                  prevRightIndicesVec.push_back( tempIndex );
-                  }
-                if ( it.Get() == static_cast< unsigned short >( WHOLELUNG ) )
-                  {
-                  prevWholeIndicesVec.push_back( tempIndex );
-                  }
-                }
-              }
-            }
-          }
-        }
+      state.Set( i, DilationStateMap::ELIGIBLE );
       }
-
-    ++it;
     }
 
-  while ( prevLeftIndicesVec.size() > 0 || prevRightIndicesVec.size() > 0 || prevWholeIndicesVec.size() > 0 )
+  NeighborhoodType neighborhood( this->GetOutput()->GetBufferedRegion() );
+
+  const LabelMapPixelType labels[3] = { static_cast< unsigned short >( RIGHTLUNG ), 
+                                        static_cast< unsigned short >( LEFTLUNG ), 
+                                        static_cast< unsigned short >( WHOLELUNG ) };
+  WavefrontType wavefronts[3];
+
+  DilationSeedFunctor seeder;
+    seeder.Output = outputBuffer;
+    seeder.State  = &state;
+    seeder.Right  = &wavefronts[0];
+    seeder.Left   = &wavefronts[1];
+    seeder.Whole  = &wavefronts[2];
+
+  neighborhood.VisitMaskedNeighbors( outputBuffer, seeder );
+
+  DilationGrowthFunctor grower;
+    grower.Output = outputBuffer;
+    grower.State  = &state;
+
+  //
+  // With ParallelConditionalDilation on, large generations are
+  // expanded by the threads of the filter (small ones are not worth
+  // the threading overhead)
+  //
+  this->GetMultiThreader()->SetNumberOfThreads( this->GetNumberOfThreads() );
+
+  WavefrontExpansionType expansion( neighborhood, this->GetMultiThreader() );
+
+  DilationClassifier classifier;
+    classifier.Output = outputBuffer;
+    classifier.State  = &state;
+
+  DilationClaimFunctor claimer;
+    claimer.Output = outputBuffer;
+    claimer.Grower = &grower;
+
+  unsigned long numRounds        = 0;
+  unsigned long numVoxelsTouched = 0;
+
+  while ( wavefronts[0].size() > 0 || wavefronts[1].size() > 0 || wavefronts[2].size() > 0 )
     {
-    tracker->FillBuffer( 0 );
+    numRounds++;
 
-    for ( unsigned int i=0; i<prevRightIndicesVec.size(); i++ )
+    //
+    // Everything in the wavefronts was queued in the last round. Those
+    // voxels may be queued again in this round.
+    //
+    for ( unsigned int l=0; l<3; l++ )
       {
-      this->GetOutput()->SetPixel( prevRightIndicesVec[i], static_cast< unsigned short >( RIGHTLUNG ) );
+      numVoxelsTouched += wavefronts[l].size();
 
-      for ( int x=-1; x<=1; x++ )
+      for ( unsigned long i=0; i<wavefronts[l].size(); i++ )
         {
-        tempIndex[0] = prevRightIndicesVec[i][0] + x;
-        
-        for ( int y=-1; y<=1; y++ )
-          {
-          tempIndex[1] = prevRightIndicesVec[i][1] + y;
-          
-          for ( int z=-1; z<=1; z++ )
-            {
-            tempIndex[2] = prevRightIndicesVec[i][2] + z;
-            
-            if ( this->GetOutput()->GetBufferedRegion().IsInside( tempIndex ) )
-              {
-              if ( (this->GetOutput()->GetPixel( tempIndex ) == 0 || this->GetOutput()->GetPixel( tempIndex ) == static_cast< unsigned short >( WHOLELUNG ))
-                   && this->GetInput()->GetPixel( tempIndex ) <= threshold && this->m_AirwayLabelMap->GetPixel( tempIndex ) == 0 )
-                {
-                if ( this->GetOutput()->GetPixel( prevRightIndicesVec[i] ) == static_cast< unsigned short >( RIGHTLUNG ) && 
-                     tracker->GetPixel( tempIndex ) == 0 )
-                  {
-                  currRightIndicesVec.push_back( tempIndex );
-                  tracker->SetPixel( tempIndex, 1 );
-                  }
-                }
-              }
-            }
-          }
+        state.Clear( wavefronts[l][i], DilationStateMap::QUEUED );
         }
       }
-    prevRightIndicesVec.clear();
-    for ( unsigned int i=0; i<currRightIndicesVec.size(); i++ )
-      {
-      prevRightIndicesVec.push_back( currRightIndicesVec[i] );
-      }
-    currRightIndicesVec.clear();
-    
-    for ( unsigned int i=0; i<prevLeftIndicesVec.size(); i++ )
+
+    for ( unsigned int l=0; l<3; l++ )
       {
-      this->GetOutput()->SetPixel( prevLeftIndicesVec[i], static_cast< unsigned short >( LEFTLUNG ) );
-      
-      for ( int x=-1; x<=1; x++ )
+      WavefrontType& wavefront = wavefronts[l];
+
+      const unsigned long generationSize = wavefront.size();
+
+      grower.Label          = labels[l];
+      grower.OverwriteWhole = labels[l] != static_cast< unsigned short >( WHOLELUNG );
+      grower.Next           = &wavefront;
+
+      if ( this->m_ParallelConditionalDilation && expansion.IsParallel( generationSize ) )
         {
-        tempIndex[0] = prevLeftIndicesVec[i][0] + x;
-        
-        for ( int y=-1; y<=1; y++ )
-          {
-          tempIndex[1] = prevLeftIndicesVec[i][1] + y;
-          
-          for ( int z=-1; z<=1; z++ )
-            {
-            tempIndex[2] = prevLeftIndicesVec[i][2] + z;
-            
-            if ( this->GetOutput()->GetBufferedRegion().IsInside( tempIndex ) )
-              {
-              if ( (this->GetOutput()->GetPixel( tempIndex ) == 0 || this->GetOutput()->GetPixel( tempIndex ) == static_cast< unsigned short >( WHOLELUNG ))
-                   && this->GetInput()->GetPixel( tempIndex ) <= threshold && this->m_AirwayLabelMap->GetPixel( tempIndex ) == 0 )
-                {
-                if ( this->GetOutput()->GetPixel( prevLeftIndicesVec[i] ) == static_cast< unsigned short >( LEFTLUNG ) &&
-                     tracker->GetPixel( tempIndex ) == 0 )
-                  {
-                  currLeftIndicesVec.push_back( tempIndex );
-                  tracker->SetPixel( tempIndex, 1 );
-                  }
-                }
-              }
-            }
-          }
+        //
+        // The claims append the next generation to the wavefront,
+        // after the voxels being expanded
+        //
+        classifier.OverwriteWhole = grower.OverwriteWhole;
+
+        expansion.Expand( wavefront, generationSize, classifier );
+        expansion.Claim( claimer );
         }
-      }
-    prevLeftIndicesVec.clear();
-    for ( unsigned int i=0; i<currLeftIndicesVec.size(); i++ )
-      {
-      prevLeftIndicesVec.push_back( currLeftIndicesVec[i] );
-      }
-    currLeftIndicesVec.clear();
-    
-    for ( unsigned int i=0; i<prevWholeIndicesVec.size(); i++ )
-      {
-      this->GetOutput()->SetPixel( prevWholeIndicesVec[i], static_cast< unsigned short >( WHOLELUNG ) );
-      
-      for ( int x=-1; x<=1; x++ )
+      else
         {
-        tempIndex[0] = prevWholeIndicesVec[i][0] + x;
-        
-        for ( int y=-1; y<=1; y++ )
+        for ( unsigned long i=0; i<generationSize; i++ )
           {
-          tempIndex[1] = prevWholeIndicesVec[i][1] + y;
-          
-          for ( int z=-1; z<=1; z++ )
-            {
-            tempIndex[2] = prevWholeIndicesVec[i][2] + z;
-            
-            if ( this->GetOutput()->GetBufferedRegion().IsInside( tempIndex ) )
-              {
-              if ( this->GetOutput()->GetPixel( tempIndex ) == 0 && this->GetInput()->GetPixel( tempIndex ) <= threshold 
-                   && this->m_AirwayLabelMap->GetPixel( tempIndex ) == 0 )
-                {
-                if ( this->GetOutput()->GetPixel( prevWholeIndicesVec[i] ) == static_cast< unsigned short >( WHOLELUNG ) &&
-                     tracker->GetPixel( tempIndex ) == 0 )
-                  {
-                  currWholeIndicesVec.push_back( tempIndex );
-                  tracker->SetPixel( tempIndex, 1 );
-                  }
-                }
-              }
-            }
+          unsigned long current = wavefront[i];
+
+          outputBuffer[current] = labels[l];
+
+          neighborhood.VisitNeighbors( current, grower );
           }
         }
+
+      wavefront.erase( wavefront.begin(), wavefront.begin() + generationSize );
       }
-    prevWholeIndicesVec.clear();
-    for ( unsigned int i=0; i<currWholeIndicesVec.size(); i++ )
-      {
-      prevWholeIndicesVec.push_back( currWholeIndicesVec[i] );
-      }
-    currWholeIndicesVec.clear();
     }
+
+  WorkCounters::Add( "PartialLungLabelMap.ConditionalDilationRounds", numRounds );
+  WorkCounters::Add( "PartialLungLabelMap.ConditionalDilationVoxels", numVoxelsTouched );
 }
 
 
+/**
+ * The closing of a label only reaches the voxels within the closing
+ * radius of the label, so it is computed on a cropped copy of the
+ * label's bounding box (see ComputeClosingRegion) and pasted back.
+ */
 template < class TInputImage >
 void
 PartialLungLabelMapImageFilter< TInputImage >
 ::CloseLabelMap( unsigned short closeLabel )
 {
-  //
-  // Perform morphological closing on the mask by dilating and then
-  // eroding.  We assume that at this point in the pipeline, the
-  // output image only has WHOLELUNG as a foreground value.  (The
-  // airways and vessels should be stored in the index vec member
-  // variables). 
-  //
-  Element3DType structuringElement;
-    structuringElement.SetRadius( this->m_ClosingNeighborhood );
-    structuringElement.CreateStructuringElement();
+  OutputImageRegionType closingRegion;
 
-  typename Dilate3DType::Pointer dilater = Dilate3DType::New();
-    dilater->SetInput( this->GetOutput() );
-    dilater->SetKernel( structuringElement );
-    dilater->SetDilateValue( closeLabel );
-  try
+  if ( !this->ComputeClosingRegion( closeLabel, closingRegion ) )
     {
-    dilater->Update();
+    return;
     }
-  catch ( itk::ExceptionObject &excp )
+
+  LabelMapType::Pointer labelMap = this->ExtractClosingRegion( closingRegion );
+
+  this->CloseLabelMapRegion( labelMap, closeLabel, this->GetNumberOfThreads() );
+
+  this->PasteClosedLabel( labelMap, closingRegion, closeLabel );
+}
+
+
+/**
+ * Close two labels, concurrently when 'ConcurrentClosing' is on. Both
+ * closings then start from the same output, so the second one misses
+ * whatever the first one writes. The second closing only depends on
+ * which voxels of its region have its label and, on the end slices of
+ * its region, which are zero. If the first closing changed any such
+ * voxel (the lungs touch and closing one overwrote the other), the
+ * second closing is done again on the updated output so that the
+ * result is always that of closing one label after the other.
+ */
+template < class TInputImage >
+void
+PartialLungLabelMapImageFilter< TInputImage >
+::CloseLabelMaps( unsigned short firstLabel, unsigned short secondLabel )
+{
+  if ( !this->m_ConcurrentClosing || this->GetNumberOfThreads() < 2 )
     {
-    std::cerr << "Exception caught dilating:";
-    std::cerr << excp << std::endl;
+    this->CloseLabelMap( firstLabel );
+    this->CloseLabelMap( secondLabel );
+
+    return;
+    }
+
+  OutputImageRegionType closingRegions[2];
+  bool                  foundLabels[2];
+
+  foundLabels[0] = this->ComputeClosingRegion( firstLabel, closingRegions[0] );
+  foundLabels[1] = this->ComputeClosingRegion( secondLabel, closingRegions[1] );
+
+  if ( !foundLabels[0] || !foundLabels[1] )
+    {
+    this->CloseLabelMap( firstLabel );
+    this->CloseLabelMap( secondLabel );
+
+    return;
     }
 
+  ClosingThreadStruct str;
+    str.Filter          = this;
+    str.Labels[0]       = firstLabel;
+    str.Labels[1]       = secondLabel;
+    str.LabelMaps[0]    = this->ExtractClosingRegion( closingRegions[0] );
+    str.LabelMaps[1]    = this->ExtractClosingRegion( closingRegions[1] );
+    str.NumberOfThreads = std::max( this->GetNumberOfThreads()/2, static_cast< int >( 1 ) );
+
+  this->GetMultiThreader()->SetNumberOfThreads( 2 );
+  this->GetMultiThreader()->SetSingleMethod( this->CloseLabelMapThreaderCallback, &str );
+  this->GetMultiThreader()->SingleMethodExecute();
+
   //
-  // Occasionally, dilation will extend the mask to the end slices. If
-  // this occurs, the erosion step below won't be able to hit these
-  // regions. To deal with this, extract the end slices from the
-  // dilater and current output image.  Then set the dilater end
-  // slices to be zero (provided that the output image is also zero at
-  // those locations).
+  // Look for voxels changed by the first closing that the second
+  // closing depends on
   //
-  OutputImageType::IndexType index;
-  OutputImageType::SizeType  size = this->GetOutput()->GetBufferedRegion().GetSize();
+  const long secondFirstSlice = closingRegions[1].GetIndex()[2];
+  const long secondLastSlice  = secondFirstSlice + static_cast< long >( closingRegions[1].GetSize()[2] ) - 1;
 
-  for ( unsigned int x=0; x<size[0]; x++ )
-    {
-    index[0] = x;
+  bool secondClosingAffected = false;
 
-    for ( unsigned int y=0; y<size[1]; y++ )
+  LabelMapIteratorType cIt( str.LabelMaps[0], str.LabelMaps[0]->GetBufferedRegion() );
+  LabelMapIteratorType mIt( this->GetOutput(), closingRegions[0] );
+
+  cIt.GoToBegin();
+  mIt.GoToBegin();
+  while ( !mIt.IsAtEnd() && !secondClosingAffected )
+    {
+    if ( cIt.Get() == firstLabel && mIt.Get() != firstLabel && closingRegions[1].IsInside( mIt.GetIndex() ) )
       {
-      index[1] = y;
-      
-      index[2] = 0;
-      if ( this->GetOutput()->GetPixel( index ) == 0 )
-        {
-        dilater->GetOutput()->SetPixel( index, 0 );
-        }
+      long slice = mIt.GetIndex()[2];
 
-      index[2] = size[2]-1;
-      if ( this->GetOutput()->GetPixel( index ) == 0 )
+      if ( mIt.Get() == secondLabel || slice == secondFirstSlice || slice == secondLastSlice )
         {
-        dilater->GetOutput()->SetPixel( index, 0 );
+        secondClosingAffected = true;
         }
       }
+
+    ++cIt;
+    ++mIt;
     }
-  
-  //
-  // Now erode
-  //
-  typename Erode3DType::Pointer eroder = Erode3DType::New();
-    eroder->SetInput( dilater->GetOutput() );
-    eroder->SetKernel( structuringElement );
-    eroder->SetErodeValue( closeLabel );
-  try
+
+  this->PasteClosedLabel( str.LabelMaps[0], closingRegions[0], firstLabel );
+
+  if ( secondClosingAffected )
     {
-    eroder->Update();
+    std::cout << "---Closing overlaps, closing label " << secondLabel << " again..." << std::endl;
+    this->CloseLabelMap( secondLabel );
     }
-  catch ( itk::ExceptionObject &excp )
+  else
+    {
+    this->PasteClosedLabel( str.LabelMaps[1], closingRegions[1], secondLabel );
+    }
+}
+
+
+template < class TInputImage >
+ITK_THREAD_RETURN_TYPE
+PartialLungLabelMapImageFilter< TInputImage >
+::CloseLabelMapThreaderCallback( void* arg )
+{
+  MultiThreader::ThreadInfoStruct* info = static_cast< MultiThreader::ThreadInfoStruct* >( arg );
+
+  unsigned int threadId = info->ThreadID;
+
+  ClosingThreadStruct* str = static_cast< ClosingThreadStruct* >( info->UserData );
+
+  if ( threadId < 2 )
+    {
+    str->Filter->CloseLabelMapRegion( str->LabelMaps[threadId], str->Labels[threadId], str->NumberOfThreads );
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+
+/**
+ * Largest displacement (in voxels) along each axis of the structuring
+ * element used for closing
+ */
+template < class TInputImage >
+void
+PartialLungLabelMapImageFilter< TInputImage >
+::ComputeClosingRadius( long* radius )
+{
+  OutputImageType::SpacingType spacing = this->GetOutput()->GetSpacing();
+
+  for ( unsigned int i=0; i<3; i++ )
+    {
+    radius[i] = static_cast< long >( this->m_ClosingNeighborhood[i] );
+
+    if ( this->m_UseDistanceTransformClosing && this->m_ClosingRadius > 0.0 )
+      {
+      radius[i] = static_cast< long >( vcl_ceil( this->m_ClosingRadius/spacing[i] ) );
+      }
+    }
+}
+
+
+/**
+ * The bounding box of the label padded by the closing radius plus
+ * one, clipped to the output. The dilation of the label stays inside
+ * the box and leaves a layer of undilated voxels on every side of the
+ * box that is not on the border of the output. Any undilated voxel
+ * outside of the box that would erode a voxel of the dilation is
+ * closer (along every axis) to that voxel than some undilated voxel of
+ * this layer, which erodes it as well. The closing of the box is
+ * therefore the closing of the whole output. Returns false if the
+ * label is not in the output.
+ */
+template < class TInputImage >
+bool
+PartialLungLabelMapImageFilter< TInputImage >
+::ComputeClosingRegion( unsigned short label, OutputImageRegionType& closingRegion )
+{
+  OutputImageRegionType      region      = this->GetOutput()->GetBufferedRegion();
+  OutputImageType::IndexType regionStart = region.GetIndex();
+  OutputImageType::SizeType  regionSize  = region.GetSize();
+
+  const LabelMapPixelType* outputBuffer = this->GetOutput()->GetBufferPointer();
+
+  long minIndex[3];
+  long maxIndex[3];
+
+  bool foundLabel = false;
+
+  unsigned long offset = 0;
+  for ( long z=0; z<static_cast< long >( regionSize[2] ); z++ )
+    {
+    for ( long y=0; y<static_cast< long >( regionSize[1] ); y++ )
+      {
+      for ( long x=0; x<static_cast< long >( regionSize[0] ); x++, offset++ )
+        {
+        if ( outputBuffer[offset] != label )
+          {
+          continue;
+          }
+
+        if ( !foundLabel )
+          {
+          minIndex[0] = maxIndex[0] = x;
+          minIndex[1] = maxIndex[1] = y;
+          minIndex[2] = maxIndex[2] = z;
+
+          foundLabel = true;
+          }
+
+        minIndex[0] = std::min( minIndex[0], x );
+        maxIndex[0] = std::max( maxIndex[0], x );
+        minIndex[1] = std::min( minIndex[1], y );
+        maxIndex[1] = std::max( maxIndex[1], y );
+        maxIndex[2] = z;
+        }
+      }
+    }
+
+  if ( !foundLabel )
+    {
+    return false;
+    }
+
+  long radius[3];
+  this->ComputeClosingRadius( radius );
+
+  OutputImageType::IndexType boxStart;
+  OutputImageType::SizeType  boxSize;
+
+  for ( unsigned int i=0; i<3; i++ )
+    {
+    long start = std::max( minIndex[i] - radius[i] - 1, static_cast< long >( 0 ) );
+    long end   = std::min( maxIndex[i] + radius[i] + 1, static_cast< long >( regionSize[i] ) - 1 );
+
+    boxStart[i] = regionStart[i] + start;
+    boxSize[i]  = end - start + 1;
+    }
+
+  closingRegion.SetIndex( boxStart );
+  closingRegion.SetSize( boxSize );
+
+  return true;
+}
+
+
+/**
+ * Cropped copy of the output, disconnected from the pipeline so that
+ * it can be closed in another thread
+ */
+template < class TInputImage >
+typename PartialLungLabelMapImageFilter< TInputImage >::LabelMapType::Pointer
+PartialLungLabelMapImageFilter< TInputImage >
+::ExtractClosingRegion( const OutputImageRegionType& closingRegion )
+{
+  LabelMapROIType::Pointer outputROI = LabelMapROIType::New();
+    outputROI->SetInput( this->GetOutput() );
+    outputROI->SetRegionOfInterest( closingRegion );
+    outputROI->Update();
+
+  LabelMapType::Pointer labelMap = outputROI->GetOutput();
+    labelMap->DisconnectPipeline();
+
+  return labelMap;
+}
+
+
+/**
+ * Apart from 'closeLabel', the closed copy holds the output values, so
+ * only the voxels with that label are pasted
+ */
+template < class TInputImage >
+void
+PartialLungLabelMapImageFilter< TInputImage >
+::PasteClosedLabel( LabelMapType::Pointer labelMap, const OutputImageRegionType& closingRegion, unsigned short closeLabel )
+{
+  LabelMapIteratorType cIt( labelMap, labelMap->GetBufferedRegion() );
+  LabelMapIteratorType mIt( this->GetOutput(), closingRegion );
+
+  cIt.GoToBegin();
+  mIt.GoToBegin();
+  while ( !mIt.IsAtEnd() )
+    {
+    if ( cIt.Get() == closeLabel )
+      {
+      mIt.Set( closeLabel );
+      }
+
+    ++cIt;
+    ++mIt;
+    }
+}
+
+
+template < class TInputImage >
+void
+PartialLungLabelMapImageFilter< TInputImage >
+::CloseLabelMapRegion( LabelMapType::Pointer labelMap, unsigned short closeLabel, unsigned int numberOfThreads )
+{
+  if ( this->m_UseDistanceTransformClosing )
+    {
+    this->CloseLabelMapRegionWithDistanceTransform( labelMap, closeLabel, numberOfThreads );
+    return;
+    }
+
+  //
+  // Perform morphological closing on the mask by dilating and then
+  // eroding.  We assume that at this point in the pipeline, the
+  // output image only has WHOLELUNG as a foreground value.  (The
+  // airways and vessels should be stored in the index vec member
+  // variables). 
+  //
+  Element3DType structuringElement;
+    structuringElement.SetRadius( this->m_ClosingNeighborhood );
+    structuringElement.CreateStructuringElement();
+
+  typename Dilate3DType::Pointer dilater = Dilate3DType::New();
+    dilater->SetInput( labelMap );
+    dilater->SetKernel( structuringElement );
+    dilater->SetDilateValue( closeLabel );
+    dilater->SetNumberOfThreads( numberOfThreads );
+  try
+    {
+    dilater->Update();
+    }
+  catch ( itk::ExceptionObject &excp )
+    {
+    std::cerr << "Exception caught dilating:";
+    std::cerr << excp << std::endl;
+    }
+
+  //
+  // Occasionally, dilation will extend the mask to the end slices. If
+  // this occurs, the erosion step below won't be able to hit these
+  // regions. To deal with this, extract the end slices from the
+  // dilater and current output image.  Then set the dilater end
+  // slices to be zero (provided that the output image is also zero at
+  // those locations).
+  //
+  OutputImageType::IndexType index;
+  OutputImageType::SizeType  size = labelMap->GetBufferedRegion().GetSize();
+
+  for ( unsigned int x=0; x<size[0]; x++ )
+    {
+    index[0] = x;
+
+    for ( unsigned int y=0; y<size[1]; y++ )
+      {
+      index[1] = y;
+      
+      index[2] = 0;
+      if ( labelMap->GetPixel( index ) == 0 )
+        {
+        dilater->GetOutput()->SetPixel( index, 0 );
+        }
+
+      index[2] = size[2]-1;
+      if ( labelMap->GetPixel( index ) == 0 )
+        {
+        dilater->GetOutput()->SetPixel( index, 0 );
+        }
+      }
+    }
+  
+  //
+  // Now erode
+  //
+  typename Erode3DType::Pointer eroder = Erode3DType::New();
+    eroder->SetInput( dilater->GetOutput() );
+    eroder->SetKernel( structuringElement );
+    eroder->SetErodeValue( closeLabel );
+    eroder->SetNumberOfThreads( numberOfThreads );
+  try
+    {
+    eroder->Update();
+    }
+  catch ( itk::ExceptionObject &excp )
     {
     std::cerr << "Exception caught eroding:";
     std::cerr << excp << std::endl;
     }
 
-  LabelMapIteratorType eIt( eroder->GetOutput(), eroder->GetOutput()->GetBufferedRegion() );
-  LabelMapIteratorType mIt( this->GetOutput(), this->GetOutput()->GetBufferedRegion() );
+  LabelMapIteratorType eIt( eroder->GetOutput(), eroder->GetOutput()->GetBufferedRegion() );
+  LabelMapIteratorType mIt( labelMap, labelMap->GetBufferedRegion() );
+
+  eIt.GoToBegin();
+  mIt.GoToBegin();
+  while ( !mIt.IsAtEnd() )
+    {
+    if ( eIt.Get() != 0 )
+      {
+      mIt.Set( eIt.Get() );
+      }
+
+    ++eIt;
+    ++mIt;
+    }
+}
+
+
+/**
+ * Closing with distance maps. Distances are scaled so that the
+ * structuring element is the unit ball. The dilation of the label is
+ * the set of voxels within distance 1 of the label, and the erosion of
+ * the dilation is the set of voxels farther than 1 from any voxel
+ * outside of the dilation. As with the erode filter, voxels outside
+ * of the image do not erode the dilation.
+ */
+template < class TInputImage >
+void
+PartialLungLabelMapImageFilter< TInputImage >
+::CloseLabelMapRegionWithDistanceTransform( LabelMapType::Pointer labelMap, unsigned short closeLabel, unsigned int numberOfThreads )
+{
+  OutputImageRegionType         region         = labelMap->GetBufferedRegion();
+  OutputImageType::SizeType     size           = region.GetSize();
+  OutputImageType::SpacingType  spacing        = labelMap->GetSpacing();
+  const unsigned long           numberOfVoxels = region.GetNumberOfPixels();
+
+  LabelMapPixelType* outputBuffer = labelMap->GetBufferPointer();
+
+  //
+  // The semi-axes of the ball (in voxels) are either the closing
+  // radius over the spacing or those of the ball structuring element
+  // of the closing neighborhood. A small tolerance keeps voxels that
+  // are exactly on the sphere.
+  //
+  SquaredDistanceTransform::WeightsType weights;
+  for ( unsigned int i=0; i<3; i++ )
+    {
+    double semiAxis = static_cast< double >( this->m_ClosingNeighborhood[i] ) + 0.5;
+    if ( this->m_ClosingRadius > 0.0 )
+      {
+      semiAxis = this->m_ClosingRadius/spacing[i];
+      }
+
+    weights[i] = 1.0/(semiAxis*semiAxis);
+    }
+
+  const float unitDistance = 1.0f + 1.0e-5f;
+
+  SquaredDistanceTransform::Pointer distanceTransform = SquaredDistanceTransform::New();
+    distanceTransform->SetAxisWeights( weights );
+    distanceTransform->SetNumberOfThreads( numberOfThreads );
+
+  std::vector< unsigned char > mask( numberOfVoxels );
+  std::vector< float >         distances( numberOfVoxels );
+
+  //
+  // Dilate
+  //
+  for ( unsigned long i=0; i<numberOfVoxels; i++ )
+    {
+    mask[i] = outputBuffer[i] == closeLabel ? 1 : 0;
+    }
+
+  distanceTransform->Compute( &mask[0], region, &distances[0] );
+
+  for ( unsigned long i=0; i<numberOfVoxels; i++ )
+    {
+    mask[i] = distances[i] <= unitDistance ? 1 : 0;
+    }
+
+  //
+  // As for the structuring element closing, the dilation is removed
+  // from the end slices where the output is zero so that the erosion
+  // can reach these regions
+  //
+  const unsigned long sliceSize = size[0]*size[1];
+  const unsigned long lastSlice = (size[2]-1)*sliceSize;
+
+  for ( unsigned long i=0; i<sliceSize; i++ )
+    {
+    if ( outputBuffer[i] == 0 )
+      {
+      mask[i] = 0;
+      }
+    if ( outputBuffer[lastSlice+i] == 0 )
+      {
+      mask[lastSlice+i] = 0;
+      }
+    }
+
+  //
+  // Now erode. Voxels outside of the dilation are at distance 0, so
+  // only the voxels of the eroded dilation are farther than 1.
+  //
+  for ( unsigned long i=0; i<numberOfVoxels; i++ )
+    {
+    mask[i] = 1 - mask[i];
+    }
+
+  distanceTransform->Compute( &mask[0], region, &distances[0] );
+
+  for ( unsigned long i=0; i<numberOfVoxels; i++ )
+    {
+    if ( distances[i] > unitDistance )
+      {
+      outputBuffer[i] = closeLabel;
+      }
+    }
+}
+
+
+/**
+ * Find the airway seeds, grow the airways from them and remove them
+ * (with their dark neighbors) from the output. Small components left
+ * over in the output are removed as well.
+ */
+template < class TInputImage >
+void
+PartialLungLabelMapImageFilter< TInputImage >
+::SegmentAndRemoveAirways()
+{
+  //
+  // Identify airways
+  //
+  this->m_Profiler->StartStage( "AirwaySeedDetection" );
+  std::vector< OutputImageType::IndexType > airwaySeedVec = this->GetAirwaySeeds();
+  this->m_Profiler->StopStage();
+
+  std::cout << "---Segmenting airways..." << std::endl;
+  this->m_Profiler->StartStage( "AirwayGrowing" );
+  typename AirwaySegmentationType::Pointer airwaySegmenter = AirwaySegmentationType::New();
+    airwaySegmenter->SetInput( this->m_WorkingInput );
+    airwaySegmenter->SetMaxAirwayVolumeIncreaseRate( this->m_MaxAirwayVolumeIncreaseRate );
+    airwaySegmenter->SetMinAirwayVolume( this->m_MinAirwayVolume );
+    airwaySegmenter->SetMaxAirwayVolume( this->m_MaxAirwayVolume );
+    airwaySegmenter->SetUsePriorityFlood( this->m_UseAirwayPriorityFlood );
+    airwaySegmenter->SetCoarseToFineShrinkFactor( this->m_AirwayCoarseToFineShrinkFactor );
+    airwaySegmenter->SetIntensityHistogram( this->GetInputHistogram() );
+  for ( unsigned int i=0; i<airwaySeedVec.size(); i++ )
+    {
+    airwaySegmenter->AddSeed( airwaySeedVec[i] );
+    }          
+    airwaySegmenter->Update();
+  this->m_Profiler->StopStage();
+
+  if ( this->m_UseAirwayPriorityFlood )
+    {
+    std::cout << "---Airway threshold:\t" << airwaySegmenter->GetFinalThreshold() << std::endl;
+    std::cout << "---Airway volume curve points:\t" << airwaySegmenter->GetThresholdVolumeCurve().size() << std::endl;
+    }
+
+  std::cout << "---Writing airway segmentation..." << std::endl;
+  //WriterType::Pointer writerAirway1 = WriterType::New();
+  //writerAirway1->SetInput( airwaySegmenter->GetOutput() );
+  //writerAirway1->SetFileName( "/spl/tmp/sila/airwaySegmenter.nhdr" );
+  //writerAirway1->UseCompressionOn();
+  //writerAirway1->Update();
+
+//   std::cout << "---Removing trachea and main bronchi..." << std::endl;
+//   this->RemoveTracheaAndMainBronchi();
+
+//   std::cout << "---Writing airway label map..." << std::endl;
+//   WriterType::Pointer writerAirway = WriterType::New();
+//   writerAirway->SetInput( this->m_AirwayLabelMap );
+//   writerAirway->SetFileName( "/projects/lmi/people/jross/tmp/airway.nhdr" );
+//   writerAirway->UseCompressionOn();
+//   writerAirway->Update();
+
+  //
+  // Collect / remove airway indices
+  //
+  this->m_Profiler->StartStage( "AirwayRemoval" );
+  this->RecordAndRemoveAirways( airwaySegmenter->GetOutput() );  
+  this->m_Profiler->StopStage();
+  std::cout << "---record and remove airways done..." << std::endl;
+  //
+  // There may still be small foreground regions
+  // within the trachea / main bronchi that were not picked up via the
+  // airway segmentation routine. We'll zero out all components that
+  // don't accomodate for a significant portion of the overall
+  // foreground region
+  //
+  this->m_Profiler->StartStage( "ComponentFiltering" );
 
-  eIt.GoToBegin();
-  mIt.GoToBegin();
-  while ( !mIt.IsAtEnd() )
+  ConnectedComponentLabeler::Pointer labeler = ConnectedComponentLabeler::New( this->GetNumberOfThreads(), false );
+    labeler->Execute( this->GetOutput() );
+
+  unsigned long totalSize = 0;
+
+  for ( unsigned long i=1; i<=labeler->GetNumberOfComponents(); i++ )
     {
-    if ( eIt.Get() != 0 )
+    totalSize += labeler->GetComponentSize( i );
+    }  
+
+  LabelMapPixelType* outputBuffer = this->GetOutput()->GetBufferPointer();
+
+  RunLengthLabelMap::ConstRunIterator rIt( labeler->GetRunLengthLabelMap() );
+
+  for ( rIt.GoToBegin(); !rIt.IsAtEnd(); ++rIt )
+    {
+    unsigned long label = labeler->GetRunLabel( rIt.GetRunNumber() );
+
+    if ( static_cast< double >( labeler->GetComponentSize( label ) )/static_cast< double >( totalSize ) < 0.20 )
       {
-      mIt.Set( eIt.Get() );
+      std::fill( outputBuffer + rIt.GetOffset(), outputBuffer + rIt.GetOffset() + rIt.GetLength(), 0 );
       }
+    }
+  this->m_Profiler->StopStage();
+  std::cout << "---remove small connected components done..." << std::endl;
+}
 
-    ++eIt;
-    ++mIt;
+
+/**
+ * The lung mask depends on the input, the helper mask and the
+ * thresholds. The version string must be changed whenever the
+ * stages up to the checkpoint are changed in a way that changes
+ * their results.
+ */
+template < class TInputImage >
+StageCheckpointKey
+PartialLungLabelMapImageFilter< TInputImage >
+::ComputeLungMaskCheckpointKey()
+{
+  StageCheckpointKey key;
+    key.Add( std::string( "PartialLungLabelMap 1" ) );
+
+  const InputImageType* input = this->GetInput();
+
+  for ( unsigned int i=0; i<3; i++ )
+    {
+    key.Add( static_cast< long >( input->GetBufferedRegion().GetSize()[i] ) );
+    key.Add( static_cast< double >( input->GetSpacing()[i] ) );
+    }
+  key.Add( input->GetBufferPointer(), input->GetBufferedRegion().GetNumberOfPixels()*sizeof( InputPixelType ) );
+
+  if ( this->m_HelperMask.IsNotNull() )
+    {
+    key.Add( this->m_HelperMask->GetBufferPointer(), this->m_HelperMask->GetBufferedRegion().GetNumberOfPixels()*sizeof( LabelMapPixelType ) );
+    }
+  else
+    {
+    key.Add( this->m_ManualThreshold );
+    key.Add( this->m_StdLungThreshold );
+    }
+
+  return key;
+}
+
+
+/**
+ * The airway removal depends on the lung mask, the lung bounding box
+ * and the airway parameters
+ */
+template < class TInputImage >
+StageCheckpointKey
+PartialLungLabelMapImageFilter< TInputImage >
+::ComputeAirwaysCheckpointKey( const StageCheckpointKey& lungMaskKey )
+{
+  StageCheckpointKey key;
+    key.Add( lungMaskKey );
+
+  for ( unsigned int i=0; i<3; i++ )
+    {
+    key.Add( static_cast< long >( this->m_LungBoundingBox.GetIndex()[i] ) );
+    key.Add( static_cast< long >( this->m_LungBoundingBox.GetSize()[i] ) );
     }
+
+  key.Add( this->m_MinVolPercentAirway );
+  key.Add( this->m_MaxVolPercentAirway );
+  key.Add( this->m_MaxAirwayVolumeIncreaseRate );
+  key.Add( this->m_UseAirwayPriorityFlood );
+  key.Add( this->m_AirwayCoarseToFineShrinkFactor );
+  key.Add( this->m_HeadFirst );
+
+  return key;
+}
+
+
+template < class TInputImage >
+StageCheckpointCache::SectionsType
+PartialLungLabelMapImageFilter< TInputImage >
+::GetLungMaskCheckpointSections()
+{
+  StageCheckpointCache::SectionsType sections;
+
+  StageCheckpointCache::AddSection( sections, this->GetOutput()->GetBufferPointer(),
+                                    this->GetOutput()->GetBufferedRegion().GetNumberOfPixels()*sizeof( LabelMapPixelType ) );
+  StageCheckpointCache::AddSection( sections, &this->m_OtsuThreshold, sizeof( this->m_OtsuThreshold ) );
+
+  return sections;
+}
+
+
+template < class TInputImage >
+StageCheckpointCache::SectionsType
+PartialLungLabelMapImageFilter< TInputImage >
+::GetAirwaysCheckpointSections()
+{
+  StageCheckpointCache::SectionsType sections;
+
+  StageCheckpointCache::AddSection( sections, this->GetOutput()->GetBufferPointer(),
+                                    this->GetOutput()->GetBufferedRegion().GetNumberOfPixels()*sizeof( LabelMapPixelType ) );
+  StageCheckpointCache::AddSection( sections, this->m_AirwayLabelMap->GetBufferPointer(),
+                                    this->m_AirwayLabelMap->GetBufferedRegion().GetNumberOfPixels()*sizeof( LabelMapPixelType ) );
+
+  return sections;
 }
 
 
@@ -817,12 +1349,10 @@ PartialLungLabelMapImageFilter< TInputImage >
 
  unsigned short airwayLabel = conventions.GetValueFromLungRegionAndType( static_cast< unsigned char >( UNDEFINEDREGION ), static_cast< unsigned char >( AIRWAY ) );
 
-  this->m_AirwayLabelMap->SetRegions( this->GetInput()->GetBufferedRegion().GetSize() );
+  this->m_AirwayLabelMap->SetRegions( this->m_WorkingInput->GetBufferedRegion().GetSize() );
   this->m_AirwayLabelMap->Allocate();
   this->m_AirwayLabelMap->FillBuffer( 0 );
 
-  LabelMapType::IndexType index;
-
   LabelMapIteratorType aIt( airwayLabelMap, airwayLabelMap->GetBufferedRegion() );
   LabelMapIteratorType maIt( this->m_AirwayLabelMap, this->m_AirwayLabelMap->GetBufferedRegion() );
 
@@ -847,40 +1377,18 @@ PartialLungLabelMapImageFilter< TInputImage >
   // out all the voxels around the airway segmentation. A 3x3x3
   // neighborhood is reasonable
   //
+  NeighborhoodType neighborhood( this->GetOutput()->GetBufferedRegion() );
+
+  AirwayNeighborFunctor airwayNeighbor;
+    airwayNeighbor.Input       = this->m_WorkingInput->GetBufferPointer();
+    airwayNeighbor.Threshold   = this->m_OtsuThreshold;
+    airwayNeighbor.Output      = this->GetOutput()->GetBufferPointer();
+    airwayNeighbor.Airway      = this->m_AirwayLabelMap->GetBufferPointer();
+    airwayNeighbor.AirwayLabel = airwayLabel;
+
   for ( unsigned int i=0; i<1; i++ )
     {
-    aIt.GoToBegin();
-    while ( !aIt.IsAtEnd() )
-      {
-      if ( aIt.Get() != 0 )
-        {       
-        for ( int x=-1; x<=1; x++ )
-          {
-          index[0] = aIt.GetIndex()[0] + x;
-          
-          for ( int y=-1; y<=1; y++ )
-            {
-            index[1] = aIt.GetIndex()[1] + y;
-            
-            for ( int z=-1; z<=1; z++ )
-              {
-              index[2] = aIt.GetIndex()[2] + z;
-              
-              if ( this->GetOutput()->GetBufferedRegion().IsInside( index ) )
-                {               
-                if ( this->GetInput()->GetPixel( index ) <= this->m_OtsuThreshold )
-                  {
-                  this->GetOutput()->SetPixel( index, 0 );
-                  this->m_AirwayLabelMap->SetPixel( index, airwayLabel );
-                  }             
-                }
-              }
-            }
-          }
-        }
-      
-      ++aIt;
-      }
+    neighborhood.VisitMaskedNeighbors( airwayLabelMap->GetBufferPointer(), airwayNeighbor );
 
     aIt.GoToBegin();
     maIt.GoToBegin();
@@ -907,59 +1415,516 @@ PartialLungLabelMapImageFilter< TInputImage >
 
 
 template < class TInputImage >
-void
+void
+PartialLungLabelMapImageFilter< TInputImage >
+::AddAirwaySegmentationSeed( OutputImageType::IndexType index )
+{
+  this->m_AirwaySegmentationSeedVec.push_back( index );
+}
+
+
+template < class TInputImage >
+void
+PartialLungLabelMapImageFilter< TInputImage >
+::SetAirwayLabelMap( OutputImageType::Pointer airwayLabelMap )
+{
+  this->m_AirwayLabelMap = airwayLabelMap;
+}
+
+
+template < class TInputImage >
+void
+PartialLungLabelMapImageFilter< TInputImage >
+::SetHelperMask( OutputImageType::Pointer helperMask )
+{
+  this->m_HelperMask = helperMask;
+}
+
+
+template < class TInputImage >
+typename PartialLungLabelMapImageFilter< TInputImage >::SweepParametersType
+PartialLungLabelMapImageFilter< TInputImage >
+::GetSweepParameters() const
+{
+  SweepParametersType parameters;
+    parameters.ManualThreshold          = this->m_ManualThreshold;
+    parameters.LeftRightLungSplitRadius = this->m_LeftRightLungSplitRadius;
+    parameters.ClosingNeighborhood[0]   = this->m_ClosingNeighborhood[0];
+    parameters.ClosingNeighborhood[1]   = this->m_ClosingNeighborhood[1];
+    parameters.ClosingNeighborhood[2]   = this->m_ClosingNeighborhood[2];
+    parameters.ClosingRadius            = this->m_ClosingRadius;
+    parameters.MinVolPercentAirway      = this->m_MinVolPercentAirway;
+    parameters.MaxVolPercentAirway      = this->m_MaxVolPercentAirway;
+
+  return parameters;
+}
+
+
+template < class TInputImage >
+void
+PartialLungLabelMapImageFilter< TInputImage >
+::AddSweepParameters( const SweepParametersType& parameters )
+{
+  this->m_SweepParameters.push_back( parameters );
+}
+
+
+template < class TInputImage >
+void
+PartialLungLabelMapImageFilter< TInputImage >
+::ClearSweepParameters()
+{
+  this->m_SweepParameters.clear();
+}
+
+
+/**
+ * The runs of a sweep form a tree: the runs with the same lung mask
+ * and airway parameters share the stages up to the airway removal and
+ * only branch after it. The first run of each branch is done on its
+ * own (stages it shares with an earlier branch, e.g. the lung mask,
+ * are loaded from the cache) and stores the shared stages. All the
+ * other runs then only load them, so they are done concurrently.
+ */
+template < class TInputImage >
+void
+PartialLungLabelMapImageFilter< TInputImage >
+::RunParameterSweep()
+{
+  if ( this->GetInput() == 0 )
+    {
+    itkExceptionMacro( << "The input must be set before running a sweep" );
+    }
+
+  this->m_SweepResults.clear();
+  this->m_SweepResults.resize( this->m_SweepParameters.size() );
+
+  StageCheckpointCache::Pointer cache = this->m_CheckpointCache;
+  if ( cache.IsNull() )
+    {
+    cache = StageCheckpointCache::New();
+    }
+
+  std::vector< unsigned int > branchRuns;
+  std::vector< unsigned int > otherRuns;
+
+  for ( unsigned int i=0; i<this->m_SweepParameters.size(); i++ )
+    {
+    bool sharesBranch = false;
+    for ( unsigned int j=0; j<branchRuns.size() && !sharesBranch; j++ )
+      {
+      sharesBranch = this->SweepRunsShareAirwayStages( this->m_SweepParameters[i], this->m_SweepParameters[branchRuns[j]] );
+      }
+
+    if ( sharesBranch )
+      {
+      otherRuns.push_back( i );
+      }
+    else
+      {
+      branchRuns.push_back( i );
+      }
+    }
+
+  std::cout << "---Sweep runs:\t" << this->m_SweepParameters.size() << "\t branches:\t" << branchRuns.size() << std::endl;
+
+  for ( unsigned int i=0; i<branchRuns.size(); i++ )
+    {
+    this->RunSweep( branchRuns[i], cache, this->GetNumberOfThreads() );
+    }
+
+  if ( otherRuns.size() == 0 )
+    {
+    return;
+    }
+
+  unsigned int numberOfConcurrentRuns = std::min( static_cast< unsigned int >( otherRuns.size() ),
+                                                  static_cast< unsigned int >( this->GetNumberOfThreads() ) );
+
+  SweepThreadStruct str;
+    str.Filter          = this;
+    str.Cache           = cache;
+    str.Runs            = &otherRuns;
+    str.NumberOfThreads = std::max( static_cast< unsigned int >( this->GetNumberOfThreads() )/numberOfConcurrentRuns, 1u );
+
+  this->GetMultiThreader()->SetNumberOfThreads( numberOfConcurrentRuns );
+  this->GetMultiThreader()->SetSingleMethod( this->SweepThreaderCallback, &str );
+  this->GetMultiThreader()->SingleMethodExecute();
+}
+
+
+template < class TInputImage >
+ITK_THREAD_RETURN_TYPE
+PartialLungLabelMapImageFilter< TInputImage >
+::SweepThreaderCallback( void* arg )
+{
+  MultiThreader::ThreadInfoStruct* info = static_cast< MultiThreader::ThreadInfoStruct* >( arg );
+
+  unsigned int threadId    = info->ThreadID;
+  unsigned int threadCount = info->NumberOfThreads;
+
+  SweepThreadStruct* str = static_cast< SweepThreadStruct* >( info->UserData );
+
+  for ( unsigned int i=threadId; i<str->Runs->size(); i += threadCount )
+    {
+    str->Filter->RunSweep( (*str->Runs)[i], str->Cache, str->NumberOfThreads );
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+
+/**
+ * Two runs share the stages up to the airway removal if they have the
+ * same lung mask and airway parameters. When the lung bounding box is
+ * used, the box padding depends on the closing radius in mm if it is
+ * used (distance transform closing with a nonzero radius), or else on
+ * the closing neighborhood, so that must be the same as well.
+ */
+template < class TInputImage >
+bool
+PartialLungLabelMapImageFilter< TInputImage >
+::SweepRunsShareAirwayStages( const SweepParametersType& first, const SweepParametersType& second ) const
+{
+  if ( this->m_HelperMask.IsNull() && first.ManualThreshold != second.ManualThreshold )
+    {
+    return false;
+    }
+
+  if ( first.MinVolPercentAirway != second.MinVolPercentAirway || first.MaxVolPercentAirway != second.MaxVolPercentAirway )
+    {
+    return false;
+    }
+
+  if ( this->m_UseLungBoundingBox )
+    {
+    if ( this->m_UseDistanceTransformClosing && first.ClosingRadius != second.ClosingRadius )
+      {
+      return false;
+      }
+
+    if ( !(this->m_UseDistanceTransformClosing && first.ClosingRadius > 0.0) )
+      {
+      for ( unsigned int i=0; i<3; i++ )
+        {
+        if ( first.ClosingNeighborhood[i] != second.ClosingNeighborhood[i] )
+          {
+          return false;
+          }
+        }
+      }
+    }
+
+  return true;
+}
+
+
+/**
+ * Run the pipeline with a filter configured as this one except for
+ * the sweep parameters. The filter gets its own images sharing the
+ * buffers of the input and helper mask, so that concurrent runs do
+ * not update the same image objects.
+ */
+template < class TInputImage >
+void
+PartialLungLabelMapImageFilter< TInputImage >
+::RunSweep( unsigned int run, StageCheckpointCache* cache, unsigned int numberOfThreads )
+{
+  const SweepParametersType& parameters = this->m_SweepParameters[run];
+
+  typename InputImageType::Pointer input = InputImageType::New();
+    input->CopyInformation( this->GetInput() );
+    input->SetRegions( this->GetInput()->GetBufferedRegion() );
+    input->SetPixelContainer( const_cast< typename InputImageType::PixelContainer* >( this->GetInput()->GetPixelContainer() ) );
+
+  typename Self::Pointer filter = Self::New();
+    filter->SetInput( input );
+    filter->SetNumberOfThreads( numberOfThreads );
+    filter->SetCheckpointCache( cache );
+    filter->SetStdLungThreshold( this->m_StdLungThreshold );
+    filter->SetMaxAirwayVolumeIncreaseRate( this->m_MaxAirwayVolumeIncreaseRate );
+    filter->SetUseAirwayPriorityFlood( this->m_UseAirwayPriorityFlood );
+    filter->SetAirwayCoarseToFineShrinkFactor( this->m_AirwayCoarseToFineShrinkFactor );
+    filter->SetUseLungBoundingBox( this->m_UseLungBoundingBox );
+    filter->SetLungBoundingBoxPadding( this->m_LungBoundingBoxPadding );
+    filter->SetParallelConditionalDilation( this->m_ParallelConditionalDilation );
+    filter->SetUseDistanceTransformClosing( this->m_UseDistanceTransformClosing );
+    filter->SetClosingRadius( parameters.ClosingRadius );
+    filter->SetConcurrentClosing( this->m_ConcurrentClosing );
+    filter->SetExponentialCoefficient( this->m_ExponentialCoefficient );
+    filter->SetExponentialTimeConstant( this->m_ExponentialTimeConstant );
+    filter->SetHeadFirst( this->m_HeadFirst );
+    filter->SetSupine( this->m_Supine );
+    filter->SetAggressiveLeftRightSplitter( this->m_AggressiveLeftRightSplitter );
+    filter->SetUseSeamSolver( this->m_UseSeamSolver );
+    filter->SetGraphSearchFallback( this->m_GraphSearchFallback );
+    filter->SetNarrowBandRadius( this->m_NarrowBandRadius );
+    filter->SetParallelSplitting( this->m_ParallelSplitting );
+    filter->SetManualThreshold( parameters.ManualThreshold );
+    filter->SetLeftRightLungSplitRadius( parameters.LeftRightLungSplitRadius );
+    filter->SetMinVolPercentAirway( parameters.MinVolPercentAirway );
+    filter->SetMaxVolPercentAirway( parameters.MaxVolPercentAirway );
+    filter->GetProfiler()->SetUsePerformanceCounters( this->m_Profiler->GetUsePerformanceCounters() );
+
+  unsigned long closingNeighborhood[3];
+  for ( unsigned int i=0; i<3; i++ )
+    {
+    closingNeighborhood[i] = parameters.ClosingNeighborhood[i];
+    }
+  filter->SetClosingNeighborhood( closingNeighborhood );
+
+  if ( this->m_HelperMask.IsNotNull() )
+    {
+    LabelMapType::Pointer helperMask = LabelMapType::New();
+      helperMask->CopyInformation( this->m_HelperMask );
+      helperMask->SetRegions( this->m_HelperMask->GetBufferedRegion() );
+      helperMask->SetPixelContainer( this->m_HelperMask->GetPixelContainer() );
+
+    filter->SetHelperMask( helperMask );
+    }
+
+  SweepResultType& result = this->m_SweepResults[run];
+    result.Parameters = parameters;
+    result.Profiler   = filter->GetProfiler();
+
+  try
+    {
+    filter->Update();
+
+    result.LabelMap = filter->GetOutput();
+    result.LabelMap->DisconnectPipeline();
+    }
+  catch ( itk::ExceptionObject &excp )
+    {
+    std::cerr << "Exception caught in sweep run " << run << ":";
+    std::cerr << excp << std::endl;
+    }
+}
+
+
+template < class TInputImage >
+void
+PartialLungLabelMapImageFilter< TInputImage >
+::ApplyHelperMask()
+{
+  //
+  // Set the output to the helper mask 
+  //
+  this->CopyLabelMapToOutput( this->m_HelperMask );
+
+  //
+  // The 'ApplyOtsuThreshold' routine typically sets the otsu
+  // threshold. Because it is not called in favor of calling this
+  // method, we have to set the threshold to a reasonable level
+  //
+  this->m_OtsuThreshold = -400;  
+}
+
+
+/**
+ * Voxel pass using the threads of the filter. Element-wise loops
+ * over the output and the images of the same size are done with
+ * voxel passes, fusing consecutive loops into one pass where
+ * possible.
+ */
+template < class TInputImage >
+VoxelPass::Pointer
 PartialLungLabelMapImageFilter< TInputImage >
-::AddAirwaySegmentationSeed( OutputImageType::IndexType index )
+::CreateVoxelPass()
 {
-  this->m_AirwaySegmentationSeedVec.push_back( index );
+  VoxelPass::Pointer pass = VoxelPass::New();
+    pass->SetNumberOfThreads( this->GetNumberOfThreads() );
+
+  return pass;
 }
 
 
+/**
+ * The histogram of the input is computed the first time it is needed
+ * during an update
+ */
 template < class TInputImage >
-void
+IntensityHistogram*
 PartialLungLabelMapImageFilter< TInputImage >
-::SetAirwayLabelMap( OutputImageType::Pointer airwayLabelMap )
+::GetInputHistogram()
 {
-  this->m_AirwayLabelMap = airwayLabelMap;
+  if ( this->m_InputHistogram.IsNull() )
+    {
+    this->m_InputHistogram = IntensityHistogram::New();
+    this->m_InputHistogram->SetNumberOfThreads( this->GetNumberOfThreads() );
+    this->m_InputHistogram->Compute( this->GetInput() );
+    }
+
+  return this->m_InputHistogram.GetPointer();
 }
 
 
+/**
+ * Copy a label map with the buffered region of the output into the
+ * output
+ */
 template < class TInputImage >
 void
 PartialLungLabelMapImageFilter< TInputImage >
-::SetHelperMask( OutputImageType::Pointer helperMask )
+::CopyLabelMapToOutput( const LabelMapType* labelMap )
 {
-  this->m_HelperMask = helperMask;
+  VoxelCopyOperation< LabelMapPixelType > copy( labelMap->GetBufferPointer(), this->GetOutput()->GetBufferPointer() );
+
+  VoxelPass::Pointer pass = this->CreateVoxelPass();
+    pass->AddOperation( &copy );
+    pass->Execute( this->GetOutput()->GetBufferedRegion().GetNumberOfPixels() );
 }
 
 
+/**
+ * Compute the bounding box of the foreground of the output (the
+ * thresholded lungs and airways), pad it and crop the output, the
+ * input and the helper mask to it. The cropped images start at index
+ * zero (their origin is moved so that they stay in place physically),
+ * so the later stages need no change. If the output has no
+ * foreground, nothing is cropped.
+ */
 template < class TInputImage >
 void
 PartialLungLabelMapImageFilter< TInputImage >
-::ApplyHelperMask()
+::CropToLungBoundingBox()
 {
-  //
-  // Set the output to the helper mask 
-  //
-  LabelMapIteratorType mIt( this->GetOutput(), this->GetOutput()->GetBufferedRegion() );
-  LabelMapIteratorType hIt( this->m_HelperMask, this->m_HelperMask->GetBufferedRegion() );
+  OutputImageRegionType region = this->GetOutput()->GetBufferedRegion();
+
+  OutputImageType::IndexType minIndex;
+  OutputImageType::IndexType maxIndex;
+
+  bool foundForeground = false;
+
+  LabelMapIteratorType mIt( this->GetOutput(), region );
 
   mIt.GoToBegin();
-  hIt.GoToBegin();
   while ( !mIt.IsAtEnd() )
     {
-    mIt.Set( hIt.Get() );
+    if ( mIt.Get() != 0 )
+      {
+      OutputImageType::IndexType index = mIt.GetIndex();
+
+      if ( !foundForeground )
+        {
+        minIndex = index;
+        maxIndex = index;
+
+        foundForeground = true;
+        }
+
+      for ( unsigned int i=0; i<3; i++ )
+        {
+        if ( index[i] < minIndex[i] )
+          {
+          minIndex[i] = index[i];
+          }
+        if ( index[i] > maxIndex[i] )
+          {
+          maxIndex[i] = index[i];
+          }
+        }
+      }
 
     ++mIt;
-    ++hIt;
     }
 
-  //
-  // The 'ApplyOtsuThreshold' routine typically sets the otsu
-  // threshold. Because it is not called in favor of calling this
-  // method, we have to set the threshold to a reasonable level
-  //
-  this->m_OtsuThreshold = -400;  
+  if ( !foundForeground )
+    {
+    return;
+    }
+
+  OutputImageType::IndexType regionStart = region.GetIndex();
+  OutputImageType::SizeType  regionSize  = region.GetSize();
+
+  OutputImageType::IndexType boxStart;
+  OutputImageType::SizeType  boxSize;
+
+  long closingRadius[3];
+  this->ComputeClosingRadius( closingRadius );
+
+  for ( unsigned int i=0; i<3; i++ )
+    {
+    //
+    // Closing dilates by the closing radius, so the box must be at
+    // least that much bigger than the lungs for closing to give the
+    // same result as on the full image
+    //
+    long padding = static_cast< long >( this->m_LungBoundingBoxPadding );
+    if ( padding < closingRadius[i] + 1 )
+      {
+      padding = closingRadius[i] + 1;
+      }
+
+    long start = std::max( static_cast< long >( minIndex[i] ) - padding, static_cast< long >( regionStart[i] ) );
+    long end   = std::min( static_cast< long >( maxIndex[i] ) + padding, static_cast< long >( regionStart[i] + regionSize[i] ) - 1 );
+
+    boxStart[i] = start;
+    boxSize[i]  = end - start + 1;
+    }
+
+  this->m_LungBoundingBox.SetIndex( boxStart );
+  this->m_LungBoundingBox.SetSize( boxSize );
+
+  std::cout << "---Lung bounding box:\t" << boxStart[0] << " " << boxStart[1] << " " << boxStart[2] << "\t" 
+            << boxSize[0] << " " << boxSize[1] << " " << boxSize[2] << std::endl;
+
+  typename InputROIType::Pointer inputROI = InputROIType::New();
+    inputROI->SetInput( this->GetInput() );
+    inputROI->SetRegionOfInterest( this->m_LungBoundingBox );
+    inputROI->Update();
+
+  this->m_WorkingInput = inputROI->GetOutput();
+
+  if ( this->m_HelperMask.IsNotNull() )
+    {
+    LabelMapROIType::Pointer helperROI = LabelMapROIType::New();
+      helperROI->SetInput( this->m_HelperMask );
+      helperROI->SetRegionOfInterest( this->m_LungBoundingBox );
+      helperROI->Update();
+
+    this->m_WorkingHelperMask = helperROI->GetOutput();
+    }
+
+  LabelMapROIType::Pointer outputROI = LabelMapROIType::New();
+    outputROI->SetInput( this->GetOutput() );
+    outputROI->SetRegionOfInterest( this->m_LungBoundingBox );
+    outputROI->Update();
+
+  this->GraftOutput( outputROI->GetOutput() );
+}
+
+
+/**
+ * Paste the (cropped) output back into a full size label map and make
+ * that the output
+ */
+template < class TInputImage >
+void
+PartialLungLabelMapImageFilter< TInputImage >
+::PasteLungBoundingBox()
+{
+  LabelMapType::Pointer fullLabelMap = LabelMapType::New();
+    fullLabelMap->CopyInformation( this->GetInput() );
+    fullLabelMap->SetRequestedRegion( this->GetInput()->GetRequestedRegion() );
+    fullLabelMap->SetBufferedRegion( this->GetInput()->GetBufferedRegion() );
+    fullLabelMap->Allocate();
+    fullLabelMap->FillBuffer( 0 );
+
+  LabelMapIteratorType cIt( this->GetOutput(), this->GetOutput()->GetBufferedRegion() );
+  LabelMapIteratorType fIt( fullLabelMap, this->m_LungBoundingBox );
+
+  cIt.GoToBegin();
+  fIt.GoToBegin();
+  while ( !cIt.IsAtEnd() )
+    {
+    fIt.Set( cIt.Get() );
+
+    ++cIt;
+    ++fIt;
+    }
+
+  this->GraftOutput( fullLabelMap );
 }
 
 
@@ -978,33 +1943,42 @@ PartialLungLabelMapImageFilter< TInputImage >
 ::ApplyOtsuThreshold()
 {
   //
-  // The first step is to run Otsu threshold on the input data.  This
-  // classifies each voxel as either "body" or "air"
+  // The first step is to compute the Otsu threshold of the input
+  // data. This classifies each voxel as either "body" or "air". The
+  // threshold comes from the input histogram, which is shared with
+  // the later stages.
   //
-  typename OtsuThresholdType::Pointer otsuThreshold = OtsuThresholdType::New();
-    otsuThreshold->SetInput( this->GetInput() );
-    otsuThreshold->Update();
-
-
+  short otsuThreshold = this->GetInputHistogram()->ComputeOtsuThreshold( 128 );
 
-  this->m_OtsuThreshold = otsuThreshold->GetThreshold();
+  this->m_OtsuThreshold = otsuThreshold;
 
   // sila
   // If the Otsu Threshold cannot find the right threshold, then threshold using the fixed LungThreshold
-  OutputImageType::Pointer temp_output = OutputImageType::New();
-  if ( otsuThreshold->GetThreshold() <= this->m_ManualThreshold-this->m_StdLungThreshold ||  otsuThreshold->GetThreshold() >= this->m_ManualThreshold+this->m_StdLungThreshold )
+  short lowerThreshold = itk::NumericTraits< short >::min();
+
+  if ( otsuThreshold <= this->m_ManualThreshold-this->m_StdLungThreshold ||  otsuThreshold >= this->m_ManualThreshold+this->m_StdLungThreshold )
      {
-	  typename BinaryThresholdType::Pointer binaryThreshold = BinaryThresholdType::New();
-	  binaryThreshold->SetInput(this->GetInput() );
-	  binaryThreshold->SetLowerThreshold(-3000);
-	  binaryThreshold->SetUpperThreshold(this->m_ManualThreshold);
+	  lowerThreshold = -3000;
 	  std::cout << "m_ManualThreshold: " << this->m_ManualThreshold << "\n";
-	  binaryThreshold->Update();
-	  temp_output = binaryThreshold->GetOutput();
 	  this->m_OtsuThreshold = this->m_ManualThreshold;
      }
-  else
-	  temp_output = otsuThreshold->GetOutput();
+
+  //
+  // Either way the volume is thresholded once, voxels at or below the
+  // threshold being foreground
+  //
+  OutputImageType::Pointer temp_output = OutputImageType::New();
+    temp_output->CopyInformation( this->GetInput() );
+    temp_output->SetRegions( this->GetInput()->GetBufferedRegion() );
+    temp_output->Allocate();
+
+  VoxelThresholdOperation< InputPixelType, LabelMapPixelType >
+    threshold( this->GetInput()->GetBufferPointer(), temp_output->GetBufferPointer(), lowerThreshold,
+               this->m_OtsuThreshold, itk::NumericTraits< LabelMapPixelType >::max(), 0 );
+
+  VoxelPass::Pointer thresholdPass = this->CreateVoxelPass();
+    thresholdPass->AddOperation( &threshold );
+    thresholdPass->Execute( this->GetInput()->GetBufferedRegion().GetNumberOfPixels() );
 
    //std::cout << "---Writing Binary Thresh image..." << std::endl;
    //typedef itk::ImageFileWriter< OutputImageType > WriterType;
@@ -1031,15 +2005,8 @@ PartialLungLabelMapImageFilter< TInputImage >
   // The next step is to identify all connected components in the
   // thresholded image
   //
-  ConnectedComponent3DType::Pointer connectedComponent = ConnectedComponent3DType::New();
-    connectedComponent->SetInput( temp_output );
-
-  //
-  // Relabel the connected components
-  //
-  Relabel3DType::Pointer relabelComponent = Relabel3DType::New();
-    relabelComponent->SetInput( connectedComponent->GetOutput() );
-    relabelComponent->Update();  
+  ConnectedComponentLabeler::Pointer labeler = ConnectedComponentLabeler::New( this->GetNumberOfThreads(), false );
+    labeler->Execute( temp_output );
 
   //
   // Now we want to identify the component labels that correspond to
@@ -1050,14 +2017,12 @@ PartialLungLabelMapImageFilter< TInputImage >
   std::vector< int >  lungHalf1ComponentCounter;
   std::vector< int >  lungHalf2ComponentCounter;
 
-  for ( unsigned int i=0; i<=relabelComponent->GetNumberOfObjects(); i++ )
+  for ( unsigned long i=0; i<=labeler->GetNumberOfComponents(); i++ )
     {
     lungHalf1ComponentCounter.push_back( 0 );
     lungHalf2ComponentCounter.push_back( 0 );
     }
 
-  ComponentIteratorType rIt( relabelComponent->GetOutput(), relabelComponent->GetOutput()->GetBufferedRegion() );
-
   int lowerYBound = static_cast< int >( 0.45*static_cast< double >( ctYDim ) );
   int upperYBound = static_cast< int >( 0.55*static_cast< double >( ctYDim ) );
 
@@ -1072,68 +2037,69 @@ PartialLungLabelMapImageFilter< TInputImage >
 
   int middleX =  static_cast< int >( 0.5*static_cast< double >( ctXDim ) );
 
-  rIt.GoToBegin();
-  while ( !rIt.IsAtEnd() )
+  //
+  // The voxels of a run in the y range are counted by intersecting its
+  // x range with each half
+  //
+  RunLengthLabelMap::ConstRunIterator rIt( labeler->GetRunLengthLabelMap() );
+
+  for ( rIt.GoToBegin(); !rIt.IsAtEnd(); ++rIt )
     {
-    if ( rIt.Get() != 0 )
+    LabelMapType::IndexType index = rIt.GetIndex();
+
+    if ( index[1] >= lowerYBound && index[1] <= upperYBound )
       {
-      LabelMapType::IndexType index = rIt.GetIndex();
+      unsigned long whichComponent = labeler->GetRunLabel( rIt.GetRunNumber() );
 
-      if ( index[1] >= lowerYBound && index[1] <= upperYBound )
-        {
-        int whichComponent = static_cast< int >( rIt.Get() );
+      long firstX = index[0];
+      long lastX  = index[0] + static_cast< long >( rIt.GetLength() ) - 1;
 
-        if ( index[0] >= lowerXBound && index[0] <= middleX )
-          {
-          lungHalf1ComponentCounter[whichComponent] = lungHalf1ComponentCounter[whichComponent]+1;
-          }
-        else if ( index[0] < upperXBound && index[0] > middleX )
-          {
-          lungHalf2ComponentCounter[whichComponent] = lungHalf2ComponentCounter[whichComponent]+1;
-          }
+      long half1Count = std::min( lastX, static_cast< long >( middleX ) ) - std::max( firstX, static_cast< long >( lowerXBound ) ) + 1;
+      long half2Count = std::min( lastX, static_cast< long >( upperXBound ) - 1 ) - std::max( firstX, static_cast< long >( middleX ) + 1 ) + 1;
+
+      if ( half1Count > 0 )
+        {
+        lungHalf1ComponentCounter[whichComponent] += half1Count;
+        }
+      if ( half2Count > 0 )
+        {
+        lungHalf2ComponentCounter[whichComponent] += half2Count;
         }
       }
-
-    ++rIt;
     }
 
-  unsigned short lungHalf1Label;
-  unsigned short lungHalf2Label;
+  unsigned long lungHalf1Label = 0;
+  unsigned long lungHalf2Label = 0;
   int maxLungHalf1Count = 0;
   int maxLungHalf2Count = 0;
-  for ( unsigned int i=0; i<=relabelComponent->GetNumberOfObjects(); i++ )
+  for ( unsigned long i=1; i<=labeler->GetNumberOfComponents(); i++ )
     {
     if ( lungHalf1ComponentCounter[i] > maxLungHalf1Count )
       {
       maxLungHalf1Count = lungHalf1ComponentCounter[i];
 
-      lungHalf1Label = static_cast< unsigned short >( i );
+      lungHalf1Label = i;
       }
     if ( lungHalf2ComponentCounter[i] > maxLungHalf2Count )
       {
       maxLungHalf2Count = lungHalf2ComponentCounter[i];
 
-      lungHalf2Label = static_cast< unsigned short >( i );
+      lungHalf2Label = i;
       }
     }
 
-  LabelMapIteratorType mIt( this->GetOutput(), this->GetOutput()->GetBufferedRegion() );
+  //
+  // The voxels outside the runs are already zero
+  //
+  LabelMapPixelType* outputBuffer = this->GetOutput()->GetBufferPointer();
 
-  mIt.GoToBegin();
-  rIt.GoToBegin();
-  while ( !mIt.IsAtEnd() )
+  for ( rIt.GoToBegin(); !rIt.IsAtEnd(); ++rIt )
     {
-    if ( rIt.Get() == lungHalf1Label || rIt.Get() == lungHalf2Label )
-      {
-      mIt.Set( WHOLELUNG );
-      }
-    else 
-      {
-      mIt.Set( 0 );
-      }
+    unsigned long label = labeler->GetRunLabel( rIt.GetRunNumber() );
 
-    ++mIt;
-    ++rIt;
+    LabelMapPixelType value = ( label == lungHalf1Label || label == lungHalf2Label ) ? WHOLELUNG : 0;
+
+    std::fill( outputBuffer + rIt.GetOffset(), outputBuffer + rIt.GetOffset() + rIt.GetLength(), value );
     }
 }
 
@@ -1201,9 +2167,9 @@ PartialLungLabelMapImageFilter< TInputImage >
   LabelMapType::IndexType index;
 
   LabelMapType::SizeType    size    = this->GetOutput()->GetBufferedRegion().GetSize();
-  LabelMapType::SpacingType spacing = this->GetInput()->GetSpacing();
+  LabelMapType::SpacingType spacing = this->m_WorkingInput->GetSpacing();
 
-  this->m_AirwayLabelMap->SetRegions( this->GetInput()->GetBufferedRegion().GetSize() );
+  this->m_AirwayLabelMap->SetRegions( this->m_WorkingInput->GetBufferedRegion().GetSize() );
   this->m_AirwayLabelMap->Allocate();
   this->m_AirwayLabelMap->FillBuffer( 0 );
 
@@ -1217,7 +2183,7 @@ PartialLungLabelMapImageFilter< TInputImage >
   // DEBUG: Applying otsu threshold here for helper assisted segmentation.
   //
   typename OtsuThresholdType::Pointer otsuThreshold = OtsuThresholdType::New();
-    otsuThreshold->SetInput( this->GetInput() );
+    otsuThreshold->SetInput( this->m_WorkingInput );
     otsuThreshold->Update();
 
   // sila
@@ -1226,7 +2192,7 @@ PartialLungLabelMapImageFilter< TInputImage >
   if ( otsuThreshold->GetThreshold() <= this->m_ManualThreshold-this->m_StdLungThreshold ||  otsuThreshold->GetThreshold() >= this->m_ManualThreshold+this->m_StdLungThreshold )
      {
        typename BinaryThresholdType::Pointer binaryThreshold = BinaryThresholdType::New();
-       binaryThreshold->SetInput(this->GetInput() );
+       binaryThreshold->SetInput(this->m_WorkingInput );
        binaryThreshold->SetLowerThreshold(-3000);
        binaryThreshold->SetUpperThreshold(this->m_ManualThreshold);
        binaryThreshold->Update();
@@ -1345,48 +2311,24 @@ PartialLungLabelMapImageFilter< TInputImage >
   // Now perform conditional dilation to connect regions of the
   // trachea / main bronchi that may be disconnected
   //
-  LabelMapIteratorType dIt( dilate3D->GetOutput(), dilate3D->GetOutput()->GetBufferedRegion() );
-  std::vector< LabelMapType::IndexType > indicesVec;
+  std::vector< unsigned long > indicesVec;
+
+  NeighborhoodType neighborhood( dilate3D->GetOutput()->GetBufferedRegion() );
+
+  DarkNeighborFunctor darkNeighbor;
+    darkNeighbor.Input     = this->m_WorkingInput->GetBufferPointer();
+    darkNeighbor.Threshold = -800;
+    darkNeighbor.Neighbors = &indicesVec;
 
 //  std::cout << "---Performing conditional dilation..." << std::endl;
   for ( unsigned int i=0; i<2; i++ )
     {
 
-    dIt.GoToBegin();
-    while ( !dIt.IsAtEnd() )
-      {
-      if ( dIt.Get() !=0 )
-        {
-        for ( int x=-1; x<=1; x++ )
-          {
-          index[0] = dIt.GetIndex()[0] + x;
-
-          for ( int y=-1; y<=1; y++ )
-            {
-            index[1] = dIt.GetIndex()[1] + y;
-
-            for ( int z=-1; z<=1; z++ )
-              {
-              index[2] = dIt.GetIndex()[2] + z;
-              
-              if ( dilate3D->GetOutput()->GetBufferedRegion().IsInside( index ) )
-                {
-                if ( this->GetInput()->GetPixel( index ) < -800 )
-                  {
-                  indicesVec.push_back( index );         
-                  }
-                }
-              }
-            }
-          }
-        }
-
-      ++dIt;
-      }
+    neighborhood.VisitMaskedNeighbors( dilate3D->GetOutput()->GetBufferPointer(), darkNeighbor );
 
     for ( unsigned int j=0; j<indicesVec.size(); j++ )
       {
-      dilate3D->GetOutput()->SetPixel( indicesVec[j], airwayLabel );
+      dilate3D->GetOutput()->GetBufferPointer()[indicesVec[j]] = airwayLabel;
       }
     indicesVec.clear();
     }
@@ -1404,53 +2346,32 @@ PartialLungLabelMapImageFilter< TInputImage >
   // be the trachea and main bronchi. It is these voxels we'll remove
   // from the lung mask image
   //
-  ConnectedComponent3DType::Pointer connectedComponent3D = ConnectedComponent3DType::New();
-    connectedComponent3D->SetInput( dilate3D->GetOutput() );
-    connectedComponent3D->FullyConnectedOn();
-  try
-    {
-    connectedComponent3D->Update();
-    }
-  catch ( itk::ExceptionObject &excp )
-    {
-    std::cerr << "Exception caught while updating connected component filter:";
-    std::cerr << excp << std::endl;
-    }    
-    
-  Relabel3DType::Pointer relabeler3D = Relabel3DType::New();
-    relabeler3D->SetInput( connectedComponent3D->GetOutput() );
-  try
-    {
-    relabeler3D->Update();
-    }
-  catch ( itk::ExceptionObject &excp )
-    {
-    std::cerr << "Exception caught while relabeling:";
-    std::cerr << excp << std::endl;
-    }
+  ConnectedComponentLabeler::Pointer labeler = ConnectedComponentLabeler::New( this->GetNumberOfThreads(), true );
+    labeler->Execute( dilate3D->GetOutput() );
+
+  //
+  // The output is cleared on the runs of the largest component and the
+  // airway label map everywhere else
+  //
+  LabelMapPixelType* outputBuffer = this->GetOutput()->GetBufferPointer();
+  LabelMapPixelType* airwayBuffer = this->m_AirwayLabelMap->GetBufferPointer();
 
-  ComponentIteratorType rIt( relabeler3D->GetOutput(), relabeler3D->GetOutput()->GetBufferedRegion() );
-  LabelMapIteratorType  oIt( this->GetOutput(), this->GetOutput()->GetBufferedRegion() );
-  LabelMapIteratorType  aIt( this->m_AirwayLabelMap, this->m_AirwayLabelMap->GetBufferedRegion() );
+  unsigned long airwayStart = 0;
 
-  rIt.GoToBegin();
-  oIt.GoToBegin();
-  aIt.GoToBegin();
-  while ( !oIt.IsAtEnd() )
+  RunLengthLabelMap::ConstRunIterator rIt( labeler->GetRunLengthLabelMap() );
+
+  for ( rIt.GoToBegin(); !rIt.IsAtEnd(); ++rIt )
     {
-    if ( rIt.Get() == 1 )
-      {
-      oIt.Set( 0 );
-      }
-    else
+    if ( labeler->GetRunLabel( rIt.GetRunNumber() ) == 1 )
       {
-      aIt.Set( 0 );
+      std::fill( outputBuffer + rIt.GetOffset(), outputBuffer + rIt.GetOffset() + rIt.GetLength(), 0 );
+      std::fill( airwayBuffer + airwayStart, airwayBuffer + rIt.GetOffset(), 0 );
+
+      airwayStart = rIt.GetOffset() + rIt.GetLength();
       }
-    
-    ++aIt;
-    ++rIt;
-    ++oIt;
     }
+
+  std::fill( airwayBuffer + airwayStart, airwayBuffer + this->m_AirwayLabelMap->GetBufferedRegion().GetNumberOfPixels(), 0 );
 }
 
 
@@ -1458,214 +2379,19 @@ PartialLungLabelMapImageFilter< TInputImage >
  * This method gets seeds for subsequent airway segmentation using
  * region growing. For qualified slices, it gets seeds from whatever
  * object is closest to the centerline (line running parallel to the
- * y-direction).
+ * y-direction). See TracheaSeedDetector.
  */
 template < class TInputImage >
 std::vector< itk::Image< unsigned short, 3 >::IndexType >
 PartialLungLabelMapImageFilter< TInputImage >
 ::GetAirwaySeeds()
 {
-  std::vector< OutputImageType::IndexType > seedVec;
-
-  LabelMapType::SizeType    size    = this->GetOutput()->GetBufferedRegion().GetSize();
-  LabelMapType::SpacingType spacing = this->GetOutput()->GetSpacing();
-
-  //
-  // Get seeds from 15 slices. We don't consider the slice unless the
-  // total area is above a threshold
-  // (foregroundSliceSizeThresholdForSeedSelection). The value is set
-  // to 2000.0 to ensure that the lungs have come into the field of
-  // view before we begin our seed search. If we simply attempt to
-  // find seeds in the first slices that show a foreground region, we
-  // can wind up with a poor airway segmentation due to pinch points
-  // near the apex of the scan. This in turn can produce failure
-  // modes. The number of slices that we consider (15) is somewhat
-  // arbitrary. 
-  //
-  unsigned int slicesProcessed                              = 0;
-  unsigned int currentSliceOffset                           = 0;
-  int          numberSlicesForSeedSearch                    = 15;
-  double       foregroundSliceSizeThresholdForSeedSelection = 2000.0;
-
-  while ( slicesProcessed < numberSlicesForSeedSearch && currentSliceOffset < size[2] )
-    {
-    //
-    // Extract a 2D slice from the mask
-    //
-    int whichSlice;
-    if ( this->m_HeadFirst )
-      {
-      whichSlice = size[2] - 1 - currentSliceOffset;
-      }
-    else
-      {
-      whichSlice = currentSliceOffset;
-      }
-
-    LabelMapSliceType::Pointer slice = LabelMapSliceType::New();    
-
-    this->ExtractLabelMapSlice( this->GetOutput(), slice, whichSlice );
-
-    //
-    // Perform connected component labeling
-    //
-    ConnectedComponent2DType::Pointer connectedComponent = ConnectedComponent2DType::New();
-      connectedComponent->SetInput( slice );
-      connectedComponent->FullyConnectedOn();
-    try
-      {
-      connectedComponent->Update();
-      }
-    catch ( itk::ExceptionObject &excp )
-      {
-      std::cerr << "Exception caught while updating connected component filter:";
-      std::cerr << excp << std::endl;
-      }    
-    
-    //
-    // Relabel the components
-    //
-    Relabel2DType::Pointer relabeler = Relabel2DType::New();
-      relabeler->SetInput( connectedComponent->GetOutput() );
-    try
-      {
-      relabeler->Update();
-      }
-    catch ( itk::ExceptionObject &excp )
-      {
-      std::cerr << "Exception caught while relabeling:";
-      std::cerr << excp << std::endl;
-      }
-
-    //
-    // If the foreground area of the slice is larger than the
-    // threshold, consider the slice for seed selection. The number of
-    // objects present in the slice must also be equal to three
-    // (trachea, left and right lungs)
-    //
-    int numVoxels = 0;
-
-    LabelMapSliceIteratorType rIt( relabeler->GetOutput(), relabeler->GetOutput()->GetBufferedRegion() );
-
-    rIt.GoToBegin();
-    while ( !rIt.IsAtEnd() )
-      {
-      if ( rIt.Get() > 0 )
-        {
-        numVoxels++;
-        }
-
-      ++rIt;
-      }
-
-    double foregroundArea = static_cast< double >( numVoxels )*spacing[0]*spacing[1];
-
-    if ( foregroundArea > foregroundSliceSizeThresholdForSeedSelection && relabeler->GetNumberOfObjects() >= 3 )
-      {
-      slicesProcessed++;
-
-      //
-      // Identify the object who's centroid (x coordinate) is in the
-      // middle. First get the centroids, then find out which one is
-      // in the middle 
-      //
-      std::map< unsigned int, unsigned short > xCentroidMap;
-
-      unsigned short bestCenterLabel = 0;
-
-      unsigned int leftmostCentroid  = size[1];
-      unsigned int rightmostCentroid = 0;
-
-      //
-      // Get the centroids and labels for each object
-      //
-      for ( unsigned int i=1; i<=relabeler->GetNumberOfObjects(); i++ )
-        {
-        int x = 0;
-        int count = 0;
-
-        rIt.GoToBegin();
-        while ( !rIt.IsAtEnd() )
-          {
-          if ( rIt.Get() == i )
-            {
-            x += (rIt.GetIndex())[0];
-            count++;
-            }
-
-          ++rIt;
-          }
-        
-        unsigned int centroidLocation = static_cast< unsigned int >( static_cast< double >( x )/static_cast< double >( count ) );
-
-        if ( centroidLocation > rightmostCentroid )
-          {
-          rightmostCentroid = centroidLocation;
-          }
-        if ( centroidLocation < leftmostCentroid )
-          {
-          leftmostCentroid = centroidLocation;
-          }
-
-        xCentroidMap[centroidLocation] = i;
-        }
-
-      unsigned int middleLocation = (rightmostCentroid + leftmostCentroid)/2;
-      std::cout << "middle Location" << std::endl;
-      std::cout << middleLocation<< std::endl;
-      //
-      // Now find the label that corresponds to the centroid that is
-      // closest to the middle location
-      //
-      unsigned int minDiff = size[1];
-
-      std::map< unsigned int, unsigned short >::iterator mapIt = xCentroidMap.begin();
-      while ( mapIt != xCentroidMap.end() )
-        {
-        int diff = vcl_abs( static_cast< int >( (*mapIt).first ) - static_cast< int >( middleLocation ) );
-
-        if ( diff < minDiff )
-          {                                     
-          minDiff = diff;
-          bestCenterLabel = (*mapIt).second;
-          }
-
-        mapIt++;
-        }
-
-
-      LabelMapType::IndexType index;
-      //Print out
-      std::cout << "---Writing seed..." << std::endl;
-      rIt.GoToBegin();
-      while ( !rIt.IsAtEnd() )
-        {
-        if ( rIt.Get() == bestCenterLabel )
-          {
-          index[0] = (rIt.GetIndex())[0];
-          index[1] = (rIt.GetIndex())[1];
-          if ( this->m_HeadFirst )
-            {
-            index[2] = size[2] - 1 - currentSliceOffset;
-            }
-          else
-            {
-            index[2] = currentSliceOffset;
-            }
-          //Print out
-          //std::cout << index<< std::endl;
-          seedVec.push_back( index );
-
-          }
-        ++rIt;
-        }
-      std::cout << index<< std::endl;
-      }
-
-    currentSliceOffset++;
-    }
+  typename TracheaSeedDetectorType::Pointer seedDetector = TracheaSeedDetectorType::New();
+    seedDetector->SetImage( this->GetOutput() );
+    seedDetector->SetHeadFirst( this->m_HeadFirst );
+    seedDetector->Compute();
 
-  return seedVec;
+  return seedDetector->GetSeeds();
 }
 
   
@@ -1684,10 +2410,22 @@ PartialLungLabelMapImageFilter< TInputImage >
   os << indent << "ClosingNeighborhood: " << this->m_ClosingNeighborhood[0] << "\t" << this->m_ClosingNeighborhood[1] << "\t" << this->m_ClosingNeighborhood[2] << std::endl;
   os << indent << "MinAirwayVolume: " << this->m_MinAirwayVolume << std::endl;
   os << indent << "MaxAirwayVolumeIncreaseRate: " << this->m_MaxAirwayVolumeIncreaseRate << std::endl;
+  os << indent << "UseAirwayPriorityFlood: " << this->m_UseAirwayPriorityFlood << std::endl;
+  os << indent << "AirwayCoarseToFineShrinkFactor: " << this->m_AirwayCoarseToFineShrinkFactor << std::endl;
+  os << indent << "UseLungBoundingBox: " << this->m_UseLungBoundingBox << std::endl;
+  os << indent << "LungBoundingBoxPadding: " << this->m_LungBoundingBoxPadding << std::endl;
+  os << indent << "ParallelConditionalDilation: " << this->m_ParallelConditionalDilation << std::endl;
+  os << indent << "UseDistanceTransformClosing: " << this->m_UseDistanceTransformClosing << std::endl;
+  os << indent << "ClosingRadius: " << this->m_ClosingRadius << std::endl;
+  os << indent << "ConcurrentClosing: " << this->m_ConcurrentClosing << std::endl;
   os << indent << "ExponentialCoefficient: " << this->m_ExponentialCoefficient << std::endl;
   os << indent << "ExponentialTimeConstant: " << this->m_ExponentialTimeConstant << std::endl;
   os << indent << "LeftRightLungSplitRadius: " << this->m_LeftRightLungSplitRadius << std::endl;
   os << indent << "AggressiveLeftRightSplitter: " << this->m_AggressiveLeftRightSplitter << std::endl;
+  os << indent << "UseSeamSolver: " << this->m_UseSeamSolver << std::endl;
+  os << indent << "GraphSearchFallback: " << this->m_GraphSearchFallback << std::endl;
+  os << indent << "NarrowBandRadius: " << this->m_NarrowBandRadius << std::endl;
+  os << indent << "ParallelSplitting: " << this->m_ParallelSplitting << std::endl;
   os << indent << "HeadFirst: " << this->m_HeadFirst << std::endl;
   os << indent << "Supine: " << this->m_Supine << std::endl;       
 }
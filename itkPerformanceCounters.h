@@ -0,0 +1,108 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkPerformanceCounters.h,v $
+  Language:  C++
+  Date:      $Date: 2012/09/13 15:47:19 $
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkPerformanceCounters_h
+#define __itkPerformanceCounters_h
+
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+#include <string>
+#include <vector>
+
+
+namespace itk
+{
+/** \class PerformanceCounters
+ * \brief Reads the Linux perf_event_open counters of the current
+ * process. Open() first tries the hardware counters (cycles,
+ * instructions, last level cache misses and branch misses). If the
+ * PMU cannot be accessed (e.g. in virtual machines and containers, or
+ * when perf_event_paranoid forbids it) it falls back to the software
+ * counters maintained by the kernel (task clock, page faults, context
+ * switches and CPU migrations). On other platforms, or if no counter
+ * at all can be opened, no counters are available and Read() returns
+ * nothing. The counters are inherited by the threads created after
+ * Open() (the counts of a thread are added once it exits). The
+ * hardware counters only count user space; the software counters
+ * also count the kernel where perf_event_paranoid allows it, since
+ * context switches and migrations happen there. Values are scaled to
+ * compensate for the multiplexing of the PMU.
+ */
+class ITK_EXPORT PerformanceCounters : public Object
+{
+public:
+  /** Standard class typedefs. */
+  typedef PerformanceCounters         Self;
+  typedef Object                      Superclass;
+  typedef SmartPointer< Self >        Pointer;
+  typedef SmartPointer< const Self >  ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro( Self );
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro( PerformanceCounters, Object );
+
+  /** Open the counters. Returns false if no counter could be
+   *  opened. Counters that are already open are closed first. */
+  bool Open();
+
+  /** Close all counters */
+  void Close();
+
+  /** True if the hardware counters are open, false if the software
+   *  counters (or none) are */
+  itkGetMacro( UsingHardwareCounters, bool );
+
+  unsigned int GetNumberOfCounters() const
+    {
+      return this->m_Names.size();
+    }
+  const std::string & GetCounterName( unsigned int i ) const
+    {
+      return this->m_Names[i];
+    }
+
+  /** Read the current (scaled) values of the open counters, in the
+   *  order of their names */
+  void Read( std::vector< double >& ) const;
+
+protected:
+  PerformanceCounters();
+  virtual ~PerformanceCounters();
+
+  void PrintSelf( std::ostream& os, Indent indent ) const;
+
+  /** Open one counter for the current process. Returns false (and
+   *  opens nothing) if the kernel refuses it. */
+  bool OpenCounter( unsigned int type, unsigned long long config, const char* name );
+
+private:
+  PerformanceCounters( const Self& ); //purposely not implemented
+  void operator=( const Self& ); //purposely not implemented
+
+  bool                        m_UsingHardwareCounters;
+  std::vector< int >          m_FileDescriptors;
+  std::vector< std::string >  m_Names;
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkPerformanceCounters.txx"
+#endif
+
+#endif
@@ -0,0 +1,225 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkPerformanceCounters.txx,v $
+  Language:  C++
+  Date:      $Date: 2012/09/13 15:47:19 $
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef _itkPerformanceCounters_txx
+#define _itkPerformanceCounters_txx
+
+#include "itkPerformanceCounters.h"
+
+#if defined( __linux__ )
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+
+namespace itk
+{
+
+inline
+PerformanceCounters
+::PerformanceCounters()
+{
+  this->m_UsingHardwareCounters = false;
+}
+
+
+inline
+PerformanceCounters
+::~PerformanceCounters()
+{
+  this->Close();
+}
+
+
+#if defined( __linux__ )
+
+inline bool
+PerformanceCounters
+::OpenCounter( unsigned int type, unsigned long long config, const char* name )
+{
+  struct perf_event_attr attr;
+  std::memset( &attr, 0, sizeof( attr ) );
+
+  attr.size           = sizeof( attr );
+  attr.type           = type;
+  attr.config         = config;
+  attr.read_format    = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  attr.inherit        = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv     = 1;
+
+  //
+  // Context switches and CPU migrations only happen in the kernel, so
+  // the software events count kernel time when they are allowed to
+  // (perf_event_paranoid may forbid it)
+  //
+  int fd = -1;
+  if ( type == PERF_TYPE_SOFTWARE )
+    {
+    attr.exclude_kernel = 0;
+    fd = static_cast< int >( syscall( __NR_perf_event_open, &attr, 0, -1, -1, 0 ) );
+    attr.exclude_kernel = 1;
+    }
+
+  if ( fd < 0 )
+    {
+    fd = static_cast< int >( syscall( __NR_perf_event_open, &attr, 0, -1, -1, 0 ) );
+    }
+
+  if ( fd < 0 )
+    {
+    return false;
+    }
+
+  this->m_FileDescriptors.push_back( fd );
+  this->m_Names.push_back( name );
+
+  return true;
+}
+
+
+inline bool
+PerformanceCounters
+::Open()
+{
+  this->Close();
+
+  //
+  // The hardware counters are only used if all of them can be opened
+  // so that the stages of a run are always described by the same set
+  //
+  this->m_UsingHardwareCounters = 
+    this->OpenCounter( PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "cycles" ) &&
+    this->OpenCounter( PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, "instructions" ) &&
+    this->OpenCounter( PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, "llc_misses" ) &&
+    this->OpenCounter( PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, "branch_misses" );
+
+  if ( !this->m_UsingHardwareCounters )
+    {
+    this->Close();
+
+    this->OpenCounter( PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK, "task_clock_ns" );
+    this->OpenCounter( PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS, "page_faults" );
+    this->OpenCounter( PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, "context_switches" );
+    this->OpenCounter( PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS, "cpu_migrations" );
+    }
+
+  return this->m_FileDescriptors.size() > 0;
+}
+
+
+inline void
+PerformanceCounters
+::Close()
+{
+  for ( unsigned int i=0; i<this->m_FileDescriptors.size(); i++ )
+    {
+    close( this->m_FileDescriptors[i] );
+    }
+
+  this->m_FileDescriptors.clear();
+  this->m_Names.clear();
+
+  this->m_UsingHardwareCounters = false;
+}
+
+
+/**
+ * When more counters are requested than the PMU has registers, the
+ * kernel time-slices them. The raw count is then extrapolated to the
+ * whole time the counter was enabled.
+ */
+inline void
+PerformanceCounters
+::Read( std::vector< double >& values ) const
+{
+  values.resize( this->m_FileDescriptors.size() );
+
+  for ( unsigned int i=0; i<this->m_FileDescriptors.size(); i++ )
+    {
+    unsigned long long data[3] = { 0, 0, 0 };
+
+    values[i] = 0.0;
+
+    if ( read( this->m_FileDescriptors[i], data, sizeof( data ) ) != static_cast< ssize_t >( sizeof( data ) ) )
+      {
+      continue;
+      }
+
+    values[i] = static_cast< double >( data[0] );
+
+    if ( data[2] > 0 && data[2] < data[1] )
+      {
+      values[i] *= static_cast< double >( data[1] )/static_cast< double >( data[2] );
+      }
+    }
+}
+
+#else
+
+inline bool
+PerformanceCounters
+::OpenCounter( unsigned int, unsigned long long, const char* )
+{
+  return false;
+}
+
+
+inline bool
+PerformanceCounters
+::Open()
+{
+  return false;
+}
+
+
+inline void
+PerformanceCounters
+::Close()
+{
+}
+
+
+inline void
+PerformanceCounters
+::Read( std::vector< double >& values ) const
+{
+  values.clear();
+}
+
+#endif
+
+
+/**
+ * Standard "PrintSelf" method
+ */
+inline void
+PerformanceCounters
+::PrintSelf( std::ostream& os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+  os << indent << "UsingHardwareCounters:\t" << this->m_UsingHardwareCounters << std::endl;
+  for ( unsigned int i=0; i<this->m_Names.size(); i++ )
+    {
+    os << indent << "Counter:\t" << this->m_Names[i] << std::endl;
+    }
+}
+
+} // end namespace itk
+
+#endif
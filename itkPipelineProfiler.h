@@ -0,0 +1,155 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkPipelineProfiler.h,v $
+  Language:  C++
+  Date:      $Date: 2012/09/04 20:23:08 $
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkPipelineProfiler_h
+#define __itkPipelineProfiler_h
+
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+#include "itkRealTimeClock.h"
+#include "itkImageMemoryTracker.h"
+#include "itkPerformanceCounters.h"
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+namespace itk
+{
+/** \class PipelineProfiler
+ * \brief This class records the wall and CPU time spent in the stages
+ * of a pipeline. A stage is opened with StartStage() and closed with
+ * StopStage(). Stages may be nested, in which case the innermost open
+ * stage is closed first. When image memory tracking is enabled (see
+ * ImageMemoryTracker), the image memory allocated in each stage and
+ * the high-water mark of live image memory during each stage are
+ * recorded as well. When UsePerformanceCounters is on, the
+ * perf_event_open counters of the process (see PerformanceCounters)
+ * are also recorded for each stage. The recorded stages can be
+ * written as JSON or as a Chrome trace (viewable with
+ * chrome://tracing).
+ */
+class ITK_EXPORT PipelineProfiler : public Object
+{
+public:
+  /** Standard class typedefs. */
+  typedef PipelineProfiler            Self;
+  typedef Object                      Superclass;
+  typedef SmartPointer< Self >        Pointer;
+  typedef SmartPointer< const Self >  ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro( Self );
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro( PipelineProfiler, Object );
+
+  /** Everything recorded for a stage. 'StartTime' is the wall time
+   *  (in seconds) at which the stage started, relative to the last
+   *  call to Reset(). 'Depth' is the number of stages that were open
+   *  when the stage started. The memory fields are in bytes and are
+   *  only filled when image memory tracking is enabled:
+   *  'BytesAllocated' is the image memory allocated during the stage,
+   *  'LiveBytes' is the image memory still allocated when the stage
+   *  ended and 'PeakLiveBytes' is the most image memory allocated at
+   *  any one time during the stage. 'Counters' holds the increase of
+   *  each performance counter during the stage, in the order of the
+   *  counter names of GetPerformanceCounters(), and is empty if no
+   *  performance counters are used. */
+  struct StageType
+  {
+    std::string            Name;
+    unsigned int           Depth;
+    double                 StartTime;
+    double                 WallTime;
+    double                 CPUTime;
+    unsigned long          BytesAllocated;
+    unsigned long          LiveBytes;
+    unsigned long          PeakLiveBytes;
+    std::vector< double >  Counters;
+  };
+
+  /** Record the performance counters of each stage (default is
+   *  false). The counters are opened when the first stage is started
+   *  after this is turned on. */
+  itkSetMacro( UsePerformanceCounters, bool );
+  itkGetMacro( UsePerformanceCounters, bool );
+  itkBooleanMacro( UsePerformanceCounters );
+
+  /** Get the performance counters. This is null until a stage has
+   *  been started with UsePerformanceCounters on. */
+  itkGetObjectMacro( PerformanceCounters, PerformanceCounters );
+
+  /** Clear all recorded stages and restart the clock */
+  void Reset();
+
+  /** Open a new stage */
+  void StartStage( const std::string& );
+
+  /** Close the innermost open stage */
+  void StopStage();
+
+  /** Get the recorded stages, in the order in which they were
+   *  started */
+  unsigned int GetNumberOfStages() const
+    {
+      return this->m_Stages.size();
+    }
+  const StageType & GetStage( unsigned int i ) const
+    {
+      return this->m_Stages[i];
+    }
+
+  /** Write the recorded stages as JSON */
+  void WriteJSON( std::ostream& ) const;
+
+  /** Write the recorded stages in the Chrome trace event format */
+  void WriteChromeTrace( std::ostream& ) const;
+
+protected:
+  PipelineProfiler();
+  virtual ~PipelineProfiler() {}
+
+  void PrintSelf( std::ostream& os, Indent indent ) const;
+
+  double GetWallTime() const;
+  double GetCPUTime() const;
+
+  static std::string EscapeString( const std::string& );
+
+  /** Write the performance counters of a stage as JSON members */
+  void WriteCounters( std::ostream&, const StageType& ) const;
+
+private:
+  PipelineProfiler( const Self& ); //purposely not implemented
+  void operator=( const Self& ); //purposely not implemented
+
+  RealTimeClock::Pointer        m_Clock;
+  double                        m_ClockOrigin;
+  std::vector< StageType >      m_Stages;
+  std::vector< unsigned int >   m_OpenStages;
+  std::vector< unsigned long >  m_OpenPeakMarkers;
+  bool                          m_UsePerformanceCounters;
+  PerformanceCounters::Pointer  m_PerformanceCounters;
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkPipelineProfiler.txx"
+#endif
+
+#endif
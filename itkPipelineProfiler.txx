@@ -0,0 +1,309 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkPipelineProfiler.txx,v $
+  Language:  C++
+  Date:      $Date: 2012/09/04 20:23:08 $
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef _itkPipelineProfiler_txx
+#define _itkPipelineProfiler_txx
+
+#include "itkPipelineProfiler.h"
+#include <ctime>
+
+
+namespace itk
+{
+
+inline
+PipelineProfiler
+::PipelineProfiler()
+{
+  this->m_Clock       = RealTimeClock::New();
+  this->m_ClockOrigin = this->m_Clock->GetTimeStamp();
+
+  this->m_UsePerformanceCounters = false;
+}
+
+
+inline void
+PipelineProfiler
+::Reset()
+{
+  for ( unsigned int i=0; i<this->m_OpenPeakMarkers.size(); i++ )
+    {
+    ImageMemoryTracker::PopPeakMarker( this->m_OpenPeakMarkers[i] );
+    }
+
+  this->m_Stages.clear();
+  this->m_OpenStages.clear();
+  this->m_OpenPeakMarkers.clear();
+
+  this->m_ClockOrigin = this->m_Clock->GetTimeStamp();
+}
+
+
+inline double
+PipelineProfiler
+::GetWallTime() const
+{
+  return static_cast< double >( this->m_Clock->GetTimeStamp() ) - this->m_ClockOrigin;
+}
+
+
+/**
+ * Processor time used by the whole process (all threads)
+ */
+inline double
+PipelineProfiler
+::GetCPUTime() const
+{
+  return static_cast< double >( std::clock() )/static_cast< double >( CLOCKS_PER_SEC );
+}
+
+
+inline void
+PipelineProfiler
+::StartStage( const std::string& name )
+{
+  //
+  // Opening the counters is not charged to the stage
+  //
+  if ( this->m_UsePerformanceCounters && this->m_PerformanceCounters.IsNull() )
+    {
+    this->m_PerformanceCounters = PerformanceCounters::New();
+    this->m_PerformanceCounters->Open();
+    }
+
+  StageType stage;
+    stage.Name           = name;
+    stage.Depth          = this->m_OpenStages.size();
+    stage.StartTime      = this->GetWallTime();
+    stage.WallTime       = 0.0;
+    stage.CPUTime        = this->GetCPUTime();
+    stage.BytesAllocated = ImageMemoryTracker::GetBytesAllocated();
+    stage.LiveBytes      = 0;
+    stage.PeakLiveBytes  = 0;
+
+  unsigned long peakMarker = ImageMemoryTracker::PushPeakMarker();
+
+  if ( this->m_UsePerformanceCounters )
+    {
+    this->m_PerformanceCounters->Read( stage.Counters );
+    }
+
+  this->m_OpenStages.push_back( this->m_Stages.size() );
+  this->m_OpenPeakMarkers.push_back( peakMarker );
+  this->m_Stages.push_back( stage );
+}
+
+
+inline void
+PipelineProfiler
+::StopStage()
+{
+  if ( this->m_OpenStages.size() == 0 )
+    {
+    itkExceptionMacro( << "No stage is open" );
+    }
+
+  StageType& stage = this->m_Stages[this->m_OpenStages.back()];
+    stage.WallTime       = this->GetWallTime() - stage.StartTime;
+    stage.CPUTime        = this->GetCPUTime() - stage.CPUTime;
+    stage.BytesAllocated = ImageMemoryTracker::GetBytesAllocated() - stage.BytesAllocated;
+    stage.LiveBytes      = ImageMemoryTracker::GetLiveBytes();
+    stage.PeakLiveBytes  = ImageMemoryTracker::PopPeakMarker( this->m_OpenPeakMarkers.back() );
+
+  if ( stage.Counters.size() > 0 )
+    {
+    std::vector< double > counters;
+    this->m_PerformanceCounters->Read( counters );
+
+    for ( unsigned int i=0; i<stage.Counters.size() && i<counters.size(); i++ )
+      {
+      stage.Counters[i] = counters[i] - stage.Counters[i];
+      }
+    }
+
+  this->m_OpenStages.pop_back();
+  this->m_OpenPeakMarkers.pop_back();
+}
+
+
+inline std::string
+PipelineProfiler
+::EscapeString( const std::string& str )
+{
+  std::string escaped;
+
+  for ( unsigned int i=0; i<str.size(); i++ )
+    {
+    if ( str[i] == '"' || str[i] == '\\' )
+      {
+      escaped += '\\';
+      }
+    escaped += str[i];
+    }
+
+  return escaped;
+}
+
+
+/**
+ * Counter values are written as integers. They are only fractional
+ * after scaling for multiplexing, and then only approximate anyway.
+ */
+inline void
+PipelineProfiler
+::WriteCounters( std::ostream& os, const StageType& stage ) const
+{
+  for ( unsigned int i=0; i<stage.Counters.size(); i++ )
+    {
+    os << ", \"" << this->m_PerformanceCounters->GetCounterName( i ) << "\": " << static_cast< unsigned long >( stage.Counters[i] );
+    }
+}
+
+
+inline void
+PipelineProfiler
+::WriteJSON( std::ostream& os ) const
+{
+  os << "{" << std::endl;
+  os << "  \"stages\": [" << std::endl;
+
+  for ( unsigned int i=0; i<this->m_Stages.size(); i++ )
+    {
+    const StageType& stage = this->m_Stages[i];
+
+    os << "    { \"name\": \"" << EscapeString( stage.Name ) << "\"";
+    os << ", \"depth\": " << stage.Depth;
+    os << ", \"start_seconds\": " << stage.StartTime;
+    os << ", \"wall_seconds\": " << stage.WallTime;
+    os << ", \"cpu_seconds\": " << stage.CPUTime;
+    if ( ImageMemoryTracker::GetEnabled() )
+      {
+      os << ", \"bytes_allocated\": " << stage.BytesAllocated;
+      os << ", \"live_bytes\": " << stage.LiveBytes;
+      os << ", \"peak_live_bytes\": " << stage.PeakLiveBytes;
+      }
+    this->WriteCounters( os, stage );
+    os << " }";
+
+    if ( i+1 < this->m_Stages.size() )
+      {
+      os << ",";
+      }
+    os << std::endl;
+    }
+
+  os << "  ]";
+  if ( ImageMemoryTracker::GetEnabled() )
+    {
+    os << "," << std::endl;
+    os << "  \"peak_live_bytes\": " << ImageMemoryTracker::GetPeakLiveBytes();
+    }
+  if ( this->m_PerformanceCounters.IsNotNull() )
+    {
+    os << "," << std::endl;
+    os << "  \"performance_counters\": \"";
+    if ( this->m_PerformanceCounters->GetNumberOfCounters() == 0 )
+      {
+      os << "unavailable";
+      }
+    else if ( this->m_PerformanceCounters->GetUsingHardwareCounters() )
+      {
+      os << "hardware";
+      }
+    else
+      {
+      os << "software";
+      }
+    os << "\"";
+    }
+  os << std::endl;
+  os << "}" << std::endl;
+}
+
+
+/**
+ * Each stage is written as a "complete" event. Times are in
+ * microseconds. Nesting is recovered by the viewer from the start
+ * times and durations.
+ */
+inline void
+PipelineProfiler
+::WriteChromeTrace( std::ostream& os ) const
+{
+  os << "{" << std::endl;
+  os << "  \"displayTimeUnit\": \"ms\"," << std::endl;
+  os << "  \"traceEvents\": [" << std::endl;
+
+  for ( unsigned int i=0; i<this->m_Stages.size(); i++ )
+    {
+    const StageType& stage = this->m_Stages[i];
+
+    os << "    { \"name\": \"" << EscapeString( stage.Name ) << "\"";
+    os << ", \"cat\": \"stage\", \"ph\": \"X\", \"pid\": 1, \"tid\": 1";
+    os << ", \"ts\": " << static_cast< long >( stage.StartTime*1.0e6 );
+    os << ", \"dur\": " << static_cast< long >( stage.WallTime*1.0e6 );
+    os << ", \"args\": { \"cpu_seconds\": " << stage.CPUTime;
+    if ( ImageMemoryTracker::GetEnabled() )
+      {
+      os << ", \"bytes_allocated\": " << stage.BytesAllocated;
+      os << ", \"peak_live_bytes\": " << stage.PeakLiveBytes;
+      }
+    this->WriteCounters( os, stage );
+    os << " }";
+    os << " }";
+
+    if ( i+1 < this->m_Stages.size() )
+      {
+      os << ",";
+      }
+    os << std::endl;
+    }
+
+  os << "  ]" << std::endl;
+  os << "}" << std::endl;
+}
+
+
+/**
+ * Standard "PrintSelf" method
+ */
+inline void
+PipelineProfiler
+::PrintSelf( std::ostream& os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+  os << indent << "UsePerformanceCounters:\t" << this->m_UsePerformanceCounters << std::endl;
+  for ( unsigned int i=0; i<this->m_Stages.size(); i++ )
+    {
+    const StageType& stage = this->m_Stages[i];
+
+    os << indent << std::string( 2*stage.Depth, ' ' ) << stage.Name << ":\t"
+       << "wall " << stage.WallTime << " s\tcpu " << stage.CPUTime << " s";
+    if ( ImageMemoryTracker::GetEnabled() )
+      {
+      os << "\tallocated " << stage.BytesAllocated << " B\tpeak " << stage.PeakLiveBytes << " B";
+      }
+    for ( unsigned int c=0; c<stage.Counters.size(); c++ )
+      {
+      os << "\t" << this->m_PerformanceCounters->GetCounterName( c ) << " " << static_cast< unsigned long >( stage.Counters[c] );
+      }
+    os << std::endl;
+    }
+}
+
+} // end namespace itk
+
+#endif
@@ -0,0 +1,262 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkRunLengthLabelMap.h,v $
+  Language:  C++
+  Date:      $Date: 2012/09/04 20:23:08 $
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkRunLengthLabelMap_h
+#define __itkRunLengthLabelMap_h
+
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+#include "itkImage.h"
+#include "itkImageRegion.h"
+#include <map>
+#include <vector>
+
+
+namespace itk
+{
+/** \class RunLengthLabelMap
+ * \brief A 3D lung label map stored as runs of voxels with the same
+ * nonzero label along the first axis. Voxels not covered by a run are
+ * zero. A row is the line of voxels along the first axis at a given
+ * position in the other two axes, and rows are numbered with the
+ * second axis varying fastest, so that the runs are in the order of
+ * the voxels in an image buffer. Runs never span more than one row.
+ *
+ * Lung label maps are mostly long runs of constant labels, so the map
+ * takes a small fraction of the memory of an image and per-label
+ * statistics (ComputeLabelCounts, or the connected components of
+ * ConnectedComponentLabeler) cost time proportional to the number of
+ * runs, not the number of voxels. Encode() and Decode() convert from and to images.
+ *
+ * A map is built row by row: AddRun() adds runs to the current row
+ * (in increasing order of position) and EndRow() moves on to the next
+ * row. Labels can be changed in place with a RunIterator, after which
+ * Compact() removes the runs set to zero and merges touching runs
+ * with the same label.
+ */
+class ITK_EXPORT RunLengthLabelMap : public Object
+{
+public:
+  /** Standard class typedefs. */
+  typedef RunLengthLabelMap           Self;
+  typedef Object                      Superclass;
+  typedef SmartPointer< Self >        Pointer;
+  typedef SmartPointer< const Self >  ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro( Self );
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro( RunLengthLabelMap, Object );
+
+  typedef unsigned short                 LabelType;
+  typedef Image< LabelType, 3 >          LabelImageType;
+  typedef ImageRegion< 3 >               RegionType;
+  typedef RegionType::IndexType          IndexType;
+  typedef std::map< LabelType, unsigned long >  LabelCountsType;
+
+  /** Voxels [X, X+Length) of a row (X relative to the start of the
+   *  region) */
+  struct RunType
+  {
+    unsigned int  X;
+    unsigned int  Length;
+    LabelType     Label;
+  };
+
+  /** Region covered by the map */
+  itkGetConstReferenceMacro( Region, RegionType );
+
+  /** Start an empty map covering 'region' (no rows yet) */
+  void Initialize( const RegionType& region );
+
+  /** Add a run to the current row. Touching runs with the same label
+   *  are merged and runs with a zero label are ignored. */
+  void AddRun( unsigned int x, unsigned int length, LabelType label );
+
+  /** End the current row */
+  void EndRow();
+
+  /** Encode the buffered region of an image */
+  void Encode( const LabelImageType* image );
+
+  /** Write the map to an image whose buffered region has the size of
+   *  the region of the map. Every voxel is written. */
+  void Decode( LabelImageType* image ) const;
+
+  /** Make this map a copy of another */
+  void DeepCopy( const Self* other );
+
+  /** Remove the zero runs and merge touching runs with the same label */
+  void Compact();
+
+  unsigned long GetNumberOfRows() const
+    {
+      return this->m_RowStarts.size() - 1;
+    }
+
+  unsigned long GetNumberOfRuns() const
+    {
+      return this->m_Runs.size();
+    }
+
+  /** Runs [GetRowBegin(row), GetRowEnd(row)) are those of a row */
+  unsigned long GetRowBegin( unsigned long row ) const
+    {
+      return this->m_RowStarts[row];
+    }
+
+  unsigned long GetRowEnd( unsigned long row ) const
+    {
+      return this->m_RowStarts[row+1];
+    }
+
+  const RunType & GetRun( unsigned long run ) const
+    {
+      return this->m_Runs[run];
+    }
+
+  /** Number of nonzero voxels */
+  unsigned long GetNumberOfVoxels() const;
+
+  /** Number of voxels of each nonzero label */
+  void ComputeLabelCounts( LabelCountsType& counts ) const;
+
+  /** Combine two maps covering the same region into this map. Every
+   *  voxel gets functor( label in 'map1', label in 'map2' ), which
+   *  must be zero when both are zero. */
+  template < class TFunctor >
+  void Combine( const Self* map1, const Self* map2, TFunctor& functor );
+
+  /** \class ConstRunIterator
+   * \brief Visits the runs in buffer order */
+  class ConstRunIterator
+  {
+  public:
+    ConstRunIterator( const Self* map )
+      {
+        this->m_Map = map;
+        this->GoToBegin();
+      }
+
+    void GoToBegin()
+      {
+        this->m_Run = 0;
+        this->m_Row = 0;
+        this->SkipEmptyRows();
+      }
+
+    bool IsAtEnd() const
+      {
+        return this->m_Run >= this->m_Map->m_Runs.size();
+      }
+
+    ConstRunIterator & operator++()
+      {
+        this->m_Run++;
+        this->SkipEmptyRows();
+
+        return *this;
+      }
+
+    LabelType GetLabel() const
+      {
+        return this->m_Map->m_Runs[this->m_Run].Label;
+      }
+
+    unsigned long GetLength() const
+      {
+        return this->m_Map->m_Runs[this->m_Run].Length;
+      }
+
+    unsigned long GetRunNumber() const
+      {
+        return this->m_Run;
+      }
+
+    unsigned long GetRow() const
+      {
+        return this->m_Row;
+      }
+
+    /** Index of the first voxel of the run */
+    IndexType GetIndex() const;
+
+    /** Buffer offset of the first voxel of the run */
+    unsigned long GetOffset() const
+      {
+        return this->m_Row*this->m_Map->m_Region.GetSize()[0] + this->m_Map->m_Runs[this->m_Run].X;
+      }
+
+  protected:
+    void SkipEmptyRows()
+      {
+        while ( !this->IsAtEnd() && this->m_Run >= this->m_Map->m_RowStarts[this->m_Row+1] )
+          {
+          this->m_Row++;
+          }
+      }
+
+    const Self*    m_Map;
+    unsigned long  m_Run;
+    unsigned long  m_Row;
+  };
+
+  /** \class RunIterator
+   * \brief Visits the runs in buffer order and may change their
+   * labels */
+  class RunIterator : public ConstRunIterator
+  {
+  public:
+    RunIterator( Self* map ) : ConstRunIterator( map )
+      {
+        this->m_MutableMap = map;
+      }
+
+    void SetLabel( LabelType label )
+      {
+        this->m_MutableMap->m_Runs[this->m_Run].Label = label;
+      }
+
+  private:
+    Self* m_MutableMap;
+  };
+
+  friend class ConstRunIterator;
+  friend class RunIterator;
+
+protected:
+  RunLengthLabelMap();
+  virtual ~RunLengthLabelMap() {}
+
+  void PrintSelf( std::ostream& os, Indent indent ) const;
+
+private:
+  RunLengthLabelMap( const Self& ); //purposely not implemented
+  void operator=( const Self& ); //purposely not implemented
+
+  RegionType                   m_Region;
+  std::vector< RunType >       m_Runs;
+  std::vector< unsigned long > m_RowStarts;
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkRunLengthLabelMap.txx"
+#endif
+
+#endif
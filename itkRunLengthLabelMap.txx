@@ -0,0 +1,356 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkRunLengthLabelMap.txx,v $
+  Language:  C++
+  Date:      $Date: 2012/09/04 20:23:08 $
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef _itkRunLengthLabelMap_txx
+#define _itkRunLengthLabelMap_txx
+
+#include "itkRunLengthLabelMap.h"
+#include "itkNumericTraits.h"
+#include <algorithm>
+
+
+namespace itk
+{
+
+inline
+RunLengthLabelMap
+::RunLengthLabelMap()
+{
+  this->m_RowStarts.assign( 1, 0 );
+}
+
+
+inline void
+RunLengthLabelMap
+::Initialize( const RegionType& region )
+{
+  this->m_Region = region;
+  this->m_Runs.clear();
+  this->m_RowStarts.assign( 1, 0 );
+}
+
+
+inline void
+RunLengthLabelMap
+::AddRun( unsigned int x, unsigned int length, LabelType label )
+{
+  if ( label == 0 || length == 0 )
+    {
+    return;
+    }
+
+  if ( this->m_Runs.size() > this->m_RowStarts.back() )
+    {
+    RunType& last = this->m_Runs.back();
+
+    if ( last.X + last.Length == x && last.Label == label )
+      {
+      last.Length += length;
+      return;
+      }
+    }
+
+  RunType run;
+    run.X      = x;
+    run.Length = length;
+    run.Label  = label;
+
+  this->m_Runs.push_back( run );
+}
+
+
+inline void
+RunLengthLabelMap
+::EndRow()
+{
+  this->m_RowStarts.push_back( this->m_Runs.size() );
+}
+
+
+inline void
+RunLengthLabelMap
+::Encode( const LabelImageType* image )
+{
+  this->Initialize( image->GetBufferedRegion() );
+
+  const unsigned long sizeX         = this->m_Region.GetSize()[0];
+  const unsigned long numberOfRows  = this->m_Region.GetSize()[1]*this->m_Region.GetSize()[2];
+
+  const LabelType* line = image->GetBufferPointer();
+
+  for ( unsigned long row=0; row<numberOfRows; row++, line += sizeX )
+    {
+    unsigned long x = 0;
+    while ( x < sizeX )
+      {
+      LabelType     label = line[x];
+      unsigned long start = x;
+
+      while ( ++x < sizeX && line[x] == label )
+        {
+        }
+
+      this->AddRun( start, x - start, label );
+      }
+
+    this->EndRow();
+    }
+}
+
+
+inline void
+RunLengthLabelMap
+::Decode( LabelImageType* image ) const
+{
+  const unsigned long sizeX        = this->m_Region.GetSize()[0];
+  const unsigned long numberOfRows = this->m_Region.GetSize()[1]*this->m_Region.GetSize()[2];
+
+  if ( image->GetBufferedRegion().GetSize() != this->m_Region.GetSize() )
+    {
+    itkExceptionMacro( << "Image and run length label map sizes differ" );
+    }
+  if ( this->GetNumberOfRows() != numberOfRows )
+    {
+    itkExceptionMacro( << "Run length label map has " << this->GetNumberOfRows() << " rows instead of " << numberOfRows );
+    }
+
+  LabelType* line = image->GetBufferPointer();
+
+  for ( unsigned long row=0; row<numberOfRows; row++, line += sizeX )
+    {
+    unsigned long x = 0;
+
+    for ( unsigned long r=this->m_RowStarts[row]; r<this->m_RowStarts[row+1]; r++ )
+      {
+      const RunType& run = this->m_Runs[r];
+
+      std::fill( line + x, line + run.X, static_cast< LabelType >( 0 ) );
+      std::fill( line + run.X, line + run.X + run.Length, run.Label );
+
+      x = run.X + run.Length;
+      }
+
+    std::fill( line + x, line + sizeX, static_cast< LabelType >( 0 ) );
+    }
+}
+
+
+inline void
+RunLengthLabelMap
+::DeepCopy( const Self* other )
+{
+  this->m_Region    = other->m_Region;
+  this->m_Runs      = other->m_Runs;
+  this->m_RowStarts = other->m_RowStarts;
+}
+
+
+inline void
+RunLengthLabelMap
+::Compact()
+{
+  const unsigned long numberOfRows = this->GetNumberOfRows();
+
+  unsigned long written = 0;
+  unsigned long begin   = 0;
+
+  for ( unsigned long row=0; row<numberOfRows; row++ )
+    {
+    unsigned long end = this->m_RowStarts[row+1];
+
+    this->m_RowStarts[row] = written;
+
+    for ( unsigned long r=begin; r<end; r++ )
+      {
+      const RunType run = this->m_Runs[r];
+
+      if ( run.Label == 0 )
+        {
+        continue;
+        }
+
+      if ( written > this->m_RowStarts[row] )
+        {
+        RunType& last = this->m_Runs[written-1];
+
+        if ( last.X + last.Length == run.X && last.Label == run.Label )
+          {
+          last.Length += run.Length;
+          continue;
+          }
+        }
+
+      this->m_Runs[written++] = run;
+      }
+
+    begin = end;
+    }
+
+  this->m_RowStarts[numberOfRows] = written;
+  this->m_Runs.resize( written );
+}
+
+
+inline unsigned long
+RunLengthLabelMap
+::GetNumberOfVoxels() const
+{
+  unsigned long count = 0;
+  for ( unsigned long r=0; r<this->m_Runs.size(); r++ )
+    {
+    count += this->m_Runs[r].Length;
+    }
+
+  return count;
+}
+
+
+inline void
+RunLengthLabelMap
+::ComputeLabelCounts( LabelCountsType& counts ) const
+{
+  counts.clear();
+
+  for ( unsigned long r=0; r<this->m_Runs.size(); r++ )
+    {
+    counts[this->m_Runs[r].Label] += this->m_Runs[r].Length;
+    }
+}
+
+
+/**
+ * Each row is cut where a run of either map starts or ends, and the
+ * pieces covered by a run of either map get the combined label
+ */
+template < class TFunctor >
+void
+RunLengthLabelMap
+::Combine( const Self* map1, const Self* map2, TFunctor& functor )
+{
+  if ( map1->m_Region.GetSize() != map2->m_Region.GetSize() || map1->GetNumberOfRows() != map2->GetNumberOfRows() )
+    {
+    itkExceptionMacro( << "Run length label maps to combine differ in size" );
+    }
+
+  //
+  // Build the result aside, since this map may be one of the two
+  //
+  Pointer result = Self::New();
+    result->Initialize( map1->m_Region );
+
+  const unsigned long numberOfRows = map1->GetNumberOfRows();
+
+  for ( unsigned long row=0; row<numberOfRows; row++ )
+    {
+    unsigned long i    = map1->m_RowStarts[row];
+    unsigned long j    = map2->m_RowStarts[row];
+    unsigned long end1 = map1->m_RowStarts[row+1];
+    unsigned long end2 = map2->m_RowStarts[row+1];
+
+    unsigned int x = 0;
+
+    while ( i < end1 || j < end2 )
+      {
+      unsigned int next   = NumericTraits< unsigned int >::max();
+      LabelType    label1 = 0;
+      LabelType    label2 = 0;
+
+      if ( i < end1 )
+        {
+        const RunType& run = map1->m_Runs[i];
+
+        if ( x >= run.X )
+          {
+          label1 = run.Label;
+          next   = run.X + run.Length;
+          }
+        else
+          {
+          next = run.X;
+          }
+        }
+      if ( j < end2 )
+        {
+        const RunType& run = map2->m_Runs[j];
+
+        if ( x >= run.X )
+          {
+          label2 = run.Label;
+          next   = std::min( next, run.X + run.Length );
+          }
+        else
+          {
+          next = std::min( next, run.X );
+          }
+        }
+
+      if ( label1 != 0 || label2 != 0 )
+        {
+        result->AddRun( x, next - x, functor( label1, label2 ) );
+        }
+
+      x = next;
+
+      if ( i < end1 && x >= map1->m_Runs[i].X + map1->m_Runs[i].Length )
+        {
+        i++;
+        }
+      if ( j < end2 && x >= map2->m_Runs[j].X + map2->m_Runs[j].Length )
+        {
+        j++;
+        }
+      }
+
+    result->EndRow();
+    }
+
+  this->m_Region = result->m_Region;
+  this->m_Runs.swap( result->m_Runs );
+  this->m_RowStarts.swap( result->m_RowStarts );
+}
+
+
+inline RunLengthLabelMap::IndexType
+RunLengthLabelMap::ConstRunIterator
+::GetIndex() const
+{
+  const unsigned long sizeY = this->m_Map->m_Region.GetSize()[1];
+
+  IndexType index = this->m_Map->m_Region.GetIndex();
+    index[0] += this->m_Map->m_Runs[this->m_Run].X;
+    index[1] += this->m_Row%sizeY;
+    index[2] += this->m_Row/sizeY;
+
+  return index;
+}
+
+
+/**
+ * Standard "PrintSelf" method
+ */
+inline void
+RunLengthLabelMap
+::PrintSelf( std::ostream& os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+  os << indent << "Region: " << this->m_Region << std::endl;
+  os << indent << "NumberOfRows: " << this->GetNumberOfRows() << std::endl;
+  os << indent << "NumberOfRuns: " << this->GetNumberOfRuns() << std::endl;
+}
+
+} // end namespace itk
+
+#endif
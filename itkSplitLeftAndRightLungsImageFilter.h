@@ -19,7 +19,6 @@
 
 #include "itkImageToImageFilter.h"
 #include "itkImage.h"
-#include "itkConnectedComponentImageFilter.h"
 #include "itkImageRegionIteratorWithIndex.h"
 #include "itkExtractImageFilter.h"
 #include "itkLungConventions.h"
@@ -28,6 +27,15 @@
 #include "itkImageToGraphFilter.h"
 #include "itkDijkstraImageToGraphFunctor.h"
 #include "itkDijkstraMinCostPathGraphToGraphFilter.h"
+#include "itkMinCostSeamSolver.h"
+#include "itkIntensityCostTable.h"
+#include "itkWorkCounters.h"
+#include "itkPipelineProfiler.h"
+#include "itkMultiThreader.h"
+#include "itkSimpleFastMutexLock.h"
+#include <algorithm>
+#include <map>
+#include <utility>
 
 
 namespace itk
@@ -99,6 +107,68 @@ public:
   itkSetMacro( ExponentialCoefficient, double );
   itkGetMacro( ExponentialCoefficient, double );
 
+  /** The costs of the voxels are looked up in a table computed once
+   *  per update (see IntensityCostTable): the seams read them from a
+   *  cost image of the slices from the first merged slice to the last,
+   *  and the graph searches from the table. By default the table is the exponential above, with costs
+   *  truncated as the graph's integer weights are. A computed table
+   *  set here is used instead, and can be shared with other
+   *  filters. */
+  itkSetConstObjectMacro( CostTable, IntensityCostTable );
+  itkGetConstObjectMacro( CostTable, IntensityCostTable );
+
+  /** The path through the merge region is by default a seam: the min
+   *  cost path among those that run from the top of the region to the
+   *  bottom without ever going back up, found directly on the image
+   *  with MinCostSeamSolver. With the same costs as the graph search,
+   *  it costs as much as the graph search's path whenever that path
+   *  does not go back up. It is not always the same path: the costs
+   *  are truncated to integers, so paths of equal cost are common and
+   *  the two searches may pick different ones. Set 'UseSeamSolver' to
+   *  false to always use the graph search. (default is true) */
+  itkSetMacro( UseSeamSolver, bool );
+  itkGetMacro( UseSeamSolver, bool );
+  itkBooleanMacro( UseSeamSolver );
+
+  /** When the lungs would still be merged after splitting along a
+   *  seam, the seam is not carved and the split attempts for that
+   *  slice use the graph search, which can find paths that go back
+   *  up. Without the fallback, every attempt is a seam and is carved.
+   *  (default is true) */
+  itkSetMacro( GraphSearchFallback, bool );
+  itkGetMacro( GraphSearchFallback, bool );
+  itkBooleanMacro( GraphSearchFallback );
+
+  /** Split the slices on several threads (see NumberOfThreads). The
+   *  merged slices are found in parallel, then each run of consecutive
+   *  merged slices is split on a thread of its own. The graph searches
+   *  of the threads run pipelines of their own (see GetMinCostPath).
+   *  The output is the same as with serial splitting. (default is
+   *  false) */
+  itkSetMacro( UseParallelSplitting, bool );
+  itkGetMacro( UseParallelSplitting, bool );
+  itkBooleanMacro( UseParallelSplitting );
+
+  /** When the lungs were split in the previous slice, the seam is
+   *  first searched for within 'NarrowBandRadius' pixels (along x) of
+   *  the path that split it. A band seam is only carved if it splits
+   *  the lungs. If it does not, the band is widened four-fold, then
+   *  the search is no longer restricted, so a slice is split as it
+   *  would be without the band whenever the band misses. Only the
+   *  seam solver searches in a band. Zero disables the band. (default
+   *  is 5) */
+  itkSetMacro( NarrowBandRadius, int );
+  itkGetMacro( NarrowBandRadius, int );
+
+  /** Number of narrow band searches of the last update, and of those
+   *  that split the slice */
+  itkGetConstMacro( NarrowBandSearches, unsigned long );
+  itkGetConstMacro( NarrowBandHits, unsigned long );
+
+  /** Fraction of the narrow band searches that split the slice (zero
+   *  if there were none) */
+  double GetNarrowBandHitRate() const;
+
   /** If the left and right lungs are merged in a certain section, 
    * graph methods are used to find a min cost path (i.e. the brightest
    * path) that passes through the merge region. This operation returns
@@ -109,12 +179,29 @@ public:
   itkSetMacro( LeftRightLungSplitRadius, int );
   itkGetMacro( LeftRightLungSplitRadius, int );
 
+  /** The junction of the lungs is searched for, and the lungs are
+   *  checked for being merged, in the middle third (along x) of this
+   *  region. When the input is cropped from a larger image, set it to
+   *  the region of the larger image, in the indices of the cropped
+   *  one, so that the middle third is that of the larger image. The
+   *  search is still limited to the cropped input. (default is an
+   *  empty region, meaning the buffered region of the input) */
+  itkSetMacro( SearchReferenceRegion, OutputImageRegionType );
+  itkGetConstReferenceMacro( SearchReferenceRegion, OutputImageRegionType );
+
   /** Use this method to get the vector of indices that were removed
    *  during the splitting process. Pass a pointer to an empty
    *  vector. This function will fill the vector with the erased
    *  indices */
   void GetRemovedIndices( std::vector< LabelMapType::IndexType >* );
 
+  /** When a profiler is set, building the cost image of the seams is
+   *  recorded as a stage of its own, nested in the stage that is open
+   *  when the filter runs. The profiler is not reset. (default is
+   *  none) */
+  itkSetObjectMacro( Profiler, PipelineProfiler );
+  itkGetObjectMacro( Profiler, PipelineProfiler );
+
   void SetLungLabelMap( LabelMapType::Pointer );
 
   void PrintSelf( std::ostream& os, Indent indent ) const;
@@ -126,11 +213,9 @@ protected:
   typedef LabelMapSliceType::IndexType               LabelMapSliceIndexType;
 
   typedef itk::Image< InputPixelType, 2 >                                                        InputImageSliceType;
-  typedef itk::ConnectedComponentImageFilter< LabelMapSliceType, LabelMapSliceType >             ConnectedComponent2DType;
   typedef itk::ImageRegionIteratorWithIndex< LabelMapType >                                      LabelMapIteratorType;
   typedef itk::ImageRegionConstIterator< InputImageType >                                        InputIteratorType;
   typedef itk::ImageRegionIteratorWithIndex< LabelMapSliceType >                                 LabelMapSliceIteratorType;
-  typedef itk::ExtractImageFilter< InputImageType, InputImageSliceType >                         InputExtractorType;
   typedef itk::ExtractImageFilter< LabelMapType, LabelMapSliceType >                             LabelMapExtractorType;
   typedef unsigned long                                                                          GraphTraitsScalarType;
   typedef itk::DijkstraGraphTraits< GraphTraitsScalarType, 2 >                                   GraphTraitsType;
@@ -147,10 +232,103 @@ protected:
 
   void ExtractLabelMapSlice( LabelMapType::Pointer, LabelMapSliceType::Pointer, int );
 
+  /** What splitting a slice hands on to the next slice: the bounds of
+   *  the search and the path that split the slice */
+  struct SplitStateType
+  {
+    int                       MinX;
+    int                       MaxX;
+    int                       MinY;
+    int                       MaxY;
+    std::map< short, short >  PreviousPathMap;
+    int                       PreviousMinY;
+    int                       PreviousMaxY;
+  };
+
+  /** Work done while splitting slices */
+  struct SplitCountsType
+  {
+    SplitCountsType() : MergedSlices( 0 ), SplitAttempts( 0 ), UnsplitSlices( 0 ), GraphSearches( 0 ),
+                        NarrowBandSearches( 0 ), NarrowBandHits( 0 ) {}
+
+    unsigned long  MergedSlices;
+    unsigned long  SplitAttempts;
+    unsigned long  UnsplitSlices;
+    unsigned long  GraphSearches;
+    unsigned long  NarrowBandSearches;
+    unsigned long  NarrowBandHits;
+  };
+
+  void InitializeSplitState( SplitStateType& );
+
+  /** The indices erased to split a slice along a path, given the
+   *  state left by the slice before it */
+  void ComputeSplitIndices( unsigned int, const std::vector< LabelMapSliceIndexType >&, SplitStateType&,
+                            std::vector< LabelMapType::IndexType >& );
+
+  /** Set the search bounds to the middle third of the reference
+   *  region */
+  void ResetSearchBounds( SplitStateType& );
+
+  /** Whether the lungs are merged in the middle third of a slice, or
+   *  would be after erasing the given indices */
+  bool GetLungsMergedInSlice( int, const std::vector< LabelMapType::IndexType >* splitIndices = 0 );
+
+  /** Split a merged slice, given the state left by the slice before
+   *  it. The indices erased are appended to the vector. */
+  void SplitSlice( unsigned int, SplitStateType&, std::vector< LabelMapType::IndexType >&, SplitCountsType& );
+
+  void FindMergedSlices( std::vector< unsigned char >&, bool );
+
+  void SplitSlicesInParallel( const std::vector< unsigned char >&, SplitCountsType& );
+
+  /** Data shared with the threads finding the merged slices and
+   *  splitting the runs of merged slices. Each run has its own removed
+   *  indices and counts, so they can be gathered in slice order. */
+  struct SplitThreadStruct
+  {
+    Self*                                                  Filter;
+    std::vector< unsigned char >                           Merged;
+    std::vector< std::pair< unsigned int, unsigned int > > Runs;
+    std::vector< std::pair< long, unsigned int > >         RunOrder;
+    unsigned long                                          NextRun;
+    SimpleFastMutexLock                                    Lock;
+    std::vector< std::vector< LabelMapType::IndexType > >  RemovedIndices;
+    std::vector< SplitCountsType >                         Counts;
+  };
+
+  /** Static function used as a "callback" by the MultiThreader to
+   *  find the merged slices among a share of the slices */
+  static ITK_THREAD_RETURN_TYPE FindMergedSlicesThreaderCallback( void* arg );
+
+  /** Static function used as a "callback" by the MultiThreader to
+   *  split runs of merged slices until none is left */
+  static ITK_THREAD_RETURN_TYPE SplitRunsThreaderCallback( void* arg );
+
+  bool CropSearchRegion( const InputImageRegionType&, typename InputSliceType::RegionType&,
+                         LabelMapSliceIndexType&, LabelMapSliceIndexType& );
+
+  InputSlicePointerType ExtractInputSlice( const typename InputSliceType::RegionType&, int );
+
   std::vector< LabelMapSliceIndexType > GetMinCostPath( InputSlicePointerType, LabelMapSliceIndexType, LabelMapSliceIndexType );
 
+  /** Same as GetMinCostPath, but the path is a seam (see
+   *  'UseSeamSolver') found in the given region of a slice of the
+   *  input, optionally within a band. The path is empty if no seam
+   *  joins the end points. */
+  std::vector< LabelMapSliceIndexType > GetMinCostSeam( const typename InputSliceType::RegionType&, int,
+                                                        LabelMapSliceIndexType, LabelMapSliceIndexType,
+                                                        const MinCostSeamSolver::BandType* band = 0 );
+
+  /** Band around the previous path for the rows of the search, and
+   *  the end points of the seam within it */
+  void ComputeNarrowBand( const SplitStateType&, int, const typename InputSliceType::RegionType&,
+                          LabelMapSliceIndexType&, LabelMapSliceIndexType&, MinCostSeamSolver::BandType& );
+
   bool GetLungsMergedInSliceRegion( int, int, int, int, int );
 
+  static bool GetLungsMergedInBuffer( const LabelMapPixelType*, long, long, long );
+
   void GenerateData();
 
 private:
@@ -164,7 +342,20 @@ private:
   double                                  m_ExponentialCoefficient;
   double                                  m_ExponentialTimeConstant;
   bool                                    m_AggressiveLeftRightSplitter;
+  bool                                    m_UseSeamSolver;
+  bool                                    m_GraphSearchFallback;
+  bool                                    m_UseParallelSplitting;
+  int                                     m_NarrowBandRadius;
+  unsigned long                           m_NarrowBandSearches;
+  unsigned long                           m_NarrowBandHits;
   int                                     m_LeftRightLungSplitRadius;
+  OutputImageRegionType                   m_SearchReferenceRegion;
+  OutputImageRegionType                   m_ReferenceRegion;
+
+  IntensityCostTable::ConstPointer               m_CostTable;
+  IntensityCostTable::ConstPointer               m_WorkingCostTable;
+  IntensityCostTable::CostImageType::Pointer     m_CostImage;
+  PipelineProfiler::Pointer                      m_Profiler;
 };
   
 } // end namespace itk
@@ -18,6 +18,7 @@
 #define _itkSplitLeftAndRightLungsImageFilter_txx
 
 #include "itkSplitLeftAndRightLungsImageFilter.h"
+#include "vnl/vnl_math.h"
 
 
 namespace itk
@@ -31,6 +32,12 @@ SplitLeftAndRightLungsImageFilter< TInputImage >
   this->m_ExponentialTimeConstant     = -700;
   this->m_LeftRightLungSplitRadius    = 2;
   this->m_AggressiveLeftRightSplitter = false;
+  this->m_UseSeamSolver               = true;
+  this->m_GraphSearchFallback         = true;
+  this->m_UseParallelSplitting        = false;
+  this->m_NarrowBandRadius            = 5;
+  this->m_NarrowBandSearches          = 0;
+  this->m_NarrowBandHits              = 0;
   this->m_LungLabelMap                = LabelMapType::New();
 }
 
@@ -65,15 +72,253 @@ SplitLeftAndRightLungsImageFilter< TInputImage >
 
   LabelMapType::SizeType size = this->GetOutput()->GetBufferedRegion().GetSize();
 
-  int minX = size[0]/3;
-  int maxX = size[0]-size[0]/3;
-  int minY = 0;
-  int maxY = size[1]-1;
+  this->m_ReferenceRegion = this->m_SearchReferenceRegion;
+  if ( this->m_ReferenceRegion.GetNumberOfPixels() == 0 )
+    {
+    this->m_ReferenceRegion = this->GetOutput()->GetBufferedRegion();
+    }
+
+  //
+  // Cost the voxels once for all the searches
+  //
+  if ( this->m_CostTable.IsNotNull() )
+    {
+    this->m_WorkingCostTable = this->m_CostTable;
+    }
+  else
+    {
+    IntensityCostTable::Pointer costTable = IntensityCostTable::New();
+      costTable->SetNumberOfThreads( this->GetNumberOfThreads() );
+      costTable->SetExponentialCoefficient( this->m_ExponentialCoefficient );
+      costTable->SetExponentialTimeConstant( this->m_ExponentialTimeConstant );
+      costTable->TruncateCostsOn();
+      costTable->Compute();
+
+    this->m_WorkingCostTable = costTable;
+    }
+
+  //
+  // Splitting a slice only changes that slice, so the merged slices
+  // can be found before any is split
+  //
+  bool splitInParallel = this->m_UseParallelSplitting && this->GetNumberOfThreads() > 1;
+
+  std::vector< unsigned char > merged;
+  this->FindMergedSlices( merged, splitInParallel );
+
+  //
+  // Only the slab of slices from the first merged slice to the last
+  // is costed for the seams
+  //
+  if ( this->m_UseSeamSolver )
+    {
+    std::vector< unsigned char >::iterator firstMerged = std::find( merged.begin(), merged.end(), 1 );
+
+    if ( firstMerged != merged.end() )
+      {
+      std::vector< unsigned char >::reverse_iterator lastMerged = std::find( merged.rbegin(), merged.rend(), 1 );
+
+      typename InputImageType::RegionType slab = this->GetInput()->GetBufferedRegion();
+
+      typename InputImageType::IndexType slabIndex = slab.GetIndex();
+        slabIndex[2] += firstMerged - merged.begin();
+
+      typename InputImageType::SizeType slabSize = slab.GetSize();
+        slabSize[2] = ( merged.rend() - lastMerged ) - ( firstMerged - merged.begin() );
+
+      slab.SetIndex( slabIndex );
+      slab.SetSize( slabSize );
+
+      if ( this->m_Profiler.IsNotNull() )
+        {
+        this->m_Profiler->StartStage( "SplitLeftAndRightLungsCostImage" );
+        }
+
+      this->m_CostImage = this->m_WorkingCostTable->ComputeCostImage( this->GetInput(), slab );
+
+      if ( this->m_Profiler.IsNotNull() )
+        {
+        this->m_Profiler->StopStage();
+        }
+      }
+    }
+
+  SplitCountsType counts;
+
+  if ( splitInParallel )
+    {
+    this->SplitSlicesInParallel( merged, counts );
+    }
+  else
+    {
+    SplitStateType state;
+    this->InitializeSplitState( state );
+
+    for ( unsigned int i=0; i<size[2]; i++ )
+      {
+      if ( merged[i] != 0 )
+        {
+        this->SplitSlice( i, state, this->m_RemovedIndices, counts );
+        }
+      else
+        {
+        this->InitializeSplitState( state );
+        }
+      }
+    }
+
+  //
+  // Every merged slice gets one split attempt; any further attempts
+  // are retries
+  //
+  WorkCounters::Add( "SplitLeftAndRightLungs.SlicesSplit", counts.MergedSlices );
+  WorkCounters::Add( "SplitLeftAndRightLungs.SplitRetries", counts.SplitAttempts - counts.MergedSlices );
+  WorkCounters::Add( "SplitLeftAndRightLungs.SlicesLeftMerged", counts.UnsplitSlices );
+  WorkCounters::Add( "SplitLeftAndRightLungs.GraphSearches", counts.GraphSearches );
+  WorkCounters::Add( "SplitLeftAndRightLungs.NarrowBandSearches", counts.NarrowBandSearches );
+  WorkCounters::Add( "SplitLeftAndRightLungs.NarrowBandHits", counts.NarrowBandHits );
+
+  this->m_NarrowBandSearches = counts.NarrowBandSearches;
+  this->m_NarrowBandHits     = counts.NarrowBandHits;
+
+  this->m_WorkingCostTable = 0;
+  this->m_CostImage        = 0;
+}
+
+
+template< class TInputImage >
+double
+SplitLeftAndRightLungsImageFilter< TInputImage >
+::GetNarrowBandHitRate() const
+{
+  if ( this->m_NarrowBandSearches == 0 )
+    {
+    return 0.0;
+    }
+
+  return static_cast< double >( this->m_NarrowBandHits )/static_cast< double >( this->m_NarrowBandSearches );
+}
+
+
+/**
+ * The state of a slice that is not merged: the search covers the
+ * middle third of the slice and there is no previous path
+ */
+template< class TInputImage >
+void
+SplitLeftAndRightLungsImageFilter< TInputImage >
+::InitializeSplitState( SplitStateType& state )
+{
+  LabelMapType::SizeType size = this->GetOutput()->GetBufferedRegion().GetSize();
+
+  this->ResetSearchBounds( state );
+
+  state.PreviousPathMap.clear();
+
+  state.PreviousMinY = size[1];
+  state.PreviousMaxY = 0;
+}
+
+
+template< class TInputImage >
+void
+SplitLeftAndRightLungsImageFilter< TInputImage >
+::ResetSearchBounds( SplitStateType& state )
+{
+  const OutputImageType::IndexType& start = this->m_ReferenceRegion.GetIndex();
+  const OutputImageType::SizeType&  size  = this->m_ReferenceRegion.GetSize();
+
+  state.MinX = start[0] + size[0]/3;
+  state.MaxX = start[0] + size[0] - size[0]/3;
+  state.MinY = start[1];
+  state.MaxY = start[1] + size[1] - 1;
+}
+
+
+/**
+ * The middle third of the reference region is clipped to the slice.
+ * Everything outside the slice is background, so clipping does not
+ * change whether an object joins the two sides of the middle third.
+ * When split indices are given, they are erased from a copy of the
+ * middle third, and the slice itself is left as it is.
+ */
+template< class TInputImage >
+bool
+SplitLeftAndRightLungsImageFilter< TInputImage >
+::GetLungsMergedInSlice( int whichSlice, const std::vector< LabelMapType::IndexType >* splitIndices )
+{
+  const OutputImageRegionType& bufferedRegion = this->GetOutput()->GetBufferedRegion();
+
+  long firstX = this->m_ReferenceRegion.GetIndex()[0] + this->m_ReferenceRegion.GetSize()[0]/3;
+  long endX   = firstX + this->m_ReferenceRegion.GetSize()[0]/3;
+
+  firstX = vnl_math_max( firstX, static_cast< long >( bufferedRegion.GetIndex()[0] ) );
+  endX   = vnl_math_min( endX, static_cast< long >( bufferedRegion.GetIndex()[0] + bufferedRegion.GetSize()[0] ) );
+
+  if ( splitIndices == 0 )
+    {
+    return this->GetLungsMergedInSliceRegion( firstX, bufferedRegion.GetIndex()[1], endX - firstX,
+                                              bufferedRegion.GetSize()[1], whichSlice );
+    }
+
+  const long sizeX = endX - firstX;
+  const long sizeY = bufferedRegion.GetSize()[1];
+
+  if ( sizeX <= 0 || sizeY <= 0 )
+    {
+    return false;
+    }
+
+  std::vector< LabelMapPixelType > window( sizeX*sizeY );
+
+  LabelMapType::IndexType rowIndex;
+    rowIndex[0] = firstX;
+    rowIndex[2] = whichSlice;
+
+  for ( long y=0; y<sizeY; y++ )
+    {
+    rowIndex[1] = bufferedRegion.GetIndex()[1] + y;
+
+    const LabelMapPixelType* row = this->GetOutput()->GetBufferPointer() + this->GetOutput()->ComputeOffset( rowIndex );
+
+    std::copy( row, row + sizeX, window.begin() + y*sizeX );
+    }
+
+  for ( unsigned int j=0; j<splitIndices->size(); j++ )
+    {
+    long x = (*splitIndices)[j][0] - firstX;
+    long y = (*splitIndices)[j][1] - bufferedRegion.GetIndex()[1];
+
+    if ( (*splitIndices)[j][2] == whichSlice && x >= 0 && x < sizeX && y >= 0 && y < sizeY )
+      {
+      window[y*sizeX + x] = 0;
+      }
+    }
+
+  return GetLungsMergedInBuffer( &window[0], sizeX, sizeX, sizeY );
+}
+
+
+/**
+ * Split a slice in which the lungs are merged. Only the slice itself
+ * is read and written, so slices can be split concurrently as long as
+ * each gets the state left by the slice before it.
+ */
+template< class TInputImage >
+void
+SplitLeftAndRightLungsImageFilter< TInputImage >
+::SplitSlice( unsigned int i, SplitStateType& state, std::vector< LabelMapType::IndexType >& removedIndices, SplitCountsType& counts )
+{
+  LabelMapType::SizeType size = this->GetOutput()->GetBufferedRegion().GetSize();
+
+  const OutputImageType::IndexType& referenceStart = this->m_ReferenceRegion.GetIndex();
+  const OutputImageType::SizeType&  referenceSize  = this->m_ReferenceRegion.GetSize();
 
   typename InputImageSliceType::IndexType searchStartIndex;
   typename InputImageSliceType::IndexType searchEndIndex;
 
   LabelMapType::IndexType index3D;
+    index3D[2] = i;
 
   //
   // We will keep track of the path indices used to split the
@@ -82,260 +327,530 @@ SplitLeftAndRightLungsImageFilter< TInputImage >
   // within the region between the path in the current slice and the
   // path in the previous slice.
   //
-  std::map< short, short > previousPathMap;
+  std::map< short, short >& previousPathMap = state.PreviousPathMap;
+
+  counts.MergedSlices++;
+
+  bool merged = true;
 
-  int previousMinY = size[1];
-  int previousMaxY = 0;
+  int numSplitAttempts = 0;
 
-  for ( unsigned int i=0; i<size[2]; i++ )
+  bool useSeamSolver = this->m_UseSeamSolver;
+
+  //
+  // Adjacent slices have almost the same junction line, so the seam is
+  // first searched for in a narrow band around the path that split the
+  // previous slice. These attempts come on top of the usual ones, and
+  // are only carved if they split the lungs, so that a slice whose
+  // junction moved out of the band gets no extra cuts.
+  //
+  int bandRadius      = this->m_NarrowBandRadius;
+  int numBandAttempts = 0;
+      
+  while ( merged && numSplitAttempts < 3 )
     {
-    bool merged = this->GetLungsMergedInSliceRegion( size[0]/3, 0, size[0]/3, size[1], i ); 
+    bool useNarrowBand = useSeamSolver && bandRadius > 0 && numBandAttempts < 2 && previousPathMap.size() > 0;
 
-    index3D[2] = i;
+    //
+    // A band seam, or a seam that is followed by the graph search if it
+    // fails, is only carved if it splits the lungs, so that a failed
+    // seam does not leave cuts behind. It does not count as an attempt.
+    //
+    bool testSplit = useNarrowBand || ( useSeamSolver && this->m_GraphSearchFallback );
 
-    if ( merged )
+    if ( useNarrowBand )
       {
-      int numSplitAttempts = 0;
-      
-      while ( merged && numSplitAttempts < 3 )
-        {
-        numSplitAttempts++;
+      numBandAttempts++;
+      counts.NarrowBandSearches++;
+      }
+    else if ( !testSplit )
+      {
+      numSplitAttempts++;
+      }
+    counts.SplitAttempts++;
+
+    //
+    // The ROI is bounded by the reference region; the search region
+    // is then cropped to the slice
+    //
+    typename InputImageType::SizeType roiSize;
+      roiSize[0] = state.MaxX - state.MinX + 20;
+
+    if ( roiSize[0] < 0 )
+      {
+      roiSize[0] = 0;
+      }
+    if ( roiSize[0] > referenceSize[0] )
+      {
+      roiSize[0] = referenceSize[0];
+      }
+        
+    roiSize[1] = state.MaxY - state.MinY + 20;
+    if ( roiSize[1] < 0 )
+      {
+      roiSize[1] = 0;
+      }
+    if ( roiSize[1] > referenceSize[1] )
+      {
+      roiSize[1] = referenceSize[1];
+      }
+
+    roiSize[2] = 0;
+        
+    typename InputImageType::IndexType roiStartIndex;
+      roiStartIndex[0] = state.MinX - 10;
+        
+    if ( roiStartIndex[0] < referenceStart[0] )
+      {
+      roiStartIndex[0] = referenceStart[0];
+      }
+        
+    roiStartIndex[1] = state.MinY - 10;
+    if ( roiStartIndex[1] < referenceStart[1] )
+      {
+      roiStartIndex[1] = referenceStart[1];
+      }
         
-        typename InputImageType::SizeType roiSize;
-          roiSize[0] = maxX - minX + 20;
+    roiStartIndex[2] = i;
+        
+    typename InputImageType::RegionType roiRegion;
+      roiRegion.SetSize( roiSize );
+      roiRegion.SetIndex( roiStartIndex );
+        
+    searchStartIndex[0] = roiStartIndex[0] + roiSize[0]/2;
+    searchStartIndex[1] = roiStartIndex[1];
+        
+    searchEndIndex[0] = roiStartIndex[0] + roiSize[0]/2;
+    searchEndIndex[1] = roiStartIndex[1] + roiSize[1] - 1;
+
+    //
+    // Set the startIndex to the the top-center of the ROI and the
+    // endIndex to be the bottom-center of the ROI
+    //
+    std::vector< LabelMapSliceType::IndexType > pathIndices;
+
+    typename InputSliceType::RegionType searchRegion;
+
+    if ( this->CropSearchRegion( roiRegion, searchRegion, searchStartIndex, searchEndIndex ) )
+      {
+      if ( useNarrowBand )
+        {
+        MinCostSeamSolver::BandType band;
+
+        this->ComputeNarrowBand( state, bandRadius, searchRegion, searchStartIndex, searchEndIndex, band );
+
+        pathIndices = this->GetMinCostSeam( searchRegion, i, searchStartIndex, searchEndIndex, &band );
+        }
+      else if ( useSeamSolver )
+        {
+        pathIndices = this->GetMinCostSeam( searchRegion, i, searchStartIndex, searchEndIndex );
+        }
+      else
+        {
+        pathIndices = this->GetMinCostPath( this->ExtractInputSlice( searchRegion, i ), searchStartIndex, searchEndIndex );
 
-        if ( roiSize[0] < 0 )
+        counts.GraphSearches++;
+        }
+      }
+        
+    SplitStateType searchBounds;
+      searchBounds.MinX = state.MinX;
+      searchBounds.MaxX = state.MaxX;
+      searchBounds.MinY = state.MinY;
+      searchBounds.MaxY = state.MaxY;
+
+    state.MinX = size[0];
+    state.MaxX = 0;
+    state.MinY = size[1];
+    state.MaxY = 0;
+        
+    bool foundMinMax = false;
+    for ( unsigned int j=0; j<pathIndices.size(); j++ )
+      {
+      index3D[0] = (pathIndices[j])[0];
+      index3D[1] = (pathIndices[j])[1];
+          
+      if ( this->GetOutput()->GetPixel( index3D ) !=0 )
+        {
+        foundMinMax = true;
+            
+        if ( index3D[0] < state.MinX )
           {
-          roiSize[0] = 0;
+          state.MinX = index3D[0];
           }
-        if ( roiSize[0] > size[0] )
+        if ( index3D[0] > state.MaxX )
           {
-          roiSize[0] = size[0];
+          state.MaxX = index3D[0];
           }
-        
-        roiSize[1] = maxY - minY + 20;
-        if ( roiSize[1] < 0 )
+        if ( index3D[1] < state.MinY )
           {
-          roiSize[1] = 0;
+          state.MinY = index3D[1];
           }
-        if ( roiSize[1] > size[1] )
+        if ( index3D[1] > state.MaxY )
           {
-          roiSize[1] = size[1];
+          state.MaxY = index3D[1];
           }
-
-        roiSize[2] = 0;
+        }          
+      }
         
-        typename InputImageType::IndexType roiStartIndex;
-          roiStartIndex[0] = minX - 10;
+    if ( !foundMinMax || this->m_AggressiveLeftRightSplitter )
+      {
+      this->ResetSearchBounds( state );
+      }
         
-        if ( roiStartIndex[0] < 0 )
+    std::vector< LabelMapType::IndexType > splitIndices;
+
+    this->ComputeSplitIndices( i, pathIndices, state, splitIndices );
+
+    if ( testSplit )
+      {
+      merged = this->GetLungsMergedInSlice( i, &splitIndices );
+      }
+
+    if ( !testSplit || !merged )
+      {
+      for ( unsigned int j=0; j<splitIndices.size(); j++ )
+        {
+        if ( this->GetOutput()->GetPixel( splitIndices[j] ) != 0 )
           {
-          roiStartIndex[0] = 0;
+          removedIndices.push_back( splitIndices[j] );
           }
+        this->GetOutput()->SetPixel( splitIndices[j], 0 );
+        }
+
+      if ( !testSplit )
+        {
+        merged = this->GetLungsMergedInSlice( i );
+        }
+      }
         
-        roiStartIndex[1] = minY - 10;
-        if ( roiStartIndex[1] < 0 )
+    if ( merged )
+      {
+      if ( testSplit )
+        {
+        state.MinX = searchBounds.MinX;
+        state.MaxX = searchBounds.MaxX;
+        state.MinY = searchBounds.MinY;
+        state.MaxY = searchBounds.MaxY;
+        }
+      else
+        {
+        this->ResetSearchBounds( state );
+        }
+
+      //
+      // The junction may have moved out of the band: widen it. The
+      // seam may not have split the lungs because the path between
+      // them has to go back up somewhere. The graph search can find
+      // such a path.
+      //
+      if ( useNarrowBand )
+        {
+        bandRadius *= 4;
+        }
+      else if ( useSeamSolver && this->m_GraphSearchFallback )
+        {
+        useSeamSolver = false;
+        }
+      }
+    else
+      {
+      if ( useNarrowBand )
+        {
+        counts.NarrowBandHits++;
+        }
+
+      //
+      // Assign the map values to use while splitting the next
+      // slice 
+      //
+      previousPathMap.clear();
+
+      state.PreviousMinY = size[1];
+      state.PreviousMaxY = 0;
+
+      for ( unsigned int j=0; j<pathIndices.size(); j++ )
+        {
+        previousPathMap[(pathIndices[j])[1]] = (pathIndices[j])[0];
+
+        if ( (pathIndices[j])[1] < state.PreviousMinY )
           {
-          roiStartIndex[1] = 0;
+          state.PreviousMinY = (pathIndices[j])[1];
           }
-        
-        roiStartIndex[2] = i;
-        
-        typename InputImageType::RegionType roiRegion;
-          roiRegion.SetSize( roiSize );
-          roiRegion.SetIndex( roiStartIndex );
-        
-        typename InputExtractorType::Pointer roiExtractor = InputExtractorType::New();
-          roiExtractor->SetInput( this->GetInput() );
-          roiExtractor->SetExtractionRegion( roiRegion );
-          roiExtractor->Update();
+        if ( (pathIndices[j])[1] > state.PreviousMaxY )
+          {
+          state.PreviousMaxY = (pathIndices[j])[1];
+          }
+        }
+      }
+    }
 
-        searchStartIndex[0] = roiStartIndex[0] + roiSize[0]/2;
-        searchStartIndex[1] = roiStartIndex[1];
-        
-        searchEndIndex[0] = roiStartIndex[0] + roiSize[0]/2;
-        searchEndIndex[1] = roiStartIndex[1] + roiSize[1] - 1;
+  if ( merged )
+    {
+    counts.UnsplitSlices++;
+    }
+}
 
+
+/**
+ * The indices of a slice erased to split it along a path: the pixels
+ * within 'LeftRightLungSplitRadius' of the path along x (or up to the
+ * path that split the previous slice, where both paths have the row),
+ * the pixels of the square of that radius around each path pixel, and
+ * the vessel pixels on the border of the square. Indices may repeat.
+ */
+template< class TInputImage >
+void
+SplitLeftAndRightLungsImageFilter< TInputImage >
+::ComputeSplitIndices( unsigned int i, const std::vector< LabelMapSliceIndexType >& pathIndices, SplitStateType& state,
+                       std::vector< LabelMapType::IndexType >& splitIndices )
+{
+  std::map< short, short >& previousPathMap = state.PreviousPathMap;
+
+  for ( unsigned int j=0; j<pathIndices.size(); j++ )
+    {
+    LabelMapType::IndexType tempIndex;
+      tempIndex[2] = i;
+
+    int currentX  = (pathIndices[j])[0];
+    int currentY  = (pathIndices[j])[1];
+
+    int startX = currentX - this->m_LeftRightLungSplitRadius;
+    int endX   = currentX + this->m_LeftRightLungSplitRadius;
+
+    if ( previousPathMap.size() > 0 )
+      {
+      if ( currentY >= state.PreviousMinY && currentY <= state.PreviousMaxY )
+        {
         //
-        // Set the startIndex to the the top-center of the ROI and the
-        // endIndex to be the bottom-center of the ROI
+        // Determine the extent in the x-direction to zero-out
         //
-        std::vector< LabelMapSliceType::IndexType > pathIndices = this->GetMinCostPath( roiExtractor->GetOutput(), searchStartIndex, searchEndIndex );
-        
-        minX = size[0];
-        maxX = 0;
-        minY = size[1];
-        maxY = 0;
-        
-        bool foundMinMax = false;
-        for ( unsigned int j=0; j<pathIndices.size(); j++ )
-          {
-          index3D[0] = (pathIndices[j])[0];
-          index3D[1] = (pathIndices[j])[1];
-          
-          if ( this->GetOutput()->GetPixel( index3D ) !=0 )
-            {
-            foundMinMax = true;
+        int previousX = previousPathMap[(pathIndices[j])[1]];
             
-            if ( index3D[0] < minX )
-              {
-              minX = index3D[0];
-              }
-            if ( index3D[0] > maxX )
-              {
-              maxX = index3D[0];
-              }
-            if ( index3D[1] < minY )
-              {
-              minY = index3D[1];
-              }
-            if ( index3D[1] > maxY )
-              {
-              maxY = index3D[1];
-              }
-            }          
-          }
-        
-        if ( !foundMinMax || this->m_AggressiveLeftRightSplitter )
+        if ( previousX - currentX < 0 )
           {
-          minX = size[0]/3;
-          maxX = size[0]-size[0]/3;
-          minY = 0;
-          maxY = size[1]-1;
+          startX = previousX - this->m_LeftRightLungSplitRadius;
+          endX   = currentX  + this->m_LeftRightLungSplitRadius;
           }
-        
-        for ( unsigned int j=0; j<pathIndices.size(); j++ )
+        else 
           {
-          LabelMapType::IndexType tempIndex;
-            tempIndex[2] = i;
+          startX = currentX  - this->m_LeftRightLungSplitRadius;
+          endX   = previousX + this->m_LeftRightLungSplitRadius;
+          }                
+        }
+      }
 
-          int currentX  = (pathIndices[j])[0];
-          int currentY  = (pathIndices[j])[1];
+    tempIndex[1] = (pathIndices[j])[1];
+    for ( int x=startX; x<=endX; x++ )
+      {
+      tempIndex[0] = x;
 
-          int startX = currentX - this->m_LeftRightLungSplitRadius;
-          int endX   = currentX + this->m_LeftRightLungSplitRadius;
+      if ( this->GetOutput()->GetBufferedRegion().IsInside( tempIndex ) )
+        {
+        splitIndices.push_back( tempIndex );
+        }
+      }
 
-          if ( previousPathMap.size() > 0 )
+    for ( int y=-this->m_LeftRightLungSplitRadius; y<=this->m_LeftRightLungSplitRadius; y++ )
+      {
+      tempIndex[1] = (pathIndices[j])[1] + y;            
+
+      for ( int x=-this->m_LeftRightLungSplitRadius; x<=this->m_LeftRightLungSplitRadius; x++ )
+        {
+        tempIndex[0] = (pathIndices[j])[0] + x;
+            
+        if ( this->GetOutput()->GetBufferedRegion().IsInside( tempIndex ) )
+          {
+          //
+          // The type is read before any index is erased. An index
+          // erased earlier is zero when it is erased again, so this
+          // erases the same pixels as erasing them one at a time.
+          //
+          if ( x==this->m_LeftRightLungSplitRadius || x==-this->m_LeftRightLungSplitRadius || 
+               y==this->m_LeftRightLungSplitRadius || y==-this->m_LeftRightLungSplitRadius )
             {
-            if ( currentY >= previousMinY && currentY <= previousMaxY )
+            if ( this->GetType( tempIndex ) == static_cast< unsigned char >( VESSEL ) )
               {
-              //
-              // Determine the extent in the x-direction to zero-out
-              //
-              int previousX = previousPathMap[(pathIndices[j])[1]];
-              
-              if ( previousX - currentX < 0 )
-                {
-                startX = previousX - this->m_LeftRightLungSplitRadius;
-                endX   = currentX  + this->m_LeftRightLungSplitRadius;
-                }
-              else 
-                {
-                startX = currentX  - this->m_LeftRightLungSplitRadius;
-                endX   = previousX + this->m_LeftRightLungSplitRadius;
-                }                
+              splitIndices.push_back( tempIndex );
               }
             }
-
-          tempIndex[1] = (pathIndices[j])[1];
-          for ( int x=startX; x<=endX; x++ )
+          else
             {
-            tempIndex[0] = x;
-
-            if ( this->GetOutput()->GetBufferedRegion().IsInside( tempIndex ) )
-              {
-              if ( this->GetOutput()->GetPixel( tempIndex ) != 0 )
-                {
-                this->m_RemovedIndices.push_back( tempIndex );
-                }
-              this->GetOutput()->SetPixel( tempIndex, 0 );
-              }
+            splitIndices.push_back( tempIndex );
             }
+          }
+        }
+      }          
+    }
+}
 
-          for ( int y=-this->m_LeftRightLungSplitRadius; y<=this->m_LeftRightLungSplitRadius; y++ )
-            {
-            tempIndex[1] = (pathIndices[j])[1] + y;            
 
-            for ( int x=-this->m_LeftRightLungSplitRadius; x<=this->m_LeftRightLungSplitRadius; x++ )
-              {
-              tempIndex[0] = (pathIndices[j])[0] + x;
-              
-              if ( this->GetOutput()->GetBufferedRegion().IsInside( tempIndex ) )
-                {
-                if ( x==this->m_LeftRightLungSplitRadius || x==-this->m_LeftRightLungSplitRadius || 
-                     y==this->m_LeftRightLungSplitRadius || y==-this->m_LeftRightLungSplitRadius )
-                  {
-                  if ( this->GetType( tempIndex ) == static_cast< unsigned char >( VESSEL ) )
-                    {
-                    if ( this->GetOutput()->GetPixel( tempIndex ) != 0 )
-                      {
-                      this->m_RemovedIndices.push_back( tempIndex );
-                      }
-                    this->GetOutput()->SetPixel( tempIndex, 0 );
-                    }
-                  }
-                else
-                  {
-                  if ( this->GetOutput()->GetPixel( tempIndex ) != 0 )
-                    {
-                    this->m_RemovedIndices.push_back( tempIndex );
-                    }
-                  this->GetOutput()->SetPixel( tempIndex, 0 );
-                  }
-                }
-              }
-            }          
-          }
-        
-        merged = this->GetLungsMergedInSliceRegion( size[0]/3, 0, size[0]/3, size[1], i ); 
-        
-        if ( merged )
-          {
-          minX = size[0]/3;
-          maxX = size[0]-size[0]/3;
-          minY = 0;
-          maxY = size[1]-1;
-          }
-        else
-          {
-          //
-          // Assign the map values to use while splitting the next
-          // slice 
-          //
-          previousPathMap.clear();
+/**
+ * Flag the slices in which the lungs are merged, on several threads
+ * if asked to
+ */
+template< class TInputImage >
+void
+SplitLeftAndRightLungsImageFilter< TInputImage >
+::FindMergedSlices( std::vector< unsigned char >& merged, bool useThreads )
+{
+  LabelMapType::SizeType size = this->GetOutput()->GetBufferedRegion().GetSize();
 
-          previousMinY = size[1];
-          previousMaxY = 0;
+  if ( useThreads )
+    {
+    this->GetMultiThreader()->SetNumberOfThreads( this->GetNumberOfThreads() );
 
-          for ( unsigned int i=0; i<pathIndices.size(); i++ )
-            {
-            previousPathMap[(pathIndices[i])[1]] = (pathIndices[i])[0];
+    SplitThreadStruct str;
+      str.Filter = this;
+      str.Merged.resize( size[2], 0 );
 
-            if ( (pathIndices[i])[1] < previousMinY )
-              {
-              previousMinY = (pathIndices[i])[1];
-              }
-            if ( (pathIndices[i])[1] > previousMaxY )
-              {
-              previousMaxY = (pathIndices[i])[1];
-              }
-            }
-          }
+    this->GetMultiThreader()->SetSingleMethod( this->FindMergedSlicesThreaderCallback, &str );
+    this->GetMultiThreader()->SingleMethodExecute();
+
+    merged.swap( str.Merged );
+    }
+  else
+    {
+    merged.assign( size[2], 0 );
+
+    for ( unsigned int i=0; i<size[2]; i++ )
+      {
+      if ( this->GetLungsMergedInSlice( i ) )
+        {
+        merged[i] = 1;
         }
       }
-    else
+    }
+}
+
+
+/**
+ * A slice only depends on the slices before it through the split
+ * state, and the state is reset at every slice in which the lungs
+ * are not merged. Each run of consecutive merged slices is therefore
+ * split serially from the initial state, and the runs are split
+ * concurrently. The result is the same as splitting all the slices
+ * in order.
+ */
+template< class TInputImage >
+void
+SplitLeftAndRightLungsImageFilter< TInputImage >
+::SplitSlicesInParallel( const std::vector< unsigned char >& merged, SplitCountsType& counts )
+{
+  this->GetMultiThreader()->SetNumberOfThreads( this->GetNumberOfThreads() );
+
+  SplitThreadStruct str;
+    str.Filter = this;
+    str.NextRun = 0;
+
+  for ( unsigned int i=0; i<merged.size(); i++ )
+    {
+    if ( merged[i] != 0 && ( i == 0 || merged[i-1] == 0 ) )
+      {
+      str.Runs.push_back( std::make_pair( i, i ) );
+      }
+    if ( merged[i] != 0 )
       {
-      minX = size[0]/3;
-      maxX = size[0]-size[0]/3;
-      minY = 0;
-      maxY = size[1]-1;
+      str.Runs.back().second = i;
+      }
+    }
+
+  //
+  // Split the runs of merged slices. Runs differ much in length, so
+  // the threads take them one at a time, longest first.
+  //
+  str.RunOrder.resize( str.Runs.size() );
+  for ( unsigned int r=0; r<str.Runs.size(); r++ )
+    {
+    str.RunOrder[r] = std::make_pair( -static_cast< long >( str.Runs[r].second - str.Runs[r].first ), r );
+    }
+  std::sort( str.RunOrder.begin(), str.RunOrder.end() );
+
+  str.RemovedIndices.resize( str.Runs.size() );
+  str.Counts.resize( str.Runs.size() );
+
+  this->GetMultiThreader()->SetSingleMethod( this->SplitRunsThreaderCallback, &str );
+  this->GetMultiThreader()->SingleMethodExecute();
+
+  //
+  // Gather the removed indices in slice order
+  //
+  for ( unsigned int r=0; r<str.Runs.size(); r++ )
+    {
+    this->m_RemovedIndices.insert( this->m_RemovedIndices.end(), str.RemovedIndices[r].begin(), str.RemovedIndices[r].end() );
+
+    counts.MergedSlices  += str.Counts[r].MergedSlices;
+    counts.SplitAttempts += str.Counts[r].SplitAttempts;
+    counts.UnsplitSlices += str.Counts[r].UnsplitSlices;
+    counts.GraphSearches += str.Counts[r].GraphSearches;
+
+    counts.NarrowBandSearches += str.Counts[r].NarrowBandSearches;
+    counts.NarrowBandHits     += str.Counts[r].NarrowBandHits;
+    }
+
+  WorkCounters::Add( "SplitLeftAndRightLungs.MergedRuns", str.Runs.size() );
+}
+
+
+template< class TInputImage >
+ITK_THREAD_RETURN_TYPE
+SplitLeftAndRightLungsImageFilter< TInputImage >
+::FindMergedSlicesThreaderCallback( void* arg )
+{
+  MultiThreader::ThreadInfoStruct* info = static_cast< MultiThreader::ThreadInfoStruct* >( arg );
+
+  unsigned int threadId    = info->ThreadID;
+  unsigned int threadCount = info->NumberOfThreads;
+
+  SplitThreadStruct* str = static_cast< SplitThreadStruct* >( info->UserData );
+
+  LabelMapType::SizeType size = str->Filter->GetOutput()->GetBufferedRegion().GetSize();
+
+  for ( unsigned int i=threadId; i<size[2]; i+=threadCount )
+    {
+    if ( str->Filter->GetLungsMergedInSlice( i ) )
+      {
+      str->Merged[i] = 1;
+      }
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
 
-      previousPathMap.clear();
 
-      previousMinY = size[1];
-      previousMaxY = 0;
+template< class TInputImage >
+ITK_THREAD_RETURN_TYPE
+SplitLeftAndRightLungsImageFilter< TInputImage >
+::SplitRunsThreaderCallback( void* arg )
+{
+  MultiThreader::ThreadInfoStruct* info = static_cast< MultiThreader::ThreadInfoStruct* >( arg );
+
+  SplitThreadStruct* str = static_cast< SplitThreadStruct* >( info->UserData );
+
+  SplitStateType state;
+
+  while ( true )
+    {
+    str->Lock.Lock();
+    unsigned long next = str->NextRun++;
+    str->Lock.Unlock();
+
+    if ( next >= str->RunOrder.size() )
+      {
+      break;
+      }
+
+    unsigned int r = str->RunOrder[next].second;
+
+    str->Filter->InitializeSplitState( state );
+
+    for ( unsigned int i=str->Runs[r].first; i<=str->Runs[r].second; i++ )
+      {
+      str->Filter->SplitSlice( i, state, str->RemovedIndices[r], str->Counts[r] );
       }
     }
+
+  return ITK_THREAD_RETURN_VALUE;
 }
 
 
@@ -373,108 +888,93 @@ SplitLeftAndRightLungsImageFilter< TInputImage >
 
 
 /**
- * 
+ * The lungs are merged in the region of a slice if an object (8-
+ * connected nonzero pixels of the region) touches both its left and
+ * its right border. Only the output buffer is read, so this is safe
+ * to call from several threads.
  */
 template< class TInputImage >
 bool
 SplitLeftAndRightLungsImageFilter< TInputImage >
 ::GetLungsMergedInSliceRegion( int startX, int startY, int sizeX, int sizeY, int whichSlice )
 {
-  LabelMapType::SizeType sliceSize;
-    sliceSize[0] = sizeX;
-    sliceSize[1] = sizeY;
-    sliceSize[2] = 0;
+  if ( sizeX <= 0 || sizeY <= 0 )
+    {
+    return false;
+    }
 
   LabelMapType::IndexType sliceStartIndex;
     sliceStartIndex[0] = startX;
     sliceStartIndex[1] = startY;
     sliceStartIndex[2] = whichSlice;
-  
-  LabelMapType::RegionType sliceRegion;
-    sliceRegion.SetSize( sliceSize );
-    sliceRegion.SetIndex( sliceStartIndex );
 
-  LabelMapExtractorType::Pointer sliceROI = LabelMapExtractorType::New();
-    sliceROI->SetInput( this->GetOutput() );
-    sliceROI->SetExtractionRegion( sliceRegion );
-    sliceROI->Update();
+  const LabelMapPixelType* buffer = this->GetOutput()->GetBufferPointer() + this->GetOutput()->ComputeOffset( sliceStartIndex );
 
-  LabelMapSliceType::SizeType roiSize = sliceROI->GetOutput()->GetBufferedRegion().GetSize();
+  const long rowStride = this->GetOutput()->GetBufferedRegion().GetSize()[0];
 
-  LabelMapSliceIteratorType sIt( sliceROI->GetOutput(), sliceROI->GetOutput()->GetBufferedRegion() );
-
-  sIt.GoToBegin();
-  LabelMapSliceType::IndexType startIndex = sIt.GetIndex();
-
-  //
-  // Perform connected components on the region
-  //
-  ConnectedComponent2DType::Pointer connectedComponent = ConnectedComponent2DType::New();
-    connectedComponent->SetInput( sliceROI->GetOutput() );
-    connectedComponent->FullyConnectedOn();
-    connectedComponent->Update();
+  return GetLungsMergedInBuffer( buffer, rowStride, sizeX, sizeY );
+}
 
-  //
-  // If there is an object that touches both the left border and the
-  // right border, then the lungs are merged in this slice.  Test this
-  // condition
-  //
-  std::list< unsigned short >  lefthandLabelList;
-  std::list< unsigned short >  righthandLabelList;
 
-  LabelMapSliceType::IndexType index;
+/**
+ * The objects touching the left border of a region of a label buffer
+ * are grown until one of them reaches the right border
+ */
+template< class TInputImage >
+bool
+SplitLeftAndRightLungsImageFilter< TInputImage >
+::GetLungsMergedInBuffer( const LabelMapPixelType* buffer, long rowStride, long sizeX, long sizeY )
+{
+  std::vector< unsigned char > visited( sizeX*sizeY, 0 );
+  std::vector< long >          stack;
 
-  for ( unsigned int i=0; i<roiSize[1]; i++ )
+  for ( long y=0; y<sizeY; y++ )
     {
-    index[1] = i;
-    index[0] = startIndex[0];
-
-    unsigned short value = connectedComponent->GetOutput()->GetPixel( index );
-
-    if ( value != static_cast< unsigned short >( 0 ) )
+    if ( buffer[y*rowStride] != 0 )
       {
-      lefthandLabelList.push_back( value );
+      visited[y*sizeX] = 1;
+      stack.push_back( y*sizeX );
       }
+    }
 
-     index[0] = startIndex[0] + roiSize[0] - 1;
+  while ( !stack.empty() )
+    {
+    long pixel = stack.back();
+    stack.pop_back();
 
-     value = connectedComponent->GetOutput()->GetPixel( index );
+    long x = pixel % sizeX;
+    long y = pixel / sizeX;
 
-    if ( value != 0 )
+    if ( x == sizeX-1 )
       {
-      righthandLabelList.push_back( value );
+      return true;
       }
-    }
-
-  lefthandLabelList.unique();
-  lefthandLabelList.sort();
-  lefthandLabelList.unique();
-
-  righthandLabelList.unique();
-  righthandLabelList.sort();
-  righthandLabelList.unique();
-
-  std::list< unsigned short >::iterator leftIt   = lefthandLabelList.begin();
-  std::list< unsigned short >::iterator rightIt  = righthandLabelList.begin();
 
-  for ( unsigned int i=0; i<lefthandLabelList.size(); i++, leftIt++ )
-    {
-    rightIt  = righthandLabelList.begin();
-    for ( unsigned int j=0; j<righthandLabelList.size(); j++, rightIt++ )
+    for ( long ny=vnl_math_max( y-1, 0L ); ny<=vnl_math_min( y+1, static_cast< long >( sizeY-1 ) ); ny++ )
       {
-      if ( *leftIt == *rightIt )
+      for ( long nx=vnl_math_max( x-1, 0L ); nx<=vnl_math_min( x+1, static_cast< long >( sizeX-1 ) ); nx++ )
         {
-        return true;
+        long neighbor = ny*sizeX + nx;
+
+        if ( visited[neighbor] == 0 && buffer[ny*rowStride + nx] != 0 )
+          {
+          visited[neighbor] = 1;
+          stack.push_back( neighbor );
+          }
         }
       }
     }
-    
+
   return false;
 }
 
 
 /**
- * 
+ * This runs a graph filter and a min cost path filter. With parallel
+ * splitting it is called from several threads at once, which is safe
+ * because each call builds its own pipeline on its own copy of the
+ * search region: the filters share no state but the cost table, which
+ * is only read, and the work counters, which are locked.
  */
 template< class TInputImage >
 std::vector< itk::Image< unsigned short, 2 >::IndexType >
@@ -492,6 +992,7 @@ SplitLeftAndRightLungsImageFilter< TInputImage >
     graphFunctor->SetUpperThreshold( upperThreshold );
     graphFunctor->SetExponentialCoefficient( this->m_ExponentialCoefficient );
     graphFunctor->SetExponentialTimeConstant( this->m_ExponentialTimeConstant );
+    graphFunctor->SetCostTable( this->m_WorkingCostTable );
     graphFunctor->ActivateAllNeighbors();
 
   typename GraphFilterType::Pointer graphFilter = GraphFilterType::New();
@@ -545,6 +1046,152 @@ SplitLeftAndRightLungsImageFilter< TInputImage >
 
 
 
+/**
+ * Crop the search region to the input, and the end points to the
+ * region (the ROI is padded without regard to the image bounds).
+ * Returns false if nothing is left to search.
+ */
+template< class TInputImage >
+bool
+SplitLeftAndRightLungsImageFilter< TInputImage >
+::CropSearchRegion( const InputImageRegionType& roiRegion, typename InputSliceType::RegionType& searchRegion,
+                    LabelMapSliceIndexType& startIndex, LabelMapSliceIndexType& endIndex )
+{
+  const InputImageRegionType& bufferedRegion = this->GetInput()->GetBufferedRegion();
+
+  typename InputSliceType::IndexType searchStartIndex;
+  typename InputSliceType::SizeType  searchSize;
+
+  for ( unsigned int d=0; d<2; d++ )
+    {
+    long lower = vnl_math_max( roiRegion.GetIndex()[d], bufferedRegion.GetIndex()[d] );
+    long upper = vnl_math_min( roiRegion.GetIndex()[d] + static_cast< long >( roiRegion.GetSize()[d] ),
+                               bufferedRegion.GetIndex()[d] + static_cast< long >( bufferedRegion.GetSize()[d] ) );
+
+    if ( upper <= lower )
+      {
+      return false;
+      }
+
+    searchStartIndex[d] = lower;
+    searchSize[d]       = upper - lower;
+
+    startIndex[d] = vnl_math_min( vnl_math_max( startIndex[d], lower ), upper - 1 );
+    endIndex[d]   = vnl_math_min( vnl_math_max( endIndex[d], lower ), upper - 1 );
+    }
+
+  searchRegion.SetIndex( searchStartIndex );
+  searchRegion.SetSize( searchSize );
+
+  return true;
+}
+
+
+/**
+ * Copy a region of a slice of the input into a 2D image with the same
+ * indices. This reads the input buffer directly rather than running
+ * an extraction filter, so it is safe to call from several threads.
+ */
+template< class TInputImage >
+typename SplitLeftAndRightLungsImageFilter< TInputImage >::InputSlicePointerType
+SplitLeftAndRightLungsImageFilter< TInputImage >
+::ExtractInputSlice( const typename InputSliceType::RegionType& region, int whichSlice )
+{
+  InputSlicePointerType slice = InputSliceType::New();
+    slice->SetRegions( region );
+    slice->Allocate();
+
+  const long width  = region.GetSize()[0];
+  const long height = region.GetSize()[1];
+
+  typename InputImageType::IndexType rowIndex;
+    rowIndex[0] = region.GetIndex()[0];
+    rowIndex[2] = whichSlice;
+
+  for ( long y=0; y<height; y++ )
+    {
+    rowIndex[1] = region.GetIndex()[1] + y;
+
+    const InputPixelType* row = this->GetInput()->GetBufferPointer() + this->GetInput()->ComputeOffset( rowIndex );
+
+    std::copy( row, row + width, slice->GetBufferPointer() + y*width );
+    }
+
+  return slice;
+}
+
+
+/**
+ * The costs are the node weights the graph search gets from the same
+ * table, so the seam costs as much as the graph search's path whenever
+ * that path does not go back up
+ */
+template< class TInputImage >
+std::vector< itk::Image< unsigned short, 2 >::IndexType >
+SplitLeftAndRightLungsImageFilter< TInputImage >
+::GetMinCostSeam( const typename InputSliceType::RegionType& region, int whichSlice,
+                  LabelMapSliceIndexType startIndex, LabelMapSliceIndexType endIndex, const MinCostSeamSolver::BandType* band )
+{
+  const long width  = region.GetSize()[0];
+  const long height = region.GetSize()[1];
+
+  std::vector< float > costs( width*height );
+
+  IntensityCostTable::CostImageType::IndexType rowIndex;
+    rowIndex[0] = region.GetIndex()[0];
+    rowIndex[2] = whichSlice;
+
+  for ( long y=0; y<height; y++ )
+    {
+    rowIndex[1] = region.GetIndex()[1] + y;
+
+    const float* row = this->m_CostImage->GetBufferPointer() + this->m_CostImage->ComputeOffset( rowIndex );
+
+    std::copy( row, row + width, costs.begin() + y*width );
+    }
+
+  MinCostSeamSolver::Pointer seamSolver = MinCostSeamSolver::New();
+    seamSolver->Compute( &costs[0], region, startIndex, endIndex, band );
+
+  return seamSolver->GetPath();
+}
+
+
+/**
+ * The band is centered on the path that split the previous slice,
+ * rows beyond that path being centered on its nearest end. The seam
+ * runs from the center of the band in the first row to its center in
+ * the last row.
+ */
+template< class TInputImage >
+void
+SplitLeftAndRightLungsImageFilter< TInputImage >
+::ComputeNarrowBand( const SplitStateType& state, int radius, const typename InputSliceType::RegionType& region,
+                     LabelMapSliceIndexType& startIndex, LabelMapSliceIndexType& endIndex, MinCostSeamSolver::BandType& band )
+{
+  band.resize( endIndex[1] - startIndex[1] + 1 );
+
+  for ( long y=startIndex[1]; y<=endIndex[1]; y++ )
+    {
+    long previousY = vnl_math_min( vnl_math_max( y, static_cast< long >( state.PreviousMinY ) ), static_cast< long >( state.PreviousMaxY ) );
+
+    std::map< short, short >::const_iterator pIt = state.PreviousPathMap.lower_bound( static_cast< short >( previousY ) );
+
+    if ( pIt == state.PreviousPathMap.end() )
+      {
+      --pIt;
+      }
+
+    band[y - startIndex[1]] = std::make_pair( static_cast< long >( pIt->second - radius ), static_cast< long >( pIt->second + radius ) );
+    }
+
+  const long firstX = region.GetIndex()[0];
+  const long lastX  = region.GetIndex()[0] + static_cast< long >( region.GetSize()[0] ) - 1;
+
+  startIndex[0] = vnl_math_min( vnl_math_max( (band.front().first + band.front().second)/2, firstX ), lastX );
+  endIndex[0]   = vnl_math_min( vnl_math_max( (band.back().first + band.back().second)/2, firstX ), lastX );
+}
+
 
 /**
  * Extract a slice from the input label map image
@@ -634,6 +1281,15 @@ SplitLeftAndRightLungsImageFilter< TInputImage >
   os << indent << "ExponentialTimeConstant:\t" << this->m_ExponentialTimeConstant << std::endl;
   os << indent << "LeftRightLungSplitRadius:\t" << this->m_LeftRightLungSplitRadius << std::endl;
   os << indent << "AggressiveLeftRightSplitter:\t" << this->m_AggressiveLeftRightSplitter << std::endl;
+  os << indent << "UseSeamSolver:\t" << this->m_UseSeamSolver << std::endl;
+  os << indent << "GraphSearchFallback:\t" << this->m_GraphSearchFallback << std::endl;
+  os << indent << "UseParallelSplitting:\t" << this->m_UseParallelSplitting << std::endl;
+  os << indent << "NarrowBandRadius:\t" << this->m_NarrowBandRadius << std::endl;
+  os << indent << "NarrowBandSearches:\t" << this->m_NarrowBandSearches << std::endl;
+  os << indent << "NarrowBandHits:\t" << this->m_NarrowBandHits << std::endl;
+  os << indent << "CostTable:\t" << this->m_CostTable.GetPointer() << std::endl;
+  os << indent << "Profiler:\t" << this->m_Profiler.GetPointer() << std::endl;
+  os << indent << "SearchReferenceRegion:\t" << this->m_SearchReferenceRegion << std::endl;
 }
 
 } // end namespace itk
@@ -0,0 +1,119 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkSquaredDistanceTransform.h,v $
+  Language:  C++
+  Date:      $Date: 2012/09/04 20:23:08 $
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkSquaredDistanceTransform_h
+#define __itkSquaredDistanceTransform_h
+
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+#include "itkMultiThreader.h"
+#include "itkImageRegion.h"
+#include "itkFixedArray.h"
+#include <vector>
+
+
+namespace itk
+{
+/** \class SquaredDistanceTransform
+ * \brief Exact squared Euclidean distance transform of a 3D binary
+ * buffer. For every voxel, Compute() gives the squared distance to
+ * the nearest feature voxel, where the squared distance between two
+ * voxels is the sum over the axes of 'AxisWeights[i]' times the
+ * squared index difference along axis i. Weights of spacing[i]^2
+ * give physical distances, weights of 1/a[i]^2 give distances in
+ * which the ellipsoid of semi-axes a[i] (in voxels) is the unit
+ * ball. Voxels with no feature voxel (only when there are no feature
+ * voxels at all) get NumericTraits<float>::max().
+ *
+ * The transform is separable (lower envelope of parabolas along each
+ * axis in turn, see Felzenszwalb and Huttenlocher, "Distance
+ * Transforms of Sampled Functions"), so its cost is linear in the
+ * number of voxels and does not depend on the distances. The lines
+ * of each axis are split among the threads.
+ */
+class ITK_EXPORT SquaredDistanceTransform : public Object
+{
+public:
+  /** Standard class typedefs. */
+  typedef SquaredDistanceTransform    Self;
+  typedef Object                      Superclass;
+  typedef SmartPointer< Self >        Pointer;
+  typedef SmartPointer< const Self >  ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro( Self );
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro( SquaredDistanceTransform, Object );
+
+  typedef ImageRegion< 3 >         RegionType;
+  typedef FixedArray< double, 3 >  WeightsType;
+
+  /** Weight of each axis in the squared distance. Default is 1 */
+  itkSetMacro( AxisWeights, WeightsType );
+  itkGetConstReferenceMacro( AxisWeights, WeightsType );
+
+  /** Number of threads (default is the MultiThreader default) */
+  itkSetMacro( NumberOfThreads, unsigned int );
+  itkGetMacro( NumberOfThreads, unsigned int );
+
+  /** Compute the squared distances. 'features' and 'distances' are
+   *  buffers covering 'region'. Feature voxels are those for which
+   *  'features' is nonzero. */
+  void Compute( const unsigned char* features, const RegionType& region, float* distances );
+
+protected:
+  SquaredDistanceTransform();
+  virtual ~SquaredDistanceTransform() {}
+
+  void PrintSelf( std::ostream& os, Indent indent ) const;
+
+  /** Data shared with the threads transforming the lines of an
+   *  axis */
+  struct LineThreadStruct
+  {
+    float*         Distances;
+    long           Size[3];
+    long           Strides[3];
+    unsigned int   Axis;
+    double         Weight;
+  };
+
+  /** Static function used as a "callback" by the MultiThreader to
+   *  transform a share of the lines of an axis */
+  static ITK_THREAD_RETURN_TYPE TransformLinesThreaderCallback( void* arg );
+
+  /** One-dimensional transform of 'f' (of length 'n') into 'd'.
+   *  'v' and 'z' are work buffers of at least 'n' and 'n+1'
+   *  elements. */
+  static void TransformLine( const double* f, double* d, long n, double weight, long* v, double* z );
+
+private:
+  SquaredDistanceTransform( const Self& ); //purposely not implemented
+  void operator=( const Self& ); //purposely not implemented
+
+  WeightsType            m_AxisWeights;
+  unsigned int           m_NumberOfThreads;
+  MultiThreader::Pointer m_MultiThreader;
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkSquaredDistanceTransform.txx"
+#endif
+
+#endif
@@ -0,0 +1,228 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkSquaredDistanceTransform.txx,v $
+  Language:  C++
+  Date:      $Date: 2012/09/04 20:23:08 $
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef _itkSquaredDistanceTransform_txx
+#define _itkSquaredDistanceTransform_txx
+
+#include "itkSquaredDistanceTransform.h"
+#include "itkNumericTraits.h"
+
+
+namespace itk
+{
+
+inline
+SquaredDistanceTransform
+::SquaredDistanceTransform()
+{
+  this->m_AxisWeights.Fill( 1.0 );
+
+  this->m_MultiThreader   = MultiThreader::New();
+  this->m_NumberOfThreads = this->m_MultiThreader->GetNumberOfThreads();
+}
+
+
+inline void
+SquaredDistanceTransform
+::Compute( const unsigned char* features, const RegionType& region, float* distances )
+{
+  for ( unsigned int i=0; i<3; i++ )
+    {
+    if ( this->m_AxisWeights[i] <= 0.0 )
+      {
+      itkExceptionMacro( << "Axis weights must be positive" );
+      }
+    }
+
+  const unsigned long numberOfVoxels = region.GetNumberOfPixels();
+
+  const float infinity = NumericTraits< float >::max();
+
+  for ( unsigned long i=0; i<numberOfVoxels; i++ )
+    {
+    distances[i] = features[i] != 0 ? 0.0f : infinity;
+    }
+
+  LineThreadStruct str;
+    str.Distances = distances;
+  for ( unsigned int i=0; i<3; i++ )
+    {
+    str.Size[i] = static_cast< long >( region.GetSize()[i] );
+    }
+    str.Strides[0] = 1;
+    str.Strides[1] = str.Size[0];
+    str.Strides[2] = str.Size[0]*str.Size[1];
+
+  this->m_MultiThreader->SetNumberOfThreads( this->m_NumberOfThreads );
+  this->m_MultiThreader->SetSingleMethod( this->TransformLinesThreaderCallback, &str );
+
+  for ( unsigned int axis=0; axis<3; axis++ )
+    {
+    str.Axis   = axis;
+    str.Weight = this->m_AxisWeights[axis];
+
+    this->m_MultiThreader->SingleMethodExecute();
+    }
+}
+
+
+/**
+ * The lines along 'Axis' are numbered by their position in the other
+ * two axes and split into contiguous shares, one per thread. Each
+ * line is copied to a work buffer, transformed and written back.
+ */
+inline ITK_THREAD_RETURN_TYPE
+SquaredDistanceTransform
+::TransformLinesThreaderCallback( void* arg )
+{
+  MultiThreader::ThreadInfoStruct* info = static_cast< MultiThreader::ThreadInfoStruct* >( arg );
+
+  unsigned int threadId    = info->ThreadID;
+  unsigned int threadCount = info->NumberOfThreads;
+
+  LineThreadStruct* str = static_cast< LineThreadStruct* >( info->UserData );
+
+  const unsigned int axis   = str->Axis;
+  const unsigned int axis1  = (axis+1)%3;
+  const unsigned int axis2  = (axis+2)%3;
+  const long         length = str->Size[axis];
+  const long         stride = str->Strides[axis];
+
+  const long numberOfLines = str->Size[axis1]*str->Size[axis2];
+
+  long lineStart = static_cast< long >( (static_cast< double >( numberOfLines )*threadId)/threadCount );
+  long lineEnd   = static_cast< long >( (static_cast< double >( numberOfLines )*(threadId+1))/threadCount );
+
+  if ( threadId == threadCount-1 )
+    {
+    lineEnd = numberOfLines;
+    }
+
+  std::vector< double > f( length );
+  std::vector< double > d( length );
+  std::vector< long >   v( length );
+  std::vector< double > z( length+1 );
+
+  const float infinity = NumericTraits< float >::max();
+
+  for ( long line=lineStart; line<lineEnd; line++ )
+    {
+    long p1 = line%str->Size[axis1];
+    long p2 = line/str->Size[axis1];
+
+    float* distances = str->Distances + p1*str->Strides[axis1] + p2*str->Strides[axis2];
+
+    bool hasFeature = false;
+    for ( long i=0; i<length; i++ )
+      {
+      f[i] = distances[i*stride];
+
+      if ( distances[i*stride] < infinity )
+        {
+        hasFeature = true;
+        }
+      }
+
+    if ( !hasFeature )
+      {
+      continue;
+      }
+
+    TransformLine( &f[0], &d[0], length, str->Weight, &v[0], &z[0] );
+
+    for ( long i=0; i<length; i++ )
+      {
+      distances[i*stride] = d[i] < static_cast< double >( infinity ) ? static_cast< float >( d[i] ) : infinity;
+      }
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+
+/**
+ * Lower envelope of the parabolas weight*(x-q)^2 + f(q). Samples
+ * with an infinite value do not contribute a parabola. At least one
+ * sample must be finite.
+ */
+inline void
+SquaredDistanceTransform
+::TransformLine( const double* f, double* d, long n, double weight, long* v, double* z )
+{
+  const double infinity = NumericTraits< float >::max();
+
+  long k = -1;
+
+  for ( long q=0; q<n; q++ )
+    {
+    if ( f[q] >= infinity )
+      {
+      continue;
+      }
+
+    while ( k >= 0 )
+      {
+      double s = ((f[q] + weight*q*q) - (f[v[k]] + weight*v[k]*v[k]))/(2.0*weight*(q - v[k]));
+
+      if ( s > z[k] )
+        {
+        k++;
+        v[k]   = q;
+        z[k]   = s;
+        z[k+1] = NumericTraits< double >::max();
+        break;
+        }
+
+      k--;
+      }
+
+    if ( k < 0 )
+      {
+      k      = 0;
+      v[0]   = q;
+      z[0]   = NumericTraits< double >::NonpositiveMin();
+      z[1]   = NumericTraits< double >::max();
+      }
+    }
+
+  k = 0;
+  for ( long x=0; x<n; x++ )
+    {
+    while ( z[k+1] < x )
+      {
+      k++;
+      }
+
+    d[x] = weight*(x - v[k])*(x - v[k]) + f[v[k]];
+    }
+}
+
+
+/**
+ * Standard "PrintSelf" method
+ */
+inline void
+SquaredDistanceTransform
+::PrintSelf( std::ostream& os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+  os << indent << "AxisWeights: " << this->m_AxisWeights << std::endl;
+  os << indent << "NumberOfThreads: " << this->m_NumberOfThreads << std::endl;
+}
+
+} // end namespace itk
+
+#endif
@@ -0,0 +1,149 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkStageCheckpointCache.h,v $
+  Language:  C++
+  Date:      $Date: 2012/09/04 20:23:08 $
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkStageCheckpointCache_h
+#define __itkStageCheckpointCache_h
+
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+#include "itkSimpleFastMutexLock.h"
+#include <map>
+#include <string>
+#include <vector>
+
+
+namespace itk
+{
+/** \class StageCheckpointKey
+ * \brief A 64 bit hash of everything a pipeline stage depends on
+ * (input buffers and parameters). Values are added in turn, and the
+ * key of a stage usually starts with the key of the stage before
+ * it. Only plain values (numbers, buffers of numbers) may be added
+ * with the template Add(), not objects.
+ */
+class ITK_EXPORT StageCheckpointKey
+{
+public:
+  StageCheckpointKey();
+
+  void Add( const void* data, unsigned long bytes );
+  void Add( const std::string& );
+  void Add( const StageCheckpointKey& );
+
+  template < class T >
+  void Add( const T& value )
+    {
+      this->Add( &value, sizeof( T ) );
+    }
+
+  /** The key as 16 hexadecimal digits */
+  std::string GetString() const;
+
+private:
+  unsigned long long m_Hash;
+};
+
+
+/** \class StageCheckpointCache
+ * \brief Cache of the outputs of pipeline stages. A stage
+ * output is a list of sections (buffers of known size) stored in the
+ * file "<Directory>/<stage>-<key>.ckpt", where the key is a
+ * StageCheckpointKey of everything the stage depends on. Since the
+ * key addresses the content, a file never needs to be invalidated:
+ * changing an input or a parameter gives another key.
+ *
+ * Load() memory maps the file (on Linux) and copies the sections into
+ * the given buffers. It returns false, leaving the buffers untouched,
+ * if there is no file for the key or if its sections do not have the
+ * expected sizes. Store() writes a temporary file and renames it, so
+ * concurrent runs sharing the directory never see partial files. The
+ * cache is an optimization only: I/O errors are reported and ignored.
+ *
+ * If no directory is set, the checkpoints are kept in memory for the
+ * lifetime of the cache instead (e.g. to share stages between the
+ * runs of a parameter sweep). Load() and Store() may be called from
+ * several threads.
+ */
+class ITK_EXPORT StageCheckpointCache : public Object
+{
+public:
+  /** Standard class typedefs. */
+  typedef StageCheckpointCache        Self;
+  typedef Object                      Superclass;
+  typedef SmartPointer< Self >        Pointer;
+  typedef SmartPointer< const Self >  ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro( Self );
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro( StageCheckpointCache, Object );
+
+  /** A buffer of a stage output */
+  struct SectionType
+  {
+    void*          Data;
+    unsigned long  Bytes;
+  };
+
+  typedef std::vector< SectionType > SectionsType;
+
+  /** Directory holding the checkpoint files. It must exist. If it is
+   *  empty (default), the checkpoints are kept in memory. */
+  itkSetStringMacro( Directory );
+  itkGetStringMacro( Directory );
+
+  /** Add a section to a list of sections */
+  static void AddSection( SectionsType& sections, void* data, unsigned long bytes );
+
+  bool Load( const std::string& stage, const StageCheckpointKey& key, const SectionsType& sections );
+  bool Store( const std::string& stage, const StageCheckpointKey& key, const SectionsType& sections );
+
+  /** Number of loads that found / did not find a checkpoint */
+  itkGetMacro( NumberOfHits, unsigned long );
+  itkGetMacro( NumberOfMisses, unsigned long );
+
+protected:
+  StageCheckpointCache();
+  virtual ~StageCheckpointCache() {}
+
+  void PrintSelf( std::ostream& os, Indent indent ) const;
+
+  std::string GetFileName( const std::string& stage, const StageCheckpointKey& key ) const;
+
+  bool LoadFile( const std::string& fileName, const SectionsType& sections );
+  bool StoreFile( const std::string& fileName, const SectionsType& sections );
+
+private:
+  StageCheckpointCache( const Self& ); //purposely not implemented
+  void operator=( const Self& ); //purposely not implemented
+
+  std::string    m_Directory;
+  unsigned long  m_NumberOfHits;
+  unsigned long  m_NumberOfMisses;
+  unsigned long  m_NumberOfStores;
+
+  std::map< std::string, std::vector< char > >  m_MemoryCheckpoints;
+  SimpleFastMutexLock                           m_Lock;
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkStageCheckpointCache.txx"
+#endif
+
+#endif
@@ -0,0 +1,427 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkStageCheckpointCache.txx,v $
+  Language:  C++
+  Date:      $Date: 2012/09/04 20:23:08 $
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef _itkStageCheckpointCache_txx
+#define _itkStageCheckpointCache_txx
+
+#include "itkStageCheckpointCache.h"
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+
+#if defined( __linux__ )
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+namespace itk
+{
+
+//
+// Files start with this tag followed by the number of sections and
+// the size of each section (all 8 byte integers)
+//
+static const char StageCheckpointTag[8] = { 'L', 'U', 'N', 'G', 'C', 'K', '0', '1' };
+
+
+inline
+StageCheckpointKey
+::StageCheckpointKey()
+{
+  this->m_Hash = 14695981039346656037ULL;
+}
+
+
+/**
+ * FNV-1a over 8 byte words (the bytes of the last partial word are
+ * hashed one at a time), which is fast enough to hash a CT volume in a
+ * small fraction of the time of any stage
+ */
+inline void
+StageCheckpointKey
+::Add( const void* data, unsigned long bytes )
+{
+  const unsigned long long prime = 1099511628211ULL;
+
+  const unsigned char* p = static_cast< const unsigned char* >( data );
+
+  unsigned long i = 0;
+  for ( ; i+8 <= bytes; i += 8 )
+    {
+    unsigned long long word;
+    std::memcpy( &word, p+i, 8 );
+
+    this->m_Hash = (this->m_Hash ^ word)*prime;
+    }
+
+  for ( ; i<bytes; i++ )
+    {
+    this->m_Hash = (this->m_Hash ^ p[i])*prime;
+    }
+
+  //
+  // The length separates consecutive values, so that e.g. "ab"+"c"
+  // and "a"+"bc" give different keys
+  //
+  unsigned long long length = bytes;
+  this->m_Hash = (this->m_Hash ^ length)*prime;
+}
+
+
+inline void
+StageCheckpointKey
+::Add( const std::string& value )
+{
+  this->Add( value.data(), static_cast< unsigned long >( value.size() ) );
+}
+
+
+inline void
+StageCheckpointKey
+::Add( const StageCheckpointKey& key )
+{
+  this->Add( &key.m_Hash, sizeof( key.m_Hash ) );
+}
+
+
+inline std::string
+StageCheckpointKey
+::GetString() const
+{
+  char digits[17];
+  for ( unsigned int i=0; i<16; i++ )
+    {
+    digits[i] = "0123456789abcdef"[ (this->m_Hash >> (60 - 4*i)) & 0xf ];
+    }
+  digits[16] = '\0';
+
+  return std::string( digits );
+}
+
+
+inline
+StageCheckpointCache
+::StageCheckpointCache()
+{
+  this->m_NumberOfHits   = 0;
+  this->m_NumberOfMisses = 0;
+  this->m_NumberOfStores = 0;
+}
+
+
+inline void
+StageCheckpointCache
+::AddSection( SectionsType& sections, void* data, unsigned long bytes )
+{
+  SectionType section;
+    section.Data  = data;
+    section.Bytes = bytes;
+
+  sections.push_back( section );
+}
+
+
+inline std::string
+StageCheckpointCache
+::GetFileName( const std::string& stage, const StageCheckpointKey& key ) const
+{
+  return this->m_Directory + "/" + stage + "-" + key.GetString() + ".ckpt";
+}
+
+
+/**
+ * Check that a checkpoint (file contents) has the expected sections
+ * and copy them out
+ */
+static bool
+CopyStageCheckpointSections( const unsigned char* checkpoint, unsigned long long checkpointBytes,
+                             const StageCheckpointCache::SectionsType& sections )
+{
+  unsigned long long headerBytes = sizeof( StageCheckpointTag ) + 8*(1 + sections.size());
+  unsigned long long totalBytes  = headerBytes;
+  for ( unsigned int i=0; i<sections.size(); i++ )
+    {
+    totalBytes += sections[i].Bytes;
+    }
+
+  if ( checkpointBytes != totalBytes || std::memcmp( checkpoint, StageCheckpointTag, sizeof( StageCheckpointTag ) ) != 0 )
+    {
+    return false;
+    }
+
+  unsigned long long numberOfSections;
+  std::memcpy( &numberOfSections, checkpoint + sizeof( StageCheckpointTag ), 8 );
+
+  if ( numberOfSections != sections.size() )
+    {
+    return false;
+    }
+
+  for ( unsigned int i=0; i<sections.size(); i++ )
+    {
+    unsigned long long bytes;
+    std::memcpy( &bytes, checkpoint + sizeof( StageCheckpointTag ) + 8*(i+1), 8 );
+
+    if ( bytes != sections[i].Bytes )
+      {
+      return false;
+      }
+    }
+
+  const unsigned char* data = checkpoint + headerBytes;
+  for ( unsigned int i=0; i<sections.size(); i++ )
+    {
+    std::memcpy( sections[i].Data, data, sections[i].Bytes );
+    data += sections[i].Bytes;
+    }
+
+  return true;
+}
+
+
+inline bool
+StageCheckpointCache
+::Load( const std::string& stage, const StageCheckpointKey& key, const SectionsType& sections )
+{
+  std::string fileName = this->GetFileName( stage, key );
+
+  bool loaded = false;
+
+  if ( this->m_Directory.empty() )
+    {
+    this->m_Lock.Lock();
+
+    std::map< std::string, std::vector< char > >::const_iterator it = this->m_MemoryCheckpoints.find( fileName );
+
+    if ( it != this->m_MemoryCheckpoints.end() )
+      {
+      loaded = CopyStageCheckpointSections( reinterpret_cast< const unsigned char* >( &it->second[0] ), it->second.size(), sections );
+      }
+
+    this->m_Lock.Unlock();
+    }
+  else
+    {
+    loaded = this->LoadFile( fileName, sections );
+    }
+
+  this->m_Lock.Lock();
+  if ( loaded )
+    {
+    this->m_NumberOfHits++;
+    }
+  else
+    {
+    this->m_NumberOfMisses++;
+    }
+  this->m_Lock.Unlock();
+
+  if ( loaded )
+    {
+    std::cout << "---Loaded checkpoint:\t" << fileName << std::endl;
+    }
+
+  return loaded;
+}
+
+
+inline bool
+StageCheckpointCache
+::LoadFile( const std::string& fileName, const SectionsType& sections )
+{
+  bool loaded = false;
+
+#if defined( __linux__ )
+  int file = open( fileName.c_str(), O_RDONLY );
+
+  if ( file < 0 )
+    {
+    return false;
+    }
+
+  struct stat status;
+  if ( fstat( file, &status ) == 0 && status.st_size > 0 )
+    {
+    unsigned long long fileBytes = static_cast< unsigned long long >( status.st_size );
+
+    void* mapping = mmap( 0, fileBytes, PROT_READ, MAP_PRIVATE, file, 0 );
+
+    if ( mapping != MAP_FAILED )
+      {
+      madvise( mapping, fileBytes, MADV_SEQUENTIAL );
+
+      loaded = CopyStageCheckpointSections( static_cast< const unsigned char* >( mapping ), fileBytes, sections );
+
+      munmap( mapping, fileBytes );
+      }
+    }
+
+  close( file );
+#else
+  FILE* file = std::fopen( fileName.c_str(), "rb" );
+
+  if ( file == 0 )
+    {
+    return false;
+    }
+
+  //
+  // Read everything before touching the buffers, so that a truncated
+  // file leaves them as they were
+  //
+  std::vector< unsigned char > checkpoint;
+  unsigned char                block[65536];
+
+  size_t bytesRead;
+  while ( (bytesRead = std::fread( block, 1, sizeof( block ), file )) > 0 )
+    {
+    checkpoint.insert( checkpoint.end(), block, block + bytesRead );
+    }
+
+  if ( checkpoint.size() > 0 )
+    {
+    loaded = CopyStageCheckpointSections( &checkpoint[0], checkpoint.size(), sections );
+    }
+
+  std::fclose( file );
+#endif
+
+  return loaded;
+}
+
+
+inline bool
+StageCheckpointCache
+::Store( const std::string& stage, const StageCheckpointKey& key, const SectionsType& sections )
+{
+  std::string fileName = this->GetFileName( stage, key );
+
+  bool stored = false;
+
+  if ( this->m_Directory.empty() )
+    {
+    unsigned long long numberOfSections = sections.size();
+
+    std::vector< char > checkpoint( StageCheckpointTag, StageCheckpointTag + sizeof( StageCheckpointTag ) );
+    checkpoint.insert( checkpoint.end(), reinterpret_cast< const char* >( &numberOfSections ),
+                       reinterpret_cast< const char* >( &numberOfSections ) + 8 );
+
+    for ( unsigned int i=0; i<sections.size(); i++ )
+      {
+      unsigned long long bytes = sections[i].Bytes;
+      checkpoint.insert( checkpoint.end(), reinterpret_cast< const char* >( &bytes ), reinterpret_cast< const char* >( &bytes ) + 8 );
+      }
+    for ( unsigned int i=0; i<sections.size(); i++ )
+      {
+      const char* data = static_cast< const char* >( sections[i].Data );
+      checkpoint.insert( checkpoint.end(), data, data + sections[i].Bytes );
+      }
+
+    this->m_Lock.Lock();
+    this->m_MemoryCheckpoints[fileName].swap( checkpoint );
+    this->m_Lock.Unlock();
+
+    stored = true;
+    }
+  else
+    {
+    stored = this->StoreFile( fileName, sections );
+    }
+
+  if ( stored )
+    {
+    std::cout << "---Stored checkpoint:\t" << fileName << std::endl;
+    }
+
+  return stored;
+}
+
+
+inline bool
+StageCheckpointCache
+::StoreFile( const std::string& fileName, const SectionsType& sections )
+{
+  this->m_Lock.Lock();
+  unsigned long storeNumber = this->m_NumberOfStores++;
+  this->m_Lock.Unlock();
+
+  std::ostringstream temporaryFileName;
+  temporaryFileName << fileName << ".tmp";
+#if defined( __linux__ )
+  temporaryFileName << "." << getpid();
+#endif
+  temporaryFileName << "." << storeNumber;
+
+  FILE* file = std::fopen( temporaryFileName.str().c_str(), "wb" );
+
+  if ( file == 0 )
+    {
+    std::cerr << "Could not write checkpoint " << fileName << std::endl;
+    return false;
+    }
+
+  unsigned long long numberOfSections = sections.size();
+
+  bool written = std::fwrite( StageCheckpointTag, sizeof( StageCheckpointTag ), 1, file ) == 1 &&
+    std::fwrite( &numberOfSections, 8, 1, file ) == 1;
+
+  for ( unsigned int i=0; i<sections.size() && written; i++ )
+    {
+    unsigned long long bytes = sections[i].Bytes;
+    written = std::fwrite( &bytes, 8, 1, file ) == 1;
+    }
+
+  for ( unsigned int i=0; i<sections.size() && written; i++ )
+    {
+    written = std::fwrite( sections[i].Data, 1, sections[i].Bytes, file ) == sections[i].Bytes;
+    }
+
+  if ( std::fclose( file ) != 0 )
+    {
+    written = false;
+    }
+
+  if ( !written || std::rename( temporaryFileName.str().c_str(), fileName.c_str() ) != 0 )
+    {
+    std::remove( temporaryFileName.str().c_str() );
+
+    std::cerr << "Could not write checkpoint " << fileName << std::endl;
+    return false;
+    }
+
+  return true;
+}
+
+
+/**
+ * Standard "PrintSelf" method
+ */
+inline void
+StageCheckpointCache
+::PrintSelf( std::ostream& os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+  os << indent << "Directory: " << this->m_Directory << std::endl;
+  os << indent << "NumberOfHits: " << this->m_NumberOfHits << std::endl;
+  os << indent << "NumberOfMisses: " << this->m_NumberOfMisses << std::endl;
+}
+
+} // end namespace itk
+
+#endif
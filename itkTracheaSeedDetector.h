@@ -0,0 +1,157 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkTracheaSeedDetector.h,v $
+  Language:  C++
+  Date:      $Date: 2012/09/04 20:23:08 $
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkTracheaSeedDetector_h
+#define __itkTracheaSeedDetector_h
+
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+#include "itkImage.h"
+#include <vector>
+
+
+namespace itk
+{
+/** \class TracheaSeedDetector
+ * \brief This class finds seeds for airway segmentation in a
+ * thresholded (foreground / background) label map. Starting at the
+ * top of the scan, it looks for the first slice whose foreground
+ * area is above 'ForegroundSliceAreaThreshold' and that has at least
+ * three 8-connected objects (trachea, left and right lungs). The
+ * trachea is taken to be the object whose centroid (x coordinate) is
+ * closest to the middle of the leftmost and rightmost centroids. All
+ * its voxels are used as seeds. In the following slices, the trachea
+ * is tracked: only a window around the trachea found in the previous
+ * slice is labeled, and the window shrinks for as long as tracking
+ * succeeds. If the trachea cannot be found in the window, the whole
+ * slice is searched again. Seeds are collected from
+ * 'NumberOfSlicesForSeedSearch' slices.
+ *
+ * Slices are read in place from the label map buffer. Labeling,
+ * areas and centroids are computed in a single pass over each slice
+ * (or window) using union-find.
+ */
+template < class TLabelMap >
+class ITK_EXPORT TracheaSeedDetector : public Object
+{
+public:
+  /** Standard class typedefs. */
+  typedef TracheaSeedDetector         Self;
+  typedef Object                      Superclass;
+  typedef SmartPointer< Self >        Pointer;
+  typedef SmartPointer< const Self >  ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro( Self );
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro( TracheaSeedDetector, Object );
+
+  typedef TLabelMap                              LabelMapType;
+  typedef typename LabelMapType::PixelType       LabelMapPixelType;
+  typedef typename LabelMapType::IndexType       IndexType;
+  typedef std::vector< IndexType >               SeedVectorType;
+
+  /** Set the label map in which to search for seeds. Any non-zero
+   *  voxel is considered foreground */
+  itkSetConstObjectMacro( Image, LabelMapType );
+
+  /** This variable indicates whether or not the patient was scanned
+   *  in the head-first position (default is true) */
+  itkSetMacro( HeadFirst, bool );
+  itkGetMacro( HeadFirst, bool );
+
+  /** Number of slices from which seeds are collected (default is
+   *  15) */
+  itkSetMacro( NumberOfSlicesForSeedSearch, unsigned int );
+  itkGetMacro( NumberOfSlicesForSeedSearch, unsigned int );
+
+  /** Foreground area (in mm^2) a slice must exceed before it is
+   *  considered for seed selection. This ensures that the lungs have
+   *  come into the field of view (default is 2000.0) */
+  itkSetMacro( ForegroundSliceAreaThreshold, double );
+  itkGetMacro( ForegroundSliceAreaThreshold, double );
+
+  /** Find the seeds */
+  void Compute();
+
+  /** Get the seeds. Only valid after Compute() */
+  const SeedVectorType & GetSeeds() const
+    {
+      return this->m_Seeds;
+    }
+
+  /** Get the number of slices in which the trachea was found by
+   *  tracking (as opposed to searching the whole slice). Only valid
+   *  after Compute() */
+  itkGetMacro( NumberOfTrackedSlices, unsigned int );
+
+protected:
+  /** Area, coordinate sums and bounding box of a connected object */
+  struct ComponentType
+  {
+    unsigned int   Label;
+    unsigned long  Area;
+    double         SumX;
+    double         SumY;
+    long           MinX;
+    long           MaxX;
+    long           MinY;
+    long           MaxY;
+  };
+
+  TracheaSeedDetector();
+  virtual ~TracheaSeedDetector() {}
+
+  void PrintSelf( std::ostream& os, Indent indent ) const;
+
+  /** Label the foreground of 'slice' within the window
+   *  [x0,x1]x[y0,y1] and fill 'm_Components' with one entry per
+   *  object. */
+  void LabelSlice( const LabelMapPixelType* slice, long x0, long x1, long y0, long y1 );
+
+  /** Add every voxel of 'component' in 'slice' to the seeds */
+  void AddComponentSeeds( const ComponentType& component, long z );
+
+  unsigned int FindRoot( unsigned int );
+
+private:
+  TracheaSeedDetector( const Self& ); //purposely not implemented
+  void operator=( const Self& ); //purposely not implemented
+
+  typename LabelMapType::ConstPointer  m_Image;
+
+  SeedVectorType                m_Seeds;
+  std::vector< unsigned int >   m_ProvisionalLabels;
+  std::vector< unsigned int >   m_Parents;
+  std::vector< ComponentType >  m_ProvisionalComponents;
+  std::vector< ComponentType >  m_Components;
+
+  long           m_SliceXSize;
+  long           m_SliceYSize;
+  bool           m_HeadFirst;
+  unsigned int   m_NumberOfSlicesForSeedSearch;
+  unsigned int   m_NumberOfTrackedSlices;
+  double         m_ForegroundSliceAreaThreshold;
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkTracheaSeedDetector.txx"
+#endif
+
+#endif
@@ -0,0 +1,455 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkTracheaSeedDetector.txx,v $
+  Language:  C++
+  Date:      $Date: 2012/09/04 20:23:08 $
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef _itkTracheaSeedDetector_txx
+#define _itkTracheaSeedDetector_txx
+
+#include "itkTracheaSeedDetector.h"
+#include "itkNumericTraits.h"
+#include <algorithm>
+
+
+namespace itk
+{
+
+template < class TLabelMap >
+TracheaSeedDetector< TLabelMap >
+::TracheaSeedDetector()
+{
+  this->m_SliceXSize                   = 0;
+  this->m_SliceYSize                   = 0;
+  this->m_HeadFirst                    = true;
+  this->m_NumberOfSlicesForSeedSearch  = 15;
+  this->m_NumberOfTrackedSlices        = 0;
+  this->m_ForegroundSliceAreaThreshold = 2000.0;
+}
+
+
+template < class TLabelMap >
+unsigned int
+TracheaSeedDetector< TLabelMap >
+::FindRoot( unsigned int label )
+{
+  while ( this->m_Parents[label] != label )
+    {
+    this->m_Parents[label] = this->m_Parents[this->m_Parents[label]];
+    label = this->m_Parents[label];
+    }
+
+  return label;
+}
+
+
+/**
+ * Single pass labeling of the foreground within a window of the
+ * slice. Each foreground voxel takes the label of its already visited
+ * 8-connected neighbors (west, north-west, north and north-east),
+ * merging their labels if they differ, or a new provisional label if
+ * it has none. Areas, coordinate sums and bounding boxes are
+ * accumulated on the fly and merged into the root labels at the end.
+ */
+template < class TLabelMap >
+void
+TracheaSeedDetector< TLabelMap >
+::LabelSlice( const LabelMapPixelType* slice, long x0, long x1, long y0, long y1 )
+{
+  this->m_Parents.clear();
+  this->m_ProvisionalComponents.clear();
+  this->m_Components.clear();
+
+  //
+  // Label 0 is the background
+  //
+  ComponentType background;
+    background.Label = 0;
+    background.Area  = 0;
+
+  this->m_Parents.push_back( 0 );
+  this->m_ProvisionalComponents.push_back( background );
+
+  const long xSize = this->m_SliceXSize;
+
+  unsigned int* labels = &(this->m_ProvisionalLabels[0]);
+
+  for ( long y=y0; y<=y1; y++ )
+    {
+    for ( long x=x0; x<=x1; x++ )
+      {
+      long p = x + y*xSize;
+
+      if ( slice[p] == 0 )
+        {
+        labels[p] = 0;
+        continue;
+        }
+
+      unsigned int neighborLabels[4];
+      unsigned int numNeighborLabels = 0;
+
+      if ( x > x0 )
+        {
+        neighborLabels[numNeighborLabels++] = labels[p-1];
+        }
+      if ( y > y0 )
+        {
+        if ( x > x0 )
+          {
+          neighborLabels[numNeighborLabels++] = labels[p-xSize-1];
+          }
+        neighborLabels[numNeighborLabels++] = labels[p-xSize];
+        if ( x < x1 )
+          {
+          neighborLabels[numNeighborLabels++] = labels[p-xSize+1];
+          }
+        }
+
+      unsigned int label = 0;
+      for ( unsigned int n=0; n<numNeighborLabels; n++ )
+        {
+        if ( neighborLabels[n] == 0 )
+          {
+          continue;
+          }
+
+        unsigned int root = this->FindRoot( neighborLabels[n] );
+
+        if ( label == 0 )
+          {
+          label = root;
+          }
+        else if ( root != label )
+          {
+          if ( root < label )
+            {
+            this->m_Parents[label] = root;
+            label = root;
+            }
+          else
+            {
+            this->m_Parents[root] = label;
+            }
+          }
+        }
+
+      if ( label == 0 )
+        {
+        label = static_cast< unsigned int >( this->m_Parents.size() );
+
+        ComponentType component;
+          component.Label = label;
+          component.Area  = 0;
+          component.SumX  = 0.0;
+          component.SumY  = 0.0;
+          component.MinX  = x;
+          component.MaxX  = x;
+          component.MinY  = y;
+          component.MaxY  = y;
+
+        this->m_Parents.push_back( label );
+        this->m_ProvisionalComponents.push_back( component );
+        }
+
+      labels[p] = label;
+
+      ComponentType& component = this->m_ProvisionalComponents[label];
+        component.Area++;
+        component.SumX += static_cast< double >( x );
+        component.SumY += static_cast< double >( y );
+        component.MinX  = x < component.MinX ? x : component.MinX;
+        component.MaxX  = x > component.MaxX ? x : component.MaxX;
+        component.MinY  = y < component.MinY ? y : component.MinY;
+        component.MaxY  = y > component.MaxY ? y : component.MaxY;
+      }
+    }
+
+  //
+  // Merge the statistics of the provisional labels into their
+  // roots. Each label is merged directly into its final root, so a
+  // single pass suffices.
+  //
+  for ( unsigned int i=this->m_ProvisionalComponents.size()-1; i>0; i-- )
+    {
+    unsigned int root = this->FindRoot( i );
+
+    if ( root != i )
+      {
+      ComponentType& from = this->m_ProvisionalComponents[i];
+      ComponentType& to   = this->m_ProvisionalComponents[root];
+
+      to.Area += from.Area;
+      to.SumX += from.SumX;
+      to.SumY += from.SumY;
+      to.MinX  = from.MinX < to.MinX ? from.MinX : to.MinX;
+      to.MaxX  = from.MaxX > to.MaxX ? from.MaxX : to.MaxX;
+      to.MinY  = from.MinY < to.MinY ? from.MinY : to.MinY;
+      to.MaxY  = from.MaxY > to.MaxY ? from.MaxY : to.MaxY;
+      }
+    }
+
+  for ( unsigned int i=1; i<this->m_ProvisionalComponents.size(); i++ )
+    {
+    if ( this->m_Parents[i] == i )
+      {
+      this->m_Components.push_back( this->m_ProvisionalComponents[i] );
+      }
+    }
+}
+
+
+template < class TLabelMap >
+void
+TracheaSeedDetector< TLabelMap >
+::AddComponentSeeds( const ComponentType& component, long z )
+{
+  typename LabelMapType::IndexType start = this->m_Image->GetBufferedRegion().GetIndex();
+
+  IndexType index;
+    index[2] = start[2] + z;
+
+  for ( long y=component.MinY; y<=component.MaxY; y++ )
+    {
+    for ( long x=component.MinX; x<=component.MaxX; x++ )
+      {
+      unsigned int label = this->m_ProvisionalLabels[x + y*this->m_SliceXSize];
+
+      if ( label != 0 && this->FindRoot( label ) == component.Label )
+        {
+        index[0] = start[0] + x;
+        index[1] = start[1] + y;
+
+        this->m_Seeds.push_back( index );
+        }
+      }
+    }
+}
+
+
+template < class TLabelMap >
+void
+TracheaSeedDetector< TLabelMap >
+::Compute()
+{
+  if ( !this->m_Image )
+    {
+    itkExceptionMacro( << "Image not set" );
+    }
+
+  this->m_Seeds.clear();
+  this->m_NumberOfTrackedSlices = 0;
+
+  typename LabelMapType::SizeType    size    = this->m_Image->GetBufferedRegion().GetSize();
+  typename LabelMapType::SpacingType spacing = this->m_Image->GetSpacing();
+
+  this->m_SliceXSize = static_cast< long >( size[0] );
+  this->m_SliceYSize = static_cast< long >( size[1] );
+
+  const long sliceSize = this->m_SliceXSize*this->m_SliceYSize;
+  const long zSize     = static_cast< long >( size[2] );
+
+  this->m_ProvisionalLabels.resize( sliceSize );
+
+  const LabelMapPixelType* buffer = this->m_Image->GetBufferPointer();
+
+  //
+  // Tracking state: the trachea found in the previous slice and the
+  // margin (in voxels) around its bounding box within which to search
+  // the next slice
+  //
+  const long minTrackingMargin = 2;
+
+  bool          tracking = false;
+  ComponentType previous;
+  long          margin   = 0;
+
+  unsigned int slicesProcessed    = 0;
+  long         currentSliceOffset = 0;
+
+  while ( slicesProcessed < this->m_NumberOfSlicesForSeedSearch && currentSliceOffset < zSize )
+    {
+    long whichSlice;
+    if ( this->m_HeadFirst )
+      {
+      whichSlice = zSize - 1 - currentSliceOffset;
+      }
+    else
+      {
+      whichSlice = currentSliceOffset;
+      }
+
+    const LabelMapPixelType* slice = buffer + whichSlice*sliceSize;
+
+    bool          found   = false;
+    bool          tracked = false;
+    ComponentType trachea;
+
+    if ( tracking )
+      {
+      long x0 = std::max( previous.MinX - margin, 0L );
+      long x1 = std::min( previous.MaxX + margin, this->m_SliceXSize - 1 );
+      long y0 = std::max( previous.MinY - margin, 0L );
+      long y1 = std::min( previous.MaxY + margin, this->m_SliceYSize - 1 );
+
+      this->LabelSlice( slice, x0, x1, y0, y1 );
+
+      double previousX = previous.SumX/static_cast< double >( previous.Area );
+      double previousY = previous.SumY/static_cast< double >( previous.Area );
+
+      //
+      // The trachea is the object closest to the previous one. It must
+      // have a comparable area and lie strictly inside the window
+      // (otherwise it may be merged with something else)
+      //
+      double minDistance = itk::NumericTraits< double >::max();
+
+      for ( unsigned int i=0; i<this->m_Components.size(); i++ )
+        {
+        const ComponentType& component = this->m_Components[i];
+
+        if ( 2*component.Area < previous.Area || component.Area > 2*previous.Area )
+          {
+          continue;
+          }
+        if ( (component.MinX == x0 && x0 > 0) || (component.MaxX == x1 && x1 < this->m_SliceXSize - 1) ||
+             (component.MinY == y0 && y0 > 0) || (component.MaxY == y1 && y1 < this->m_SliceYSize - 1) )
+          {
+          continue;
+          }
+
+        double dx = component.SumX/static_cast< double >( component.Area ) - previousX;
+        double dy = component.SumY/static_cast< double >( component.Area ) - previousY;
+
+        if ( dx*dx + dy*dy < minDistance )
+          {
+          minDistance = dx*dx + dy*dy;
+          trachea     = component;
+          found       = true;
+          tracked     = true;
+          }
+        }
+
+      if ( !found )
+        {
+        tracking = false;
+        }
+      }
+
+    if ( !found )
+      {
+      this->LabelSlice( slice, 0, this->m_SliceXSize - 1, 0, this->m_SliceYSize - 1 );
+
+      unsigned long numVoxels = 0;
+      for ( unsigned int i=0; i<this->m_Components.size(); i++ )
+        {
+        numVoxels += this->m_Components[i].Area;
+        }
+
+      double foregroundArea = static_cast< double >( numVoxels )*spacing[0]*spacing[1];
+
+      //
+      // If the foreground area of the slice is larger than the
+      // threshold, consider the slice for seed selection. The number of
+      // objects present in the slice must also be at least three
+      // (trachea, left and right lungs)
+      //
+      if ( foregroundArea > this->m_ForegroundSliceAreaThreshold && this->m_Components.size() >= 3 )
+        {
+        //
+        // Identify the object whose centroid (x coordinate) is closest
+        // to the middle of the leftmost and rightmost centroids
+        //
+        std::vector< long > centroids( this->m_Components.size() );
+
+        long leftmostCentroid  = this->m_SliceXSize;
+        long rightmostCentroid = 0;
+
+        for ( unsigned int i=0; i<this->m_Components.size(); i++ )
+          {
+          centroids[i] = static_cast< long >( this->m_Components[i].SumX/static_cast< double >( this->m_Components[i].Area ) );
+
+          leftmostCentroid  = std::min( leftmostCentroid, centroids[i] );
+          rightmostCentroid = std::max( rightmostCentroid, centroids[i] );
+          }
+
+        long middleLocation = (rightmostCentroid + leftmostCentroid)/2;
+        long minDiff        = this->m_SliceXSize + 1;
+        long bestCentroid   = 0;
+
+        //
+        // Ties go to the leftmost centroid, then to the smallest object
+        //
+        for ( unsigned int i=0; i<this->m_Components.size(); i++ )
+          {
+          long diff = centroids[i] > middleLocation ? centroids[i] - middleLocation : middleLocation - centroids[i];
+
+          if ( diff < minDiff || 
+               (diff == minDiff && centroids[i] < bestCentroid) ||
+               (diff == minDiff && centroids[i] == bestCentroid && this->m_Components[i].Area < trachea.Area) )
+            {
+            minDiff      = diff;
+            bestCentroid = centroids[i];
+            trachea      = this->m_Components[i];
+            found        = true;
+            }
+          }
+        }
+      }
+
+    if ( found )
+      {
+      slicesProcessed++;
+
+      this->AddComponentSeeds( trachea, whichSlice );
+
+      if ( tracked )
+        {
+        this->m_NumberOfTrackedSlices++;
+
+        margin = std::max( margin/2, minTrackingMargin );
+        }
+      else
+        {
+        margin = std::max( trachea.MaxX - trachea.MinX, trachea.MaxY - trachea.MinY ) + 1;
+        margin = std::max( margin, minTrackingMargin );
+        }
+
+      tracking = true;
+      previous = trachea;
+      }
+
+    currentSliceOffset++;
+    }
+}
+
+
+/**
+ * Standard "PrintSelf" method
+ */
+template < class TLabelMap >
+void
+TracheaSeedDetector< TLabelMap >
+::PrintSelf( std::ostream& os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+  os << indent << "HeadFirst: " << this->m_HeadFirst << std::endl;
+  os << indent << "NumberOfSlicesForSeedSearch: " << this->m_NumberOfSlicesForSeedSearch << std::endl;
+  os << indent << "ForegroundSliceAreaThreshold: " << this->m_ForegroundSliceAreaThreshold << std::endl;
+  os << indent << "NumberOfTrackedSlices: " << this->m_NumberOfTrackedSlices << std::endl;
+  os << indent << "Number of seeds: " << this->m_Seeds.size() << std::endl;
+}
+
+} // end namespace itk
+
+#endif
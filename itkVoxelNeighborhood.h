@@ -0,0 +1,267 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkVoxelNeighborhood.h,v $
+  Language:  C++
+  Date:      $Date: 2012/09/04 20:23:08 $
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkVoxelNeighborhood_h
+#define __itkVoxelNeighborhood_h
+
+#include "itkImageRegion.h"
+#include "itkIndex.h"
+#include "itkSize.h"
+#include "itkMacro.h"
+#include "itkMultiThreader.h"
+#include <vector>
+
+
+namespace itk
+{
+/** \class VoxelNeighborhood
+ * \brief Visits the immediate neighbors (the 3x3x3 block, or the 3x3
+ * block in 2D) of voxels in an image buffer. The neighbors are
+ * selected by 'VConnectivity': 6, 18 or 26 in 3D and 4 or 8 in
+ * 2D. When 'VIncludeCenter' is true, the voxel itself is visited as
+ * well. Neighbors are visited in the order of the nested loops used
+ * throughout this project, with the first dimension outermost and the
+ * last dimension innermost.
+ *
+ * The linear buffer offsets of the neighbors are computed once for
+ * the buffered region given at construction. Voxels that are not on
+ * the border of the region (interior voxels) are visited without any
+ * bounds checking or index arithmetic. For border voxels, neighbors
+ * outside of the region are skipped.
+ *
+ * The functor passed to the visit methods is called with the buffer
+ * offset of the voxel and the buffer offset of the neighbor.
+ */
+template < unsigned int VDimension, unsigned int VConnectivity, bool VIncludeCenter = false >
+class ITK_EXPORT VoxelNeighborhood
+{
+public:
+  /** Standard class typedefs. */
+  typedef VoxelNeighborhood  Self;
+
+  itkStaticConstMacro( ImageDimension, unsigned int, VDimension );
+  itkStaticConstMacro( Connectivity, unsigned int, VConnectivity );
+  itkStaticConstMacro( NumberOfNeighbors, unsigned int, VConnectivity + (VIncludeCenter ? 1 : 0) );
+
+  typedef ImageRegion< VDimension >  RegionType;
+  typedef Index< VDimension >        IndexType;
+  typedef Size< VDimension >         SizeType;
+
+  VoxelNeighborhood( const RegionType& );
+
+  const RegionType & GetRegion() const
+    {
+      return this->m_Region;
+    }
+
+  /** Buffer offset of the 'n'th neighbor relative to the voxel */
+  long GetOffset( unsigned int n ) const
+    {
+      return this->m_Offsets[n];
+    }
+
+  /** Buffer offset of an index of the region, and the reverse */
+  unsigned long ComputeOffset( const IndexType& ) const;
+  IndexType ComputeIndex( unsigned long ) const;
+
+  /** Visit the neighbors of the voxel at buffer offset 'offset' */
+  template < class TFunctor >
+  void VisitNeighbors( unsigned long offset, TFunctor& functor ) const
+    {
+      long position[VDimension];
+      this->ComputePosition( offset, position );
+
+      if ( this->IsInterior( position ) )
+        {
+        this->VisitInteriorNeighbors( offset, functor );
+        }
+      else
+        {
+        this->VisitBorderNeighbors( offset, position, functor );
+        }
+    }
+
+  /** Visit the neighbors of every voxel whose 'mask' value (a buffer
+   *  covering the same region) is nonzero, in buffer order. Rows in
+   *  the interior of the region are split into their two end voxels
+   *  and an interior run that is visited without bounds checks. */
+  template < class TMaskPixel, class TFunctor >
+  void VisitMaskedNeighbors( const TMaskPixel* mask, TFunctor& functor ) const;
+
+protected:
+  void ComputePosition( unsigned long, long* ) const;
+  bool IsInterior( const long* ) const;
+
+  template < class TFunctor >
+  void VisitInteriorNeighbors( unsigned long offset, TFunctor& functor ) const
+    {
+      for ( unsigned int n=0; n<NumberOfNeighbors; n++ )
+        {
+        functor( offset, offset + this->m_Offsets[n] );
+        }
+    }
+
+  template < class TFunctor >
+  void VisitBorderNeighbors( unsigned long offset, const long* position, TFunctor& functor ) const
+    {
+      for ( unsigned int n=0; n<NumberOfNeighbors; n++ )
+        {
+        bool inside = true;
+        for ( unsigned int d=0; d<VDimension; d++ )
+          {
+          long p = position[d] + this->m_Displacements[n][d];
+
+          if ( p < 0 || p >= this->m_Size[d] )
+            {
+            inside = false;
+            break;
+            }
+          }
+
+        if ( inside )
+          {
+          functor( offset, offset + this->m_Offsets[n] );
+          }
+        }
+    }
+
+private:
+  //
+  // Only the connectivities of the immediate neighbors are
+  // supported. Instantiating any other fails to compile here.
+  //
+  typedef char ConnectivityCheckType[ ((VDimension == 2 && (VConnectivity == 4 || VConnectivity == 8)) ||
+                                       (VDimension == 3 && (VConnectivity == 6 || VConnectivity == 18 || VConnectivity == 26))) ? 1 : -1 ];
+
+  RegionType  m_Region;
+  long        m_Size[VDimension];
+  long        m_Strides[VDimension];
+  long        m_Offsets[NumberOfNeighbors];
+  int         m_Displacements[NumberOfNeighbors][VDimension];
+};
+
+
+/** \class VoxelFrontierExpansion
+ * \brief Expands the frontier of a region growing with several
+ * threads when the voxels must be claimed in frontier order. The
+ * frontier holds buffer offsets ('TFrontier' is a std::vector or a
+ * std::deque).
+ *
+ * Expand() splits the frontier into contiguous chunks, one per
+ * thread. Each thread visits the neighbors of its chunk (see
+ * VoxelNeighborhood) and tags them with 'TClassifier', which is
+ * called with the buffer offsets of the voxel and the neighbor and
+ * returns 0 for neighbors the growing cannot take. The classifier
+ * only reads the state of the growing. Claim() then hands the tagged
+ * neighbors of each frontier voxel, in frontier order, to a functor
+ * that claims them serially.
+ *
+ * A neighbor may be tagged for several voxels of the frontier, and
+ * claims made earlier in the same generation may change it, so the
+ * claim functor rechecks what may have changed. The classifier must
+ * only drop neighbors that the claim would never take.
+ */
+template < class TNeighborhood, class TFrontier, class TClassifier >
+class ITK_EXPORT VoxelFrontierExpansion
+{
+public:
+  /** Standard class typedefs. */
+  typedef VoxelFrontierExpansion  Self;
+
+  /** Frontiers smaller than this are not worth the threading
+   *  overhead and are better expanded serially */
+  itkStaticConstMacro( MinimumParallelFrontierSize, unsigned long, 4096 );
+
+  /** The chunks are expanded by the threads of 'multiThreader', as
+   *  many as it has */
+  VoxelFrontierExpansion( const TNeighborhood& neighborhood, MultiThreader* multiThreader );
+
+  /** Whether a frontier of the given size is worth expanding in
+   *  parallel */
+  bool IsParallel( unsigned long frontierSize ) const
+    {
+      return this->m_MultiThreader->GetNumberOfThreads() > 1 && frontierSize >= MinimumParallelFrontierSize;
+    }
+
+  /** Tag the neighbors of the first 'frontierSize' voxels of
+   *  'frontier'. The frontier must outlive the following Claim(). */
+  void Expand( const TFrontier& frontier, unsigned long frontierSize, const TClassifier& classifier );
+
+  /** Call 'functor( voxel, neighbors, tags, numberOfNeighbors )' for
+   *  each voxel of the expanded frontier, in order, with its tagged
+   *  neighbors in neighborhood order. Stops as soon as the functor
+   *  returns false. */
+  template < class TFunctor >
+  void Claim( TFunctor& functor ) const;
+
+protected:
+  /** Data shared with the threads expanding the chunks */
+  struct ExpansionThreadStruct
+  {
+    Self*               Expansion;
+    const TFrontier*    Frontier;
+    unsigned long       FrontierSize;
+    const TClassifier*  Classifier;
+  };
+
+  /** Records the neighbors the classifier tags */
+  struct TagFunctor
+  {
+    const TClassifier*             Classifier;
+    std::vector< unsigned long >*  Neighbors;
+    std::vector< unsigned char >*  Tags;
+
+    void operator()( unsigned long offset, unsigned long neighbor )
+      {
+        unsigned char tag = (*this->Classifier)( offset, neighbor );
+
+        if ( tag != 0 )
+          {
+          this->Neighbors->push_back( neighbor );
+          this->Tags->push_back( tag );
+          }
+      }
+  };
+
+  /** Static function used as a "callback" by the MultiThreader to tag
+   *  the neighbors of a chunk of the frontier */
+  static ITK_THREAD_RETURN_TYPE ExpandThreaderCallback( void* arg );
+
+private:
+  VoxelFrontierExpansion( const Self& ); //purposely not implemented
+  void operator=( const Self& ); //purposely not implemented
+
+  //
+  // Each thread writes only to its own entries. 'm_NeighborEnds[t][i]'
+  // is the end of the neighbors tagged for the i-th voxel of chunk
+  // 't'.
+  //
+  const TNeighborhood*                         m_Neighborhood;
+  MultiThreader*                               m_MultiThreader;
+  const TFrontier*                             m_Frontier;
+  std::vector< unsigned long >                 m_ChunkStarts;
+  std::vector< std::vector< unsigned long > >  m_Neighbors;
+  std::vector< std::vector< unsigned char > >  m_Tags;
+  std::vector< std::vector< unsigned long > >  m_NeighborEnds;
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkVoxelNeighborhood.txx"
+#endif
+
+#endif
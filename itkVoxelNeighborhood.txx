@@ -0,0 +1,397 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkVoxelNeighborhood.txx,v $
+  Language:  C++
+  Date:      $Date: 2012/09/04 20:23:08 $
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef _itkVoxelNeighborhood_txx
+#define _itkVoxelNeighborhood_txx
+
+#include "itkVoxelNeighborhood.h"
+
+
+namespace itk
+{
+
+/**
+ * The 3^D block is enumerated with the first dimension outermost. A
+ * displacement is a neighbor if its number of nonzero components is
+ * at most 'maxNonzero', which is the smallest value giving
+ * 'VConnectivity' neighbors (1 for 6/4, 2 for 18/8, 3 for 26).
+ */
+template < unsigned int VDimension, unsigned int VConnectivity, bool VIncludeCenter >
+VoxelNeighborhood< VDimension, VConnectivity, VIncludeCenter >
+::VoxelNeighborhood( const RegionType& region )
+{
+  this->m_Region = region;
+
+  long stride = 1;
+  for ( unsigned int d=0; d<VDimension; d++ )
+    {
+    this->m_Size[d]    = static_cast< long >( region.GetSize()[d] );
+    this->m_Strides[d] = stride;
+
+    stride *= this->m_Size[d];
+    }
+
+  unsigned int numberOfDisplacements = 1;
+  for ( unsigned int d=0; d<VDimension; d++ )
+    {
+    numberOfDisplacements *= 3;
+    }
+
+  unsigned int maxNonzero = 0;
+  unsigned int count      = 0;
+  while ( count < VConnectivity )
+    {
+    maxNonzero++;
+
+    for ( unsigned int k=0; k<numberOfDisplacements; k++ )
+      {
+      unsigned int nonzero = 0;
+      unsigned int digits  = k;
+      for ( unsigned int d=0; d<VDimension; d++ )
+        {
+        if ( digits%3 != 1 )
+          {
+          nonzero++;
+          }
+        digits /= 3;
+        }
+
+      if ( nonzero == maxNonzero )
+        {
+        count++;
+        }
+      }
+    }
+
+  unsigned int n = 0;
+  for ( unsigned int k=0; k<numberOfDisplacements; k++ )
+    {
+    int          displacement[VDimension];
+    unsigned int nonzero = 0;
+    unsigned int digits  = k;
+
+    for ( int d=VDimension-1; d>=0; d-- )
+      {
+      displacement[d] = static_cast< int >( digits%3 ) - 1;
+      digits /= 3;
+
+      if ( displacement[d] != 0 )
+        {
+        nonzero++;
+        }
+      }
+
+    if ( nonzero > maxNonzero || (nonzero == 0 && !VIncludeCenter) )
+      {
+      continue;
+      }
+
+    this->m_Offsets[n] = 0;
+    for ( unsigned int d=0; d<VDimension; d++ )
+      {
+      this->m_Displacements[n][d] = displacement[d];
+      this->m_Offsets[n]         += displacement[d]*this->m_Strides[d];
+      }
+
+    n++;
+    }
+}
+
+
+template < unsigned int VDimension, unsigned int VConnectivity, bool VIncludeCenter >
+unsigned long
+VoxelNeighborhood< VDimension, VConnectivity, VIncludeCenter >
+::ComputeOffset( const IndexType& index ) const
+{
+  long offset = 0;
+  for ( unsigned int d=0; d<VDimension; d++ )
+    {
+    offset += (index[d] - this->m_Region.GetIndex()[d])*this->m_Strides[d];
+    }
+
+  return static_cast< unsigned long >( offset );
+}
+
+
+template < unsigned int VDimension, unsigned int VConnectivity, bool VIncludeCenter >
+typename VoxelNeighborhood< VDimension, VConnectivity, VIncludeCenter >::IndexType
+VoxelNeighborhood< VDimension, VConnectivity, VIncludeCenter >
+::ComputeIndex( unsigned long offset ) const
+{
+  long position[VDimension];
+  this->ComputePosition( offset, position );
+
+  IndexType index;
+  for ( unsigned int d=0; d<VDimension; d++ )
+    {
+    index[d] = position[d] + this->m_Region.GetIndex()[d];
+    }
+
+  return index;
+}
+
+
+/**
+ * Position of a buffer offset relative to the start of the region
+ */
+template < unsigned int VDimension, unsigned int VConnectivity, bool VIncludeCenter >
+void
+VoxelNeighborhood< VDimension, VConnectivity, VIncludeCenter >
+::ComputePosition( unsigned long offset, long* position ) const
+{
+  long remainder = static_cast< long >( offset );
+  for ( int d=VDimension-1; d>0; d-- )
+    {
+    position[d] = remainder/this->m_Strides[d];
+    remainder  -= position[d]*this->m_Strides[d];
+    }
+  position[0] = remainder;
+}
+
+
+template < unsigned int VDimension, unsigned int VConnectivity, bool VIncludeCenter >
+bool
+VoxelNeighborhood< VDimension, VConnectivity, VIncludeCenter >
+::IsInterior( const long* position ) const
+{
+  for ( unsigned int d=0; d<VDimension; d++ )
+    {
+    if ( position[d] < 1 || position[d] > this->m_Size[d]-2 )
+      {
+      return false;
+      }
+    }
+
+  return true;
+}
+
+
+template < unsigned int VDimension, unsigned int VConnectivity, bool VIncludeCenter >
+template < class TMaskPixel, class TFunctor >
+void
+VoxelNeighborhood< VDimension, VConnectivity, VIncludeCenter >
+::VisitMaskedNeighbors( const TMaskPixel* mask, TFunctor& functor ) const
+{
+  if ( this->m_Region.GetNumberOfPixels() == 0 )
+    {
+    return;
+    }
+
+  const long rowLength = this->m_Size[0];
+
+  long position[VDimension];
+  for ( unsigned int d=0; d<VDimension; d++ )
+    {
+    position[d] = 0;
+    }
+
+  unsigned long rowStart = 0;
+
+  while ( true )
+    {
+    bool interiorRow = rowLength > 2;
+    for ( unsigned int d=1; d<VDimension && interiorRow; d++ )
+      {
+      if ( position[d] < 1 || position[d] > this->m_Size[d]-2 )
+        {
+        interiorRow = false;
+        }
+      }
+
+    if ( interiorRow )
+      {
+      //
+      // The two end voxels of the row are on the border, everything
+      // between them is interior
+      //
+      if ( mask[rowStart] != 0 )
+        {
+        position[0] = 0;
+        this->VisitBorderNeighbors( rowStart, position, functor );
+        }
+
+      const unsigned long interiorEnd = rowStart + rowLength - 1;
+      for ( unsigned long offset=rowStart+1; offset<interiorEnd; offset++ )
+        {
+        if ( mask[offset] != 0 )
+          {
+          this->VisitInteriorNeighbors( offset, functor );
+          }
+        }
+
+      if ( mask[interiorEnd] != 0 )
+        {
+        position[0] = rowLength-1;
+        this->VisitBorderNeighbors( interiorEnd, position, functor );
+        }
+      }
+    else
+      {
+      for ( long x=0; x<rowLength; x++ )
+        {
+        if ( mask[rowStart+x] != 0 )
+          {
+          position[0] = x;
+          this->VisitBorderNeighbors( rowStart+x, position, functor );
+          }
+        }
+      }
+
+    rowStart += rowLength;
+
+    //
+    // Move on to the next row
+    //
+    unsigned int d = 1;
+    while ( d < VDimension )
+      {
+      position[d]++;
+      if ( position[d] < this->m_Size[d] )
+        {
+        break;
+        }
+      position[d] = 0;
+      d++;
+      }
+
+    if ( d == VDimension )
+      {
+      break;
+      }
+    }
+}
+
+
+template < class TNeighborhood, class TFrontier, class TClassifier >
+VoxelFrontierExpansion< TNeighborhood, TFrontier, TClassifier >
+::VoxelFrontierExpansion( const TNeighborhood& neighborhood, MultiThreader* multiThreader )
+{
+  this->m_Neighborhood  = &neighborhood;
+  this->m_MultiThreader = multiThreader;
+  this->m_Frontier      = 0;
+}
+
+
+template < class TNeighborhood, class TFrontier, class TClassifier >
+void
+VoxelFrontierExpansion< TNeighborhood, TFrontier, TClassifier >
+::Expand( const TFrontier& frontier, unsigned long frontierSize, const TClassifier& classifier )
+{
+  const unsigned int numberOfThreads = this->m_MultiThreader->GetNumberOfThreads();
+
+  this->m_Frontier = &frontier;
+  this->m_ChunkStarts.resize( numberOfThreads );
+  this->m_Neighbors.resize( numberOfThreads );
+  this->m_Tags.resize( numberOfThreads );
+  this->m_NeighborEnds.resize( numberOfThreads );
+
+  ExpansionThreadStruct str;
+    str.Expansion    = this;
+    str.Frontier     = &frontier;
+    str.FrontierSize = frontierSize;
+    str.Classifier   = &classifier;
+
+  this->m_MultiThreader->SetSingleMethod( this->ExpandThreaderCallback, &str );
+  this->m_MultiThreader->SingleMethodExecute();
+}
+
+
+template < class TNeighborhood, class TFrontier, class TClassifier >
+ITK_THREAD_RETURN_TYPE
+VoxelFrontierExpansion< TNeighborhood, TFrontier, TClassifier >
+::ExpandThreaderCallback( void* arg )
+{
+  MultiThreader::ThreadInfoStruct* info = static_cast< MultiThreader::ThreadInfoStruct* >( arg );
+
+  unsigned int threadId    = info->ThreadID;
+  unsigned int threadCount = info->NumberOfThreads;
+
+  ExpansionThreadStruct* str = static_cast< ExpansionThreadStruct* >( info->UserData );
+
+  Self* expansion = str->Expansion;
+
+  std::vector< unsigned long >& neighbors    = expansion->m_Neighbors[threadId];
+  std::vector< unsigned char >& tags         = expansion->m_Tags[threadId];
+  std::vector< unsigned long >& neighborEnds = expansion->m_NeighborEnds[threadId];
+
+  neighbors.clear();
+  tags.clear();
+  neighborEnds.clear();
+
+  TagFunctor tagger;
+    tagger.Classifier = str->Classifier;
+    tagger.Neighbors  = &neighbors;
+    tagger.Tags       = &tags;
+
+  //
+  // Chunks are contiguous and ordered by thread id so that visiting
+  // the chunks in thread order visits the frontier in order
+  //
+  unsigned long chunkStart = static_cast< unsigned long >( (static_cast< double >( str->FrontierSize )*threadId)/threadCount );
+  unsigned long chunkEnd   = static_cast< unsigned long >( (static_cast< double >( str->FrontierSize )*(threadId+1))/threadCount );
+
+  if ( threadId == threadCount-1 )
+    {
+    chunkEnd = str->FrontierSize;
+    }
+
+  expansion->m_ChunkStarts[threadId] = chunkStart;
+
+  for ( unsigned long i=chunkStart; i<chunkEnd; i++ )
+    {
+    expansion->m_Neighborhood->VisitNeighbors( (*str->Frontier)[i], tagger );
+
+    neighborEnds.push_back( neighbors.size() );
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+
+template < class TNeighborhood, class TFrontier, class TClassifier >
+template < class TFunctor >
+void
+VoxelFrontierExpansion< TNeighborhood, TFrontier, TClassifier >
+::Claim( TFunctor& functor ) const
+{
+  for ( unsigned int t=0; t<this->m_NeighborEnds.size(); t++ )
+    {
+    const std::vector< unsigned long >& neighbors    = this->m_Neighbors[t];
+    const std::vector< unsigned char >& tags         = this->m_Tags[t];
+    const std::vector< unsigned long >& neighborEnds = this->m_NeighborEnds[t];
+
+    unsigned long neighborStart = 0;
+
+    for ( unsigned long i=0; i<neighborEnds.size(); i++ )
+      {
+      unsigned long numberOfNeighbors = neighborEnds[i] - neighborStart;
+
+      const unsigned long* voxelNeighbors = numberOfNeighbors > 0 ? &neighbors[neighborStart] : 0;
+      const unsigned char* voxelTags      = numberOfNeighbors > 0 ? &tags[neighborStart] : 0;
+
+      if ( !functor( (*this->m_Frontier)[this->m_ChunkStarts[t] + i], voxelNeighbors, voxelTags, numberOfNeighbors ) )
+        {
+        return;
+        }
+
+      neighborStart = neighborEnds[i];
+      }
+    }
+}
+
+} // end namespace itk
+
+#endif
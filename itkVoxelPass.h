@@ -0,0 +1,429 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkVoxelPass.h,v $
+  Language:  C++
+  Date:      $Date: 2012/09/04 20:23:08 $
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkVoxelPass_h
+#define __itkVoxelPass_h
+
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+#include "itkMultiThreader.h"
+#include <algorithm>
+#include <vector>
+
+
+namespace itk
+{
+/** \class VoxelPass
+ * \brief A single pass over raw voxel buffers applying a list of
+ * element-wise operations (thresholds, clips, masks, copies, counts,
+ * histograms, table lookups). Instead of one pass over the whole volume per
+ * operation, the voxels are split into blocks of 'BlockSize' voxels
+ * and all the operations are applied to a block, in the order they
+ * were added, before moving on to the next block. The block stays
+ * in the cache between operations, so the volume is read from memory
+ * once.
+ *
+ * Since an operation on voxel i may only depend on voxel i of its
+ * buffers, the result is that of applying the operations one after
+ * the other to the whole volume. The blocks are split among the
+ * threads.
+ *
+ * The kernels for 16 bit voxels (CT values and label maps) use AVX2
+ * or SSE2 instructions when the processor supports them (checked at
+ * run time), other voxel types use plain loops.
+ */
+class ITK_EXPORT VoxelPass : public Object
+{
+public:
+  /** Standard class typedefs. */
+  typedef VoxelPass                   Self;
+  typedef Object                      Superclass;
+  typedef SmartPointer< Self >        Pointer;
+  typedef SmartPointer< const Self >  ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro( Self );
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro( VoxelPass, Object );
+
+  /** \class Operation
+   * \brief An element-wise operation on voxels [begin, end) of its
+   * buffers. Process() is called concurrently for different blocks,
+   * with the id of the calling thread. */
+  class Operation
+  {
+  public:
+    virtual ~Operation() {}
+
+    /** Called before the pass with the number of threads used */
+    virtual void Initialize( unsigned int ) {}
+
+    virtual void Process( unsigned long begin, unsigned long end, unsigned int threadId ) = 0;
+  };
+
+  typedef std::vector< Operation* > OperationsType;
+
+  /** Number of threads (default is the MultiThreader default) */
+  itkSetMacro( NumberOfThreads, unsigned int );
+  itkGetMacro( NumberOfThreads, unsigned int );
+
+  /** Number of voxels in a block (default is 8192) */
+  itkSetMacro( BlockSize, unsigned long );
+  itkGetMacro( BlockSize, unsigned long );
+
+  /** Add an operation to the pass. The pass does not own the
+   *  operation, which must exist until the pass is executed. */
+  void AddOperation( Operation* operation );
+
+  void ClearOperations();
+
+  /** Apply the operations to voxels [0, numberOfVoxels) */
+  void Execute( unsigned long numberOfVoxels );
+
+  /** Instruction set used by the kernels: "AVX2", "SSE2" or "Scalar" */
+  static const char* GetInstructionSet();
+
+  /** Kernels used by the operations. Each has a plain loop for any
+   *  voxel type and a vectorized overload for 16 bit voxels. */
+  template < class TPixel >
+  static void Clip( TPixel* buffer, unsigned long n, TPixel clipValue, TPixel replacementValue, bool clipAbove );
+  static void Clip( short* buffer, unsigned long n, short clipValue, short replacementValue, bool clipAbove );
+
+  template < class TInputPixel, class TOutputPixel >
+  static void Threshold( const TInputPixel* input, TOutputPixel* output, unsigned long n,
+                         TInputPixel lowerThreshold, TInputPixel upperThreshold,
+                         TOutputPixel insideValue, TOutputPixel outsideValue );
+  static void Threshold( const short* input, unsigned short* output, unsigned long n,
+                         short lowerThreshold, short upperThreshold,
+                         unsigned short insideValue, unsigned short outsideValue );
+
+  template < class TPixel, class TMaskPixel >
+  static void Mask( TPixel* buffer, const TMaskPixel* mask, unsigned long n, TPixel value, bool whereMaskIsZero );
+  static void Mask( unsigned short* buffer, const unsigned short* mask, unsigned long n, unsigned short value, bool whereMaskIsZero );
+
+  template < class TPixel >
+  static unsigned long CountNonzero( const TPixel* buffer, unsigned long n );
+  static unsigned long CountNonzero( const unsigned short* buffer, unsigned long n );
+
+  /** Add the voxels where the mask is nonzero (all voxels if 'mask' is
+   *  null) to 'counts', which has an entry for each of the 65536
+   *  values, indexed by the value plus 32768 */
+  static void Histogram( const short* buffer, const unsigned short* mask, unsigned long n, unsigned long* counts );
+
+  /** Set each output voxel to the entry of 'table' for the value of
+   *  the input voxel. The table has an entry for each of the 65536
+   *  values, indexed by the value plus 32768. */
+  static void Lookup( const short* input, const float* table, float* output, unsigned long n );
+
+protected:
+  VoxelPass();
+  virtual ~VoxelPass() {}
+
+  void PrintSelf( std::ostream& os, Indent indent ) const;
+
+  /** Data shared with the threads of the pass */
+  struct PassThreadStruct
+  {
+    const OperationsType*  Operations;
+    unsigned long          NumberOfVoxels;
+    unsigned long          BlockSize;
+  };
+
+  /** Static function used as a "callback" by the MultiThreader to
+   *  process a share of the blocks */
+  static ITK_THREAD_RETURN_TYPE PassThreaderCallback( void* arg );
+
+  /** 0 for plain loops, 1 for SSE2 and 2 for AVX2 */
+  static int GetInstructionSetLevel();
+
+private:
+  VoxelPass( const Self& ); //purposely not implemented
+  void operator=( const Self& ); //purposely not implemented
+
+  OperationsType         m_Operations;
+  unsigned int           m_NumberOfThreads;
+  unsigned long          m_BlockSize;
+  MultiThreader::Pointer m_MultiThreader;
+};
+
+
+/** \class VoxelClipOperation
+ * \brief Replace the voxels below (or above, if 'clipAbove') the clip
+ * value with the replacement value
+ */
+template < class TPixel >
+class ITK_EXPORT VoxelClipOperation : public VoxelPass::Operation
+{
+public:
+  VoxelClipOperation( TPixel* buffer, TPixel clipValue, TPixel replacementValue, bool clipAbove )
+    {
+      this->m_Buffer           = buffer;
+      this->m_ClipValue        = clipValue;
+      this->m_ReplacementValue = replacementValue;
+      this->m_ClipAbove        = clipAbove;
+    }
+
+  void Process( unsigned long begin, unsigned long end, unsigned int )
+    {
+      VoxelPass::Clip( this->m_Buffer + begin, end - begin, this->m_ClipValue, this->m_ReplacementValue, this->m_ClipAbove );
+    }
+
+private:
+  TPixel*  m_Buffer;
+  TPixel   m_ClipValue;
+  TPixel   m_ReplacementValue;
+  bool     m_ClipAbove;
+};
+
+
+/** \class VoxelThresholdOperation
+ * \brief Set the output to the inside value where the input is within
+ * [lowerThreshold, upperThreshold] and to the outside value elsewhere
+ */
+template < class TInputPixel, class TOutputPixel >
+class ITK_EXPORT VoxelThresholdOperation : public VoxelPass::Operation
+{
+public:
+  VoxelThresholdOperation( const TInputPixel* input, TOutputPixel* output,
+                           TInputPixel lowerThreshold, TInputPixel upperThreshold,
+                           TOutputPixel insideValue, TOutputPixel outsideValue )
+    {
+      this->m_Input          = input;
+      this->m_Output         = output;
+      this->m_LowerThreshold = lowerThreshold;
+      this->m_UpperThreshold = upperThreshold;
+      this->m_InsideValue    = insideValue;
+      this->m_OutsideValue   = outsideValue;
+    }
+
+  void Process( unsigned long begin, unsigned long end, unsigned int )
+    {
+      VoxelPass::Threshold( this->m_Input + begin, this->m_Output + begin, end - begin, this->m_LowerThreshold,
+                            this->m_UpperThreshold, this->m_InsideValue, this->m_OutsideValue );
+    }
+
+private:
+  const TInputPixel*  m_Input;
+  TOutputPixel*       m_Output;
+  TInputPixel         m_LowerThreshold;
+  TInputPixel         m_UpperThreshold;
+  TOutputPixel        m_InsideValue;
+  TOutputPixel        m_OutsideValue;
+};
+
+
+/** \class VoxelMaskOperation
+ * \brief Set the voxels to 'value' where the mask is nonzero (or
+ * zero, if 'whereMaskIsZero')
+ */
+template < class TPixel, class TMaskPixel >
+class ITK_EXPORT VoxelMaskOperation : public VoxelPass::Operation
+{
+public:
+  VoxelMaskOperation( TPixel* buffer, const TMaskPixel* mask, TPixel value, bool whereMaskIsZero )
+    {
+      this->m_Buffer          = buffer;
+      this->m_Mask            = mask;
+      this->m_Value           = value;
+      this->m_WhereMaskIsZero = whereMaskIsZero;
+    }
+
+  void Process( unsigned long begin, unsigned long end, unsigned int )
+    {
+      VoxelPass::Mask( this->m_Buffer + begin, this->m_Mask + begin, end - begin, this->m_Value, this->m_WhereMaskIsZero );
+    }
+
+private:
+  TPixel*            m_Buffer;
+  const TMaskPixel*  m_Mask;
+  TPixel             m_Value;
+  bool               m_WhereMaskIsZero;
+};
+
+
+/** \class VoxelLabelMaskOperation
+ * \brief Set the voxels to 'value' where the label (e.g. a component
+ * label sorted by size) is at least 'minimumLabel'
+ */
+template < class TPixel, class TLabelPixel >
+class ITK_EXPORT VoxelLabelMaskOperation : public VoxelPass::Operation
+{
+public:
+  VoxelLabelMaskOperation( TPixel* buffer, const TLabelPixel* labels, TLabelPixel minimumLabel, TPixel value )
+    {
+      this->m_Buffer       = buffer;
+      this->m_Labels       = labels;
+      this->m_MinimumLabel = minimumLabel;
+      this->m_Value        = value;
+    }
+
+  void Process( unsigned long begin, unsigned long end, unsigned int )
+    {
+      for ( unsigned long i=begin; i<end; i++ )
+        {
+        this->m_Buffer[i] = this->m_Labels[i] >= this->m_MinimumLabel ? this->m_Value : this->m_Buffer[i];
+        }
+    }
+
+private:
+  TPixel*             m_Buffer;
+  const TLabelPixel*  m_Labels;
+  TLabelPixel         m_MinimumLabel;
+  TPixel              m_Value;
+};
+
+
+/** \class VoxelCopyOperation
+ * \brief Copy a buffer into another
+ */
+template < class TPixel >
+class ITK_EXPORT VoxelCopyOperation : public VoxelPass::Operation
+{
+public:
+  VoxelCopyOperation( const TPixel* source, TPixel* destination )
+    {
+      this->m_Source      = source;
+      this->m_Destination = destination;
+    }
+
+  void Process( unsigned long begin, unsigned long end, unsigned int )
+    {
+      std::copy( this->m_Source + begin, this->m_Source + end, this->m_Destination + begin );
+    }
+
+private:
+  const TPixel*  m_Source;
+  TPixel*        m_Destination;
+};
+
+
+/** \class VoxelCountOperation
+ * \brief Count the nonzero voxels. Each thread has its own count, so
+ * the threads never write to the same memory.
+ */
+template < class TPixel >
+class ITK_EXPORT VoxelCountOperation : public VoxelPass::Operation
+{
+public:
+  VoxelCountOperation( const TPixel* buffer )
+    {
+      this->m_Buffer = buffer;
+    }
+
+  void Initialize( unsigned int numberOfThreads )
+    {
+      this->m_Counts.assign( numberOfThreads, 0 );
+    }
+
+  void Process( unsigned long begin, unsigned long end, unsigned int threadId )
+    {
+      this->m_Counts[threadId] += VoxelPass::CountNonzero( this->m_Buffer + begin, end - begin );
+    }
+
+  unsigned long GetCount() const
+    {
+      unsigned long count = 0;
+      for ( unsigned int i=0; i<this->m_Counts.size(); i++ )
+        {
+        count += this->m_Counts[i];
+        }
+
+      return count;
+    }
+
+private:
+  const TPixel*                m_Buffer;
+  std::vector< unsigned long > m_Counts;
+};
+
+
+/** \class VoxelHistogramOperation
+ * \brief Count the voxels of each value of a 16 bit buffer, where the
+ * mask is nonzero if there is one. Each thread has its own counts.
+ */
+class ITK_EXPORT VoxelHistogramOperation : public VoxelPass::Operation
+{
+public:
+  VoxelHistogramOperation( const short* buffer, const unsigned short* mask )
+    {
+      this->m_Buffer = buffer;
+      this->m_Mask   = mask;
+    }
+
+  void Initialize( unsigned int numberOfThreads )
+    {
+      this->m_Counts.assign( numberOfThreads, std::vector< unsigned long >( 65536, 0 ) );
+    }
+
+  void Process( unsigned long begin, unsigned long end, unsigned int threadId )
+    {
+      VoxelPass::Histogram( this->m_Buffer + begin, this->m_Mask != 0 ? this->m_Mask + begin : 0, end - begin,
+                            &this->m_Counts[threadId][0] );
+    }
+
+  /** Counts indexed by the value plus 32768 */
+  void GetCounts( std::vector< unsigned long >& counts ) const
+    {
+      counts.assign( 65536, 0 );
+      for ( unsigned int t=0; t<this->m_Counts.size(); t++ )
+        {
+        for ( unsigned long v=0; v<65536; v++ )
+          {
+          counts[v] += this->m_Counts[t][v];
+          }
+        }
+    }
+
+private:
+  const short*                                 m_Buffer;
+  const unsigned short*                        m_Mask;
+  std::vector< std::vector< unsigned long > >  m_Counts;
+};
+
+
+/** \class VoxelLookupOperation
+ * \brief Map the values of a 16 bit buffer through a table with an
+ * entry for each of the 65536 values (see IntensityCostTable)
+ */
+class ITK_EXPORT VoxelLookupOperation : public VoxelPass::Operation
+{
+public:
+  VoxelLookupOperation( const short* input, const float* table, float* output )
+    {
+      this->m_Input  = input;
+      this->m_Table  = table;
+      this->m_Output = output;
+    }
+
+  void Process( unsigned long begin, unsigned long end, unsigned int )
+    {
+      VoxelPass::Lookup( this->m_Input + begin, this->m_Table, this->m_Output + begin, end - begin );
+    }
+
+private:
+  const short*  m_Input;
+  const float*  m_Table;
+  float*        m_Output;
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkVoxelPass.txx"
+#endif
+
+#endif
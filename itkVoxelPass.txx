@@ -0,0 +1,729 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkVoxelPass.txx,v $
+  Language:  C++
+  Date:      $Date: 2012/09/04 20:23:08 $
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef _itkVoxelPass_txx
+#define _itkVoxelPass_txx
+
+#include "itkVoxelPass.h"
+
+//
+// The SSE2 and AVX2 kernels are compiled for their instruction set
+// with the 'target' attribute, whatever the compiler flags, and are
+// only called if the processor supports it
+//
+#if defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+#define ITK_VOXEL_PASS_X86
+#include <immintrin.h>
+#endif
+
+
+namespace itk
+{
+
+#if defined( ITK_VOXEL_PASS_X86 )
+
+//
+// Each kernel processes the leading multiple of its vector width and
+// returns the number of voxels processed. The remaining voxels are
+// left to the plain loop.
+//
+__attribute__(( target( "sse2" ) ))
+static unsigned long
+VoxelPassClipSSE2( short* buffer, unsigned long n, short clipValue, short replacementValue, bool clipAbove )
+{
+  const __m128i clip        = _mm_set1_epi16( clipValue );
+  const __m128i replacement = _mm_set1_epi16( replacementValue );
+
+  unsigned long i = 0;
+  for ( ; i+8 <= n; i += 8 )
+    {
+    __m128i* p = reinterpret_cast< __m128i* >( buffer + i );
+    __m128i  x = _mm_loadu_si128( p );
+
+    __m128i select = clipAbove ? _mm_cmpgt_epi16( x, clip ) : _mm_cmpgt_epi16( clip, x );
+
+    _mm_storeu_si128( p, _mm_or_si128( _mm_and_si128( select, replacement ), _mm_andnot_si128( select, x ) ) );
+    }
+
+  return i;
+}
+
+
+__attribute__(( target( "avx2" ) ))
+static unsigned long
+VoxelPassClipAVX2( short* buffer, unsigned long n, short clipValue, short replacementValue, bool clipAbove )
+{
+  const __m256i clip        = _mm256_set1_epi16( clipValue );
+  const __m256i replacement = _mm256_set1_epi16( replacementValue );
+
+  unsigned long i = 0;
+  for ( ; i+16 <= n; i += 16 )
+    {
+    __m256i* p = reinterpret_cast< __m256i* >( buffer + i );
+    __m256i  x = _mm256_loadu_si256( p );
+
+    __m256i select = clipAbove ? _mm256_cmpgt_epi16( x, clip ) : _mm256_cmpgt_epi16( clip, x );
+
+    _mm256_storeu_si256( p, _mm256_blendv_epi8( x, replacement, select ) );
+    }
+
+  return i;
+}
+
+
+__attribute__(( target( "sse2" ) ))
+static unsigned long
+VoxelPassThresholdSSE2( const short* input, unsigned short* output, unsigned long n, short lowerThreshold,
+                        short upperThreshold, unsigned short insideValue, unsigned short outsideValue )
+{
+  const __m128i lower   = _mm_set1_epi16( lowerThreshold );
+  const __m128i upper   = _mm_set1_epi16( upperThreshold );
+  const __m128i inside  = _mm_set1_epi16( static_cast< short >( insideValue ) );
+  const __m128i outside = _mm_set1_epi16( static_cast< short >( outsideValue ) );
+
+  unsigned long i = 0;
+  for ( ; i+8 <= n; i += 8 )
+    {
+    __m128i x = _mm_loadu_si128( reinterpret_cast< const __m128i* >( input + i ) );
+
+    __m128i outOfRange = _mm_or_si128( _mm_cmpgt_epi16( lower, x ), _mm_cmpgt_epi16( x, upper ) );
+
+    _mm_storeu_si128( reinterpret_cast< __m128i* >( output + i ),
+                      _mm_or_si128( _mm_and_si128( outOfRange, outside ), _mm_andnot_si128( outOfRange, inside ) ) );
+    }
+
+  return i;
+}
+
+
+__attribute__(( target( "avx2" ) ))
+static unsigned long
+VoxelPassThresholdAVX2( const short* input, unsigned short* output, unsigned long n, short lowerThreshold,
+                        short upperThreshold, unsigned short insideValue, unsigned short outsideValue )
+{
+  const __m256i lower   = _mm256_set1_epi16( lowerThreshold );
+  const __m256i upper   = _mm256_set1_epi16( upperThreshold );
+  const __m256i inside  = _mm256_set1_epi16( static_cast< short >( insideValue ) );
+  const __m256i outside = _mm256_set1_epi16( static_cast< short >( outsideValue ) );
+
+  unsigned long i = 0;
+  for ( ; i+16 <= n; i += 16 )
+    {
+    __m256i x = _mm256_loadu_si256( reinterpret_cast< const __m256i* >( input + i ) );
+
+    __m256i outOfRange = _mm256_or_si256( _mm256_cmpgt_epi16( lower, x ), _mm256_cmpgt_epi16( x, upper ) );
+
+    _mm256_storeu_si256( reinterpret_cast< __m256i* >( output + i ), _mm256_blendv_epi8( inside, outside, outOfRange ) );
+    }
+
+  return i;
+}
+
+
+__attribute__(( target( "sse2" ) ))
+static unsigned long
+VoxelPassMaskSSE2( unsigned short* buffer, const unsigned short* mask, unsigned long n, unsigned short value,
+                   bool whereMaskIsZero )
+{
+  const __m128i zero     = _mm_setzero_si128();
+  const __m128i ones     = _mm_cmpeq_epi16( zero, zero );
+  const __m128i invert   = whereMaskIsZero ? zero : ones;
+  const __m128i newValue = _mm_set1_epi16( static_cast< short >( value ) );
+
+  unsigned long i = 0;
+  for ( ; i+8 <= n; i += 8 )
+    {
+    __m128i* p = reinterpret_cast< __m128i* >( buffer + i );
+    __m128i  x = _mm_loadu_si128( p );
+    __m128i  m = _mm_loadu_si128( reinterpret_cast< const __m128i* >( mask + i ) );
+
+    __m128i select = _mm_xor_si128( _mm_cmpeq_epi16( m, zero ), invert );
+
+    _mm_storeu_si128( p, _mm_or_si128( _mm_and_si128( select, newValue ), _mm_andnot_si128( select, x ) ) );
+    }
+
+  return i;
+}
+
+
+__attribute__(( target( "avx2" ) ))
+static unsigned long
+VoxelPassMaskAVX2( unsigned short* buffer, const unsigned short* mask, unsigned long n, unsigned short value,
+                   bool whereMaskIsZero )
+{
+  const __m256i zero     = _mm256_setzero_si256();
+  const __m256i ones     = _mm256_cmpeq_epi16( zero, zero );
+  const __m256i invert   = whereMaskIsZero ? zero : ones;
+  const __m256i newValue = _mm256_set1_epi16( static_cast< short >( value ) );
+
+  unsigned long i = 0;
+  for ( ; i+16 <= n; i += 16 )
+    {
+    __m256i* p = reinterpret_cast< __m256i* >( buffer + i );
+    __m256i  x = _mm256_loadu_si256( p );
+    __m256i  m = _mm256_loadu_si256( reinterpret_cast< const __m256i* >( mask + i ) );
+
+    __m256i select = _mm256_xor_si256( _mm256_cmpeq_epi16( m, zero ), invert );
+
+    _mm256_storeu_si256( p, _mm256_blendv_epi8( x, newValue, select ) );
+    }
+
+  return i;
+}
+
+
+//
+// The comparison with zero sets both bytes of every zero voxel, so
+// the zero voxels are half the bits set in the byte mask
+//
+__attribute__(( target( "sse2" ) ))
+static unsigned long
+VoxelPassCountNonzeroSSE2( const unsigned short* buffer, unsigned long n, unsigned long& count )
+{
+  const __m128i zero = _mm_setzero_si128();
+
+  unsigned long zeros = 0;
+
+  unsigned long i = 0;
+  for ( ; i+8 <= n; i += 8 )
+    {
+    __m128i x = _mm_loadu_si128( reinterpret_cast< const __m128i* >( buffer + i ) );
+
+    zeros += __builtin_popcount( _mm_movemask_epi8( _mm_cmpeq_epi16( x, zero ) ) );
+    }
+
+  count = i - zeros/2;
+
+  return i;
+}
+
+
+__attribute__(( target( "avx2" ) ))
+static unsigned long
+VoxelPassCountNonzeroAVX2( const unsigned short* buffer, unsigned long n, unsigned long& count )
+{
+  const __m256i zero = _mm256_setzero_si256();
+
+  unsigned long zeros = 0;
+
+  unsigned long i = 0;
+  for ( ; i+16 <= n; i += 16 )
+    {
+    __m256i x = _mm256_loadu_si256( reinterpret_cast< const __m256i* >( buffer + i ) );
+
+    zeros += __builtin_popcount( static_cast< unsigned int >( _mm256_movemask_epi8( _mm256_cmpeq_epi16( x, zero ) ) ) );
+    }
+
+  count = i - zeros/2;
+
+  return i;
+}
+
+
+//
+// Blocks whose mask is all zero are skipped and blocks of a single
+// value (air or padding around the body) are counted at once. Other
+// blocks are counted voxel by voxel. Counts are indexed by the value
+// plus 32768.
+//
+__attribute__(( target( "sse2" ) ))
+static unsigned long
+VoxelPassHistogramSSE2( const short* buffer, const unsigned short* mask, unsigned long n, unsigned long* counts )
+{
+  const __m128i zero = _mm_setzero_si128();
+
+  unsigned long i = 0;
+  for ( ; i+8 <= n; i += 8 )
+    {
+    if ( mask != 0 )
+      {
+      int maskedOut = _mm_movemask_epi8( _mm_cmpeq_epi16( _mm_loadu_si128( reinterpret_cast< const __m128i* >( mask + i ) ), zero ) );
+
+      if ( maskedOut == 0xFFFF )
+        {
+        continue;
+        }
+      if ( maskedOut != 0 )
+        {
+        for ( unsigned long k=i; k<i+8; k++ )
+          {
+          if ( mask[k] != 0 )
+            {
+            counts[buffer[k] + 32768]++;
+            }
+          }
+        continue;
+        }
+      }
+
+    __m128i x = _mm_loadu_si128( reinterpret_cast< const __m128i* >( buffer + i ) );
+
+    if ( _mm_movemask_epi8( _mm_cmpeq_epi16( x, _mm_set1_epi16( buffer[i] ) ) ) == 0xFFFF )
+      {
+      counts[buffer[i] + 32768] += 8;
+      }
+    else
+      {
+      for ( unsigned long k=i; k<i+8; k++ )
+        {
+        counts[buffer[k] + 32768]++;
+        }
+      }
+    }
+
+  return i;
+}
+
+
+__attribute__(( target( "avx2" ) ))
+static unsigned long
+VoxelPassHistogramAVX2( const short* buffer, const unsigned short* mask, unsigned long n, unsigned long* counts )
+{
+  const __m256i zero = _mm256_setzero_si256();
+
+  unsigned long i = 0;
+  for ( ; i+16 <= n; i += 16 )
+    {
+    if ( mask != 0 )
+      {
+      int maskedOut = _mm256_movemask_epi8( _mm256_cmpeq_epi16( _mm256_loadu_si256( reinterpret_cast< const __m256i* >( mask + i ) ), zero ) );
+
+      if ( maskedOut == -1 )
+        {
+        continue;
+        }
+      if ( maskedOut != 0 )
+        {
+        for ( unsigned long k=i; k<i+16; k++ )
+          {
+          if ( mask[k] != 0 )
+            {
+            counts[buffer[k] + 32768]++;
+            }
+          }
+        continue;
+        }
+      }
+
+    __m256i x = _mm256_loadu_si256( reinterpret_cast< const __m256i* >( buffer + i ) );
+
+    if ( _mm256_movemask_epi8( _mm256_cmpeq_epi16( x, _mm256_set1_epi16( buffer[i] ) ) ) == -1 )
+      {
+      counts[buffer[i] + 32768] += 16;
+      }
+    else
+      {
+      for ( unsigned long k=i; k<i+16; k++ )
+        {
+        counts[buffer[k] + 32768]++;
+        }
+      }
+    }
+
+  return i;
+}
+
+
+//
+// There is no SSE2 gather, so only AVX2 has a lookup kernel
+//
+__attribute__(( target( "avx2" ) ))
+static unsigned long
+VoxelPassLookupAVX2( const short* input, const float* table, float* output, unsigned long n )
+{
+  const __m256i offset = _mm256_set1_epi32( 32768 );
+
+  unsigned long i = 0;
+  for ( ; i+8 <= n; i += 8 )
+    {
+    __m256i x = _mm256_cvtepi16_epi32( _mm_loadu_si128( reinterpret_cast< const __m128i* >( input + i ) ) );
+
+    _mm256_storeu_ps( output + i, _mm256_i32gather_ps( table, _mm256_add_epi32( x, offset ), 4 ) );
+    }
+
+  return i;
+}
+
+#endif
+
+
+inline
+VoxelPass
+::VoxelPass()
+{
+  this->m_BlockSize       = 8192;
+  this->m_MultiThreader   = MultiThreader::New();
+  this->m_NumberOfThreads = this->m_MultiThreader->GetNumberOfThreads();
+}
+
+
+inline void
+VoxelPass
+::AddOperation( Operation* operation )
+{
+  this->m_Operations.push_back( operation );
+}
+
+
+inline void
+VoxelPass
+::ClearOperations()
+{
+  this->m_Operations.clear();
+}
+
+
+inline void
+VoxelPass
+::Execute( unsigned long numberOfVoxels )
+{
+  if ( this->m_BlockSize == 0 )
+    {
+    itkExceptionMacro( << "Block size must be positive" );
+    }
+
+  const unsigned long numberOfBlocks = (numberOfVoxels + this->m_BlockSize - 1)/this->m_BlockSize;
+
+  unsigned int numberOfThreads = std::max( this->m_NumberOfThreads, static_cast< unsigned int >( 1 ) );
+  if ( numberOfBlocks < numberOfThreads )
+    {
+    numberOfThreads = std::max( static_cast< unsigned int >( numberOfBlocks ), static_cast< unsigned int >( 1 ) );
+    }
+
+  for ( unsigned int i=0; i<this->m_Operations.size(); i++ )
+    {
+    this->m_Operations[i]->Initialize( numberOfThreads );
+    }
+
+  PassThreadStruct str;
+    str.Operations     = &this->m_Operations;
+    str.NumberOfVoxels = numberOfVoxels;
+    str.BlockSize      = this->m_BlockSize;
+
+  this->m_MultiThreader->SetNumberOfThreads( numberOfThreads );
+  this->m_MultiThreader->SetSingleMethod( this->PassThreaderCallback, &str );
+  this->m_MultiThreader->SingleMethodExecute();
+}
+
+
+/**
+ * The blocks are split into contiguous shares, one per thread, and
+ * every operation is applied to a block before the next block
+ */
+inline ITK_THREAD_RETURN_TYPE
+VoxelPass
+::PassThreaderCallback( void* arg )
+{
+  MultiThreader::ThreadInfoStruct* info = static_cast< MultiThreader::ThreadInfoStruct* >( arg );
+
+  unsigned int threadId    = info->ThreadID;
+  unsigned int threadCount = info->NumberOfThreads;
+
+  PassThreadStruct* str = static_cast< PassThreadStruct* >( info->UserData );
+
+  const OperationsType& operations = *str->Operations;
+
+  const unsigned long numberOfBlocks = (str->NumberOfVoxels + str->BlockSize - 1)/str->BlockSize;
+
+  unsigned long blockStart = static_cast< unsigned long >( (static_cast< double >( numberOfBlocks )*threadId)/threadCount );
+  unsigned long blockEnd   = static_cast< unsigned long >( (static_cast< double >( numberOfBlocks )*(threadId+1))/threadCount );
+
+  if ( threadId == threadCount-1 )
+    {
+    blockEnd = numberOfBlocks;
+    }
+
+  for ( unsigned long block=blockStart; block<blockEnd; block++ )
+    {
+    unsigned long begin = block*str->BlockSize;
+    unsigned long end   = std::min( begin + str->BlockSize, str->NumberOfVoxels );
+
+    for ( unsigned int i=0; i<operations.size(); i++ )
+      {
+      operations[i]->Process( begin, end, threadId );
+      }
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+
+/**
+ * The processor is queried once. Racing threads all find the same
+ * level.
+ */
+inline int
+VoxelPass
+::GetInstructionSetLevel()
+{
+  static int level = -1;
+
+  if ( level < 0 )
+    {
+    int supported = 0;
+
+#if defined( ITK_VOXEL_PASS_X86 )
+    __builtin_cpu_init();
+
+    if ( __builtin_cpu_supports( "sse2" ) )
+      {
+      supported = 1;
+      }
+    if ( __builtin_cpu_supports( "avx2" ) )
+      {
+      supported = 2;
+      }
+#endif
+
+    level = supported;
+    }
+
+  return level;
+}
+
+
+inline const char*
+VoxelPass
+::GetInstructionSet()
+{
+  switch ( GetInstructionSetLevel() )
+    {
+    case 2:
+      return "AVX2";
+    case 1:
+      return "SSE2";
+    default:
+      return "Scalar";
+    }
+}
+
+
+template < class TPixel >
+void
+VoxelPass
+::Clip( TPixel* buffer, unsigned long n, TPixel clipValue, TPixel replacementValue, bool clipAbove )
+{
+  for ( unsigned long i=0; i<n; i++ )
+    {
+    if ( clipAbove ? buffer[i] > clipValue : buffer[i] < clipValue )
+      {
+      buffer[i] = replacementValue;
+      }
+    }
+}
+
+
+inline void
+VoxelPass
+::Clip( short* buffer, unsigned long n, short clipValue, short replacementValue, bool clipAbove )
+{
+  unsigned long i = 0;
+
+#if defined( ITK_VOXEL_PASS_X86 )
+  switch ( GetInstructionSetLevel() )
+    {
+    case 2:
+      i = VoxelPassClipAVX2( buffer, n, clipValue, replacementValue, clipAbove );
+      break;
+    case 1:
+      i = VoxelPassClipSSE2( buffer, n, clipValue, replacementValue, clipAbove );
+      break;
+    }
+#endif
+
+  Clip< short >( buffer + i, n - i, clipValue, replacementValue, clipAbove );
+}
+
+
+template < class TInputPixel, class TOutputPixel >
+void
+VoxelPass
+::Threshold( const TInputPixel* input, TOutputPixel* output, unsigned long n, TInputPixel lowerThreshold,
+             TInputPixel upperThreshold, TOutputPixel insideValue, TOutputPixel outsideValue )
+{
+  for ( unsigned long i=0; i<n; i++ )
+    {
+    output[i] = (input[i] >= lowerThreshold && input[i] <= upperThreshold) ? insideValue : outsideValue;
+    }
+}
+
+
+inline void
+VoxelPass
+::Threshold( const short* input, unsigned short* output, unsigned long n, short lowerThreshold,
+             short upperThreshold, unsigned short insideValue, unsigned short outsideValue )
+{
+  unsigned long i = 0;
+
+#if defined( ITK_VOXEL_PASS_X86 )
+  switch ( GetInstructionSetLevel() )
+    {
+    case 2:
+      i = VoxelPassThresholdAVX2( input, output, n, lowerThreshold, upperThreshold, insideValue, outsideValue );
+      break;
+    case 1:
+      i = VoxelPassThresholdSSE2( input, output, n, lowerThreshold, upperThreshold, insideValue, outsideValue );
+      break;
+    }
+#endif
+
+  Threshold< short, unsigned short >( input + i, output + i, n - i, lowerThreshold, upperThreshold, insideValue, outsideValue );
+}
+
+
+template < class TPixel, class TMaskPixel >
+void
+VoxelPass
+::Mask( TPixel* buffer, const TMaskPixel* mask, unsigned long n, TPixel value, bool whereMaskIsZero )
+{
+  for ( unsigned long i=0; i<n; i++ )
+    {
+    if ( (mask[i] == 0) == whereMaskIsZero )
+      {
+      buffer[i] = value;
+      }
+    }
+}
+
+
+inline void
+VoxelPass
+::Mask( unsigned short* buffer, const unsigned short* mask, unsigned long n, unsigned short value, bool whereMaskIsZero )
+{
+  unsigned long i = 0;
+
+#if defined( ITK_VOXEL_PASS_X86 )
+  switch ( GetInstructionSetLevel() )
+    {
+    case 2:
+      i = VoxelPassMaskAVX2( buffer, mask, n, value, whereMaskIsZero );
+      break;
+    case 1:
+      i = VoxelPassMaskSSE2( buffer, mask, n, value, whereMaskIsZero );
+      break;
+    }
+#endif
+
+  Mask< unsigned short, unsigned short >( buffer + i, mask + i, n - i, value, whereMaskIsZero );
+}
+
+
+template < class TPixel >
+unsigned long
+VoxelPass
+::CountNonzero( const TPixel* buffer, unsigned long n )
+{
+  unsigned long count = 0;
+  for ( unsigned long i=0; i<n; i++ )
+    {
+    if ( buffer[i] != 0 )
+      {
+      count++;
+      }
+    }
+
+  return count;
+}
+
+
+inline unsigned long
+VoxelPass
+::CountNonzero( const unsigned short* buffer, unsigned long n )
+{
+  unsigned long i     = 0;
+  unsigned long count = 0;
+
+#if defined( ITK_VOXEL_PASS_X86 )
+  switch ( GetInstructionSetLevel() )
+    {
+    case 2:
+      i = VoxelPassCountNonzeroAVX2( buffer, n, count );
+      break;
+    case 1:
+      i = VoxelPassCountNonzeroSSE2( buffer, n, count );
+      break;
+    }
+#endif
+
+  return count + CountNonzero< unsigned short >( buffer + i, n - i );
+}
+
+
+inline void
+VoxelPass
+::Histogram( const short* buffer, const unsigned short* mask, unsigned long n, unsigned long* counts )
+{
+  unsigned long i = 0;
+
+#if defined( ITK_VOXEL_PASS_X86 )
+  switch ( GetInstructionSetLevel() )
+    {
+    case 2:
+      i = VoxelPassHistogramAVX2( buffer, mask, n, counts );
+      break;
+    case 1:
+      i = VoxelPassHistogramSSE2( buffer, mask, n, counts );
+      break;
+    }
+#endif
+
+  for ( ; i<n; i++ )
+    {
+    if ( mask == 0 || mask[i] != 0 )
+      {
+      counts[buffer[i] + 32768]++;
+      }
+    }
+}
+
+
+inline void
+VoxelPass
+::Lookup( const short* input, const float* table, float* output, unsigned long n )
+{
+  unsigned long i = 0;
+
+#if defined( ITK_VOXEL_PASS_X86 )
+  if ( GetInstructionSetLevel() == 2 )
+    {
+    i = VoxelPassLookupAVX2( input, table, output, n );
+    }
+#endif
+
+  for ( ; i<n; i++ )
+    {
+    output[i] = table[input[i] + 32768];
+    }
+}
+
+
+/**
+ * Standard "PrintSelf" method
+ */
+inline void
+VoxelPass
+::PrintSelf( std::ostream& os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+  os << indent << "NumberOfThreads: " << this->m_NumberOfThreads << std::endl;
+  os << indent << "BlockSize: " << this->m_BlockSize << std::endl;
+  os << indent << "NumberOfOperations: " << this->m_Operations.size() << std::endl;
+  os << indent << "InstructionSet: " << GetInstructionSet() << std::endl;
+}
+
+} // end namespace itk
+
+#endif
@@ -19,7 +19,6 @@
 
 #include "itkImageToImageFilter.h"
 #include "itkImage.h"
-#include "itkOtsuThresholdImageFilter.h"
 #include "itkRelabelComponentImageFilter.h"
 #include "itkConnectedComponentImageFilter.h"
 #include "itkImageRegionIteratorWithIndex.h"
@@ -30,7 +29,13 @@
 #include "itkBinaryThresholdImageFilter.h"
 #include "itkBinaryErodeImageFilter.h"
 #include "itkAutoThresholdAirwaySegmentationImageFilter.h"
+#include "itkTracheaSeedDetector.h"
 #include "itkExtractLungLabelMapImageFilter.h"
+#include "itkPipelineProfiler.h"
+#include "itkVoxelNeighborhood.h"
+#include "itkConnectedComponentLabeler.h"
+#include "itkIntensityHistogram.h"
+#include "itkVoxelPass.h"
 
 
 namespace itk
@@ -119,6 +124,11 @@ public:
    *  morphological closing (3 dimensions) */
   void SetClosingNeighborhood( unsigned long * );
 
+  /** The profiler records the time spent in each stage of the
+   *  filter. Its stages are cleared every time the filter runs. */
+  itkSetObjectMacro( Profiler, PipelineProfiler );
+  itkGetObjectMacro( Profiler, PipelineProfiler );
+
   void PrintSelf( std::ostream& os, Indent indent ) const;
 
 protected:
@@ -128,14 +138,9 @@ protected:
   typedef typename LabelMapSliceType::IndexType        LabelMapSliceIndexType;
 
   typedef itk::Image< LabelMapPixelType, 3 >                                                     LabelMapType;
-  typedef itk::Image< unsigned long, 3 >                                                         ComponentImageType;
-  typedef itk::OtsuThresholdImageFilter< InputImageType, OutputImageType >                       OtsuThresholdType;
   typedef itk::ConnectedComponentImageFilter< LabelMapSliceType, LabelMapSliceType >             ConnectedComponent2DType;
-  typedef itk::ConnectedComponentImageFilter< LabelMapType, ComponentImageType >                 ConnectedComponent3DType;
   typedef itk::RelabelComponentImageFilter< LabelMapSliceType, LabelMapSliceType >               Relabel2DType;
-  typedef itk::RelabelComponentImageFilter< ComponentImageType, ComponentImageType >             Relabel3DType;
   typedef itk::ImageRegionIteratorWithIndex< LabelMapType >                                      LabelMapIteratorType;
-  typedef itk::ImageRegionIteratorWithIndex< ComponentImageType >                                ComponentIteratorType;
   typedef itk::ImageRegionIteratorWithIndex< LabelMapSliceType >                                 LabelMapSliceIteratorType;
   typedef itk::ExtractImageFilter< LabelMapType, LabelMapSliceType >                             LabelMapExtractorType;
   typedef itk::BinaryBallStructuringElement< LabelMapPixelType, 2 >                              Element2DType;
@@ -145,7 +150,33 @@ protected:
   typedef itk::BinaryThresholdImageFilter< LabelMapSliceType, LabelMapSliceType >                Threshold2DType;
   typedef itk::BinaryErodeImageFilter< LabelMapType, LabelMapType, Element3DType >               Erode3DType;
   typedef itk::AutoThresholdAirwaySegmentationImageFilter< InputImageType >                      AirwaySegmentationType;
+  typedef itk::TracheaSeedDetector< LabelMapType >                                               TracheaSeedDetectorType;
   typedef itk::ExtractLungLabelMapImageFilter                                                    ExtractLabelMapType;
+  typedef itk::VoxelNeighborhood< 2, 8, true >                                                   SliceNeighborhoodType;
+
+  /** Applied by VoxelNeighborhood to the in-plane neighbors of an
+   *  airway voxel. 'Output' points to the start of the slice in the
+   *  output. A voxel is on the perimeter if a neighbor is background
+   *  or whole lung. */
+  struct PerimeterFunctor
+  {
+    const OutputPixelType*  Output;
+    bool                    IsPerimeter;
+    bool                    TouchingBackground;
+
+    void operator()( unsigned long, unsigned long neighbor )
+      {
+        if ( this->Output[neighbor] == itk::NumericTraits< OutputPixelType >::Zero )
+          {
+          this->TouchingBackground = true;
+          this->IsPerimeter        = true;
+          }
+        if ( this->Output[neighbor] == static_cast< OutputPixelType >( WHOLELUNG ) )
+          {
+          this->IsPerimeter = true;
+          }
+      }
+  };
 
   WholeLungVesselAndAirwaySegmentationImageFilter();
   virtual ~WholeLungVesselAndAirwaySegmentationImageFilter() {}
@@ -170,6 +201,8 @@ private:
 
   LabelMapType::Pointer m_AirwayLabelMap;
 
+  PipelineProfiler::Pointer m_Profiler;
+
   LungConventions  m_LungConventions;
   bool             m_HeadFirst;
   unsigned long    m_ClosingNeighborhood[3];
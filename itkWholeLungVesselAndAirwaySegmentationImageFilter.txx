@@ -34,6 +34,7 @@ WholeLungVesselAndAirwaySegmentationImageFilter< TInputImage >
   this->m_HeadFirst                   = true;
   this->m_MinAirwayVolume             = 10.0;
   this->m_MaxAirwayVolumeIncreaseRate = 2.0; 
+  this->m_Profiler                    = PipelineProfiler::New();
 }
 
 
@@ -42,7 +43,12 @@ void
 WholeLungVesselAndAirwaySegmentationImageFilter< TInputImage >
 ::GenerateData()
 {
+  this->m_Profiler->Reset();
+  this->m_Profiler->StartStage( "WholeLungVesselAndAirwaySegmentation" );
+
+  this->m_Profiler->StartStage( "OtsuThreshold" );
   this->ApplyOtsuThreshold();
+  this->m_Profiler->StopStage();
 
   //
   // Get or set the airway segmentation
@@ -55,7 +61,9 @@ WholeLungVesselAndAirwaySegmentationImageFilter< TInputImage >
       airwaySegmenter->SetMinAirwayVolume( this->m_MinAirwayVolume );
     if ( this->m_AirwaySegmentationSeedVec.size() == 0 )
       {
+      this->m_Profiler->StartStage( "AirwaySeedDetection" );
       std::vector< OutputImageType::IndexType > airwaySeedVec = this->GetAirwaySeeds();
+      this->m_Profiler->StopStage();
 
       for ( unsigned int i=0; i<airwaySeedVec.size(); i++ )
         {
@@ -69,8 +77,11 @@ WholeLungVesselAndAirwaySegmentationImageFilter< TInputImage >
         airwaySegmenter->AddSeed( this->m_AirwaySegmentationSeedVec[i] );
         }      
       }
+    this->m_Profiler->StartStage( "AirwayGrowing" );
     airwaySegmenter->Update();
+    this->m_Profiler->StopStage();
 
+    this->m_Profiler->StartStage( "AirwayLabeling" );
     LabelMapIteratorType oIt( this->GetOutput(), this->GetOutput()->GetBufferedRegion() );
     LabelMapIteratorType aIt( airwaySegmenter->GetOutput(), airwaySegmenter->GetOutput()->GetBufferedRegion() );
 
@@ -88,9 +99,11 @@ WholeLungVesselAndAirwaySegmentationImageFilter< TInputImage >
       ++oIt;
       ++aIt;
       }
+    this->m_Profiler->StopStage();
     }
   else
     {
+    this->m_Profiler->StartStage( "AirwayLabeling" );
     LabelMapIteratorType oIt( this->GetOutput(), this->GetOutput()->GetBufferedRegion() );
     LabelMapIteratorType aIt( this->m_AirwayLabelMap, this->m_AirwayLabelMap->GetBufferedRegion() );
 
@@ -108,10 +121,18 @@ WholeLungVesselAndAirwaySegmentationImageFilter< TInputImage >
       ++oIt;
       ++aIt;
       }
+    this->m_Profiler->StopStage();
     }
 
+  this->m_Profiler->StartStage( "NonLungAirwayRegion" );
   this->SetNonLungAirwayRegion();
+  this->m_Profiler->StopStage();
+
+  this->m_Profiler->StartStage( "VesselFilling" );
   this->FillAndRecordVessels();
+  this->m_Profiler->StopStage();
+
+  this->m_Profiler->StopStage();
 }
 
 
@@ -141,31 +162,42 @@ WholeLungVesselAndAirwaySegmentationImageFilter< TInputImage >
 ::ApplyOtsuThreshold()
 {
   //
-  // The first step is to run Otsu threshold on the input data.  This
-  // classifies each voxel as either "body" or "air"
+  // The first step is to compute the Otsu threshold of the input
+  // data.  This classifies each voxel as either "body" or "air".  The
+  // threshold comes from the input histogram, so the volume is only
+  // read twice: once to count it and once to threshold it
   //
-  typename OtsuThresholdType::Pointer otsuThreshold = OtsuThresholdType::New();
-    otsuThreshold->SetInput( this->GetInput() );
-    otsuThreshold->Update();
+  const unsigned long numberOfVoxels = this->GetInput()->GetBufferedRegion().GetNumberOfPixels();
+
+  IntensityHistogram::Pointer histogram = IntensityHistogram::New();
+    histogram->SetNumberOfThreads( this->GetNumberOfThreads() );
+    histogram->Compute( this->GetInput() );
+
+  OutputImageType::Pointer otsuOutput = OutputImageType::New();
+    otsuOutput->CopyInformation( this->GetInput() );
+    otsuOutput->SetRegions( this->GetInput()->GetBufferedRegion() );
+    otsuOutput->Allocate();
+
+  VoxelThresholdOperation< InputPixelType, OutputPixelType >
+    threshold( this->GetInput()->GetBufferPointer(), otsuOutput->GetBufferPointer(), NumericTraits< InputPixelType >::NonpositiveMin(),
+               histogram->ComputeOtsuThreshold( 128 ), NumericTraits< OutputPixelType >::max(), 0 );
+
+  VoxelPass::Pointer thresholdPass = VoxelPass::New();
+    thresholdPass->SetNumberOfThreads( this->GetNumberOfThreads() );
+    thresholdPass->AddOperation( &threshold );
+    thresholdPass->Execute( numberOfVoxels );
 
   int ctXDim = (this->GetInput()->GetBufferedRegion().GetSize())[0];
   int ctYDim = (this->GetInput()->GetBufferedRegion().GetSize())[1];
 
-  this->GraftOutput( otsuThreshold->GetOutput() );
+  this->GraftOutput( otsuOutput );
 
   //
   // The next step is to identify all connected components in the
   // thresholded image
   //
-  ConnectedComponent3DType::Pointer connectedComponent = ConnectedComponent3DType::New();
-    connectedComponent->SetInput( otsuThreshold->GetOutput() );
-
-  //
-  // Relabel the connected components
-  //
-  Relabel3DType::Pointer relabelComponent = Relabel3DType::New();
-    relabelComponent->SetInput( connectedComponent->GetOutput() );
-    relabelComponent->Update();  
+  ConnectedComponentLabeler::Pointer labeler = ConnectedComponentLabeler::New( this->GetNumberOfThreads(), false );
+    labeler->Execute( otsuOutput );
 
   //
   // Now we want to identify the component labels that correspond to
@@ -175,14 +207,12 @@ WholeLungVesselAndAirwaySegmentationImageFilter< TInputImage >
   //
   std::vector< int >  lungHalf1ComponentCounter;
   std::vector< int >  lungHalf2ComponentCounter;
-  for ( unsigned int i=0; i<=relabelComponent->GetNumberOfObjects(); i++ )
+  for ( unsigned long i=0; i<=labeler->GetNumberOfComponents(); i++ )
     {
     lungHalf1ComponentCounter.push_back( 0 );
     lungHalf2ComponentCounter.push_back( 0 );
     }
 
-  ComponentIteratorType rIt( relabelComponent->GetOutput(), relabelComponent->GetOutput()->GetBufferedRegion() );
-
   int lowerYBound = static_cast< int >( 0.45*static_cast< double >( ctYDim ) );
   int upperYBound = static_cast< int >( 0.55*static_cast< double >( ctYDim ) );
 
@@ -191,68 +221,69 @@ WholeLungVesselAndAirwaySegmentationImageFilter< TInputImage >
 
   int middleX =  static_cast< int >( 0.5*static_cast< double >( ctXDim ) );
 
-  rIt.GoToBegin();
-  while ( !rIt.IsAtEnd() )
+  //
+  // The voxels of a run in the y range are counted by intersecting its
+  // x range with each half
+  //
+  RunLengthLabelMap::ConstRunIterator rIt( labeler->GetRunLengthLabelMap() );
+
+  for ( rIt.GoToBegin(); !rIt.IsAtEnd(); ++rIt )
     {
-    if ( rIt.Get() != 0 )
+    LabelMapType::IndexType index = rIt.GetIndex();
+
+    if ( index[1] >= lowerYBound && index[1] <= upperYBound )
       {
-      LabelMapType::IndexType index = rIt.GetIndex();
+      unsigned long whichComponent = labeler->GetRunLabel( rIt.GetRunNumber() );
 
-      if ( index[1] >= lowerYBound && index[1] <= upperYBound )
-        {
-        int whichComponent = static_cast< int >( rIt.Get() );
+      long firstX = index[0];
+      long lastX  = index[0] + static_cast< long >( rIt.GetLength() ) - 1;
 
-        if ( index[0] >= lowerXBound && index[0] <= middleX )
-          {
-          lungHalf1ComponentCounter[whichComponent] = lungHalf1ComponentCounter[whichComponent]+1;
-          }
-        else if ( index[0] < upperXBound && index[0] > middleX )
-          {
-          lungHalf2ComponentCounter[whichComponent] = lungHalf2ComponentCounter[whichComponent]+1;
-          }
+      long half1Count = std::min( lastX, static_cast< long >( middleX ) ) - std::max( firstX, static_cast< long >( lowerXBound ) ) + 1;
+      long half2Count = std::min( lastX, static_cast< long >( upperXBound ) - 1 ) - std::max( firstX, static_cast< long >( middleX ) + 1 ) + 1;
+
+      if ( half1Count > 0 )
+        {
+        lungHalf1ComponentCounter[whichComponent] += half1Count;
+        }
+      if ( half2Count > 0 )
+        {
+        lungHalf2ComponentCounter[whichComponent] += half2Count;
         }
       }
-
-    ++rIt;
     }
 
-  unsigned short lungHalf1Label;
-  unsigned short lungHalf2Label;
+  unsigned long lungHalf1Label = 0;
+  unsigned long lungHalf2Label = 0;
   int maxLungHalf1Count = 0;
   int maxLungHalf2Count = 0;
-  for ( unsigned int i=0; i<=relabelComponent->GetNumberOfObjects(); i++ )
+  for ( unsigned long i=1; i<=labeler->GetNumberOfComponents(); i++ )
     {
     if ( lungHalf1ComponentCounter[i] > maxLungHalf1Count )
       {
       maxLungHalf1Count = lungHalf1ComponentCounter[i];
 
-      lungHalf1Label = static_cast< unsigned short >( i );
+      lungHalf1Label = i;
       }
     if ( lungHalf2ComponentCounter[i] > maxLungHalf2Count )
       {
       maxLungHalf2Count = lungHalf2ComponentCounter[i];
 
-      lungHalf2Label = static_cast< unsigned short >( i );
+      lungHalf2Label = i;
       }
     }
 
-  LabelMapIteratorType mIt( this->GetOutput(), this->GetOutput()->GetBufferedRegion() );
+  //
+  // The voxels outside the runs are already zero
+  //
+  LabelMapPixelType* outputBuffer = this->GetOutput()->GetBufferPointer();
 
-  mIt.GoToBegin();
-  rIt.GoToBegin();
-  while ( !mIt.IsAtEnd() )
+  for ( rIt.GoToBegin(); !rIt.IsAtEnd(); ++rIt )
     {
-    if ( rIt.Get() == lungHalf1Label || rIt.Get() == lungHalf2Label )
-      {
-      mIt.Set( WHOLELUNG );
-      }
-    else 
-      {
-      mIt.Set( 0 );
-      }
+    unsigned long label = labeler->GetRunLabel( rIt.GetRunNumber() );
 
-    ++mIt;
-    ++rIt;
+    LabelMapPixelType value = ( label == lungHalf1Label || label == lungHalf2Label ) ? WHOLELUNG : 0;
+
+    std::fill( outputBuffer + rIt.GetOffset(), outputBuffer + rIt.GetOffset() + rIt.GetLength(), value );
     }
 }
 
@@ -389,209 +420,19 @@ WholeLungVesselAndAirwaySegmentationImageFilter< TInputImage >
  * This method gets seeds for subsequent airway segmentation using
  * region growing. For qualified slices, it gets seeds from whatever
  * object is closest to the centerline (line running parallel to the
- * y-direction).
+ * y-direction). See TracheaSeedDetector.
  */
 template < class TInputImage >
 std::vector< itk::Image< unsigned short, 3 >::IndexType >
 WholeLungVesselAndAirwaySegmentationImageFilter< TInputImage >
 ::GetAirwaySeeds()
 {
-  std::vector< OutputImageType::IndexType > seedVec;
-
-  LabelMapType::SizeType    size    = this->GetOutput()->GetBufferedRegion().GetSize();
-  LabelMapType::SpacingType spacing = this->GetOutput()->GetSpacing();
-
-  //
-  // Get seeds from 15 slices. We don't consider the slice unless the
-  // total area is above a threshold
-  // (foregroundSliceSizeThresholdForSeedSelection). The value is set
-  // to 2000.0 to ensure that the lungs have come into the field of
-  // view before we begin our seed search. If we simply attempt to
-  // find seeds in the first slices that show a foreground region, we
-  // can wind up with a poor airway segmentation due to pinch points
-  // near the apex of the scan. This in turn can produce failure
-  // modes. The number of slices that we consider (15) is somewhat
-  // arbitrary. 
-  //
-  unsigned int slicesProcessed                              = 0;
-  unsigned int currentSliceOffset                           = 0;
-  int          numberSlicesForSeedSearch                    = 15;
-  double       foregroundSliceSizeThresholdForSeedSelection = 2000.0;
-
-  while ( slicesProcessed < numberSlicesForSeedSearch && currentSliceOffset < size[2] )
-    {
-    //
-    // Extract a 2D slice from the mask
-    //
-    int whichSlice;
-    if ( this->m_HeadFirst )
-      {
-      whichSlice = size[2] - 1 - currentSliceOffset;
-      }
-    else
-      {
-      whichSlice = currentSliceOffset;
-      }
-
-    LabelMapSliceType::Pointer slice = LabelMapSliceType::New();    
-
-    this->ExtractLabelMapSlice( this->GetOutput(), slice, whichSlice );
-
-    //
-    // Perform connected component labeling
-    //
-    ConnectedComponent2DType::Pointer connectedComponent = ConnectedComponent2DType::New();
-      connectedComponent->SetInput( slice );
-      connectedComponent->FullyConnectedOn();
-    try
-      {
-      connectedComponent->Update();
-      }
-    catch ( itk::ExceptionObject &excp )
-      {
-      std::cerr << "Exception caught while updating connected component filter:";
-      std::cerr << excp << std::endl;
-      }    
-    
-    //
-    // Relabel the components
-    //
-    Relabel2DType::Pointer relabeler = Relabel2DType::New();
-      relabeler->SetInput( connectedComponent->GetOutput() );
-    try
-      {
-      relabeler->Update();
-      }
-    catch ( itk::ExceptionObject &excp )
-      {
-      std::cerr << "Exception caught while relabeling:";
-      std::cerr << excp << std::endl;
-      }
+  typename TracheaSeedDetectorType::Pointer seedDetector = TracheaSeedDetectorType::New();
+    seedDetector->SetImage( this->GetOutput() );
+    seedDetector->SetHeadFirst( this->m_HeadFirst );
+    seedDetector->Compute();
 
-    //
-    // If the foreground area of the slice is larger than the
-    // threshold, consider the slice for seed selection. The number of
-    // objects present in the slice must also be equal to three
-    // (trachea, left and right lungs)
-    //
-    int numVoxels = 0;
-
-    LabelMapSliceIteratorType rIt( relabeler->GetOutput(), relabeler->GetOutput()->GetBufferedRegion() );
-
-    rIt.GoToBegin();
-    while ( !rIt.IsAtEnd() )
-      {
-      if ( rIt.Get() > 0 )
-        {
-        numVoxels++;
-        }
-
-      ++rIt;
-      }
-
-    double foregroundArea = static_cast< double >( numVoxels )*spacing[0]*spacing[1];
-
-    if ( foregroundArea > foregroundSliceSizeThresholdForSeedSelection && relabeler->GetNumberOfObjects() >= 3 )
-      {
-      slicesProcessed++;
-
-      //
-      // Identify the object who's centroid (x coordinate) is in the
-      // middle. First get the centroids, then find out which one is
-      // in the middle 
-      //
-      std::map< unsigned int, unsigned short > xCentroidMap;
-
-      unsigned short bestCenterLabel = 0;
-
-      unsigned int leftmostCentroid  = size[1];
-      unsigned int rightmostCentroid = 0;
-
-      //
-      // Get the centroids and labels for each object
-      //
-      for ( unsigned int i=1; i<=relabeler->GetNumberOfObjects(); i++ )
-        {
-        int x = 0;
-        int count = 0;
-
-        rIt.GoToBegin();
-        while ( !rIt.IsAtEnd() )
-          {
-          if ( rIt.Get() == i )
-            {
-            x += (rIt.GetIndex())[0];
-            count++;
-            }
-
-          ++rIt;
-          }
-        
-        unsigned int centroidLocation = static_cast< unsigned int >( static_cast< double >( x )/static_cast< double >( count ) );
-
-        if ( centroidLocation > rightmostCentroid )
-          {
-          rightmostCentroid = centroidLocation;
-          }
-        if ( centroidLocation < leftmostCentroid )
-          {
-          leftmostCentroid = centroidLocation;
-          }
-
-        xCentroidMap[centroidLocation] = i;
-        }
-     
-      unsigned int middleLocation = (rightmostCentroid + leftmostCentroid)/2;
-
-      //
-      // Now find the label that corresponds to the centroid that is
-      // closest to the middle location
-      //
-      unsigned int minDiff = size[1];
-
-      std::map< unsigned int, unsigned short >::iterator mapIt = xCentroidMap.begin();
-      while ( mapIt != xCentroidMap.end() )
-        {
-        int diff = vcl_abs( static_cast< int >( (*mapIt).first ) - static_cast< int >( middleLocation ) );
-
-        if ( diff < minDiff )
-          {                                     
-          minDiff = diff;
-          bestCenterLabel = (*mapIt).second;
-          }
-
-        mapIt++;
-        }
-
-      LabelMapType::IndexType index;
-
-      rIt.GoToBegin();
-      while ( !rIt.IsAtEnd() )
-        {
-        if ( rIt.Get() == bestCenterLabel )
-          {
-          index[0] = (rIt.GetIndex())[0];
-          index[1] = (rIt.GetIndex())[1];
-          if ( this->m_HeadFirst )
-            {
-            index[2] = size[2] - 1 - currentSliceOffset;
-            }
-          else
-            {
-            index[2] = currentSliceOffset;
-            }
-
-          seedVec.push_back( index );
-          }
-
-        ++rIt;
-        }
-      }
-
-    currentSliceOffset++;
-    }
-
-  return seedVec;
+  return seedDetector->GetSeeds();
 }
 
 
@@ -784,6 +625,16 @@ WholeLungVesselAndAirwaySegmentationImageFilter< TInputImage >
       ++trIt;
       }
 
+    //
+    // The in-plane 3x3 neighborhood of a slice voxel has the same
+    // buffer offsets in the slice and in the output, so only the
+    // start of the slice needs to be added
+    //
+    SliceNeighborhoodType neighborhood( relabeler->GetOutput()->GetBufferedRegion() );
+
+    PerimeterFunctor perimeterChecker;
+      perimeterChecker.Output = this->GetOutput()->GetBufferPointer() + static_cast< unsigned long >( whichSlice )*size[0]*size[1];
+
     rIt.GoToBegin();
     trIt.GoToBegin();
     while ( !rIt.IsAtEnd() )
@@ -816,45 +667,17 @@ WholeLungVesselAndAirwaySegmentationImageFilter< TInputImage >
           }
 
         unsigned short label = rIt.Get();
-        
-        LabelMapSliceType::IndexType index = rIt.GetIndex();
-        LabelMapType::IndexType tempIndex;
-        tempIndex[2] = whichSlice;
 
-        bool isPerimeter = false;
-        bool touchingBackground = false;
+        perimeterChecker.IsPerimeter        = false;
+        perimeterChecker.TouchingBackground = false;
 
-        for ( unsigned int x=(index[0]-1); x<=(index[0]+1); x++ )
-          {
-          tempIndex[0] = x;
-          
-          if ( x >= 0 && x < size[0] )
-            {
-            for ( unsigned int y=(index[1]-1); y<=(index[1]+1); y++ )
-              {
-              tempIndex[1] = y;
-              
-              if ( y >= 0 && y < size[1] )
-                {
-                if ( this->GetOutput()->GetPixel( tempIndex ) == itk::NumericTraits< OutputPixelType >::Zero )
-                  {
-                  touchingBackground = true;
-                  isPerimeter = true;
-                  }
-                if ( this->GetOutput()->GetPixel( tempIndex ) == static_cast< OutputPixelType >( WHOLELUNG ) )
-                  {
-                  isPerimeter = true;
-                  }
-                }
-              }
-            }
-          }
+        neighborhood.VisitNeighbors( neighborhood.ComputeOffset( rIt.GetIndex() ), perimeterChecker );
 
-        if ( isPerimeter )
+        if ( perimeterChecker.IsPerimeter )
           {
           perimeterCountVec[label-1]++;
           }
-        if ( touchingBackground )
+        if ( perimeterChecker.TouchingBackground )
           {
           touchingBackgroundCountVec[label-1]++;
           }
@@ -955,60 +778,38 @@ WholeLungVesselAndAirwaySegmentationImageFilter< TInputImage >
     labelMapExtractor->SetLungRegion( static_cast< unsigned char >( WHOLELUNG ) );
     labelMapExtractor->Update();
 
-  ConnectedComponent3DType::Pointer connectedComponent = ConnectedComponent3DType::New();
-    connectedComponent->SetInput( labelMapExtractor->GetOutput() );
-
-  Relabel3DType::Pointer relabeler = Relabel3DType::New();
-    relabeler->SetInput( connectedComponent->GetOutput() );
-    relabeler->Update();
+  ConnectedComponentLabeler::Pointer labeler = ConnectedComponentLabeler::New( this->GetNumberOfThreads(), false );
+    labeler->Execute( labelMapExtractor->GetOutput() );
   
-  unsigned int totalNumberForegroundVoxels = 0;
-
-  ComponentIteratorType rIt( relabeler->GetOutput(), relabeler->GetOutput()->GetBufferedRegion() );
+  unsigned long totalNumberForegroundVoxels = 0;
 
-  rIt.GoToBegin();
-  while ( !rIt.IsAtEnd() )
+  for ( unsigned long i=1; i<=labeler->GetNumberOfComponents(); i++ )
     {
-    if ( rIt.Get() != 0 )
-      {
-      totalNumberForegroundVoxels++;
-      }
-
-    ++rIt;
+    totalNumberForegroundVoxels += labeler->GetComponentSize( i );
     }
 
-  int cutoffLabel = itk::NumericTraits< int >::max();
+  LabelMapPixelType* outputBuffer = this->GetOutput()->GetBufferPointer();
+
+  RunLengthLabelMap::ConstRunIterator rIt( labeler->GetRunLengthLabelMap() );
 
-  for ( unsigned int i=0; i<relabeler->GetNumberOfObjects(); i++ )
+  for ( rIt.GoToBegin(); !rIt.IsAtEnd(); ++rIt )
     {
-    double percentage = static_cast< double >( relabeler->GetSizeOfObjectsInPixels()[i] )/static_cast< double >( totalNumberForegroundVoxels );
+    double percentage = static_cast< double >( labeler->GetComponentSize( labeler->GetRunLabel( rIt.GetRunNumber() ) ) )/static_cast< double >( totalNumberForegroundVoxels );
 
     //
     // Note that the 0.15 value has been somewhat arbitrarily chosen
     //
     if ( percentage <= 0.15 )
       {
-      cutoffLabel = i+1;
+      std::fill( outputBuffer + rIt.GetOffset(), outputBuffer + rIt.GetOffset() + rIt.GetLength(), 0 );
 
-      break;
-      }
-    }
-
-  LabelMapIteratorType oIt( this->GetOutput(), this->GetOutput()->GetBufferedRegion() );
+      OutputImageType::IndexType index = rIt.GetIndex();
 
-  rIt.GoToBegin();
-  oIt.GoToBegin();
-  while ( !rIt.IsAtEnd() )
-    {
-    if ( rIt.Get() >= cutoffLabel )
-      {
-      oIt.Set( 0 );
-
-      this->m_AirwayIndexVec.push_back( oIt.GetIndex() );
+      for ( unsigned long i=0; i<rIt.GetLength(); i++, index[0]++ )
+        {
+        this->m_AirwayIndexVec.push_back( index );
+        }
       }
-
-    ++rIt;
-    ++oIt;
     }
 }
 
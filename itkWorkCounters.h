@@ -0,0 +1,73 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkWorkCounters.h,v $
+  Language:  C++
+  Date:      $Date: 2012/09/11 17:02:41 $
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkWorkCounters_h
+#define __itkWorkCounters_h
+
+#include "itkSimpleFastMutexLock.h"
+#include <map>
+#include <ostream>
+#include <string>
+
+
+namespace itk
+{
+/** \class WorkCounters
+ * \brief Process-wide registry of named counters of algorithmic work
+ * (iterations, voxels visited, graph nodes settled, ...). Filters add
+ * to the counters of their hot loops so that a slow run can be
+ * explained by the amount of work done rather than by timings alone.
+ * Counter names are of the form "FilterName.CounterName". Filters
+ * accumulate counts locally and call Add() once per loop, so the lock
+ * is never taken inside a hot loop.
+ */
+class ITK_EXPORT WorkCounters
+{
+public:
+  typedef std::map< std::string, unsigned long >  CounterMapType;
+
+  /** Add 'amount' to the named counter, creating it if needed */
+  static void Add( const std::string&, unsigned long amount = 1 );
+
+  /** Get the value of the named counter (zero if it does not exist) */
+  static unsigned long Get( const std::string& );
+
+  /** Get a copy of all counters, sorted by name */
+  static CounterMapType GetCounters();
+
+  /** Remove all counters */
+  static void Reset();
+
+  /** Write all counters as a JSON object */
+  static void WriteJSON( std::ostream& );
+
+private:
+  struct StateType
+  {
+    CounterMapType       Counters;
+    SimpleFastMutexLock  Lock;
+  };
+
+  static StateType & GetState();
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkWorkCounters.txx"
+#endif
+
+#endif
@@ -0,0 +1,119 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkWorkCounters.txx,v $
+  Language:  C++
+  Date:      $Date: 2012/09/11 17:02:41 $
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef _itkWorkCounters_txx
+#define _itkWorkCounters_txx
+
+#include "itkWorkCounters.h"
+
+
+namespace itk
+{
+
+inline WorkCounters::StateType &
+WorkCounters
+::GetState()
+{
+  static StateType state;
+
+  return state;
+}
+
+
+inline void
+WorkCounters
+::Add( const std::string& name, unsigned long amount )
+{
+  StateType& state = GetState();
+
+  state.Lock.Lock();
+  state.Counters[name] += amount;
+  state.Lock.Unlock();
+}
+
+
+inline unsigned long
+WorkCounters
+::Get( const std::string& name )
+{
+  StateType& state = GetState();
+
+  unsigned long value = 0;
+
+  state.Lock.Lock();
+  CounterMapType::const_iterator it = state.Counters.find( name );
+  if ( it != state.Counters.end() )
+    {
+    value = it->second;
+    }
+  state.Lock.Unlock();
+
+  return value;
+}
+
+
+inline WorkCounters::CounterMapType
+WorkCounters
+::GetCounters()
+{
+  StateType& state = GetState();
+
+  state.Lock.Lock();
+  CounterMapType counters = state.Counters;
+  state.Lock.Unlock();
+
+  return counters;
+}
+
+
+inline void
+WorkCounters
+::Reset()
+{
+  StateType& state = GetState();
+
+  state.Lock.Lock();
+  state.Counters.clear();
+  state.Lock.Unlock();
+}
+
+
+inline void
+WorkCounters
+::WriteJSON( std::ostream& os )
+{
+  CounterMapType counters = GetCounters();
+
+  os << "{" << std::endl;
+
+  unsigned int i = 0;
+  for ( CounterMapType::const_iterator it = counters.begin(); it != counters.end(); ++it, ++i )
+    {
+    os << "  \"" << it->first << "\": " << it->second;
+
+    if ( i+1 < counters.size() )
+      {
+      os << ",";
+      }
+    os << std::endl;
+    }
+
+  os << "}" << std::endl;
+}
+
+} // end namespace itk
+
+#endif